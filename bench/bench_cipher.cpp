@@ -0,0 +1,190 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <sse/crypto/cipher.hpp>
+#include <sse/crypto/key.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using sse::crypto::Cipher;
+using sse::crypto::Key;
+using sse::crypto::XChaCha20Cipher;
+
+// Encryption of state.range(0) bytes
+template<class C>
+static void Cipher_encrypt(benchmark::State& state)
+{
+    C           cipher((Key<C::kKeySize>()));
+    auto        session = cipher.unlock_session();
+    std::string in(state.range(0), 0x42);
+    std::string out;
+
+    for (auto _ : state) {
+        cipher.encrypt(in, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Decryption of the ciphertext of state.range(0) bytes
+template<class C>
+static void Cipher_decrypt(benchmark::State& state)
+{
+    C           cipher((Key<C::kKeySize>()));
+    auto        session = cipher.unlock_session();
+    std::string in(state.range(0), 0x42);
+    std::string ciphertext;
+    std::string out;
+
+    cipher.encrypt(in, ciphertext);
+
+    for (auto _ : state) {
+        cipher.decrypt(ciphertext, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// state.range(0) plaintexts of 40 bytes (index entries), encrypted with one
+// encrypt() call per plaintext
+template<class C>
+static void Cipher_encrypt_per_call(benchmark::State& state)
+{
+    constexpr size_t kInputSize = 40;
+
+    C                    cipher((Key<C::kKeySize>()));
+    auto                 session = cipher.unlock_session();
+    std::vector<uint8_t> in(state.range(0) * kInputSize, 0x42);
+    std::vector<uint8_t> out(state.range(0) * C::ciphertext_length(kInputSize));
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < static_cast<size_t>(state.range(0)); i++) {
+            std::string m(
+                reinterpret_cast<const char*>(in.data() + i * kInputSize),
+                kInputSize);
+            std::string c;
+            cipher.encrypt(m, c);
+            std::copy(c.begin(),
+                      c.end(),
+                      out.begin() + i * C::ciphertext_length(kInputSize));
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Same as Cipher_encrypt_per_call, with a single encrypt_many() call. If
+// state.range(1) is not 0, the encryption runs on state.range(1) threads.
+template<class C>
+static void Cipher_encrypt_many(benchmark::State& state)
+{
+    constexpr size_t kInputSize = 40;
+
+    const size_t                count = state.range(0);
+    C                           cipher((Key<C::kKeySize>()));
+    std::vector<uint8_t>        in(count * kInputSize, 0x42);
+    std::vector<const uint8_t*> ins(count);
+    std::vector<size_t>         lens(count, kInputSize);
+    std::vector<uint8_t>        out(count * C::ciphertext_length(kInputSize));
+
+    for (size_t i = 0; i < count; i++) {
+        ins[i] = in.data() + i * kInputSize;
+    }
+
+    const sse::crypto::Executor executor
+        = sse::crypto::thread_executor(state.range(1));
+
+    for (auto _ : state) {
+        if (state.range(1) == 0) {
+            cipher.encrypt_many(ins.data(), lens.data(), count, out.data());
+        } else {
+            cipher.encrypt_many(
+                ins.data(), lens.data(), count, out.data(), executor);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Streaming encryption of 16 MiB, in chunks of state.range(0) bytes. The
+// memory usage only depends on the chunk size.
+static void Cipher_stream_push(benchmark::State& state)
+{
+    constexpr size_t kPayloadSize = 1UL << 24;
+
+    const size_t         chunk_size = state.range(0);
+    Cipher               cipher((Key<Cipher::kKeySize>()));
+    std::vector<uint8_t> chunk(chunk_size, 0x42);
+    std::vector<uint8_t> out(chunk_size + Cipher::kChunkExpansion);
+
+    for (auto _ : state) {
+        auto encryptor = cipher.stream_encryptor(chunk_size);
+        for (size_t offset = 0; offset < kPayloadSize; offset += chunk_size) {
+            encryptor.push(chunk.data(),
+                           chunk_size,
+                           offset + chunk_size == kPayloadSize,
+                           out.data());
+            benchmark::DoNotOptimize(out.data());
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * kPayloadSize);
+}
+
+BENCHMARK_TEMPLATE(Cipher_encrypt, Cipher)
+    ->Arg(40)
+    ->Arg(100)
+    ->Arg(200)
+    ->Arg(4096);
+BENCHMARK_TEMPLATE(Cipher_encrypt, XChaCha20Cipher)
+    ->Arg(40)
+    ->Arg(100)
+    ->Arg(200)
+    ->Arg(4096);
+BENCHMARK_TEMPLATE(Cipher_decrypt, Cipher)
+    ->Arg(40)
+    ->Arg(100)
+    ->Arg(200)
+    ->Arg(4096);
+BENCHMARK_TEMPLATE(Cipher_decrypt, XChaCha20Cipher)
+    ->Arg(40)
+    ->Arg(100)
+    ->Arg(200)
+    ->Arg(4096);
+BENCHMARK_TEMPLATE(Cipher_encrypt_per_call, Cipher)
+    ->RangeMultiplier(8)
+    ->Range(64, 4096);
+BENCHMARK_TEMPLATE(Cipher_encrypt_many, Cipher)
+    ->Ranges({{64, 4096}, {0, 0}})
+    ->Args({4096, 4})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(Cipher_encrypt_per_call, XChaCha20Cipher)
+    ->RangeMultiplier(8)
+    ->Range(64, 4096);
+BENCHMARK_TEMPLATE(Cipher_encrypt_many, XChaCha20Cipher)
+    ->Ranges({{64, 4096}, {0, 0}})
+    ->Args({4096, 4})
+    ->UseRealTime();
+BENCHMARK(Cipher_stream_push)->RangeMultiplier(8)->Range(1 << 12, 1 << 18);
@@ -0,0 +1,186 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "hash/blake2b.hpp"
+#include "hash/blake3.hpp"
+#include "hash/sha512.hpp"
+
+#include <sse/crypto/hash.hpp>
+#include <sse/crypto/parallel.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <vector>
+
+using sse::crypto::Hash;
+using sse::crypto::hash::blake2b;
+using sse::crypto::hash::blake3;
+using sse::crypto::hash::sha512;
+
+using Blake2bHash = sse::crypto::BasicHash<sse::crypto::Blake2bBackend>;
+using Sha512Hash  = sse::crypto::BasicHash<sse::crypto::Sha512Backend>;
+using Blake3Hash  = sse::crypto::BasicHash<sse::crypto::Blake3Backend>;
+
+// One-shot hash of state.range(0) bytes
+template<class H>
+static void Hash_hash(benchmark::State& state)
+{
+    std::vector<uint8_t>                in(state.range(0), 0x42);
+    std::array<uint8_t, H::kDigestSize> out;
+
+    for (auto _ : state) {
+        H::hash(in.data(), in.size(), out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Incremental hash of state.range(0) bytes, absorbed in 1 kB pieces
+template<class H>
+static void Hash_incremental(benchmark::State& state)
+{
+    constexpr size_t kPieceSize = 1024;
+
+    std::vector<uint8_t>                in(state.range(0), 0x42);
+    std::array<uint8_t, H::kDigestSize> out;
+
+    for (auto _ : state) {
+        typename H::state_type hash_state;
+        H::init(hash_state);
+        for (size_t pos = 0; pos < in.size(); pos += kPieceSize) {
+            const size_t len
+                = (in.size() - pos < kPieceSize) ? in.size() - pos : kPieceSize;
+            H::update(hash_state, in.data() + pos, len);
+        }
+        H::final(hash_state, out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// state.range(0) messages of 64 bytes (e.g. the inner digests hashed by the
+// outer hash of HMac), finalized one after the other
+template<class H>
+static void Hash_update_final_loop(benchmark::State& state)
+{
+    constexpr size_t kMessageSize = 64;
+
+    const size_t         n = static_cast<size_t>(state.range(0));
+    std::vector<uint8_t> in(n * kMessageSize, 0x42);
+    std::vector<uint8_t> out(n * H::kDigestSize);
+
+    typename H::state_type prefix;
+    H::init(prefix);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < n; i++) {
+            typename H::state_type hash_state = prefix;
+            H::update(hash_state, in.data() + i * kMessageSize, kMessageSize);
+            H::final(hash_state, out.data() + i * H::kDigestSize);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Same as Hash_update_final_loop, with a single update_final_many() call
+template<class H>
+static void Hash_update_final_many(benchmark::State& state)
+{
+    constexpr size_t kMessageSize = 64;
+
+    const size_t                      n = static_cast<size_t>(state.range(0));
+    std::vector<uint8_t>              in(n * kMessageSize, 0x42);
+    std::vector<uint8_t>              out(n * H::kDigestSize);
+    std::vector<const unsigned char*> ins(n);
+    std::vector<size_t>               lens(n, kMessageSize);
+    std::vector<unsigned char*>       outs(n);
+
+    for (size_t i = 0; i < n; i++) {
+        ins[i]  = in.data() + i * kMessageSize;
+        outs[i] = out.data() + i * H::kDigestSize;
+    }
+
+    typename H::state_type prefix;
+    H::init(prefix);
+
+    for (auto _ : state) {
+        H::update_final_many(prefix, ins.data(), lens.data(), outs.data(), n);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Tree hash of state.range(0) bytes, with state.range(1) threads (0 for all
+// the hardware threads)
+static void Hash_tree_hash(benchmark::State& state)
+{
+    std::vector<uint8_t>                   in(state.range(0), 0x42);
+    std::array<uint8_t, Hash::kDigestSize> out;
+    const auto                             executor
+        = sse::crypto::thread_executor(static_cast<unsigned>(state.range(1)));
+
+    for (auto _ : state) {
+        Hash::tree_hash(in.data(), in.size(), out.data(), executor);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_TEMPLATE(Hash_hash, Hash)->RangeMultiplier(16)->Range(64, 1 << 20);
+BENCHMARK_TEMPLATE(Hash_hash, Blake2bHash)
+    ->RangeMultiplier(16)
+    ->Range(64, 1 << 20);
+BENCHMARK_TEMPLATE(Hash_hash, Sha512Hash)
+    ->RangeMultiplier(16)
+    ->Range(64, 1 << 20);
+BENCHMARK_TEMPLATE(Hash_hash, Blake3Hash)
+    ->RangeMultiplier(16)
+    ->Range(64, 1 << 20);
+BENCHMARK_TEMPLATE(Hash_hash, blake2b)->RangeMultiplier(16)->Range(64, 1 << 20);
+BENCHMARK_TEMPLATE(Hash_hash, sha512)->RangeMultiplier(16)->Range(64, 1 << 20);
+BENCHMARK_TEMPLATE(Hash_hash, blake3)->RangeMultiplier(16)->Range(64, 1 << 20);
+BENCHMARK_TEMPLATE(Hash_incremental, blake2b)
+    ->RangeMultiplier(16)
+    ->Range(64, 1 << 20);
+BENCHMARK_TEMPLATE(Hash_incremental, sha512)
+    ->RangeMultiplier(16)
+    ->Range(64, 1 << 20);
+BENCHMARK_TEMPLATE(Hash_incremental, blake3)
+    ->RangeMultiplier(16)
+    ->Range(64, 1 << 20);
+BENCHMARK_TEMPLATE(Hash_update_final_loop, blake2b)
+    ->RangeMultiplier(8)
+    ->Range(8, 512);
+BENCHMARK_TEMPLATE(Hash_update_final_many, blake2b)
+    ->RangeMultiplier(8)
+    ->Range(8, 512);
+BENCHMARK_TEMPLATE(Hash_update_final_loop, sha512)
+    ->RangeMultiplier(8)
+    ->Range(8, 512);
+BENCHMARK_TEMPLATE(Hash_update_final_many, sha512)
+    ->RangeMultiplier(8)
+    ->Range(8, 512);
+BENCHMARK(Hash_tree_hash)
+    ->Args({1 << 26, 1})
+    ->Args({1 << 26, 0})
+    ->UseRealTime();
@@ -0,0 +1,169 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <sse/crypto/hash.hpp>
+#include <sse/crypto/hmac.hpp>
+#include <sse/crypto/prf.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+using sse::crypto::Blake2bPrfPolicy;
+using sse::crypto::Hash;
+using sse::crypto::HMac;
+using sse::crypto::Key;
+using sse::crypto::Prf;
+
+// HMac over each hash backend
+using Blake2bHMacPolicy = sse::crypto::BasicHMacPrfPolicy<
+    sse::crypto::BasicHash<sse::crypto::Blake2bBackend>>;
+using Sha512HMacPolicy = sse::crypto::BasicHMacPrfPolicy<
+    sse::crypto::BasicHash<sse::crypto::Sha512Backend>>;
+using Blake3HMacPolicy = sse::crypto::BasicHMacPrfPolicy<
+    sse::crypto::BasicHash<sse::crypto::Blake3Backend>>;
+
+// Inputs of state.range(0) bytes
+template<uint16_t NBYTES, class Policy = sse::crypto::HMacPrfPolicy>
+static void Prf_prf(benchmark::State& state)
+{
+    Prf<NBYTES, Policy>  prf;
+    auto                 session = prf.unlock_session();
+    std::vector<uint8_t> in(state.range(0), 0x42);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(prf.prf(in.data(), in.size()));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// state.range(0) inputs of 16 bytes (keywords, counters), evaluated with one
+// prf() call per input
+template<uint16_t NBYTES, class Policy = sse::crypto::HMacPrfPolicy>
+static void Prf_prf_per_call(benchmark::State& state)
+{
+    constexpr size_t kInputSize = 16;
+
+    Prf<NBYTES, Policy>  prf;
+    auto                 session = prf.unlock_session();
+    std::vector<uint8_t> in(state.range(0) * kInputSize, 0x42);
+    std::vector<uint8_t> out(state.range(0) * NBYTES);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < static_cast<size_t>(state.range(0)); i++) {
+            auto res = prf.prf(in.data() + i * kInputSize, kInputSize);
+            std::copy(res.begin(), res.end(), out.begin() + i * NBYTES);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Same as Prf_prf_per_call, with a single prf_batch() call
+template<uint16_t NBYTES, class Policy = sse::crypto::HMacPrfPolicy>
+static void Prf_prf_batch(benchmark::State& state)
+{
+    constexpr size_t kInputSize = 16;
+
+    Prf<NBYTES, Policy>  prf;
+    auto                 session = prf.unlock_session();
+    std::vector<uint8_t> in(state.range(0) * kInputSize, 0x42);
+    std::vector<uint8_t> out(state.range(0) * NBYTES);
+
+    for (auto _ : state) {
+        prf.prf_batch(in.data(), kInputSize, state.range(0), out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Same as Prf_prf<64>, without unlock session: the key is unlocked and locked
+// again for every call
+static void Prf_prf_locked(benchmark::State& state)
+{
+    Prf<64>              prf;
+    std::vector<uint8_t> in(state.range(0), 0x42);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(prf.prf(in.data(), in.size()));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Incremental evaluation of HMac, on inputs given in 16 bytes pieces
+static void HMac_incremental(benchmark::State& state)
+{
+    HMac<Hash, 32>                         hmac;
+    auto                                   session = hmac.unlock_session();
+    std::vector<uint8_t>                   in(state.range(0), 0x42);
+    std::array<uint8_t, Hash::kDigestSize> out;
+
+    for (auto _ : state) {
+        auto hmac_state = hmac.init();
+        for (size_t pos = 0; pos < in.size(); pos += 16) {
+            hmac_state.update(in.data() + pos, 16);
+        }
+        hmac_state.final(out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_TEMPLATE(Prf_prf, 16)->RangeMultiplier(2)->Range(16, 1024);
+BENCHMARK_TEMPLATE(Prf_prf, 32)->RangeMultiplier(2)->Range(16, 64);
+BENCHMARK_TEMPLATE(Prf_prf, 64)->RangeMultiplier(2)->Range(16, 64);
+BENCHMARK_TEMPLATE(Prf_prf, 16, Blake2bPrfPolicy)
+    ->RangeMultiplier(2)
+    ->Range(16, 1024);
+BENCHMARK_TEMPLATE(Prf_prf, 32, Blake2bPrfPolicy)
+    ->RangeMultiplier(2)
+    ->Range(16, 64);
+BENCHMARK_TEMPLATE(Prf_prf, 128, Blake2bPrfPolicy)
+    ->RangeMultiplier(2)
+    ->Range(16, 64);
+BENCHMARK_TEMPLATE(Prf_prf, 32, Blake2bHMacPolicy)
+    ->RangeMultiplier(4)
+    ->Range(16, 1024);
+BENCHMARK_TEMPLATE(Prf_prf, 32, Sha512HMacPolicy)
+    ->RangeMultiplier(4)
+    ->Range(16, 1024);
+BENCHMARK_TEMPLATE(Prf_prf, 32, Blake3HMacPolicy)
+    ->RangeMultiplier(4)
+    ->Range(16, 1024);
+BENCHMARK_TEMPLATE(Prf_prf_per_call, 16)->RangeMultiplier(8)->Range(8, 4096);
+BENCHMARK_TEMPLATE(Prf_prf_batch, 16)->RangeMultiplier(8)->Range(8, 4096);
+BENCHMARK_TEMPLATE(Prf_prf_per_call, 16, Blake2bPrfPolicy)
+    ->RangeMultiplier(8)
+    ->Range(8, 4096);
+BENCHMARK_TEMPLATE(Prf_prf_batch, 16, Blake2bPrfPolicy)
+    ->RangeMultiplier(8)
+    ->Range(8, 4096);
+BENCHMARK_TEMPLATE(Prf_prf_batch, 16, Sha512HMacPolicy)
+    ->RangeMultiplier(8)
+    ->Range(8, 4096);
+BENCHMARK_TEMPLATE(Prf_prf_batch, 16, Blake3HMacPolicy)
+    ->RangeMultiplier(8)
+    ->Range(8, 4096);
+BENCHMARK(Prf_prf_locked)->RangeMultiplier(2)->Range(16, 64);
+BENCHMARK(HMac_incremental)->RangeMultiplier(4)->Range(16, 1024);
@@ -0,0 +1,139 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <sse/crypto/prp.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <numeric>
+#include <vector>
+
+using sse::crypto::Prp;
+using sse::crypto::RangePrp;
+
+// Permutation of state.range(0) 64 bits identifiers, with one encrypt_64()
+// call per identifier
+static void Prp_encrypt_64_per_call(benchmark::State& state)
+{
+    Prp                   prp;
+    auto                  session = prp.unlock_session();
+    std::vector<uint64_t> in(state.range(0));
+    std::vector<uint64_t> out(state.range(0));
+    std::iota(in.begin(), in.end(), 0);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < in.size(); i++) {
+            out[i] = prp.encrypt_64(in[i]);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Same as Prp_encrypt_64_per_call, with a single encrypt_64_batch() call
+static void Prp_encrypt_64_batch(benchmark::State& state)
+{
+    Prp                   prp;
+    auto                  session = prp.unlock_session();
+    std::vector<uint64_t> in(state.range(0));
+    std::vector<uint64_t> out(state.range(0));
+    std::iota(in.begin(), in.end(), 0);
+
+    for (auto _ : state) {
+        prp.encrypt_64_batch(in.data(), in.size(), out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Same as Prp_encrypt_64_batch, on 32 bits identifiers
+static void Prp_encrypt_32_batch(benchmark::State& state)
+{
+    Prp                   prp;
+    auto                  session = prp.unlock_session();
+    std::vector<uint32_t> in(state.range(0));
+    std::vector<uint32_t> out(state.range(0));
+    std::iota(in.begin(), in.end(), 0);
+
+    for (auto _ : state) {
+        prp.encrypt_batch(in.data(), in.size(), out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Encryption of a single state.range(0) bytes long message
+static void Prp_encrypt_buffer(benchmark::State& state)
+{
+    Prp                  prp;
+    auto                 session = prp.unlock_session();
+    std::vector<uint8_t> in(state.range(0));
+    std::vector<uint8_t> out(state.range(0));
+    std::iota(in.begin(), in.end(), 0);
+
+    for (auto _ : state) {
+        prp.encrypt(in.data(),
+                    static_cast<unsigned int>(in.size()),
+                    out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Permutation of state.range(0) values of [0, 1000000), with one
+// encrypt_batch() call
+static void RangePrp_encrypt_batch(benchmark::State& state)
+{
+    RangePrp              prp(1000000);
+    auto                  session = prp.unlock_session();
+    std::vector<uint64_t> in(state.range(0));
+    std::vector<uint64_t> out(state.range(0));
+    std::iota(in.begin(), in.end(), 0);
+
+    for (auto _ : state) {
+        prp.encrypt_batch(in.data(), in.size(), out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Permutation of the whole [0, state.range(0)) domain, on all the cores
+static void RangePrp_permute_domain(benchmark::State& state)
+{
+    RangePrp              prp(state.range(0));
+    auto                  executor = sse::crypto::thread_executor();
+    std::vector<uint64_t> out(state.range(0));
+
+    for (auto _ : state) {
+        prp.permute_domain(out.data(), executor);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(Prp_encrypt_64_per_call)->RangeMultiplier(8)->Range(8, 1 << 15);
+BENCHMARK(Prp_encrypt_64_batch)->RangeMultiplier(8)->Range(8, 1 << 15);
+BENCHMARK(Prp_encrypt_32_batch)->RangeMultiplier(8)->Range(8, 1 << 15);
+BENCHMARK(Prp_encrypt_buffer)->RangeMultiplier(8)->Range(64, 1 << 18);
+BENCHMARK(RangePrp_encrypt_batch)->RangeMultiplier(8)->Range(8, 1 << 15);
+BENCHMARK(RangePrp_permute_domain)
+    ->RangeMultiplier(16)
+    ->Range(1 << 10, 1 << 22)
+    ->UseRealTime();
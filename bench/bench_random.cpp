@@ -0,0 +1,55 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include <sse/crypto/random.hpp>
+
+#include <sodium/randombytes.h>
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+// Generation of state.range(0) random bytes with random_bytes
+static void Random_bytes(benchmark::State& state)
+{
+    std::vector<uint8_t> out(state.range(0));
+
+    for (auto _ : state) {
+        sse::crypto::random_bytes(out.size(), out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Same as Random_bytes, directly with libsodium's randombytes_buf
+static void Random_bytes_sodium(benchmark::State& state)
+{
+    std::vector<uint8_t> out(state.range(0));
+
+    for (auto _ : state) {
+        randombytes_buf(out.data(), out.size());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(Random_bytes)->RangeMultiplier(4)->Range(16, 1 << 16);
+BENCHMARK(Random_bytes_sodium)->RangeMultiplier(4)->Range(16, 1 << 16);
@@ -22,12 +22,60 @@
 
 #include <benchmark/benchmark.h>
 
+#include <algorithm>
+#include <array>
 #include <random>
+#include <vector>
 
 using sse::crypto::Key;
+using sse::crypto::ConstrainedRCPrfView;
+using sse::crypto::Prg;
 using sse::crypto::RCPrf;
+using sse::crypto::RCPrfCursor;
 using sse::crypto::RCPrfParams;
 
+// Depth-first range evaluation, building a new Prg object for every node, as
+// RCPrf::eval_range used to do. Kept as a baseline for the breadth-first
+// engine.
+static void recursive_eval_range(const Prg&                      prg,
+                                 uint8_t                         height,
+                                 uint64_t                        offset,
+                                 uint64_t                        min,
+                                 uint64_t                        max,
+                                 std::array<uint8_t, 32>&        leaf,
+                                 const RCPrf<32>::callback_type& callback)
+{
+    if (height == 2) {
+        for (uint64_t i = min; i <= max; i++) {
+            prg.derive(static_cast<uint32_t>(i) * 32, 32, leaf.data());
+            callback(offset + i, leaf);
+        }
+        return;
+    }
+
+    const uint64_t half = 1UL << (height - 2);
+    if (min < half) {
+        Prg left(prg.derive_key<RCPrfParams::kKeySize>(0));
+        recursive_eval_range(left,
+                             height - 1,
+                             offset,
+                             min,
+                             std::min(max, half - 1),
+                             leaf,
+                             callback);
+    }
+    if (max >= half) {
+        Prg right(prg.derive_key<RCPrfParams::kKeySize>(1));
+        recursive_eval_range(right,
+                             height - 1,
+                             offset + half,
+                             std::max(min, half) - half,
+                             max - half,
+                             leaf,
+                             callback);
+    }
+}
+
 static void RCPrf_eval(benchmark::State& state)
 {
     uint8_t  depth          = state.range(0);
@@ -47,6 +95,33 @@ static void RCPrf_eval(benchmark::State& state)
     state.SetItemsProcessed(state.iterations());
 }
 
+static void RCPrf_eval_sequential(benchmark::State& state)
+{
+    uint8_t depth = state.range(0);
+
+    RCPrf<32> rcprf(Key<RCPrfParams::kKeySize>(), depth);
+
+    uint64_t leaf = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(rcprf.eval(leaf++));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void RCPrf_cursor_eval_sequential(benchmark::State& state)
+{
+    uint8_t depth = state.range(0);
+
+    RCPrf<32>       rcprf(Key<RCPrfParams::kKeySize>(), depth);
+    RCPrfCursor<32> cursor(rcprf);
+
+    uint64_t leaf = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cursor.eval(leaf++));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
 static void RCPrf_eval_range(benchmark::State& state)
 {
     uint8_t  depth          = state.range(0);
@@ -70,6 +145,120 @@ static void RCPrf_eval_range(benchmark::State& state)
     state.SetItemsProcessed(state.iterations() * state.range(1));
 }
 
+// Same as RCPrf_eval_range, but the callback goes through an std::function,
+// and cannot be inlined
+static void RCPrf_eval_range_std_function(benchmark::State& state)
+{
+    uint8_t  depth          = state.range(0);
+    uint64_t max_leaf_index = RCPrfParams::max_leaf_index_generic(depth);
+
+    std::random_device                      rnd;
+    std::mt19937_64                         rnd_gen(rnd());
+    std::uniform_int_distribution<uint64_t> unif_dist(
+        0, max_leaf_index - state.range(1));
+
+    RCPrf<32> rcprf(Key<RCPrfParams::kKeySize>(), depth);
+
+    uint8_t                  acc = 0;
+    RCPrf<32>::callback_type callback
+        = [&acc](uint64_t, const std::array<uint8_t, 32>& leaf) {
+              acc ^= leaf[0];
+          };
+
+    for (auto _ : state) {
+        // randomly generate a starting point
+        uint64_t start_index = unif_dist(rnd_gen);
+
+        rcprf.eval_range(
+            start_index, start_index + state.range(1) - 1, callback);
+    }
+    benchmark::DoNotOptimize(acc);
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+static void RCPrf_eval_range_template(benchmark::State& state)
+{
+    uint8_t  depth          = state.range(0);
+    uint64_t max_leaf_index = RCPrfParams::max_leaf_index_generic(depth);
+
+    std::random_device                      rnd;
+    std::mt19937_64                         rnd_gen(rnd());
+    std::uniform_int_distribution<uint64_t> unif_dist(
+        0, max_leaf_index - state.range(1));
+
+    RCPrf<32> rcprf(Key<RCPrfParams::kKeySize>(), depth);
+
+    uint8_t acc      = 0;
+    auto    callback = [&acc](uint64_t, const std::array<uint8_t, 32>& leaf) {
+        acc ^= leaf[0];
+    };
+
+    for (auto _ : state) {
+        // randomly generate a starting point
+        uint64_t start_index = unif_dist(rnd_gen);
+
+        rcprf.eval_range(
+            start_index, start_index + state.range(1) - 1, callback);
+    }
+    benchmark::DoNotOptimize(acc);
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+static void RCPrf_eval_range_recursive(benchmark::State& state)
+{
+    uint8_t  depth          = state.range(0);
+    uint64_t max_leaf_index = RCPrfParams::max_leaf_index_generic(depth);
+
+    std::random_device                      rnd;
+    std::mt19937_64                         rnd_gen(rnd());
+    std::uniform_int_distribution<uint64_t> unif_dist(
+        0, max_leaf_index - state.range(1));
+
+    Prg root((Key<RCPrfParams::kKeySize>()));
+
+    auto                    callback = [](size_t, std::array<uint8_t, 32>) {};
+    std::array<uint8_t, 32> leaf;
+
+    for (auto _ : state) {
+        // randomly generate a starting point
+        uint64_t start_index = unif_dist(rnd_gen);
+
+        recursive_eval_range(root,
+                             depth,
+                             0,
+                             start_index,
+                             start_index + state.range(1) - 1,
+                             leaf,
+                             callback);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+static void RCPrf_eval_range_into(benchmark::State& state)
+{
+    uint8_t  depth          = state.range(0);
+    uint64_t max_leaf_index = RCPrfParams::max_leaf_index_generic(depth);
+
+    std::random_device                      rnd;
+    std::mt19937_64                         rnd_gen(rnd());
+    std::uniform_int_distribution<uint64_t> unif_dist(
+        0, max_leaf_index - state.range(1));
+
+    RCPrf<32> rcprf(Key<RCPrfParams::kKeySize>(), depth);
+
+    std::vector<uint8_t> out(state.range(1) * 32);
+
+    for (auto _ : state) {
+        // randomly generate a starting point
+        uint64_t start_index = unif_dist(rnd_gen);
+
+        rcprf.eval_range_into(
+            start_index, start_index + state.range(1) - 1, out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
 static void RCPrf_eval_range_constrain(benchmark::State& state)
 {
     uint8_t  depth          = state.range(0);
@@ -100,12 +289,101 @@ static void RCPrf_eval_range_constrain(benchmark::State& state)
     state.SetItemsProcessed(state.iterations() * state.range(1));
 }
 
+static void RCPrf_constrain(benchmark::State& state)
+{
+    uint8_t  depth          = state.range(0);
+    uint64_t max_leaf_index = RCPrfParams::max_leaf_index_generic(depth);
+
+    std::random_device                      rnd;
+    std::mt19937_64                         rnd_gen(rnd());
+    std::uniform_int_distribution<uint64_t> unif_dist(
+        0, max_leaf_index - state.range(1));
+
+    RCPrf<32> rcprf(Key<RCPrfParams::kKeySize>(), depth);
+
+    for (auto _ : state) {
+        // randomly generate a starting point
+        uint64_t start_index = unif_dist(rnd_gen);
+
+        auto constrained
+            = rcprf.constrain(start_index, start_index + state.range(1));
+        benchmark::DoNotOptimize(constrained.min_leaf());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Same as RCPrf_eval_range_constrain, but the constrained key is evaluated
+// from its serialization, as received by a server
+static void RCPrf_eval_range_view(benchmark::State& state)
+{
+    uint8_t  depth          = state.range(0);
+    uint64_t max_leaf_index = RCPrfParams::max_leaf_index_generic(depth);
+
+    std::random_device                      rnd;
+    std::mt19937_64                         rnd_gen(rnd());
+    std::uniform_int_distribution<uint64_t> unif_dist(
+        0, max_leaf_index - state.range(1));
+
+    RCPrf<32> rcprf(Key<RCPrfParams::kKeySize>(), depth);
+
+    auto callback = [](size_t, std::array<uint8_t, 32>) {};
+
+    std::vector<uint8_t> token;
+
+    for (auto _ : state) {
+        // randomly generate a starting point
+        uint64_t start_index = unif_dist(rnd_gen);
+
+        state.PauseTiming();
+        auto constrained
+            = rcprf.constrain(start_index, start_index + state.range(1));
+        token.resize(constrained.serialized_size());
+        constrained.serialize(token.data());
+
+        state.ResumeTiming();
+
+        ConstrainedRCPrfView<32> view(token.data(), token.size());
+        view.eval_range(start_index, start_index + state.range(1), callback);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
 BENCHMARK(RCPrf_eval)->RangeMultiplier(2)->Range(48, 48);
+BENCHMARK(RCPrf_eval_sequential)->RangeMultiplier(2)->Range(48, 48);
+BENCHMARK(RCPrf_cursor_eval_sequential)->RangeMultiplier(2)->Range(48, 48);
 
 BENCHMARK(RCPrf_eval_range)->RangeMultiplier(2)->Ranges({{48, 48}, {8, 128}});
 // ->Ranges({{16, 32}, {8, 128}});
 
+// search ranges, from 2^10 to 2^20 leaves
+BENCHMARK(RCPrf_eval_range_recursive)
+    ->RangeMultiplier(4)
+    ->Ranges({{48, 48}, {1 << 10, 1 << 20}});
+BENCHMARK(RCPrf_eval_range)
+    ->RangeMultiplier(4)
+    ->Ranges({{48, 48}, {1 << 10, 1 << 20}});
+BENCHMARK(RCPrf_eval_range_into)
+    ->RangeMultiplier(4)
+    ->Ranges({{48, 48}, {1 << 10, 1 << 20}});
+
+// cost of the std::function callback
+BENCHMARK(RCPrf_eval_range_std_function)
+    ->RangeMultiplier(4)
+    ->Ranges({{48, 48}, {1 << 10, 1 << 16}});
+BENCHMARK(RCPrf_eval_range_template)
+    ->RangeMultiplier(4)
+    ->Ranges({{48, 48}, {1 << 10, 1 << 16}});
+
+// constrained key (token) generation
+BENCHMARK(RCPrf_constrain)
+    ->RangeMultiplier(16)
+    ->Ranges({{48, 48}, {1 << 4, 1 << 20}});
+
 BENCHMARK(RCPrf_eval_range_constrain)
     ->RangeMultiplier(2)
     ->Ranges({{48, 48}, {8, 128}});
 // ->Ranges({{16, 32}, {8, 128}});
+
+BENCHMARK(RCPrf_eval_range_view)
+    ->RangeMultiplier(2)
+    ->Ranges({{48, 48}, {8, 128}});
@@ -277,10 +277,168 @@ static block aez_hash(const aez_ctx_t *ctx, const char *n, unsigned nbytes, unsi
 
 /* ------------------------------------------------------------------------- */
 
+/* VAES path of pass_one and pass_two: the AES rounds of 4 blocks are computed
+ * by a single instruction on 512 bits registers. Selected at runtime by
+ * aez_init_dispatch(). */
+
+#if __AES__ && defined(__x86_64__) && \
+    ((defined(__clang__) && __clang_major__ >= 8) || \
+     (!defined(__clang__) && __GNUC__ >= 9))
+#define AEZ_VAES 1
+#endif
+
+static int aez_use_vaes = 0;
+
+void aez_init_dispatch(void) {
+#if AEZ_VAES
+    __builtin_cpu_init();
+    aez_use_vaes = __builtin_cpu_supports("vaes")
+                   && __builtin_cpu_supports("avx512f");
+#else
+    aez_use_vaes = 0;
+#endif
+}
+
+#if AEZ_VAES
+
+#include <immintrin.h>
+
+/* Number of groups of 16 blocks processed by an iteration of the VAES loops:
+ * enough independent AES chains to hide the latency of VAESENC */
+#define AEZ_VAES_GROUPS 4
+#define AEZ_VAES_BYTES  (AEZ_VAES_GROUPS*16*16)
+
+#define VAES_TARGET __attribute__((target("vaes,avx512f")))
+
+#define aes4_512(in,a,b,c,d) \
+    _mm512_aesenc_epi128(_mm512_aesenc_epi128(_mm512_aesenc_epi128( \
+        _mm512_aesenc_epi128(in,a),b),c),d)
+
+/* Splits 8 consecutive blocks in the even and the odd ones */
+VAES_TARGET static void vaes_split(const block *p, __m512i *even, __m512i *odd) {
+    __m512i lo = _mm512_loadu_si512((const void*)p);
+    __m512i hi = _mm512_loadu_si512((const void*)(p+4));
+    *even = _mm512_shuffle_i64x2(lo, hi, _MM_SHUFFLE(2,0,2,0));
+    *odd  = _mm512_shuffle_i64x2(lo, hi, _MM_SHUFFLE(3,1,3,1));
+}
+
+/* Inverse of vaes_split */
+VAES_TARGET static void vaes_merge(block *p, __m512i even, __m512i odd) {
+    __m512i lo = _mm512_shuffle_i64x2(even, odd, _MM_SHUFFLE(1,0,1,0));
+    __m512i hi = _mm512_shuffle_i64x2(even, odd, _MM_SHUFFLE(3,2,3,2));
+    _mm512_storeu_si512((void*)p,     _mm512_shuffle_i64x2(lo, lo, _MM_SHUFFLE(3,1,2,0)));
+    _mm512_storeu_si512((void*)(p+4), _mm512_shuffle_i64x2(hi, hi, _MM_SHUFFLE(3,1,2,0)));
+}
+
+/* Offsets of the 8 pairs of blocks of a group, from the group's offset */
+VAES_TARGET static void vaes_offsets(const aez_ctx_t *ctx, block offset,
+                                     __m512i *lo, __m512i *hi) {
+    __m512i d = _mm512_setzero_si512();
+    d = _mm512_inserti32x4(d, ctx->I[0], 1);
+    d = _mm512_inserti32x4(d, ctx->I[1], 2);
+    d = _mm512_inserti32x4(d, vxor(ctx->I[0],ctx->I[1]), 3);
+    *lo = _mm512_xor_si512(_mm512_broadcast_i32x4(offset), d);
+    *hi = _mm512_xor_si512(*lo, _mm512_broadcast_i32x4(ctx->I[2]));
+}
+
+VAES_TARGET static block vaes_reduce(__m512i x) {
+    return vxor4(_mm512_extracti32x4_epi32(x,0), _mm512_extracti32x4_epi32(x,1),
+                 _mm512_extracti32x4_epi32(x,2), _mm512_extracti32x4_epi32(x,3));
+}
+
+/* Same as the 16 blocks loop of pass_one, on AEZ_VAES_BYTES bytes at a time.
+ * Updates the pointers, the number of remaining bytes and the offset doubling
+ * state, and returns the checksum of the processed blocks. */
+VAES_TARGET static block pass_one_vaes(const aez_ctx_t *ctx, const block **psrc,
+                                       unsigned *pbytes, block **pdst,
+                                       block *pIfordoubling) {
+    const __m512i I = _mm512_broadcast_i32x4(ctx->I[0]);
+    const __m512i J = _mm512_broadcast_i32x4(ctx->J[0]);
+    const __m512i L = _mm512_broadcast_i32x4(ctx->L);
+    __m512i e[2*AEZ_VAES_GROUPS], o[2*AEZ_VAES_GROUPS], off[2*AEZ_VAES_GROUPS];
+    __m512i x, sum = _mm512_setzero_si512();
+    const block *src = *psrc;
+    block *dst = *pdst, Ifordoubling = *pIfordoubling;
+    unsigned bytes = *pbytes, g;
+
+    while (bytes >= AEZ_VAES_BYTES) {
+        for (g=0; g<2*AEZ_VAES_GROUPS; g+=2) {
+            vaes_offsets(ctx, bswap16(Ifordoubling), &off[g], &off[g+1]);
+            Ifordoubling = double_block(Ifordoubling);
+            vaes_split(src + 8*g,     &e[g],   &o[g]);
+            vaes_split(src + 8*g + 8, &e[g+1], &o[g+1]);
+        }
+        for (g=0; g<2*AEZ_VAES_GROUPS; g++) {
+            x = aes4_512(_mm512_xor_si512(o[g],off[g]), J, I, L, e[g]);
+            e[g] = x;
+        }
+        for (g=0; g<2*AEZ_VAES_GROUPS; g++) {
+            o[g] = aes4_512(e[g], J, I, L, o[g]);
+            sum = _mm512_xor_si512(sum, o[g]);
+        }
+        for (g=0; g<2*AEZ_VAES_GROUPS; g++) {
+            vaes_merge(dst + 8*g, e[g], o[g]);
+        }
+        bytes -= AEZ_VAES_BYTES; src += AEZ_VAES_BYTES/16; dst += AEZ_VAES_BYTES/16;
+    }
+
+    *psrc = src; *pdst = dst; *pbytes = bytes; *pIfordoubling = Ifordoubling;
+    return vaes_reduce(sum);
+}
+
+/* Same as the 16 blocks loop of pass_two, on AEZ_VAES_BYTES bytes at a time */
+VAES_TARGET static block pass_two_vaes(const aez_ctx_t *ctx, block s,
+                                       unsigned *pbytes, block **pdst,
+                                       block *pIfordoubling) {
+    const __m512i I = _mm512_broadcast_i32x4(ctx->I[0]);
+    const __m512i J = _mm512_broadcast_i32x4(ctx->J[0]);
+    const __m512i L = _mm512_broadcast_i32x4(ctx->L);
+    const __m512i S = _mm512_broadcast_i32x4(s);
+    __m512i e[2*AEZ_VAES_GROUPS], o[2*AEZ_VAES_GROUPS], off[2*AEZ_VAES_GROUPS];
+    __m512i fs, t[2*AEZ_VAES_GROUPS], sum = _mm512_setzero_si512();
+    block *dst = *pdst, Ifordoubling = *pIfordoubling;
+    unsigned bytes = *pbytes, g;
+
+    while (bytes >= AEZ_VAES_BYTES) {
+        for (g=0; g<2*AEZ_VAES_GROUPS; g+=2) {
+            vaes_offsets(ctx, bswap16(Ifordoubling), &off[g], &off[g+1]);
+            Ifordoubling = double_block(Ifordoubling);
+            vaes_split(dst + 8*g,     &e[g],   &o[g]);
+            vaes_split(dst + 8*g + 8, &e[g+1], &o[g+1]);
+        }
+        for (g=0; g<2*AEZ_VAES_GROUPS; g++) {
+            fs = aes4_512(_mm512_xor_si512(S,off[g]), L, I, J, L);
+            t[g] = _mm512_xor_si512(e[g], fs);
+            sum = _mm512_xor_si512(sum, t[g]);
+            e[g] = _mm512_xor_si512(o[g], fs);
+        }
+        for (g=0; g<2*AEZ_VAES_GROUPS; g++) {
+            o[g] = aes4_512(e[g], J, I, L, t[g]);
+        }
+        for (g=0; g<2*AEZ_VAES_GROUPS; g++) {
+            e[g] = aes4_512(_mm512_xor_si512(o[g],off[g]), J, I, L, e[g]);
+            vaes_merge(dst + 8*g, e[g], o[g]);
+        }
+        bytes -= AEZ_VAES_BYTES; dst += AEZ_VAES_BYTES/16;
+    }
+
+    *pdst = dst; *pbytes = bytes; *pIfordoubling = Ifordoubling;
+    return vaes_reduce(sum);
+}
+
+#endif /* AEZ_VAES */
+
+/* ------------------------------------------------------------------------- */
+
 static block pass_one(const aez_ctx_t *ctx, const block *src, unsigned bytes, block *dst) {
     block o0, o1, o2, o3, o4, o5, o6, o7, offset, tmp, sum=zero;
     block I=ctx->I[0], L=ctx->L, J=ctx->J[0];
     block Ifordoubling = double_block(bswap16(ctx->I[2]));  /* I8 */
+#if AEZ_VAES
+    if (aez_use_vaes) {
+        sum = pass_one_vaes(ctx, &src, &bytes, &dst, &Ifordoubling);
+    }
+#endif
     offset = bswap16(Ifordoubling);
     while (bytes >= 16*16) {
         o0 = offset;
@@ -351,6 +509,11 @@ static block pass_two(const aez_ctx_t *ctx, block s, unsigned bytes, block *dst)
     block fs[8], tmp[8];
     block I=ctx->I[0], L=ctx->L, J=ctx->J[0];
     block Ifordoubling = double_block(bswap16(ctx->I[2]));  /* I8 */
+#if AEZ_VAES
+    if (aez_use_vaes) {
+        sum = pass_two_vaes(ctx, s, &bytes, &dst, &Ifordoubling);
+    }
+#endif
     offset = bswap16(Ifordoubling);
     while (bytes >= 16*16) {
         o0 = offset;
@@ -632,6 +795,187 @@ static int cipher_aez_tiny(const aez_ctx_t *ctx, block t, int d, const char *src
 
 /* ------------------------------------------------------------------------- */
 
+/* Number of messages enciphered together by aez_tiny_many */
+#define AEZ_LANES 8
+
+/* Same as cipher_aez_tiny with abytes == 0 and 0 < bytes < 16, on AEZ_LANES
+ * independent messages. The rounds of the lanes are interleaved: the AES
+ * instructions of a lane do not wait for the results of the previous ones. */
+static void cipher_aez_tiny_lanes(const aez_ctx_t *ctx, block t, int d,
+                                  const char *src, unsigned bytes,
+                                  unsigned n_lanes, char *dst) {
+    block l[AEZ_LANES], r[AEZ_LANES], buf[AEZ_LANES][2];
+    block tmp, one, rcon, rcon_init, mask_10, mask_ff;
+    block I=ctx->I[0], L=ctx->L, J=ctx->J[0], t_orig = t;
+    unsigned rnds, i, k;
+
+    /* masks and tweak offset, shared by all the lanes */
+    mask_ff = loadu(pad+16-bytes/2);
+    mask_10 = loadu(pad+32-bytes/2);
+    if (bytes&1) {
+        mask_10 = sll4(mask_10);
+        ((char*)&mask_ff)[bytes/2] = (char)0xf0;
+    }
+    t = vxor4(t, ctx->I[0], ctx->I[1], ctx->I[2]);      /* (0,7) offset */
+    if (bytes>=3) {
+        rnds = 10;
+    } else if (bytes==2) {
+        rnds = 16;
+    } else {
+        rnds = 24;
+    }
+    if (!d) {
+        one = zero_set_byte(1,15);
+        rcon_init = zero;
+    } else {
+        one = zero_set_byte(-1,15);
+        rcon_init = zero_set_byte((char)(rnds-1),15);
+    }
+
+    /* load the lanes, the missing ones are left to 0 */
+    for (k=0; k<AEZ_LANES; k++) {
+        buf[k][0] = zero;
+        buf[k][1] = zero;
+        if (k < n_lanes) {
+            memcpy(&buf[k][0], src + k*bytes, bytes);
+        }
+        l[k] = buf[k][0];
+        r[k] = loadu((char*)buf[k]+bytes/2);
+        if (bytes&1) {
+            r[k] = bswap16(srl4(bswap16(r[k])));
+        }
+        r[k] = vor(vand(r[k], mask_ff), mask_10);
+    }
+
+    if (d) {
+        for (k=0; k<AEZ_LANES; k++) {
+            tmp = vor(l[k], loadu(pad+32));
+            tmp = aes4(vxor4(tmp,t_orig,ctx->I[0],ctx->I[1]), J, I, L, zero);
+            l[k] = vxor(l[k], vand(tmp, loadu(pad+32)));
+        }
+    }
+
+    /* Feistel */
+    rcon = rcon_init;
+    for (i=0; i<rnds; i+=2) {
+        for (k=0; k<AEZ_LANES; k++) {
+            l[k] = vor(vand(aes4(vxor3(t,r[k],rcon), J, I, L, l[k]),
+                            mask_ff), mask_10);
+        }
+        rcon = vadd(rcon,one);
+        for (k=0; k<AEZ_LANES; k++) {
+            r[k] = vor(vand(aes4(vxor3(t,l[k],rcon), J, I, L, r[k]),
+                            mask_ff), mask_10);
+        }
+        rcon = vadd(rcon,one);
+    }
+
+    for (k=0; k<AEZ_LANES; k++) {
+        buf[k][0] = r[k];
+        if (bytes&1) {
+            l[k] = bswap16(sll4(bswap16(l[k])));
+            tmp = vand(loadu((char*)buf[k]+bytes/2), zero_set_byte((char)0xf0,0));
+            l[k] = vor(l[k], tmp);
+        }
+        storeu((char*)buf[k]+bytes/2, l[k]);
+    }
+    if (!d) {
+        for (k=0; k<AEZ_LANES; k++) {
+            tmp = vor(zero_pad(buf[k][0], 16-bytes), loadu(pad+32));
+            tmp = aes4(vxor4(tmp,t_orig,ctx->I[0],ctx->I[1]), J, I, L, zero);
+            buf[k][0] = vxor(buf[k][0], vand(tmp, loadu(pad+32)));
+        }
+    }
+    for (k=0; k<n_lanes; k++) {
+        memcpy(dst + k*bytes, &buf[k][0], bytes);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void aez_tiny_many(const aez_ctx_t *ctx, const char *n, unsigned nbytes,
+                   int d, const char *src, unsigned bytes, size_t count,
+                   char *dst) {
+    /* the tweak is the same for all the messages */
+    block t = aez_hash(ctx, n, nbytes, 0);
+
+    while (count >= AEZ_LANES) {
+        cipher_aez_tiny_lanes(ctx, t, d, src, bytes, AEZ_LANES, dst);
+        src += AEZ_LANES*bytes; dst += AEZ_LANES*bytes; count -= AEZ_LANES;
+    }
+    if (count) {
+        cipher_aez_tiny_lanes(ctx, t, d, src, bytes, (unsigned)count, dst);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* Feistel network on AEZ_LANES integers of bits bits, with the same AES4
+ * round function and number of rounds as cipher_aez_tiny. The high half of
+ * the integers has bits/2 bits and the low half the remaining ones. */
+static void feistel_lanes(const aez_ctx_t *ctx, block t, int d, unsigned bits,
+                          const uint64_t *src, unsigned n_lanes,
+                          uint64_t *dst) {
+    uint64_t a[AEZ_LANES], b[AEZ_LANES], f, c;
+    block I=ctx->I[0], L=ctx->L, J=ctx->J[0], x, y;
+    unsigned rnds, i, k, wa = bits/2, wb = bits - wa, w;
+
+    if (bits>=24) {
+        rnds = 10;
+    } else if (bits>=16) {
+        rnds = 16;
+    } else {
+        rnds = 24;
+    }
+
+    for (k=0; k<AEZ_LANES; k++) {
+        f = (k < n_lanes ? src[k] : 0);
+        a[k] = f >> wb;
+        b[k] = f & (((uint64_t)1 << wb) - 1);
+    }
+
+    /* Round i maps (a, b) to (b, a ^ F_i(b)), and swaps the widths */
+    for (i=0; i<rnds; i++) {
+        block rcon = vxor(t, zero_set_byte((char)(d ? rnds-1-i : i), 15));
+        for (k=0; k<AEZ_LANES; k++) {
+            x = zero;
+            memcpy(&x, (d ? &a[k] : &b[k]), sizeof(uint64_t));
+            y = aes4(vxor(x, rcon), J, I, L, zero);
+            memcpy(&f, &y, sizeof(uint64_t));
+            if (!d) {
+                c = a[k] ^ (f & (((uint64_t)1 << wa) - 1));
+                a[k] = b[k];
+                b[k] = c;
+            } else {
+                c = b[k] ^ (f & (((uint64_t)1 << wb) - 1));
+                b[k] = a[k];
+                a[k] = c;
+            }
+        }
+        w = wa; wa = wb; wb = w;
+    }
+
+    for (k=0; k<n_lanes; k++) {
+        dst[k] = (a[k] << wb) | b[k];
+    }
+}
+
+void aez_feistel_many(const aez_ctx_t *ctx, const char *n, unsigned nbytes,
+                      int d, unsigned bits, const uint64_t *src, size_t count,
+                      uint64_t *dst) {
+    block t = aez_hash(ctx, n, nbytes, 0);
+
+    while (count >= AEZ_LANES) {
+        feistel_lanes(ctx, t, d, bits, src, AEZ_LANES, dst);
+        src += AEZ_LANES; dst += AEZ_LANES; count -= AEZ_LANES;
+    }
+    if (count) {
+        feistel_lanes(ctx, t, d, bits, src, (unsigned)count, dst);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
 void aez_encrypt(const aez_ctx_t *ctx, const char *n, unsigned nbytes,
                  unsigned abytes,
                  const char *src, unsigned bytes, char *dst) {
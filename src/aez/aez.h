@@ -10,6 +10,7 @@ extern "C" {
 /* ------------------------------------------------------------------------- */
 
 #include <smmintrin.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <wmmintrin.h>
 #define block __m128i
@@ -19,6 +20,8 @@ extern "C" {
 /* ------------------------------------------------------------------------- */
 
 #include <arm_neon.h>
+#include <stddef.h>
+#include <stdint.h>
 #define block uint8x16_t
 
 /* ------------------------------------------------------------------------- */
@@ -36,6 +39,11 @@ typedef struct {
 
 
 
+/* Selects the fastest implementation supported by the CPU (VAES on x86).
+ * Must be called before any other function of the module, from a single
+ * thread. */
+void aez_init_dispatch(void);
+
 void aez_setup(const unsigned char *key, unsigned keylen, aez_ctx_t *ctx);
 void aez_encrypt(const aez_ctx_t *ctx, const char *n, unsigned nbytes,
                  unsigned abytes,
@@ -44,6 +52,22 @@ int aez_decrypt(const aez_ctx_t *ctx, const char *n, unsigned nbytes,
                  unsigned abytes,
                  const char *src, unsigned bytes, char *dst);
 
+/* Enciphers (d == 0) or deciphers (d == 1) count messages of bytes bytes each
+ * (0 < bytes < 16), stored contiguously in src, with the same nonce and no
+ * authenticator (abytes == 0). The output is the one of count calls to
+ * aez_encrypt (or aez_decrypt), and src can be equal to dst. */
+void aez_tiny_many(const aez_ctx_t *ctx, const char *n, unsigned nbytes,
+                   int d, const char *src, unsigned bytes, size_t count,
+                   char *dst);
+
+/* Enciphers (d == 0) or deciphers (d == 1) count integers of [0, 2^bits)
+ * (2 <= bits <= 64) with a balanced Feistel network tweaked by the nonce. It
+ * is the building block of small-domain permutations, on top of which
+ * arbitrary domains are handled by cycle walking. src can be equal to dst. */
+void aez_feistel_many(const aez_ctx_t *ctx, const char *n, unsigned nbytes,
+                      int d, unsigned bits, const uint64_t *src, size_t count,
+                      uint64_t *dst);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,329 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "chacha/chacha20_multi.hpp"
+
+#include <cstring>
+
+#include <sodium/crypto_stream_chacha20.h>
+#include <sodium/runtime.h>
+#include <sodium/utils.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHACHA_MULTI_X86 1
+#include <immintrin.h>
+#endif
+
+// The multi-buffer kernels store the ChaCha20 state "vertically": the i-th
+// vector of the state contains the i-th word of the state of every lane. Each
+// lane uses its own key and block counter. The keys are loaded, and the
+// keystream blocks stored, with matrix transpositions.
+
+namespace sse {
+
+namespace crypto {
+
+namespace chacha {
+
+namespace {
+
+const uint8_t kZeroNonce[crypto_stream_chacha20_NONCEBYTES] = {0};
+
+// "expand 32-byte k"
+const uint32_t kSigma[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+
+bool use_avx2__ = false;
+
+void keystream_blocks_ref(const uint8_t* const* keys,
+                          const uint64_t*       counters,
+                          uint8_t* const*       outs,
+                          const size_t          n)
+{
+    for (size_t i = 0; i < n; i++) {
+        memset(outs[i], 0, kBlockSize);
+        crypto_stream_chacha20_xor_ic(
+            outs[i], outs[i], kBlockSize, kZeroNonce, counters[i], keys[i]);
+    }
+}
+
+#ifdef CHACHA_MULTI_X86
+
+inline int lo_word(const uint64_t c)
+{
+    return static_cast<int>(static_cast<uint32_t>(c));
+}
+
+inline int hi_word(const uint64_t c)
+{
+    return static_cast<int>(static_cast<uint32_t>(c >> 32));
+}
+
+// SSE2 kernel (4 lanes). SSE2 is part of the x86-64 baseline.
+
+#define CHACHA_ROTL128(v, n)                                                   \
+    _mm_or_si128(_mm_slli_epi32((v), (n)), _mm_srli_epi32((v), 32 - (n)))
+
+#define CHACHA_QR128(a, b, c, d)                                               \
+    a = _mm_add_epi32(a, b);                                                   \
+    d = _mm_xor_si128(d, a);                                                   \
+    d = CHACHA_ROTL128(d, 16);                                                 \
+    c = _mm_add_epi32(c, d);                                                   \
+    b = _mm_xor_si128(b, c);                                                   \
+    b = CHACHA_ROTL128(b, 12);                                                 \
+    a = _mm_add_epi32(a, b);                                                   \
+    d = _mm_xor_si128(d, a);                                                   \
+    d = CHACHA_ROTL128(d, 8);                                                  \
+    c = _mm_add_epi32(c, d);                                                   \
+    b = _mm_xor_si128(b, c);                                                   \
+    b = CHACHA_ROTL128(b, 7);
+
+inline void transpose4(__m128i* r)
+{
+    const __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);
+    const __m128i t1 = _mm_unpackhi_epi32(r[0], r[1]);
+    const __m128i t2 = _mm_unpacklo_epi32(r[2], r[3]);
+    const __m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);
+
+    r[0] = _mm_unpacklo_epi64(t0, t2);
+    r[1] = _mm_unpackhi_epi64(t0, t2);
+    r[2] = _mm_unpacklo_epi64(t1, t3);
+    r[3] = _mm_unpackhi_epi64(t1, t3);
+}
+
+void keystream_blocks_sse2(const uint8_t* const* keys,
+                           const uint64_t*       counters,
+                           uint8_t* const*       outs)
+{
+    __m128i x[16];
+    __m128i s[16];
+
+    for (size_t i = 0; i < 4; i++) {
+        x[i] = _mm_set1_epi32(static_cast<int>(kSigma[i]));
+    }
+    for (size_t half = 0; half < 2; half++) {
+        __m128i* r = x + 4 + 4 * half;
+        for (size_t l = 0; l < 4; l++) {
+            r[l] = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(keys[l] + 16 * half));
+        }
+        transpose4(r);
+    }
+    x[12] = _mm_set_epi32(lo_word(counters[3]),
+                          lo_word(counters[2]),
+                          lo_word(counters[1]),
+                          lo_word(counters[0]));
+    x[13] = _mm_set_epi32(hi_word(counters[3]),
+                          hi_word(counters[2]),
+                          hi_word(counters[1]),
+                          hi_word(counters[0]));
+    x[14] = _mm_setzero_si128();
+    x[15] = _mm_setzero_si128();
+
+    memcpy(s, x, sizeof(x));
+
+    for (size_t round = 0; round < 10; round++) {
+        CHACHA_QR128(x[0], x[4], x[8], x[12])
+        CHACHA_QR128(x[1], x[5], x[9], x[13])
+        CHACHA_QR128(x[2], x[6], x[10], x[14])
+        CHACHA_QR128(x[3], x[7], x[11], x[15])
+        CHACHA_QR128(x[0], x[5], x[10], x[15])
+        CHACHA_QR128(x[1], x[6], x[11], x[12])
+        CHACHA_QR128(x[2], x[7], x[8], x[13])
+        CHACHA_QR128(x[3], x[4], x[9], x[14])
+    }
+
+    for (size_t i = 0; i < 16; i++) {
+        x[i] = _mm_add_epi32(x[i], s[i]);
+    }
+    for (size_t g = 0; g < 4; g++) {
+        __m128i* r = x + 4 * g;
+        transpose4(r);
+        for (size_t l = 0; l < 4; l++) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(outs[l] + 16 * g),
+                             r[l]);
+        }
+    }
+
+    sodium_memzero(x, sizeof(x));
+    sodium_memzero(s, sizeof(s));
+}
+
+// AVX2 kernel (8 lanes), selected at runtime
+
+#define CHACHA_ROTL256(v, n)                                                   \
+    _mm256_or_si256(_mm256_slli_epi32((v), (n)),                               \
+                    _mm256_srli_epi32((v), 32 - (n)))
+
+#define CHACHA_QR256(a, b, c, d)                                               \
+    a = _mm256_add_epi32(a, b);                                                \
+    d = _mm256_xor_si256(d, a);                                                \
+    d = _mm256_shuffle_epi8(d, rot16);                                         \
+    c = _mm256_add_epi32(c, d);                                                \
+    b = _mm256_xor_si256(b, c);                                                \
+    b = CHACHA_ROTL256(b, 12);                                                 \
+    a = _mm256_add_epi32(a, b);                                                \
+    d = _mm256_xor_si256(d, a);                                                \
+    d = _mm256_shuffle_epi8(d, rot8);                                          \
+    c = _mm256_add_epi32(c, d);                                                \
+    b = _mm256_xor_si256(b, c);                                                \
+    b = CHACHA_ROTL256(b, 7);
+
+__attribute__((target("avx2"))) inline void transpose8(__m256i* r)
+{
+    const __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+    const __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    const __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+    const __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    const __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+    const __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    const __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+    const __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+    const __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    const __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    const __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    const __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    const __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    const __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    const __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    const __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+__attribute__((target("avx2"))) void keystream_blocks_avx2(
+    const uint8_t* const* keys,
+    const uint64_t*       counters,
+    uint8_t* const*       outs)
+{
+    // byte shuffles implementing the 16 and 8 bits rotations
+    const __m256i rot16 = _mm256_set_epi64x(0x0d0c0f0e09080b0a,
+                                            0x0504070601000302,
+                                            0x0d0c0f0e09080b0a,
+                                            0x0504070601000302);
+    const __m256i rot8  = _mm256_set_epi64x(0x0e0d0c0f0a09080b,
+                                            0x0605040702010003,
+                                            0x0e0d0c0f0a09080b,
+                                            0x0605040702010003);
+
+    __m256i x[16];
+    __m256i s[16];
+
+    for (size_t i = 0; i < 4; i++) {
+        x[i] = _mm256_set1_epi32(static_cast<int>(kSigma[i]));
+    }
+    for (size_t l = 0; l < 8; l++) {
+        x[4 + l]
+            = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys[l]));
+    }
+    transpose8(x + 4);
+
+    x[12] = _mm256_set_epi32(lo_word(counters[7]),
+                             lo_word(counters[6]),
+                             lo_word(counters[5]),
+                             lo_word(counters[4]),
+                             lo_word(counters[3]),
+                             lo_word(counters[2]),
+                             lo_word(counters[1]),
+                             lo_word(counters[0]));
+    x[13] = _mm256_set_epi32(hi_word(counters[7]),
+                             hi_word(counters[6]),
+                             hi_word(counters[5]),
+                             hi_word(counters[4]),
+                             hi_word(counters[3]),
+                             hi_word(counters[2]),
+                             hi_word(counters[1]),
+                             hi_word(counters[0]));
+    x[14] = _mm256_setzero_si256();
+    x[15] = _mm256_setzero_si256();
+
+    memcpy(s, x, sizeof(x));
+
+    for (size_t round = 0; round < 10; round++) {
+        CHACHA_QR256(x[0], x[4], x[8], x[12])
+        CHACHA_QR256(x[1], x[5], x[9], x[13])
+        CHACHA_QR256(x[2], x[6], x[10], x[14])
+        CHACHA_QR256(x[3], x[7], x[11], x[15])
+        CHACHA_QR256(x[0], x[5], x[10], x[15])
+        CHACHA_QR256(x[1], x[6], x[11], x[12])
+        CHACHA_QR256(x[2], x[7], x[8], x[13])
+        CHACHA_QR256(x[3], x[4], x[9], x[14])
+    }
+
+    for (size_t i = 0; i < 16; i++) {
+        x[i] = _mm256_add_epi32(x[i], s[i]);
+    }
+
+    // after the transpositions, x[l] (resp. x[8+l]) contains the first (resp.
+    // last) 32 bytes of the block of lane l
+    transpose8(x);
+    transpose8(x + 8);
+    for (size_t l = 0; l < 8; l++) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(outs[l]), x[l]);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(outs[l] + 32),
+                            x[8 + l]);
+    }
+
+    sodium_memzero(x, sizeof(x));
+    sodium_memzero(s, sizeof(s));
+}
+
+#endif // CHACHA_MULTI_X86
+
+} // namespace
+
+void init_dispatch() noexcept
+{
+#ifdef CHACHA_MULTI_X86
+    use_avx2__ = (sodium_runtime_has_avx2() == 1);
+#endif
+}
+
+void keystream_blocks(const uint8_t* const* keys,
+                      const uint64_t*       counters,
+                      uint8_t* const*       outs,
+                      const size_t          n)
+{
+    size_t i = 0;
+
+#ifdef CHACHA_MULTI_X86
+    if (use_avx2__) {
+        for (; i + 8 <= n; i += 8) {
+            keystream_blocks_avx2(keys + i, counters + i, outs + i);
+        }
+    }
+    for (; i + 4 <= n; i += 4) {
+        keystream_blocks_sse2(keys + i, counters + i, outs + i);
+    }
+#endif
+
+    keystream_blocks_ref(keys + i, counters + i, outs + i, n - i);
+}
+
+} // namespace chacha
+} // namespace crypto
+} // namespace sse
@@ -0,0 +1,71 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sse {
+
+namespace crypto {
+
+namespace chacha {
+
+/// @brief Size (in bytes) of a ChaCha20 key
+constexpr size_t kKeySize = 32;
+/// @brief Size (in bytes) of a ChaCha20 block
+constexpr size_t kBlockSize = 64;
+/// @brief Maximum number of blocks computed in parallel by the kernels
+constexpr size_t kMaxLanes = 8;
+
+///
+/// @brief Computes ChaCha20 keystream blocks for independent keys
+///
+/// For each i < n, writes to outs[i] the 64 bytes keystream block of index
+/// counters[i] generated with the key keys[i] and an all-zero 8 bytes nonce
+/// (original ChaCha20, with a 64 bits block counter). The result is the same as
+/// libsodium's crypto_stream_chacha20_xor_ic applied to a zero block.
+///
+/// The blocks are computed kMaxLanes (AVX2) or 4 (SSE2) at a time, depending on
+/// the CPU features detected by init_dispatch(), and with libsodium otherwise.
+///
+/// @param keys         The n keys. Each key is kKeySize bytes long.
+/// @param counters     The n block indices.
+/// @param outs         The n output buffers. Each buffer must be kBlockSize
+///                     bytes wide.
+/// @param n            The number of blocks to generate.
+///
+void keystream_blocks(const uint8_t* const* keys,
+                      const uint64_t*       counters,
+                      uint8_t* const*       outs,
+                      const size_t          n);
+
+///
+/// @brief Selects the fastest kernel available on the CPU
+///
+/// Must be called after libsodium has been initialized (this is done by
+/// init_crypto_lib()). Before the first call, the portable kernel is used.
+///
+void init_dispatch() noexcept;
+
+} // namespace chacha
+} // namespace crypto
+} // namespace sse
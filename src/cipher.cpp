@@ -22,32 +22,94 @@
 
 #include "random.hpp"
 
+#include <cerrno>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
 #include <exception>
+#include <stdexcept>
+#include <string>
+#include <system_error>
 #include <vector>
 
+#include <fcntl.h>
 #include <sodium/crypto_aead_chacha20poly1305.h>
+#include <sodium/crypto_aead_xchacha20poly1305.h>
 #include <sodium/crypto_generichash_blake2b.h>
 #include <sodium/utils.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace sse {
 
 namespace crypto {
 
 #define NONCE_SIZE crypto_generichash_blake2b_SALTBYTES
+#define XNONCE_SIZE crypto_aead_xchacha20poly1305_ietf_NPUBBYTES
+#define XHEADER_SIZE 1
+#define STREAM_SALT_SIZE 16
+#define STREAM_SALT_OFFSET 5
 
 static constexpr uint8_t
     hash_personal__[crypto_generichash_blake2b_PERSONALBYTES]
     = "encryption_key";
 
+static constexpr uint8_t
+    stream_personal__[crypto_generichash_blake2b_PERSONALBYTES]
+    = "stream_key";
+
+static constexpr uint8_t kStreamVersion = 0x01;
+
 static_assert(crypto_generichash_blake2b_KEYBYTES == Cipher::kKeySize,
               "Invalid Cipher key size");
+static_assert(crypto_aead_xchacha20poly1305_ietf_KEYBYTES
+                  == XChaCha20Cipher::kKeySize,
+              "Invalid XChaCha20Cipher key size");
 
 static_assert(NONCE_SIZE + crypto_aead_chacha20poly1305_IETF_ABYTES
                   == Cipher::kCiphertextExpansion,
               "Invalid Cipher expansion constant");
+static_assert(XHEADER_SIZE + XNONCE_SIZE
+                      + crypto_aead_xchacha20poly1305_ietf_ABYTES
+                  == XChaCha20Cipher::kCiphertextExpansion,
+              "Invalid XChaCha20Cipher expansion constant");
+
+static_assert(STREAM_SALT_OFFSET + STREAM_SALT_SIZE
+                  == Cipher::kStreamHeaderSize,
+              "Invalid stream header size");
+static_assert(crypto_aead_chacha20poly1305_IETF_ABYTES
+                  == Cipher::kChunkExpansion,
+              "Invalid chunk expansion constant");
+static_assert(Cipher::kMaxChunkSize <= UINT32_MAX,
+              "The chunk size does not fit in the stream header");
 
+// Position of the random nonce in the ciphertexts
+template<class Policy>
+struct nonce_layout;
 
-Cipher::Cipher(Key<kKeySize>&& k) : key_(std::move(k))
+template<>
+struct nonce_layout<DerivedKeyCipherPolicy>
+{
+    static constexpr size_t kOffset = 0;
+    static constexpr size_t kSize   = NONCE_SIZE;
+};
+
+template<>
+struct nonce_layout<XChaCha20CipherPolicy>
+{
+    static constexpr size_t kOffset = XHEADER_SIZE;
+    static constexpr size_t kSize   = XNONCE_SIZE;
+};
+
+// Number of messages processed by a task of encrypt_many and decrypt_many. The
+// nonces of a task are drawn at once.
+static constexpr size_t kBatchSize = 256;
+
+
+template<class Policy>
+BasicCipher<Policy>::BasicCipher(Key<kKeySize>&& k) : key_(std::move(k))
 {
 }
 
@@ -57,32 +119,28 @@ Cipher::Cipher(Key<kKeySize>&& k) : key_(std::move(k))
 // 2^(8*kIVSize) different IVs)
 
 
-void Cipher::encrypt(const unsigned char* in,
-                     const size_t&        len,
-                     unsigned char*       out) const
+// Nonce-derived key construction: the output is nonce || ciphertext || tag.
+// The random nonce must already be in place in out, and the master key must be
+// unlocked.
+static void encrypt_with_key(DerivedKeyCipherPolicy /*unused*/,
+                             const uint8_t*       key,
+                             const unsigned char* in,
+                             const size_t         len,
+                             unsigned char*       out) noexcept
 {
     uint8_t            chacha_key[crypto_aead_chacha20poly1305_KEYBYTES];
     unsigned long long c_len = 0; // NOLINT
 
-    // generate a random nonce, and place it at the beginning of the output
-    random_bytes(NONCE_SIZE, out);
-
-    // unlock the master key
-    key_.unlock();
-
     // start by deriving a subkey from the master and the nonce
     crypto_generichash_blake2b_salt_personal(chacha_key,
                                              sizeof(chacha_key),
                                              nullptr,
                                              0,
-                                             key_.data(),
-                                             kKeySize,
+                                             key,
+                                             Cipher::kKeySize,
                                              out,
                                              hash_personal__);
 
-    // re-lock the master key
-    key_.lock();
-
     // go for encryption with the derived key
     crypto_aead_chacha20poly1305_ietf_encrypt(out + NONCE_SIZE,
                                               &c_len,
@@ -98,56 +156,27 @@ void Cipher::encrypt(const unsigned char* in,
     sodium_memzero(chacha_key, crypto_aead_chacha20poly1305_KEYBYTES);
 }
 
-void Cipher::encrypt(const std::string& in, std::string& out)
-{
-    if (in.empty()) {
-        throw std::invalid_argument(
-            "The minimum number of bytes to encrypt is 1.");
-    }
-
-    size_t         len   = in.size();
-    size_t         c_len = ciphertext_length(len);
-    unsigned char* data  = new unsigned char[c_len];
-
-    encrypt(reinterpret_cast<const unsigned char*>(in.data()), len, data);
-    out = std::string(reinterpret_cast<char*>(data), c_len);
-
-    // erase the buffer
-    sodium_memzero(data, c_len);
-
-    delete[] data;
-}
-
-void Cipher::decrypt(const unsigned char* in,
-                     const size_t&        len,
-                     unsigned char*       out) const
+// Returns false if the tag is invalid. len must be at least
+// Cipher::kCiphertextExpansion
+static bool decrypt_with_key(DerivedKeyCipherPolicy /*unused*/,
+                             const uint8_t*       key,
+                             const unsigned char* in,
+                             const size_t         len,
+                             unsigned char*       out) noexcept
 {
-    if (len < ciphertext_length(0)) {
-        /* LCOV_EXCL_START */
-        throw std::invalid_argument("The minimum number of bytes to decrypt is "
-                                    + std::to_string(ciphertext_length(0)));
-        /* LCOV_EXCL_STOP */
-    }
-
     uint8_t            chacha_key[crypto_aead_chacha20poly1305_KEYBYTES];
     unsigned long long m_len = 0; // NOLINT
 
-    // unlock the master key
-    key_.unlock();
-
     // start by deriving a subkey from the master and the nonce
     crypto_generichash_blake2b_salt_personal(chacha_key,
                                              sizeof(chacha_key),
                                              nullptr,
                                              0,
-                                             key_.data(),
-                                             kKeySize,
+                                             key,
+                                             Cipher::kKeySize,
                                              in,
                                              hash_personal__);
 
-    // re-lock the master key
-    key_.lock();
-
     // go for decryption with the derived key
     int ret = crypto_aead_chacha20poly1305_ietf_decrypt(out,
                                                         &m_len,
@@ -165,40 +194,854 @@ void Cipher::decrypt(const unsigned char* in,
     if (ret == -1) { // invalid decryption
         // erase the decrypted plaintext
         sodium_memzero(out, m_len);
+        return false;
+    }
+    return true;
+}
+
+// XChaCha20+Poly1305 construction: the output is
+// version || nonce || ciphertext || tag, and the version is authenticated.
+// The random nonce must already be in place in out, and the master key must be
+// unlocked.
+static void encrypt_with_key(XChaCha20CipherPolicy /*unused*/,
+                             const uint8_t*       key,
+                             const unsigned char* in,
+                             const size_t         len,
+                             unsigned char*       out) noexcept
+{
+    unsigned long long c_len = 0; // NOLINT
+
+    out[0] = kXChaCha20CipherVersion;
+
+    crypto_aead_xchacha20poly1305_ietf_encrypt(out + XHEADER_SIZE + XNONCE_SIZE,
+                                               &c_len,
+                                               in,
+                                               len,
+                                               out,
+                                               XHEADER_SIZE,
+                                               nullptr,
+                                               out + XHEADER_SIZE,
+                                               key);
+}
+
+// Returns false if the header or the tag is invalid. len must be at least
+// XChaCha20Cipher::kCiphertextExpansion
+static bool decrypt_with_key(XChaCha20CipherPolicy /*unused*/,
+                             const uint8_t*       key,
+                             const unsigned char* in,
+                             const size_t         len,
+                             unsigned char*       out) noexcept
+{
+    if (in[0] != kXChaCha20CipherVersion) {
+        return false;
+    }
+
+    unsigned long long m_len = 0; // NOLINT
+
+    int ret = crypto_aead_xchacha20poly1305_ietf_decrypt(
+        out,
+        &m_len,
+        nullptr,
+        in + XHEADER_SIZE + XNONCE_SIZE,
+        len - XHEADER_SIZE - XNONCE_SIZE,
+        in,
+        XHEADER_SIZE,
+        in + XHEADER_SIZE,
+        key);
+
+    if (ret == -1) { // invalid decryption
+        // erase the decrypted plaintext
+        sodium_memzero(out, m_len);
+        return false;
+    }
+    return true;
+}
+
+template<class Policy>
+void BasicCipher<Policy>::encrypt(const unsigned char* in,
+                                  const size_t&        len,
+                                  unsigned char*       out) const
+{
+    using layout = nonce_layout<Policy>;
+
+    // generate a random nonce, and place it in the output
+    random_bytes(layout::kSize, out + layout::kOffset);
+
+    // the master key stays unlocked for the scope of the session
+    UnlockSession session = key_.unlock_session();
+
+    encrypt_with_key(Policy(), key_.data(), in, len, out);
+}
+
+template<class Policy>
+void BasicCipher<Policy>::encrypt(const std::string& in,
+                                  std::string&       out) const
+{
+    if (in.empty()) {
+        throw std::invalid_argument(
+            "The minimum number of bytes to encrypt is 1.");
+    }
+
+    if (&in == &out) {
+        // the input would be overwritten
+        const std::string in_copy(in);
+        encrypt(in_copy, out);
+        return;
+    }
 
+    // encrypt in place, in the output string
+    out.resize(ciphertext_length(in.size()));
+    encrypt(reinterpret_cast<const unsigned char*>(in.data()),
+            in.size(),
+            reinterpret_cast<unsigned char*>(&out[0]));
+}
+
+template<class Policy>
+void BasicCipher<Policy>::decrypt(const unsigned char* in,
+                                  const size_t&        len,
+                                  unsigned char*       out) const
+{
+    if (len < ciphertext_length(0)) {
+        /* LCOV_EXCL_START */
+        throw std::invalid_argument("The minimum number of bytes to decrypt is "
+                                    + std::to_string(ciphertext_length(0)));
+        /* LCOV_EXCL_STOP */
+    }
+
+    bool success;
+    {
+        // the master key stays unlocked for the scope of the session
+        UnlockSession session = key_.unlock_session();
+
+        success = decrypt_with_key(Policy(), key_.data(), in, len, out);
+    }
+
+    if (!success) {
         throw std::runtime_error("Failed decryption. Invalid ciphertext");
     }
 }
 
-void Cipher::decrypt(const std::string& in, std::string& out)
+template<class Policy>
+void BasicCipher<Policy>::decrypt(const std::string& in,
+                                  std::string&       out) const
 {
     size_t len = in.size();
 
-    if (len <= NONCE_SIZE + crypto_aead_chacha20poly1305_IETF_ABYTES) {
+    if (len <= Cipher::kCiphertextExpansion) {
         throw std::invalid_argument("The minimum number of bytes to decrypt is "
                                     "1. The minimum length for a "
                                     "decryption input is kIVSize+1");
     }
 
-    size_t p_len = plaintext_length(len);
+    if (&in == &out) {
+        // the input would be overwritten
+        const std::string in_copy(in);
+        decrypt(in_copy, out);
+        return;
+    }
+
+    const auto* in_bytes = reinterpret_cast<const unsigned char*>(in.data());
+
+    // decrypt in place, in the output string, large enough for the plaintexts
+    // of both policies
+    out.resize(Cipher::plaintext_length(len));
+    auto*  out_bytes = reinterpret_cast<unsigned char*>(&out[0]);
+    size_t p_len     = 0;
+    bool   success   = false;
+
+    {
+        // the master key stays unlocked for the scope of the session
+        UnlockSession session = key_.unlock_session();
+
+        if (len > kCiphertextExpansion) {
+            success = decrypt_with_key(
+                Policy(), key_.data(), in_bytes, len, out_bytes);
+            p_len = plaintext_length(len);
+        }
+        if (!success && kIsXChaCha20) {
+            // ciphertext without version header: DerivedKeyCipherPolicy
+            success = decrypt_with_key(DerivedKeyCipherPolicy(),
+                                       key_.data(),
+                                       in_bytes,
+                                       len,
+                                       out_bytes);
+            p_len = Cipher::plaintext_length(len);
+        }
+    }
+
+    if (!success) {
+        out.clear();
+        throw std::runtime_error("Failed decryption. Invalid ciphertext");
+    }
+    out.resize(p_len);
+}
+
+template<class Policy>
+void BasicCipher<Policy>::encrypt_many(const uint8_t* const* ins,
+                                       const size_t*         lens,
+                                       const size_t          count,
+                                       uint8_t*              out) const
+{
+    encrypt_many(ins, lens, count, out, serial_executor());
+}
+
+template<class Policy>
+void BasicCipher<Policy>::encrypt_many(const uint8_t* const* ins,
+                                       const size_t*         lens,
+                                       const size_t          count,
+                                       uint8_t*              out,
+                                       const Executor&       executor) const
+{
+    if (count == 0) {
+        return;
+    }
+    if (ins == nullptr || lens == nullptr || out == nullptr) {
+        throw std::invalid_argument("ins, lens or out is NULL");
+    }
+
+    const size_t n_tasks = (count + kBatchSize - 1) / kBatchSize;
+
+    // offsets of the first ciphertext of every task in the output arena
+    std::vector<size_t> task_offsets(n_tasks);
+    size_t              offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (ins[i] == nullptr) {
+            throw std::invalid_argument("ins[i] is NULL");
+        }
+        if (lens[i] == 0) {
+            throw std::invalid_argument(
+                "The minimum number of bytes to encrypt is 1.");
+        }
+        if (i % kBatchSize == 0) {
+            task_offsets[i / kBatchSize] = offset;
+        }
+        offset += ciphertext_length(lens[i]);
+    }
+
+    using layout = nonce_layout<Policy>;
+
+    UnlockSession  session = key_.unlock_session();
+    const uint8_t* key     = key_.data();
+
+    executor(n_tasks, [ins, lens, count, out, key, &task_offsets](size_t t) {
+        const size_t begin = t * kBatchSize;
+        const size_t end   = std::min(begin + kBatchSize, count);
+
+        // draw the nonces of the whole block at once
+        uint8_t nonces[kBatchSize * layout::kSize];
+        random_bytes((end - begin) * layout::kSize, nonces);
+
+        uint8_t* c = out + task_offsets[t];
+        for (size_t i = begin; i < end; i++) {
+            memcpy(c + layout::kOffset,
+                   nonces + (i - begin) * layout::kSize,
+                   layout::kSize);
+            encrypt_with_key(Policy(), key, ins[i], lens[i], c);
+            c += ciphertext_length(lens[i]);
+        }
+    });
+}
+
+template<class Policy>
+size_t BasicCipher<Policy>::decrypt_many(const uint8_t* const* ins,
+                                         const size_t*         lens,
+                                         const size_t          count,
+                                         uint8_t*              out,
+                                         bool*                 valid) const
+{
+    return decrypt_many(ins, lens, count, out, valid, serial_executor());
+}
+
+template<class Policy>
+size_t BasicCipher<Policy>::decrypt_many(const uint8_t* const* ins,
+                                         const size_t*         lens,
+                                         const size_t          count,
+                                         uint8_t*              out,
+                                         bool*                 valid,
+                                         const Executor&       executor) const
+{
+    if (count == 0) {
+        return 0;
+    }
+    if (ins == nullptr || lens == nullptr || out == nullptr
+        || valid == nullptr) {
+        throw std::invalid_argument("ins, lens, out or valid is NULL");
+    }
+
+    const size_t n_tasks = (count + kBatchSize - 1) / kBatchSize;
+
+    // offsets of the first plaintext of every task in the output arena
+    std::vector<size_t> task_offsets(n_tasks);
+    size_t              offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (ins[i] == nullptr) {
+            throw std::invalid_argument("ins[i] is NULL");
+        }
+        if (i % kBatchSize == 0) {
+            task_offsets[i / kBatchSize] = offset;
+        }
+        offset += plaintext_length(lens[i]);
+    }
+
+    std::atomic<size_t> n_failures(0);
+
+    UnlockSession  session = key_.unlock_session();
+    const uint8_t* key     = key_.data();
+
+    executor(n_tasks,
+             [ins, lens, count, out, valid, key, &task_offsets, &n_failures](
+                 size_t t) {
+                 const size_t begin = t * kBatchSize;
+                 const size_t end   = std::min(begin + kBatchSize, count);
+
+                 size_t   task_failures = 0;
+                 uint8_t* m             = out + task_offsets[t];
+                 for (size_t i = begin; i < end; i++) {
+                     valid[i] = (lens[i] > kCiphertextExpansion)
+                                && decrypt_with_key(
+                                    Policy(), key, ins[i], lens[i], m);
+                     if (!valid[i]) {
+                         // some failures (e.g. a wrong version byte) are
+                         // detected before the slot is written: it could
+                         // still hold a previous plaintext
+                         sodium_memzero(m, plaintext_length(lens[i]));
+                         task_failures++;
+                     }
+                     m += plaintext_length(lens[i]);
+                 }
+                 n_failures += task_failures;
+             });
+
+    return n_failures.load();
+}
+
+// Derives the key of a stream from the master key and the stream's salt. The
+// master key must be unlocked.
+static void derive_stream_key(const uint8_t* master_key,
+                              const uint8_t* header,
+                              uint8_t*       stream_key) noexcept
+{
+    crypto_generichash_blake2b_salt_personal(stream_key,
+                                             Cipher::kKeySize,
+                                             nullptr,
+                                             0,
+                                             master_key,
+                                             Cipher::kKeySize,
+                                             header + STREAM_SALT_OFFSET,
+                                             stream_personal__);
+}
+
+// Nonce of a chunk: the index of the chunk (little endian), followed by the
+// last chunk flag
+static void stream_chunk_nonce(const uint64_t index,
+                               const bool     last,
+                               unsigned char* nonce) noexcept
+{
+    for (size_t i = 0; i < 8; i++) {
+        nonce[i] = static_cast<unsigned char>((index >> (8 * i)) & 0xFF);
+    }
+    nonce[8]  = last ? 0x01 : 0x00;
+    nonce[9]  = 0x00;
+    nonce[10] = 0x00;
+    nonce[11] = 0x00;
+}
+
+// Encryption of a chunk with the stream key. The header is authenticated.
+static void stream_encrypt_chunk(const uint8_t*       stream_key,
+                                 const uint8_t*       header,
+                                 const uint64_t       index,
+                                 const bool           last,
+                                 const unsigned char* in,
+                                 const size_t         len,
+                                 unsigned char*       out) noexcept
+{
+    unsigned char nonce[crypto_aead_chacha20poly1305_IETF_NPUBBYTES];
+    stream_chunk_nonce(index, last, nonce);
+
+    crypto_aead_chacha20poly1305_ietf_encrypt(out,
+                                              nullptr,
+                                              in,
+                                              len,
+                                              header,
+                                              Cipher::kStreamHeaderSize,
+                                              nullptr,
+                                              nonce,
+                                              stream_key);
+}
+
+// Decryption of a chunk with the stream key. The output is zeroed on failure.
+static bool stream_decrypt_chunk(const uint8_t*       stream_key,
+                                 const uint8_t*       header,
+                                 const uint64_t       index,
+                                 const bool           last,
+                                 const unsigned char* in,
+                                 const size_t         len,
+                                 unsigned char*       out) noexcept
+{
+    unsigned char nonce[crypto_aead_chacha20poly1305_IETF_NPUBBYTES];
+    stream_chunk_nonce(index, last, nonce);
+
+    int ret = crypto_aead_chacha20poly1305_ietf_decrypt(
+        out,
+        nullptr,
+        nullptr,
+        in,
+        len,
+        header,
+        Cipher::kStreamHeaderSize,
+        nonce,
+        stream_key);
+
+    if (ret != 0) {
+        sodium_memzero(out, len - Cipher::kChunkExpansion);
+        return false;
+    }
+    return true;
+}
+
+// File descriptor closed when going out of scope
+class ScopedFd
+{
+public:
+    ScopedFd(const std::string& path, const int flags, const mode_t mode = 0)
+        : fd_(open(path.c_str(), flags, mode))
+    {
+        if (fd_ == -1) {
+            throw std::system_error(
+                errno, std::generic_category(), "Unable to open " + path);
+        }
+    }
+
+    ~ScopedFd()
+    {
+        close(fd_);
+    }
+
+    ScopedFd(const ScopedFd&) = delete;
+    ScopedFd& operator=(const ScopedFd&) = delete;
+
+    int get() const noexcept
+    {
+        return fd_;
+    }
+
+    size_t size(const std::string& path) const
+    {
+        struct stat st;
+        if (fstat(fd_, &st) == -1) {
+            /* LCOV_EXCL_START */
+            throw std::system_error(
+                errno, std::generic_category(), "Unable to stat " + path);
+            /* LCOV_EXCL_STOP */
+        }
+        return static_cast<size_t>(st.st_size);
+    }
+
+private:
+    int fd_;
+};
+
+// Reads exactly len bytes at the given offset
+static void pread_all(const ScopedFd&    fd,
+                      uint8_t*           buf,
+                      size_t             len,
+                      off_t              offset,
+                      const std::string& path)
+{
+    while (len > 0) {
+        ssize_t n = pread(fd.get(), buf, len, offset);
+        if (n == -1 && errno == EINTR) {
+            continue; // LCOV_EXCL_LINE
+        }
+        if (n <= 0) {
+            /* LCOV_EXCL_START */
+            throw std::system_error((n == 0) ? EIO : errno,
+                                    std::generic_category(),
+                                    "Unable to read " + path);
+            /* LCOV_EXCL_STOP */
+        }
+        buf += n;
+        len -= static_cast<size_t>(n);
+        offset += n;
+    }
+}
+
+// Writes the len bytes of buf
+static void write_all(const ScopedFd&    fd,
+                      const uint8_t*     buf,
+                      size_t             len,
+                      const std::string& path)
+{
+    while (len > 0) {
+        ssize_t n = write(fd.get(), buf, len);
+        if (n == -1 && errno == EINTR) {
+            continue; // LCOV_EXCL_LINE
+        }
+        if (n <= 0) {
+            /* LCOV_EXCL_START */
+            throw std::system_error((n == 0) ? EIO : errno,
+                                    std::generic_category(),
+                                    "Unable to write " + path);
+            /* LCOV_EXCL_STOP */
+        }
+        buf += n;
+        len -= static_cast<size_t>(n);
+    }
+}
+
+template<class Policy>
+BasicCipher<Policy>::StreamEncryptor::StreamEncryptor(
+    Key<kKeySize>&&                               key,
+    const std::array<uint8_t, kStreamHeaderSize>& header,
+    const size_t                                  chunk_size) noexcept
+    : key_(std::move(key)), header_(header), chunk_size_(chunk_size)
+{
+}
+
+template<class Policy>
+void BasicCipher<Policy>::StreamEncryptor::push(const uint8_t* in,
+                                                const size_t   len,
+                                                const bool     last,
+                                                uint8_t*       out)
+{
+    if (finalized_) {
+        throw std::runtime_error(
+            "StreamEncryptor: the last chunk has already been pushed");
+    }
+    if (in == nullptr && len != 0) {
+        throw std::invalid_argument("in is NULL");
+    }
+    if (out == nullptr) {
+        throw std::invalid_argument("out is NULL");
+    }
+    if (last ? (len > chunk_size_) : (len != chunk_size_)) {
+        throw std::invalid_argument(
+            "Invalid chunk length: only the last chunk can be partial");
+    }
+
+    {
+        UnlockSession session = key_.unlock_session();
+        stream_encrypt_chunk(
+            key_.data(), header_.data(), index_, last, in, len, out);
+    }
+
+    index_++;
+    finalized_ = last;
+}
+
+template<class Policy>
+BasicCipher<Policy>::StreamDecryptor::StreamDecryptor(
+    Key<kKeySize>&&                               key,
+    const std::array<uint8_t, kStreamHeaderSize>& header,
+    const size_t                                  chunk_size) noexcept
+    : key_(std::move(key)), header_(header), chunk_size_(chunk_size)
+{
+}
+
+template<class Policy>
+bool BasicCipher<Policy>::StreamDecryptor::pull(const uint8_t* in,
+                                                const size_t   len,
+                                                uint8_t*       out)
+{
+    if (finalized_) {
+        throw std::runtime_error(
+            "StreamDecryptor: the last chunk has already been pulled");
+    }
+    if (in == nullptr) {
+        throw std::invalid_argument("in is NULL");
+    }
+    if (out == nullptr && len != kChunkExpansion) {
+        throw std::invalid_argument("out is NULL");
+    }
+    if (len < kChunkExpansion || len > chunk_size_ + kChunkExpansion) {
+        throw std::invalid_argument("Invalid encrypted chunk length");
+    }
+
+    // only the last chunk can be partial, but it can also be full
+    bool last = (len < chunk_size_ + kChunkExpansion);
+
+    bool success;
+    {
+        UnlockSession session = key_.unlock_session();
+        success               = stream_decrypt_chunk(
+            key_.data(), header_.data(), index_, last, in, len, out);
+        if (!success && !last) {
+            last    = true;
+            success = stream_decrypt_chunk(
+                key_.data(), header_.data(), index_, last, in, len, out);
+        }
+    }
+
+    if (!success) {
+        throw std::runtime_error("Failed decryption. Invalid chunk");
+    }
+
+    index_++;
+    finalized_ = last;
+    return last;
+}
+
+template<class Policy>
+uint64_t BasicCipher<Policy>::StreamDecryptor::chunk_count(
+    const size_t stream_len) const
+{
+    if (stream_len < kStreamHeaderSize + kChunkExpansion) {
+        throw std::invalid_argument("Invalid stream length");
+    }
+
+    const size_t   body_len    = stream_len - kStreamHeaderSize;
+    const size_t   encrypted   = chunk_size_ + kChunkExpansion;
+    const uint64_t n_chunks    = (body_len + encrypted - 1) / encrypted;
+    const size_t   last_length = body_len - (n_chunks - 1) * encrypted;
+
+    if (last_length < kChunkExpansion) {
+        throw std::invalid_argument("Invalid stream length");
+    }
+    return n_chunks;
+}
+
+template<class Policy>
+void BasicCipher<Policy>::StreamDecryptor::decrypt_chunk(const uint64_t index,
+                                                         const uint8_t* in,
+                                                         const size_t   len,
+                                                         const bool     last,
+                                                         uint8_t* out) const
+{
+    if (in == nullptr) {
+        throw std::invalid_argument("in is NULL");
+    }
+    if (out == nullptr && len != kChunkExpansion) {
+        throw std::invalid_argument("out is NULL");
+    }
+    if (last ? (len < kChunkExpansion || len > chunk_size_ + kChunkExpansion)
+             : (len != chunk_size_ + kChunkExpansion)) {
+        throw std::invalid_argument("Invalid encrypted chunk length");
+    }
+
+    bool success;
+    {
+        UnlockSession session = key_.unlock_session();
+        success               = stream_decrypt_chunk(
+            key_.data(), header_.data(), index, last, in, len, out);
+    }
+
+    if (!success) {
+        throw std::runtime_error("Failed decryption. Invalid chunk");
+    }
+}
+
+template<class Policy>
+typename BasicCipher<Policy>::StreamEncryptor BasicCipher<
+    Policy>::stream_encryptor(const size_t chunk_size) const
+{
+    if (chunk_size == 0 || chunk_size > kMaxChunkSize) {
+        throw std::invalid_argument(
+            "Invalid chunk size: it must be between 1 and kMaxChunkSize");
+    }
+
+    std::array<uint8_t, kStreamHeaderSize> header;
+    header[0] = kStreamVersion;
+    for (size_t i = 0; i < 4; i++) {
+        header[1 + i] = static_cast<uint8_t>((chunk_size >> (8 * i)) & 0xFF);
+    }
+    random_bytes(STREAM_SALT_SIZE, header.data() + STREAM_SALT_OFFSET);
+
+    uint8_t stream_key[kKeySize];
+
+    {
+        UnlockSession session = key_.unlock_session();
+        derive_stream_key(key_.data(), header.data(), stream_key);
+    }
+
+    // the Key constructor erases stream_key
+    return StreamEncryptor(Key<kKeySize>(stream_key), header, chunk_size);
+}
+
+template<class Policy>
+typename BasicCipher<Policy>::StreamDecryptor BasicCipher<
+    Policy>::stream_decryptor(const uint8_t* header) const
+{
+    if (header == nullptr) {
+        throw std::invalid_argument("header is NULL");
+    }
+    if (header[0] != kStreamVersion) {
+        throw std::invalid_argument("Invalid stream header: unknown version");
+    }
+
+    size_t chunk_size = 0;
+    for (size_t i = 0; i < 4; i++) {
+        chunk_size |= static_cast<size_t>(header[1 + i]) << (8 * i);
+    }
+    if (chunk_size == 0 || chunk_size > kMaxChunkSize) {
+        throw std::invalid_argument("Invalid stream header: chunk size");
+    }
+
+    std::array<uint8_t, kStreamHeaderSize> header_copy;
+    std::copy(header, header + kStreamHeaderSize, header_copy.begin());
+
+    uint8_t stream_key[kKeySize];
+
+    {
+        UnlockSession session = key_.unlock_session();
+        derive_stream_key(key_.data(), header, stream_key);
+    }
+
+    // the Key constructor erases stream_key
+    return StreamDecryptor(
+        Key<kKeySize>(stream_key), header_copy, chunk_size);
+}
+
+template<class Policy>
+void BasicCipher<Policy>::encrypt_file(const std::string& in_path,
+                                       const std::string& out_path,
+                                       const size_t       chunk_size) const
+{
+    StreamEncryptor encryptor = stream_encryptor(chunk_size);
+
+    ScopedFd     in_fd(in_path, O_RDONLY);
+    const size_t len = in_fd.size(in_path);
+    ScopedFd out_fd(out_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+
+    std::vector<uint8_t> chunk(chunk_size);
+    std::vector<uint8_t> encrypted_chunk(chunk_size + kChunkExpansion);
+
+    write_all(out_fd, encryptor.header().data(), kStreamHeaderSize, out_path);
+
+    // the last chunk is never empty, unless the file is
+    size_t offset = 0;
+    do {
+        const size_t chunk_len = std::min(len - offset, chunk_size);
+        const bool   last      = (offset + chunk_len == len);
+
+        pread_all(in_fd, chunk.data(), chunk_len, offset, in_path);
+        encryptor.push(chunk.data(), chunk_len, last, encrypted_chunk.data());
+        write_all(out_fd,
+                  encrypted_chunk.data(),
+                  chunk_len + kChunkExpansion,
+                  out_path);
+        offset += chunk_len;
+    } while (offset < len);
+
+    sodium_memzero(chunk.data(), chunk.size());
+}
+
+template<class Policy>
+void BasicCipher<Policy>::decrypt_file(const std::string& in_path,
+                                       const std::string& out_path) const
+{
+    ScopedFd     in_fd(in_path, O_RDONLY);
+    const size_t len = in_fd.size(in_path);
+
+    if (len < kStreamHeaderSize + kChunkExpansion) {
+        throw std::invalid_argument("Invalid stream: " + in_path
+                                    + " is too short");
+    }
+
+    void* map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, in_fd.get(), 0);
+    if (map == MAP_FAILED) {
+        /* LCOV_EXCL_START */
+        throw std::system_error(
+            errno, std::generic_category(), "Unable to map " + in_path);
+        /* LCOV_EXCL_STOP */
+    }
+    // the file is read once, linearly
+    madvise(map, len, MADV_SEQUENTIAL);
+
+    const auto*          stream = static_cast<const uint8_t*>(map);
+    std::vector<uint8_t> chunk;
+
+    try {
+        StreamDecryptor decryptor = stream_decryptor(stream);
+        const uint64_t  n_chunks  = decryptor.chunk_count(len);
+
+        chunk.resize(decryptor.chunk_size());
+
+        ScopedFd out_fd(
+            out_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+
+        try {
+            for (uint64_t i = 0; i < n_chunks; i++) {
+                const bool   last   = (i + 1 == n_chunks);
+                const size_t offset = decryptor.chunk_offset(i);
+                const size_t c_len
+                    = last ? len - offset
+                           : decryptor.chunk_size() + kChunkExpansion;
+
+                decryptor.decrypt_chunk(
+                    i, stream + offset, c_len, last, chunk.data());
+                write_all(
+                    out_fd, chunk.data(), c_len - kChunkExpansion, out_path);
+            }
+        } catch (...) {
+            // do not leave a partially decrypted file behind
+            unlink(out_path.c_str());
+            throw;
+        }
+    } catch (...) {
+        sodium_memzero(chunk.data(), chunk.size());
+        munmap(map, len);
+        throw;
+    }
+    sodium_memzero(chunk.data(), chunk.size());
+    munmap(map, len);
+}
+
+template<class Policy>
+void BasicCipher<Policy>::decrypt_file_chunk(const std::string& path,
+                                             const uint64_t     index,
+                                             std::string&       out) const
+{
+    ScopedFd     fd(path, O_RDONLY);
+    const size_t len = fd.size(path);
 
-    std::vector<uint8_t> data(p_len);
-    decrypt(
-        reinterpret_cast<const unsigned char*>(in.data()), len, data.data());
+    if (len < kStreamHeaderSize + kChunkExpansion) {
+        throw std::invalid_argument("Invalid stream: " + path
+                                    + " is too short");
+    }
 
-    out = std::string(reinterpret_cast<const char*>(data.data()), p_len);
+    uint8_t header[kStreamHeaderSize];
+    pread_all(fd, header, kStreamHeaderSize, 0, path);
+
+    StreamDecryptor decryptor = stream_decryptor(header);
+    const uint64_t  n_chunks  = decryptor.chunk_count(len);
+
+    if (index >= n_chunks) {
+        throw std::out_of_range("Invalid chunk index: the stream has "
+                                + std::to_string(n_chunks) + " chunks");
+    }
+
+    const bool   last   = (index + 1 == n_chunks);
+    const size_t offset = decryptor.chunk_offset(index);
+    const size_t c_len
+        = last ? len - offset : decryptor.chunk_size() + kChunkExpansion;
+
+    std::vector<uint8_t> encrypted_chunk(c_len);
+    pread_all(fd, encrypted_chunk.data(), c_len, offset, path);
+
+    out.resize(c_len - kChunkExpansion);
+    try {
+        decryptor.decrypt_chunk(index,
+                                encrypted_chunk.data(),
+                                c_len,
+                                last,
+                                reinterpret_cast<uint8_t*>(&out[0]));
+    } catch (...) {
+        out.clear();
+        throw;
+    }
 }
 
-void Cipher::serialize(uint8_t* out) const
+template<class Policy>
+void BasicCipher<Policy>::serialize(uint8_t* out) const
 {
-    key_.unlock();
+    UnlockSession session = key_.unlock_session();
     key_.serialize(out);
-    key_.lock();
 }
 
-Cipher Cipher::deserialize(uint8_t*     in,
-                           const size_t in_size,
-                           size_t&      n_bytes_read)
+template<class Policy>
+BasicCipher<Policy> BasicCipher<Policy>::deserialize(uint8_t*     in,
+                                                     const size_t in_size,
+                                                     size_t&      n_bytes_read)
 {
     if (in_size < kKeySize) {
         /* LCOV_EXCL_START */
@@ -207,8 +1050,11 @@ Cipher Cipher::deserialize(uint8_t*     in,
         /* LCOV_EXCL_STOP */
     }
     n_bytes_read += kKeySize;
-    return Cipher(Key<kKeySize>(in));
+    return BasicCipher(Key<kKeySize>(in));
 }
 
+template class BasicCipher<DerivedKeyCipherPolicy>;
+template class BasicCipher<XChaCha20CipherPolicy>;
+
 } // namespace crypto
 } // namespace sse
@@ -21,19 +21,59 @@
 #include "hash.hpp"
 
 #include "hash/blake2b.hpp"
+#include "hash/blake3.hpp"
 #include "hash/sha512.hpp"
 
+#include <cerrno>
 #include <cstring>
 
 #include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sodium/utils.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace sse {
 
 namespace crypto {
 
-using hash_function = hash::blake2b;
+// Maps the backend tags to the hash function implementations
+template<class Backend>
+struct backend_function;
+
+template<>
+struct backend_function<Blake2bBackend>
+{
+    using type = hash::blake2b;
+};
+
+template<>
+struct backend_function<Sha512Backend>
+{
+    using type = hash::sha512;
+};
+
+template<>
+struct backend_function<Blake3Backend>
+{
+    using type = hash::blake3;
+};
+
+template<class Backend>
+using hash_function = typename backend_function<Backend>::type;
+
+// The tree mode needs the tree parameters of BLAKE2b's parameter block: it
+// always uses BLAKE2b
+using tree_hash_function = hash::blake2b;
 
-void Hash::hash(const unsigned char* in, const size_t len, unsigned char* out)
+template<class Backend>
+void BasicHash<Backend>::hash(const unsigned char* in,
+                              const size_t         len,
+                              unsigned char*       out)
 {
     if (in == nullptr) {
         throw std::invalid_argument("in is NULL");
@@ -44,18 +84,19 @@ void Hash::hash(const unsigned char* in, const size_t len, unsigned char* out)
     }
 
     static_assert(
-        kDigestSize == hash_function::kDigestSize,
+        kDigestSize == hash_function<Backend>::kDigestSize,
         "Declared digest size and hash_function digest size do not match");
     static_assert(
-        kBlockSize == hash_function::kBlockSize,
+        kBlockSize == hash_function<Backend>::kBlockSize,
         "Declared block size and hash_function block size do not match");
-    hash_function::hash(in, len, out);
+    hash_function<Backend>::hash(in, len, out);
 }
 
-void Hash::hash(const unsigned char* in,
-                const size_t         len,
-                const size_t         out_len,
-                unsigned char*       out)
+template<class Backend>
+void BasicHash<Backend>::hash(const unsigned char* in,
+                              const size_t         len,
+                              const size_t         out_len,
+                              unsigned char*       out)
 {
     if (out_len > kDigestSize) {
         throw std::invalid_argument(
@@ -77,7 +118,8 @@ void Hash::hash(const unsigned char* in,
     memcpy(out, digest, out_len);
 }
 
-void Hash::hash(const std::string& in, std::string& out)
+template<class Backend>
+void BasicHash<Backend>::hash(const std::string& in, std::string& out)
 {
     unsigned char tmp_out[kDigestSize];
     hash(reinterpret_cast<const unsigned char*>(in.data()),
@@ -87,7 +129,10 @@ void Hash::hash(const std::string& in, std::string& out)
     out = std::string(reinterpret_cast<char*>(tmp_out), kDigestSize);
 }
 
-void Hash::hash(const std::string& in, const size_t out_len, std::string& out)
+template<class Backend>
+void BasicHash<Backend>::hash(const std::string& in,
+                              const size_t       out_len,
+                              std::string&       out)
 {
     if (out_len > kDigestSize) {
         throw std::invalid_argument(
@@ -103,19 +148,284 @@ void Hash::hash(const std::string& in, const size_t out_len, std::string& out)
     out = std::string(reinterpret_cast<char*>(tmp_out), out_len);
 }
 
-std::string Hash::hash(const std::string& in)
+template<class Backend>
+std::string BasicHash<Backend>::hash(const std::string& in)
 {
     std::string out;
     hash(in, out);
     return out;
 }
 
-std::string Hash::hash(const std::string& in, const size_t out_len)
+template<class Backend>
+std::string BasicHash<Backend>::hash(const std::string& in,
+                                     const size_t       out_len)
 {
     std::string out;
     hash(in, out_len, out);
     return out;
 }
 
+template<class Backend>
+static typename hash_function<Backend>::state_type& inner_state(
+    typename BasicHash<Backend>::state_type& state)
+{
+    using inner_type = typename hash_function<Backend>::state_type;
+
+    static_assert(sizeof(inner_type) <= BasicHash<Backend>::kStateSize,
+                  "kStateSize is too small for hash_function's state");
+    static_assert(
+        alignof(inner_type) <= alignof(typename BasicHash<Backend>::state_type),
+        "state_type is not aligned for hash_function's state");
+
+    return *reinterpret_cast<inner_type*>(&state);
+}
+
+template<class Backend>
+void BasicHash<Backend>::init(state_type& state) noexcept
+{
+    hash_function<Backend>::init(inner_state<Backend>(state));
+}
+
+template<class Backend>
+void BasicHash<Backend>::update(state_type&          state,
+                                const unsigned char* in,
+                                const size_t         len)
+{
+    if (in == nullptr && len != 0) {
+        throw std::invalid_argument("in is NULL");
+    }
+    hash_function<Backend>::update(inner_state<Backend>(state), in, len);
+}
+
+template<class Backend>
+void BasicHash<Backend>::absorb_block(state_type&          state,
+                                      const unsigned char* block)
+{
+    if (block == nullptr) {
+        throw std::invalid_argument("block is NULL");
+    }
+    hash_function<Backend>::absorb_block(inner_state<Backend>(state), block);
+}
+
+template<class Backend>
+void BasicHash<Backend>::final(state_type& state, unsigned char* out)
+{
+    if (out == nullptr) {
+        throw std::invalid_argument("out is NULL");
+    }
+    hash_function<Backend>::final(inner_state<Backend>(state), out);
+}
+
+template<class Backend>
+void BasicHash<Backend>::update_final_many(const state_type&           state,
+                                           const unsigned char* const* ins,
+                                           const size_t*               lens,
+                                           unsigned char* const*       outs,
+                                           const size_t                n)
+{
+    if (n == 0) {
+        return;
+    }
+    if (ins == nullptr || lens == nullptr || outs == nullptr) {
+        throw std::invalid_argument("ins, lens or outs is NULL");
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (ins[i] == nullptr || outs[i] == nullptr) {
+            throw std::invalid_argument("ins[i] or outs[i] is NULL");
+        }
+        if (lens[i] == 0) {
+            throw std::invalid_argument("Invalid input length: lens[i] is 0");
+        }
+    }
+
+    using inner_type = typename hash_function<Backend>::state_type;
+
+    hash_function<Backend>::update_final_many(
+        *reinterpret_cast<const inner_type*>(&state),
+        ins,
+        lens,
+        outs,
+        n);
+}
+
+template<class Backend>
+BasicHash<Backend>::State::State() noexcept : finalized_(false)
+{
+    init(state_);
+}
+
+template<class Backend>
+BasicHash<Backend>::State::~State()
+{
+    sodium_memzero(&state_, sizeof(state_));
+}
+
+template<class Backend>
+void BasicHash<Backend>::State::update(const unsigned char* in,
+                                       const size_t         len)
+{
+    if (finalized_) {
+        throw std::runtime_error("Hash::State: the state is finalized");
+    }
+    BasicHash::update(state_, in, len);
+}
+
+template<class Backend>
+void BasicHash<Backend>::State::update(const std::string& in)
+{
+    update(reinterpret_cast<const unsigned char*>(in.data()), in.length());
+}
+
+template<class Backend>
+void BasicHash<Backend>::State::final(unsigned char* out,
+                                      const size_t   out_len)
+{
+    if (finalized_) {
+        throw std::runtime_error("Hash::State: the state is finalized");
+    }
+    if (out_len > kDigestSize) {
+        throw std::invalid_argument(
+            "Invalid output length: out_len > kDigestSize");
+    }
+    if (out == nullptr) {
+        throw std::invalid_argument("out is NULL");
+    }
+
+    unsigned char digest[kDigestSize];
+
+    BasicHash::final(state_, digest);
+    finalized_ = true;
+    memcpy(out, digest, out_len);
+
+    sodium_memzero(digest, kDigestSize);
+}
+
+// Initializes the state of a node of the tree hashing mode, with the BLAKE2
+// parameter block: unlimited fanout, depth 2, kTreeLeafSize bytes leaves,
+// kDigestSize bytes inner digests
+template<class Backend>
+static void tree_node_init(tree_hash_function::state_type& state,
+                           const uint64_t                  node_offset,
+                           const uint8_t                   node_depth)
+{
+    constexpr size_t kLeafSize   = BasicHash<Backend>::kTreeLeafSize;
+    constexpr size_t kDigestSize = BasicHash<Backend>::kDigestSize;
+
+    static_assert(kLeafSize <= UINT32_MAX,
+                  "The tree leaves are too large for the parameter block");
+
+    unsigned char param[tree_hash_function::kParamSize] = {0};
+    param[0] = kDigestSize; // digest length
+    param[2] = 0;           // fanout
+    param[3] = 2;           // depth
+    for (size_t i = 0; i < 4; i++) {
+        param[4 + i] = static_cast<unsigned char>((kLeafSize >> (8 * i))
+                                                  & 0xFF); // leaf length
+    }
+    for (size_t i = 0; i < 8; i++) {
+        param[8 + i] = static_cast<unsigned char>(
+            (node_offset >> (8 * i)) & 0xFF); // node offset
+    }
+    param[16] = node_depth;  // node depth
+    param[17] = kDigestSize; // inner length
+
+    tree_hash_function::init_param(state, param);
+}
+
+template<class Backend>
+void BasicHash<Backend>::tree_hash(const unsigned char* in,
+                                   const size_t         len,
+                                   unsigned char*       out,
+                                   const Executor&      executor)
+{
+    if (in == nullptr && len != 0) {
+        throw std::invalid_argument("in is NULL");
+    }
+    if (out == nullptr) {
+        throw std::invalid_argument("out is NULL");
+    }
+
+    const size_t n_leaves
+        = (len == 0) ? 1 : (len + kTreeLeafSize - 1) / kTreeLeafSize;
+
+    std::vector<unsigned char> digests(n_leaves * kDigestSize);
+
+    executor(n_leaves, [in, len, n_leaves, &digests](size_t i) {
+        const size_t offset = i * kTreeLeafSize;
+        const size_t leaf_len
+            = (len - offset < kTreeLeafSize) ? len - offset : kTreeLeafSize;
+
+        tree_hash_function::state_type state;
+        tree_node_init<Backend>(state, i, 0);
+        tree_hash_function::update(state, in + offset, leaf_len);
+        tree_hash_function::final(
+            state, digests.data() + i * kDigestSize, i + 1 == n_leaves);
+    });
+
+    // the root is the last (and only) node of its level
+    tree_hash_function::state_type root;
+    tree_node_init<Backend>(root, 0, 1);
+    tree_hash_function::update(root, digests.data(), digests.size());
+    tree_hash_function::final(root, out, true);
+}
+
+template<class Backend>
+void BasicHash<Backend>::tree_hash_file(const std::string& path,
+                                        unsigned char*     out,
+                                        const Executor&    executor)
+{
+    if (out == nullptr) {
+        throw std::invalid_argument("out is NULL");
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::system_error(
+            errno, std::generic_category(), "Unable to open " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        /* LCOV_EXCL_START */
+        const int err = errno;
+        close(fd);
+        throw std::system_error(
+            err, std::generic_category(), "Unable to stat " + path);
+        /* LCOV_EXCL_STOP */
+    }
+    const size_t len = static_cast<size_t>(st.st_size);
+
+    if (len == 0) {
+        // empty files cannot be mapped
+        close(fd);
+        tree_hash(nullptr, 0, out, executor);
+        return;
+    }
+
+    void* map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int map_err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw std::system_error(
+            map_err, std::generic_category(), "Unable to map " + path);
+    }
+    // the file is read once, linearly within every leaf
+    madvise(map, len, MADV_SEQUENTIAL);
+
+    try {
+        tree_hash(static_cast<const unsigned char*>(map), len, out, executor);
+    } catch (...) {
+        /* LCOV_EXCL_START */
+        munmap(map, len);
+        throw;
+        /* LCOV_EXCL_STOP */
+    }
+    munmap(map, len);
+}
+
+template class BasicHash<Blake2bBackend>;
+template class BasicHash<Sha512Backend>;
+template class BasicHash<Blake3Backend>;
+
 } // namespace crypto
 } // namespace sse
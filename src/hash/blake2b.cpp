@@ -20,9 +20,18 @@
 
 #include "blake2b.hpp"
 
+#include <cassert>
 #include <cstdint>
+#include <cstring>
 
 #include <sodium/crypto_generichash_blake2b.h>
+#include <sodium/runtime.h>
+#include <sodium/utils.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BLAKE2B_X86 1
+#include <immintrin.h>
+#endif
 
 
 namespace sse {
@@ -31,6 +40,609 @@ namespace crypto {
 
 namespace hash {
 
+// Implementation of BLAKE2b (RFC 7693), for the incremental interface. One-shot
+// hashes still go through libsodium. The compression function has a portable,
+// an AVX2 and an AVX-512 implementation, selected at runtime by
+// init_dispatch().
+
+static bool use_avx2__   = false;
+static bool use_avx512__ = false;
+
+static constexpr uint64_t blake2b_iv[8]
+    = {0x6a09e667f3bcc908ULL,
+       0xbb67ae8584caa73bULL,
+       0x3c6ef372fe94f82bULL,
+       0xa54ff53a5f1d36f1ULL,
+       0x510e527fade682d1ULL,
+       0x9b05688c2b3e6c1fULL,
+       0x1f83d9abfb41bd6bULL,
+       0x5be0cd19137e2179ULL};
+
+static constexpr uint8_t blake2b_sigma[12][16]
+    = {{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+       {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+       {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+       {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+       {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+       {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+       {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+       {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+       {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+       {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+       {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+       {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}};
+
+static inline uint64_t load64(const unsigned char* src) noexcept
+{
+    uint64_t w = 0;
+    for (size_t i = 0; i < 8; i++) {
+        w |= static_cast<uint64_t>(src[i]) << (8 * i);
+    }
+    return w;
+}
+
+static inline void store64(unsigned char* dst, uint64_t w) noexcept
+{
+    for (size_t i = 0; i < 8; i++) {
+        dst[i] = static_cast<unsigned char>(w >> (8 * i));
+    }
+}
+
+static inline uint64_t rotr64(const uint64_t w, const unsigned c) noexcept
+{
+    return (w >> c) | (w << (64 - c));
+}
+
+// The rounds are unrolled, so that the message schedule is known at compile
+// time and the state stays in registers
+#define BLAKE2B_G(r, i, a, b, c, d)                                            \
+    do {                                                                       \
+        a = a + b + m[blake2b_sigma[r][2 * (i)]];                              \
+        d = rotr64(d ^ a, 32);                                                 \
+        c = c + d;                                                             \
+        b = rotr64(b ^ c, 24);                                                 \
+        a = a + b + m[blake2b_sigma[r][2 * (i) + 1]];                          \
+        d = rotr64(d ^ a, 16);                                                 \
+        c = c + d;                                                             \
+        b = rotr64(b ^ c, 63);                                                 \
+    } while (0)
+
+#define BLAKE2B_ROUND(r)                                                       \
+    do {                                                                       \
+        BLAKE2B_G(r, 0, v[0], v[4], v[8], v[12]);                              \
+        BLAKE2B_G(r, 1, v[1], v[5], v[9], v[13]);                              \
+        BLAKE2B_G(r, 2, v[2], v[6], v[10], v[14]);                             \
+        BLAKE2B_G(r, 3, v[3], v[7], v[11], v[15]);                             \
+        BLAKE2B_G(r, 4, v[0], v[5], v[10], v[15]);                             \
+        BLAKE2B_G(r, 5, v[1], v[6], v[11], v[12]);                             \
+        BLAKE2B_G(r, 6, v[2], v[7], v[8], v[13]);                              \
+        BLAKE2B_G(r, 7, v[3], v[4], v[9], v[14]);                              \
+    } while (0)
+
+static void blake2b_increment_counter(blake2b::state_type& state,
+                                      const uint64_t       inc) noexcept
+{
+    state.t[0] += inc;
+    state.t[1] += (state.t[0] < inc) ? 1 : 0;
+}
+
+static void blake2b_compress_ref(blake2b::state_type& state,
+                                 const unsigned char* block,
+                                 const bool           last,
+                                 const bool           last_node) noexcept
+{
+    uint64_t m[16];
+    uint64_t v[16];
+
+    for (size_t i = 0; i < 16; i++) {
+        m[i] = load64(block + 8 * i);
+    }
+    for (size_t i = 0; i < 8; i++) {
+        v[i]     = state.h[i];
+        v[i + 8] = blake2b_iv[i];
+    }
+    v[12] ^= state.t[0];
+    v[13] ^= state.t[1];
+    if (last) {
+        v[14] = ~v[14];
+    }
+    if (last_node) {
+        v[15] = ~v[15];
+    }
+
+    BLAKE2B_ROUND(0);
+    BLAKE2B_ROUND(1);
+    BLAKE2B_ROUND(2);
+    BLAKE2B_ROUND(3);
+    BLAKE2B_ROUND(4);
+    BLAKE2B_ROUND(5);
+    BLAKE2B_ROUND(6);
+    BLAKE2B_ROUND(7);
+    BLAKE2B_ROUND(8);
+    BLAKE2B_ROUND(9);
+    BLAKE2B_ROUND(10);
+    BLAKE2B_ROUND(11);
+
+    for (size_t i = 0; i < 8; i++) {
+        state.h[i] ^= v[i] ^ v[i + 8];
+    }
+
+    sodium_memzero(m, sizeof(m));
+}
+
+#undef BLAKE2B_ROUND
+#undef BLAKE2B_G
+
+#ifdef BLAKE2B_X86
+
+// AVX2 compression function. The rows of the 4x4 working matrix are stored in
+// four vectors.
+
+#define BLAKE2B_ROR63_256(x)                                                   \
+    _mm256_or_si256(_mm256_srli_epi64((x), 63), _mm256_add_epi64((x), (x)))
+
+#define BLAKE2B_G_256(a, b, c, d, mx, my)                                      \
+    do {                                                                       \
+        a = _mm256_add_epi64(_mm256_add_epi64(a, b), mx);                      \
+        d = _mm256_shuffle_epi32(_mm256_xor_si256(d, a), 0xB1);                \
+        c = _mm256_add_epi64(c, d);                                            \
+        b = _mm256_shuffle_epi8(_mm256_xor_si256(b, c), rot24);                \
+        a = _mm256_add_epi64(_mm256_add_epi64(a, b), my);                      \
+        d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16);                \
+        c = _mm256_add_epi64(c, d);                                            \
+        b = BLAKE2B_ROR63_256(_mm256_xor_si256(b, c));                         \
+    } while (0)
+
+#define BLAKE2B_MSG_256(r, i0, i1, i2, i3)                                     \
+    _mm256_set_epi64x(static_cast<int64_t>(m[blake2b_sigma[r][i3]]),           \
+                      static_cast<int64_t>(m[blake2b_sigma[r][i2]]),           \
+                      static_cast<int64_t>(m[blake2b_sigma[r][i1]]),           \
+                      static_cast<int64_t>(m[blake2b_sigma[r][i0]]))
+
+// The diagonal step is computed after a rotation of the rows b, c and d, so
+// that the diagonals become columns. G is the column/diagonal step macro, and
+// mx0, my0 (resp. mx1, my1) are the message words of the column (resp.
+// diagonal) step.
+#define BLAKE2B_ROUND_256(G, mx0, my0, mx1, my1)                               \
+    do {                                                                       \
+        G(a, b, c, d, mx0, my0);                                               \
+        b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(0, 3, 2, 1));              \
+        c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));              \
+        d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(2, 1, 0, 3));              \
+        G(a, b, c, d, mx1, my1);                                               \
+        b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(2, 1, 0, 3));              \
+        c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));              \
+        d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(0, 3, 2, 1));              \
+    } while (0)
+
+#define BLAKE2B_ROUND_AVX2(r)                                                  \
+    BLAKE2B_ROUND_256(BLAKE2B_G_256,                                           \
+                      BLAKE2B_MSG_256(r, 0, 2, 4, 6),                          \
+                      BLAKE2B_MSG_256(r, 1, 3, 5, 7),                          \
+                      BLAKE2B_MSG_256(r, 8, 10, 12, 14),                       \
+                      BLAKE2B_MSG_256(r, 9, 11, 13, 15))
+
+__attribute__((target("avx2"))) static void blake2b_compress_avx2(
+    blake2b::state_type& state,
+    const unsigned char* block,
+    const bool           last,
+    const bool           last_node) noexcept
+{
+    const __m256i rot16 = _mm256_setr_epi8(2,  3,  4,  5,  6,  7,  0,  1,
+                                           10, 11, 12, 13, 14, 15, 8,  9,
+                                           2,  3,  4,  5,  6,  7,  0,  1,
+                                           10, 11, 12, 13, 14, 15, 8,  9);
+    const __m256i rot24 = _mm256_setr_epi8(3,  4,  5,  6,  7,  0,  1,  2,
+                                           11, 12, 13, 14, 15, 8,  9,  10,
+                                           3,  4,  5,  6,  7,  0,  1,  2,
+                                           11, 12, 13, 14, 15, 8,  9,  10);
+
+    uint64_t m[16];
+    for (size_t i = 0; i < 16; i++) {
+        m[i] = load64(block + 8 * i);
+    }
+
+    const __m256i h0
+        = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state.h));
+    const __m256i h1
+        = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state.h + 4));
+
+    __m256i a = h0;
+    __m256i b = h1;
+    __m256i c
+        = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blake2b_iv));
+    __m256i d = _mm256_xor_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blake2b_iv + 4)),
+        _mm256_set_epi64x(last_node ? -1 : 0,
+                          last ? -1 : 0,
+                          static_cast<int64_t>(state.t[1]),
+                          static_cast<int64_t>(state.t[0])));
+
+    BLAKE2B_ROUND_AVX2(0);
+    BLAKE2B_ROUND_AVX2(1);
+    BLAKE2B_ROUND_AVX2(2);
+    BLAKE2B_ROUND_AVX2(3);
+    BLAKE2B_ROUND_AVX2(4);
+    BLAKE2B_ROUND_AVX2(5);
+    BLAKE2B_ROUND_AVX2(6);
+    BLAKE2B_ROUND_AVX2(7);
+    BLAKE2B_ROUND_AVX2(8);
+    BLAKE2B_ROUND_AVX2(9);
+    BLAKE2B_ROUND_AVX2(10);
+    BLAKE2B_ROUND_AVX2(11);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state.h),
+                        _mm256_xor_si256(h0, _mm256_xor_si256(a, c)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state.h + 4),
+                        _mm256_xor_si256(h1, _mm256_xor_si256(b, d)));
+
+    sodium_memzero(m, sizeof(m));
+}
+
+// AVX-512 compression function. The rows are still stored in 256 bits
+// vectors, but the message is kept in two 512 bits vectors from which the
+// message words of a round are gathered with a single two-source permutation
+// per step, and the rotations use the native vprorq instruction.
+
+// blake2b_sigma, rearranged so that the first (resp. last) 8 indices are the
+// message words of the column (resp. diagonal) step, in the order expected by
+// BLAKE2B_ROUND_256: mx0 | my0 | mx1 | my1
+alignas(64) static constexpr uint64_t blake2b_sigma_512[12][16] = {
+    {0, 2, 4, 6, 1, 3, 5, 7, 8, 10, 12, 14, 9, 11, 13, 15},
+    {14, 4, 9, 13, 10, 8, 15, 6, 1, 0, 11, 5, 12, 2, 7, 3},
+    {11, 12, 5, 15, 8, 0, 2, 13, 10, 3, 7, 9, 14, 6, 1, 4},
+    {7, 3, 13, 11, 9, 1, 12, 14, 2, 5, 4, 15, 6, 10, 0, 8},
+    {9, 5, 2, 10, 0, 7, 4, 15, 14, 11, 6, 3, 1, 12, 8, 13},
+    {2, 6, 0, 8, 12, 10, 11, 3, 4, 7, 15, 1, 13, 5, 14, 9},
+    {12, 1, 14, 4, 5, 15, 13, 10, 0, 6, 9, 8, 7, 3, 2, 11},
+    {13, 7, 12, 3, 11, 14, 1, 9, 5, 15, 8, 2, 0, 4, 6, 10},
+    {6, 14, 11, 0, 15, 9, 3, 8, 12, 13, 1, 10, 2, 7, 4, 5},
+    {10, 8, 7, 1, 2, 4, 6, 5, 15, 9, 3, 13, 11, 14, 12, 0},
+    {0, 2, 4, 6, 1, 3, 5, 7, 8, 10, 12, 14, 9, 11, 13, 15},
+    {14, 4, 9, 13, 10, 8, 15, 6, 1, 0, 11, 5, 12, 2, 7, 3},
+};
+
+#define BLAKE2B_G_512(a, b, c, d, mx, my)                                      \
+    do {                                                                       \
+        a = _mm256_add_epi64(_mm256_add_epi64(a, b), mx);                      \
+        d = _mm256_ror_epi64(_mm256_xor_si256(d, a), 32);                      \
+        c = _mm256_add_epi64(c, d);                                            \
+        b = _mm256_ror_epi64(_mm256_xor_si256(b, c), 24);                      \
+        a = _mm256_add_epi64(_mm256_add_epi64(a, b), my);                      \
+        d = _mm256_ror_epi64(_mm256_xor_si256(d, a), 16);                      \
+        c = _mm256_add_epi64(c, d);                                            \
+        b = _mm256_ror_epi64(_mm256_xor_si256(b, c), 63);                      \
+    } while (0)
+
+#define BLAKE2B_ROUND_AVX512(r)                                                \
+    do {                                                                       \
+        const __m512i s0 = _mm512_permutex2var_epi64(                          \
+            m_lo,                                                              \
+            _mm512_load_si512(blake2b_sigma_512[r]),                           \
+            m_hi);                                                             \
+        const __m512i s1 = _mm512_permutex2var_epi64(                          \
+            m_lo,                                                              \
+            _mm512_load_si512(blake2b_sigma_512[r] + 8),                       \
+            m_hi);                                                             \
+        /* the masked extraction avoids a spurious GCC warning */              \
+        const __m256i mx0 = _mm512_maskz_extracti64x4_epi64(0xF, s0, 0);       \
+        const __m256i my0 = _mm512_maskz_extracti64x4_epi64(0xF, s0, 1);       \
+        const __m256i mx1 = _mm512_maskz_extracti64x4_epi64(0xF, s1, 0);       \
+        const __m256i my1 = _mm512_maskz_extracti64x4_epi64(0xF, s1, 1);       \
+        BLAKE2B_ROUND_256(BLAKE2B_G_512, mx0, my0, mx1, my1);                  \
+    } while (0)
+
+__attribute__((target("avx512f,avx512vl"))) static void
+blake2b_compress_avx512(blake2b::state_type& state,
+                        const unsigned char* block,
+                        const bool           last,
+                        const bool           last_node) noexcept
+{
+    // x86 is little endian: the message words can be loaded directly
+    const __m512i m_lo = _mm512_loadu_si512(block);
+    const __m512i m_hi = _mm512_loadu_si512(block + 64);
+
+    const __m256i h0
+        = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state.h));
+    const __m256i h1
+        = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state.h + 4));
+
+    __m256i a = h0;
+    __m256i b = h1;
+    __m256i c
+        = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blake2b_iv));
+    __m256i d = _mm256_xor_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blake2b_iv + 4)),
+        _mm256_set_epi64x(last_node ? -1 : 0,
+                          last ? -1 : 0,
+                          static_cast<int64_t>(state.t[1]),
+                          static_cast<int64_t>(state.t[0])));
+
+    BLAKE2B_ROUND_AVX512(0);
+    BLAKE2B_ROUND_AVX512(1);
+    BLAKE2B_ROUND_AVX512(2);
+    BLAKE2B_ROUND_AVX512(3);
+    BLAKE2B_ROUND_AVX512(4);
+    BLAKE2B_ROUND_AVX512(5);
+    BLAKE2B_ROUND_AVX512(6);
+    BLAKE2B_ROUND_AVX512(7);
+    BLAKE2B_ROUND_AVX512(8);
+    BLAKE2B_ROUND_AVX512(9);
+    BLAKE2B_ROUND_AVX512(10);
+    BLAKE2B_ROUND_AVX512(11);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state.h),
+                        _mm256_xor_si256(h0, _mm256_xor_si256(a, c)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state.h + 4),
+                        _mm256_xor_si256(h1, _mm256_xor_si256(b, d)));
+}
+
+// Multi-buffer compression functions, used by update_final_many(). The states
+// of the lanes are stored "vertically": h[i][l] is the i-th word of the state
+// of lane l, so that each vector of the working matrix contains the same word
+// of every lane, and the rounds are the ones of the portable implementation.
+// Each lane has its own message block, counter and finalization flag. The
+// states of the inactive lanes are left unchanged.
+struct blake2b_lanes
+{
+    alignas(64) uint64_t h[8][blake2b::kMaxLanes];
+    alignas(64) uint64_t m[16][blake2b::kMaxLanes];
+    alignas(64) uint64_t t[2][blake2b::kMaxLanes];
+    alignas(64) uint64_t f[blake2b::kMaxLanes];
+    unsigned active;
+};
+
+#define BLAKE2B_ROUND_LANES(G, r)                                              \
+    do {                                                                       \
+        G(v[0], v[4], v[8], v[12], r, 0);                                      \
+        G(v[1], v[5], v[9], v[13], r, 1);                                      \
+        G(v[2], v[6], v[10], v[14], r, 2);                                     \
+        G(v[3], v[7], v[11], v[15], r, 3);                                     \
+        G(v[0], v[5], v[10], v[15], r, 4);                                     \
+        G(v[1], v[6], v[11], v[12], r, 5);                                     \
+        G(v[2], v[7], v[8], v[13], r, 6);                                      \
+        G(v[3], v[4], v[9], v[14], r, 7);                                      \
+    } while (0)
+
+#define BLAKE2B_ROUNDS_LANES(G)                                                \
+    do {                                                                       \
+        BLAKE2B_ROUND_LANES(G, 0);                                             \
+        BLAKE2B_ROUND_LANES(G, 1);                                             \
+        BLAKE2B_ROUND_LANES(G, 2);                                             \
+        BLAKE2B_ROUND_LANES(G, 3);                                             \
+        BLAKE2B_ROUND_LANES(G, 4);                                             \
+        BLAKE2B_ROUND_LANES(G, 5);                                             \
+        BLAKE2B_ROUND_LANES(G, 6);                                             \
+        BLAKE2B_ROUND_LANES(G, 7);                                             \
+        BLAKE2B_ROUND_LANES(G, 8);                                             \
+        BLAKE2B_ROUND_LANES(G, 9);                                             \
+        BLAKE2B_ROUND_LANES(G, 10);                                            \
+        BLAKE2B_ROUND_LANES(G, 11);                                            \
+    } while (0)
+
+#define BLAKE2B_G_X4(a, b, c, d, r, i)                                         \
+    BLAKE2B_G_256(a,                                                           \
+                  b,                                                           \
+                  c,                                                           \
+                  d,                                                           \
+                  m[blake2b_sigma[r][2 * (i)]],                                \
+                  m[blake2b_sigma[r][2 * (i) + 1]])
+
+// AVX2 kernel (4 lanes)
+__attribute__((target("avx2"))) static void blake2b_compress_x4_avx2(
+    blake2b_lanes& lanes) noexcept
+{
+    const __m256i rot16 = _mm256_setr_epi8(2,  3,  4,  5,  6,  7,  0,  1,
+                                           10, 11, 12, 13, 14, 15, 8,  9,
+                                           2,  3,  4,  5,  6,  7,  0,  1,
+                                           10, 11, 12, 13, 14, 15, 8,  9);
+    const __m256i rot24 = _mm256_setr_epi8(3,  4,  5,  6,  7,  0,  1,  2,
+                                           11, 12, 13, 14, 15, 8,  9,  10,
+                                           3,  4,  5,  6,  7,  0,  1,  2,
+                                           11, 12, 13, 14, 15, 8,  9,  10);
+
+    __m256i m[16];
+    __m256i v[16];
+
+    for (size_t i = 0; i < 16; i++) {
+        m[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.m[i]));
+    }
+    for (size_t i = 0; i < 8; i++) {
+        v[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.h[i]));
+        v[i + 8] = _mm256_set1_epi64x(static_cast<int64_t>(blake2b_iv[i]));
+    }
+    v[12] = _mm256_xor_si256(
+        v[12], _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.t[0])));
+    v[13] = _mm256_xor_si256(
+        v[13], _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.t[1])));
+    v[14] = _mm256_xor_si256(
+        v[14], _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.f)));
+
+    BLAKE2B_ROUNDS_LANES(BLAKE2B_G_X4);
+
+    const __m256i active
+        = _mm256_set_epi64x(-static_cast<int64_t>((lanes.active >> 3) & 1),
+                            -static_cast<int64_t>((lanes.active >> 2) & 1),
+                            -static_cast<int64_t>((lanes.active >> 1) & 1),
+                            -static_cast<int64_t>(lanes.active & 1));
+    for (size_t i = 0; i < 8; i++) {
+        __m256i* h = reinterpret_cast<__m256i*>(lanes.h[i]);
+
+        const __m256i h_old = _mm256_load_si256(h);
+        const __m256i h_new
+            = _mm256_xor_si256(h_old, _mm256_xor_si256(v[i], v[i + 8]));
+        _mm256_store_si256(h, _mm256_blendv_epi8(h_old, h_new, active));
+    }
+
+    sodium_memzero(m, sizeof(m));
+    sodium_memzero(v, sizeof(v));
+}
+
+// the masked rotation avoids a spurious GCC warning
+#define BLAKE2B_ROR_512(x, n) _mm512_maskz_ror_epi64(0xFF, (x), (n))
+
+#define BLAKE2B_G_X8(a, b, c, d, r, i)                                         \
+    do {                                                                       \
+        a = _mm512_add_epi64(_mm512_add_epi64(a, b),                           \
+                             m[blake2b_sigma[r][2 * (i)]]);                    \
+        d = BLAKE2B_ROR_512(_mm512_xor_si512(d, a), 32);                       \
+        c = _mm512_add_epi64(c, d);                                            \
+        b = BLAKE2B_ROR_512(_mm512_xor_si512(b, c), 24);                       \
+        a = _mm512_add_epi64(_mm512_add_epi64(a, b),                           \
+                             m[blake2b_sigma[r][2 * (i) + 1]]);                \
+        d = BLAKE2B_ROR_512(_mm512_xor_si512(d, a), 16);                       \
+        c = _mm512_add_epi64(c, d);                                            \
+        b = BLAKE2B_ROR_512(_mm512_xor_si512(b, c), 63);                       \
+    } while (0)
+
+// AVX-512 kernel (8 lanes)
+__attribute__((target("avx512f"))) static void blake2b_compress_x8_avx512(
+    blake2b_lanes& lanes) noexcept
+{
+    __m512i m[16];
+    __m512i v[16];
+
+    for (size_t i = 0; i < 16; i++) {
+        m[i] = _mm512_load_si512(lanes.m[i]);
+    }
+    for (size_t i = 0; i < 8; i++) {
+        v[i]     = _mm512_load_si512(lanes.h[i]);
+        v[i + 8] = _mm512_set1_epi64(static_cast<int64_t>(blake2b_iv[i]));
+    }
+    v[12] = _mm512_xor_si512(v[12], _mm512_load_si512(lanes.t[0]));
+    v[13] = _mm512_xor_si512(v[13], _mm512_load_si512(lanes.t[1]));
+    v[14] = _mm512_xor_si512(v[14], _mm512_load_si512(lanes.f));
+
+    BLAKE2B_ROUNDS_LANES(BLAKE2B_G_X8);
+
+    const __mmask8 active = static_cast<__mmask8>(lanes.active);
+    for (size_t i = 0; i < 8; i++) {
+        const __m512i h_old = _mm512_load_si512(lanes.h[i]);
+        _mm512_store_si512(
+            lanes.h[i],
+            _mm512_mask_xor_epi64(
+                h_old, active, h_old, _mm512_xor_si512(v[i], v[i + 8])));
+    }
+
+    sodium_memzero(m, sizeof(m));
+    sodium_memzero(v, sizeof(v));
+}
+
+// Hashes n_lanes (at most kMaxLanes) messages from a common state, using the
+// compress kernel. x86 is little endian: the words are moved with memcpy, which
+// is much cheaper than the bytewise load64()/store64() when transposing
+static void blake2b_update_final_lanes(const blake2b::state_type&  state,
+                                       const unsigned char* const* ins,
+                                       const size_t*               lens,
+                                       unsigned char* const*       digests,
+                                       const size_t                n_lanes,
+                                       void (*compress)(blake2b_lanes&))
+{
+    blake2b_lanes lanes;
+    unsigned char block[blake2b::kBlockSize];
+    size_t        n_blocks[blake2b::kMaxLanes];
+    size_t        max_blocks = 0;
+
+    memset(&lanes, 0, sizeof(lanes));
+    for (size_t l = 0; l < n_lanes; l++) {
+        n_blocks[l] = (lens[l] + blake2b::kBlockSize - 1) / blake2b::kBlockSize;
+        max_blocks  = (n_blocks[l] > max_blocks) ? n_blocks[l] : max_blocks;
+
+        for (size_t i = 0; i < 8; i++) {
+            lanes.h[i][l] = state.h[i];
+        }
+    }
+
+    for (size_t b = 0; b < max_blocks; b++) {
+        const size_t pos = b * blake2b::kBlockSize;
+
+        lanes.active = 0;
+        for (size_t l = 0; l < n_lanes; l++) {
+            if (b >= n_blocks[l]) {
+                continue; // the message of this lane is fully absorbed
+            }
+
+            const size_t rem = lens[l] - pos;
+            const size_t len
+                = (rem < blake2b::kBlockSize) ? rem : blake2b::kBlockSize;
+            const unsigned char* src = ins[l] + pos;
+
+            // the last block is padded with zeros
+            if (len < blake2b::kBlockSize) {
+                memcpy(block, src, len);
+                memset(block + len, 0, blake2b::kBlockSize - len);
+                src = block;
+            }
+            for (size_t i = 0; i < 16; i++) {
+                memcpy(&lanes.m[i][l], src + 8 * i, sizeof(uint64_t));
+            }
+
+            const uint64_t inc = pos + len;
+            lanes.t[0][l]      = state.t[0] + inc;
+            lanes.t[1][l]      = state.t[1] + ((lanes.t[0][l] < inc) ? 1 : 0);
+            lanes.f[l]         = (b + 1 == n_blocks[l]) ? ~0ULL : 0;
+            lanes.active |= 1U << l;
+        }
+
+        compress(lanes);
+    }
+
+    for (size_t l = 0; l < n_lanes; l++) {
+        for (size_t i = 0; i < 8; i++) {
+            memcpy(digests[l] + 8 * i, &lanes.h[i][l], sizeof(uint64_t));
+        }
+    }
+
+    sodium_memzero(&lanes, sizeof(lanes));
+    sodium_memzero(block, sizeof(block));
+}
+
+#undef BLAKE2B_G_X8
+#undef BLAKE2B_ROR_512
+#undef BLAKE2B_G_X4
+#undef BLAKE2B_ROUNDS_LANES
+#undef BLAKE2B_ROUND_LANES
+#undef BLAKE2B_ROUND_AVX512
+#undef BLAKE2B_G_512
+#undef BLAKE2B_ROUND_AVX2
+#undef BLAKE2B_ROUND_256
+#undef BLAKE2B_MSG_256
+#undef BLAKE2B_G_256
+#undef BLAKE2B_ROR63_256
+
+#endif // BLAKE2B_X86
+
+// last sets the last block flag (f0), last_node the last node flag (f1) of the
+// tree hashing mode
+static void blake2b_compress(blake2b::state_type& state,
+                             const unsigned char* block,
+                             const bool           last,
+                             const bool           last_node) noexcept
+{
+#ifdef BLAKE2B_X86
+    if (use_avx512__) {
+        blake2b_compress_avx512(state, block, last, last_node);
+        return;
+    }
+    if (use_avx2__) {
+        blake2b_compress_avx2(state, block, last, last_node);
+        return;
+    }
+#endif
+    blake2b_compress_ref(state, block, last, last_node);
+}
+
+void blake2b::init_dispatch() noexcept
+{
+#ifdef BLAKE2B_X86
+    use_avx2__ = (sodium_runtime_has_avx2() == 1);
+    // libsodium does not report AVX-512VL, which is needed for the 256 bits
+    // rotations
+    use_avx512__ = (sodium_runtime_has_avx512f() == 1)
+                   && __builtin_cpu_supports("avx512vl");
+#endif
+}
+
 void blake2b::hash(const unsigned char* in,
                    const size_t         len,
                    unsigned char*       digest)
@@ -38,6 +650,131 @@ void blake2b::hash(const unsigned char* in,
     crypto_generichash_blake2b(digest, kDigestSize, in, len, nullptr, 0);
 }
 
+void blake2b::init(state_type& state) noexcept
+{
+    // parameter block: 64 bytes digest, no key, sequential mode
+    unsigned char param[kParamSize] = {0};
+    param[0]                        = kDigestSize;
+    param[2]                        = 1;
+    param[3]                        = 1;
+
+    init_param(state, param);
+}
+
+void blake2b::init_param(state_type&          state,
+                         const unsigned char* param) noexcept
+{
+    for (size_t i = 0; i < 8; i++) {
+        state.h[i] = blake2b_iv[i] ^ load64(param + 8 * i);
+    }
+
+    state.t[0]    = 0;
+    state.t[1]    = 0;
+    state.buf_len = 0;
+    memset(state.buf, 0, kBlockSize);
+}
+
+void blake2b::update(state_type&          state,
+                     const unsigned char* in,
+                     size_t               len) noexcept
+{
+    if (len == 0) {
+        return;
+    }
+
+    // the last block must be compressed by final(): keep the pending bytes in
+    // the buffer until we know more data comes in
+    const size_t fill = kBlockSize - state.buf_len;
+    if (len > fill) {
+        memcpy(state.buf + state.buf_len, in, fill);
+        blake2b_increment_counter(state, kBlockSize);
+        blake2b_compress(state, state.buf, false, false);
+        state.buf_len = 0;
+        in += fill;
+        len -= fill;
+
+        while (len > kBlockSize) {
+            blake2b_increment_counter(state, kBlockSize);
+            blake2b_compress(state, in, false, false);
+            in += kBlockSize;
+            len -= kBlockSize;
+        }
+    }
+    memcpy(state.buf + state.buf_len, in, len);
+    state.buf_len += len;
+}
+
+void blake2b::absorb_block(state_type&          state,
+                           const unsigned char* block) noexcept
+{
+    assert(state.buf_len == 0);
+
+    blake2b_increment_counter(state, kBlockSize);
+    blake2b_compress(state, block, false, false);
+}
+
+void blake2b::final(state_type&    state,
+                    unsigned char* digest,
+                    const bool     last_node) noexcept
+{
+    blake2b_increment_counter(state, state.buf_len);
+    memset(state.buf + state.buf_len, 0, kBlockSize - state.buf_len);
+    blake2b_compress(state, state.buf, true, last_node);
+
+    for (size_t i = 0; i < 8; i++) {
+        store64(digest + 8 * i, state.h[i]);
+    }
+
+    sodium_memzero(&state, sizeof(state));
+}
+
+void blake2b::update_final_many(const state_type&           state,
+                                const unsigned char* const* ins,
+                                const size_t*               lens,
+                                unsigned char* const*       digests,
+                                const size_t                n) noexcept
+{
+    size_t i = 0;
+
+#ifdef BLAKE2B_X86
+    // the lanes start from a block boundary: with pending bytes, the messages
+    // go through the scalar implementation
+    const bool aligned = (state.buf_len == 0);
+
+    // incomplete groups still go through the kernels, unless a single message
+    // is left
+    if (use_avx512__ && aligned) {
+        while (i + 1 < n) {
+            const size_t n_lanes = (n - i < kMaxLanes) ? n - i : kMaxLanes;
+            blake2b_update_final_lanes(state,
+                                       ins + i,
+                                       lens + i,
+                                       digests + i,
+                                       n_lanes,
+                                       blake2b_compress_x8_avx512);
+            i += n_lanes;
+        }
+    } else if (use_avx2__ && aligned) {
+        while (i + 1 < n) {
+            const size_t n_lanes = (n - i < 4) ? n - i : 4;
+            blake2b_update_final_lanes(state,
+                                       ins + i,
+                                       lens + i,
+                                       digests + i,
+                                       n_lanes,
+                                       blake2b_compress_x4_avx2);
+            i += n_lanes;
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        state_type s = state;
+        update(s, ins[i], lens[i]);
+        final(s, digests[i]);
+    }
+}
+
 } // namespace hash
 } // namespace crypto
 } // namespace sse
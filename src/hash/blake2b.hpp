@@ -20,6 +20,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
 namespace sse {
 
@@ -31,10 +32,95 @@ struct blake2b
 {
     constexpr static size_t kDigestSize = 64;
     constexpr static size_t kBlockSize  = 128;
+    constexpr static size_t kParamSize  = 64;
+
+    /// @brief State of an incremental (unkeyed, 64 bytes output) hash
+    struct state_type
+    {
+        uint64_t      h[8];
+        uint64_t      t[2];
+        unsigned char buf[kBlockSize];
+        size_t        buf_len;
+    };
 
     static void hash(const unsigned char* in,
                      const size_t         len,
                      unsigned char*       digest);
+
+    /// @brief Initializes an incremental hash
+    static void init(state_type& state) noexcept;
+
+    ///
+    /// @brief Initializes an incremental hash with a custom parameter block
+    ///
+    /// The kParamSize bytes parameter block (digest length, key length, tree
+    /// parameters, salt and personalization) is laid out as specified by RFC
+    /// 7693 and the BLAKE2X specification. In keyed mode, the caller must
+    /// then absorb the key, zero-padded to a full block.
+    ///
+    static void init_param(state_type&          state,
+                           const unsigned char* param) noexcept;
+
+    /// @brief Absorbs len bytes in the state
+    static void update(state_type&          state,
+                       const unsigned char* in,
+                       const size_t         len) noexcept;
+
+    ///
+    /// @brief Absorbs a full block in the state
+    ///
+    /// Unlike update(), the block is compressed immediately, and not when
+    /// more data comes in. As the last block of a BLAKE2b input is compressed
+    /// differently, absorb_block() can only be used when at least one more
+    /// byte will be absorbed before finalization. The state must not have any
+    /// pending byte, i.e. the number of bytes absorbed so far must be a
+    /// multiple of kBlockSize.
+    ///
+    /// Used by HMac to precompute the states after the key pads.
+    ///
+    static void absorb_block(state_type&          state,
+                             const unsigned char* block) noexcept;
+
+    ///
+    /// @brief Writes the digest in the digest buffer and erases the state
+    ///
+    /// @param last_node    Set the last node flag of the tree hashing mode: it
+    ///                     must be set for the last node of each level of the
+    ///                     tree (including the root).
+    ///
+    static void final(state_type&    state,
+                      unsigned char* digest,
+                      const bool     last_node = false) noexcept;
+
+    /// @brief Maximum number of messages hashed in parallel
+    constexpr static size_t kMaxLanes = 8;
+
+    ///
+    /// @brief Absorbs and finalizes several messages from a common state
+    ///
+    /// For each i < n, writes to digests[i] the digest obtained by absorbing
+    /// the lens[i] bytes of ins[i] in a copy of state and finalizing it. The
+    /// messages are processed 4 (AVX2) or kMaxLanes (AVX-512) at a time, in the
+    /// lanes of a vectorized compression function.
+    ///
+    /// The lanes are only used when the state does not have any pending byte
+    /// (as after absorb_block()). Otherwise, the messages are hashed one after
+    /// the other. The messages must be non-empty. The state is not modified.
+    ///
+    static void update_final_many(const state_type&           state,
+                                  const unsigned char* const* ins,
+                                  const size_t*               lens,
+                                  unsigned char* const*       digests,
+                                  const size_t                n) noexcept;
+
+    ///
+    /// @brief Selects the fastest compression function available on the CPU
+    ///
+    /// Must be called after libsodium has been initialized (this is done by
+    /// init_crypto_lib()). Before the first call, the portable implementation
+    /// is used.
+    ///
+    static void init_dispatch() noexcept;
 };
 
 } // namespace hash
@@ -0,0 +1,358 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "blake3.hpp"
+
+#include <cstring>
+
+#include <sodium/utils.h>
+
+
+namespace sse {
+
+namespace crypto {
+
+namespace hash {
+
+// Portable implementation of BLAKE3, following the reference implementation
+// of the specification (https://github.com/BLAKE3-team/BLAKE3-specs)
+
+static constexpr uint32_t blake3_iv[8] = {0x6A09E667UL,
+                                          0xBB67AE85UL,
+                                          0x3C6EF372UL,
+                                          0xA54FF53AUL,
+                                          0x510E527FUL,
+                                          0x9B05688CUL,
+                                          0x1F83D9ABUL,
+                                          0x5BE0CD19UL};
+
+static constexpr uint8_t blake3_msg_permutation[16]
+    = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+// domain separation flags
+static constexpr uint32_t kChunkStart = 1 << 0;
+static constexpr uint32_t kChunkEnd   = 1 << 1;
+static constexpr uint32_t kParent     = 1 << 2;
+static constexpr uint32_t kRoot       = 1 << 3;
+
+static inline uint32_t load32(const unsigned char* src) noexcept
+{
+    return static_cast<uint32_t>(src[0])
+           | (static_cast<uint32_t>(src[1]) << 8)
+           | (static_cast<uint32_t>(src[2]) << 16)
+           | (static_cast<uint32_t>(src[3]) << 24);
+}
+
+static inline void store32(unsigned char* dst, uint32_t w) noexcept
+{
+    for (size_t i = 0; i < 4; i++) {
+        dst[i] = static_cast<unsigned char>(w >> (8 * i));
+    }
+}
+
+static inline uint32_t rotr32(const uint32_t w, const unsigned c) noexcept
+{
+    return (w >> c) | (w << (32 - c));
+}
+
+static inline void blake3_g(uint32_t*      v,
+                            const size_t   a,
+                            const size_t   b,
+                            const size_t   c,
+                            const size_t   d,
+                            const uint32_t mx,
+                            const uint32_t my) noexcept
+{
+    v[a] = v[a] + v[b] + mx;
+    v[d] = rotr32(v[d] ^ v[a], 16);
+    v[c] = v[c] + v[d];
+    v[b] = rotr32(v[b] ^ v[c], 12);
+    v[a] = v[a] + v[b] + my;
+    v[d] = rotr32(v[d] ^ v[a], 8);
+    v[c] = v[c] + v[d];
+    v[b] = rotr32(v[b] ^ v[c], 7);
+}
+
+// Compression function: writes the 16 words of the extended output in out
+static void blake3_compress(const uint32_t cv[8],
+                            const uint32_t block[16],
+                            const uint64_t counter,
+                            const uint32_t block_len,
+                            const uint32_t flags,
+                            uint32_t       out[16]) noexcept
+{
+    uint32_t v[16] = {cv[0],
+                      cv[1],
+                      cv[2],
+                      cv[3],
+                      cv[4],
+                      cv[5],
+                      cv[6],
+                      cv[7],
+                      blake3_iv[0],
+                      blake3_iv[1],
+                      blake3_iv[2],
+                      blake3_iv[3],
+                      static_cast<uint32_t>(counter),
+                      static_cast<uint32_t>(counter >> 32),
+                      block_len,
+                      flags};
+    uint32_t m[16];
+    uint32_t permuted[16];
+
+    memcpy(m, block, sizeof(m));
+
+    for (size_t r = 0; r < 7; r++) {
+        // columns
+        blake3_g(v, 0, 4, 8, 12, m[0], m[1]);
+        blake3_g(v, 1, 5, 9, 13, m[2], m[3]);
+        blake3_g(v, 2, 6, 10, 14, m[4], m[5]);
+        blake3_g(v, 3, 7, 11, 15, m[6], m[7]);
+        // diagonals
+        blake3_g(v, 0, 5, 10, 15, m[8], m[9]);
+        blake3_g(v, 1, 6, 11, 12, m[10], m[11]);
+        blake3_g(v, 2, 7, 8, 13, m[12], m[13]);
+        blake3_g(v, 3, 4, 9, 14, m[14], m[15]);
+
+        for (size_t i = 0; i < 16; i++) {
+            permuted[i] = m[blake3_msg_permutation[i]];
+        }
+        memcpy(m, permuted, sizeof(m));
+    }
+
+    for (size_t i = 0; i < 8; i++) {
+        out[i]     = v[i] ^ v[i + 8];
+        out[i + 8] = v[i + 8] ^ cv[i];
+    }
+
+    sodium_memzero(v, sizeof(v));
+    sodium_memzero(m, sizeof(m));
+    sodium_memzero(permuted, sizeof(permuted));
+}
+
+static void blake3_load_block(const unsigned char* in,
+                              uint32_t             block[16]) noexcept
+{
+    for (size_t i = 0; i < 16; i++) {
+        block[i] = load32(in + 4 * i);
+    }
+}
+
+// A node of the tree, before its compression: it gives either a chaining
+// value, or the root output
+struct blake3_output
+{
+    uint32_t cv[8];
+    uint32_t block[16];
+    uint64_t counter;
+    uint32_t block_len;
+    uint32_t flags;
+};
+
+static void blake3_chaining_value(const blake3_output& output,
+                                  uint32_t             cv[8]) noexcept
+{
+    uint32_t out[16];
+    blake3_compress(output.cv,
+                    output.block,
+                    output.counter,
+                    output.block_len,
+                    output.flags,
+                    out);
+    memcpy(cv, out, 8 * sizeof(uint32_t));
+    sodium_memzero(out, sizeof(out));
+}
+
+static void blake3_chunk_output(const blake3::state_type& state,
+                                blake3_output&            output) noexcept
+{
+    unsigned char block[blake3::kBlockSize];
+
+    memcpy(block, state.buf, state.buf_len);
+    memset(block + state.buf_len, 0, blake3::kBlockSize - state.buf_len);
+
+    memcpy(output.cv, state.cv, sizeof(output.cv));
+    blake3_load_block(block, output.block);
+    output.counter   = state.chunk_counter;
+    output.block_len = static_cast<uint32_t>(state.buf_len);
+    output.flags
+        = kChunkEnd | ((state.blocks_compressed == 0) ? kChunkStart : 0);
+
+    sodium_memzero(block, sizeof(block));
+}
+
+static void blake3_parent_output(const uint32_t left[8],
+                                 const uint32_t right[8],
+                                 blake3_output& output) noexcept
+{
+    memcpy(output.cv, blake3_iv, sizeof(output.cv));
+    memcpy(output.block, left, 8 * sizeof(uint32_t));
+    memcpy(output.block + 8, right, 8 * sizeof(uint32_t));
+    output.counter   = 0;
+    output.block_len = blake3::kBlockSize;
+    output.flags     = kParent;
+}
+
+// Starts the chunk following the current one, after having merged the
+// chaining value of the current chunk with the completed subtrees
+static void blake3_end_chunk(blake3::state_type& state) noexcept
+{
+    blake3_output output;
+    uint32_t      cv[8];
+
+    blake3_chunk_output(state, output);
+    blake3_chaining_value(output, cv);
+
+    // the number of trailing zeros of the number of chunks is the number of
+    // subtrees completed by this chunk
+    uint64_t total_chunks = state.chunk_counter + 1;
+    while ((total_chunks & 1) == 0) {
+        state.cv_stack_len--;
+        blake3_parent_output(state.cv_stack[state.cv_stack_len], cv, output);
+        blake3_chaining_value(output, cv);
+        total_chunks >>= 1;
+    }
+    memcpy(state.cv_stack[state.cv_stack_len], cv, sizeof(cv));
+    state.cv_stack_len++;
+
+    memcpy(state.cv, blake3_iv, sizeof(state.cv));
+    state.chunk_counter++;
+    state.buf_len           = 0;
+    state.blocks_compressed = 0;
+
+    sodium_memzero(&output, sizeof(output));
+    sodium_memzero(cv, sizeof(cv));
+}
+
+void blake3::hash(const unsigned char* in,
+                  const size_t         len,
+                  unsigned char*       digest) noexcept
+{
+    state_type state;
+    init(state);
+    update(state, in, len);
+    final(state, digest);
+}
+
+void blake3::init(state_type& state) noexcept
+{
+    memcpy(state.cv, blake3_iv, sizeof(state.cv));
+    state.chunk_counter     = 0;
+    state.buf_len           = 0;
+    state.blocks_compressed = 0;
+    state.cv_stack_len      = 0;
+    memset(state.buf, 0, kBlockSize);
+}
+
+void blake3::update(state_type&          state,
+                    const unsigned char* in,
+                    size_t               len) noexcept
+{
+    while (len > 0) {
+        // the last block of a chunk must be compressed with the chunk end
+        // flag: a full chunk is only ended when more data comes in
+        if (state.blocks_compressed * kBlockSize + state.buf_len
+            == kChunkSize) {
+            blake3_end_chunk(state);
+        }
+
+        // the pending block is full, and more data comes in
+        if (state.buf_len == kBlockSize) {
+            uint32_t block[16];
+            uint32_t out[16];
+
+            blake3_load_block(state.buf, block);
+            blake3_compress(state.cv,
+                            block,
+                            state.chunk_counter,
+                            kBlockSize,
+                            (state.blocks_compressed == 0) ? kChunkStart : 0,
+                            out);
+            memcpy(state.cv, out, sizeof(state.cv));
+            state.blocks_compressed++;
+            state.buf_len = 0;
+
+            sodium_memzero(block, sizeof(block));
+            sodium_memzero(out, sizeof(out));
+            continue;
+        }
+
+        const size_t available = kBlockSize - state.buf_len;
+        const size_t take      = (len < available) ? len : available;
+        memcpy(state.buf + state.buf_len, in, take);
+        state.buf_len += take;
+        in += take;
+        len -= take;
+    }
+}
+
+void blake3::absorb_block(state_type&          state,
+                          const unsigned char* block) noexcept
+{
+    update(state, block, kBlockSize);
+}
+
+void blake3::final(state_type& state, unsigned char* digest) noexcept
+{
+    blake3_output output;
+    uint32_t      cv[8];
+    uint32_t      out[16];
+
+    blake3_chunk_output(state, output);
+    for (size_t i = state.cv_stack_len; i > 0; i--) {
+        blake3_chaining_value(output, cv);
+        blake3_parent_output(state.cv_stack[i - 1], cv, output);
+    }
+
+    // a single output block of the root
+    static_assert(kDigestSize == 16 * sizeof(uint32_t),
+                  "The digest must be a single block of the root output");
+    blake3_compress(output.cv,
+                    output.block,
+                    0,
+                    output.block_len,
+                    output.flags | kRoot,
+                    out);
+    for (size_t i = 0; i < 16; i++) {
+        store32(digest + 4 * i, out[i]);
+    }
+
+    sodium_memzero(&output, sizeof(output));
+    sodium_memzero(cv, sizeof(cv));
+    sodium_memzero(out, sizeof(out));
+    sodium_memzero(&state, sizeof(state));
+}
+
+void blake3::update_final_many(const state_type&           state,
+                               const unsigned char* const* ins,
+                               const size_t*               lens,
+                               unsigned char* const*       digests,
+                               const size_t                n) noexcept
+{
+    for (size_t i = 0; i < n; i++) {
+        state_type s = state;
+        update(s, ins[i], lens[i]);
+        final(s, digests[i]);
+    }
+}
+
+} // namespace hash
+} // namespace crypto
+} // namespace sse
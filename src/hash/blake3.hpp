@@ -0,0 +1,107 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sse {
+
+namespace crypto {
+
+namespace hash {
+
+///
+/// @brief BLAKE3, with 64 bytes digests
+///
+/// Portable implementation of the BLAKE3 hash mode, with the same interface as
+/// blake2b and sha512. The digests are the first 64 bytes of the extendable
+/// output of BLAKE3. kBlockSize is the size of the blocks of the compression
+/// function, which is also the size of the key pads when BLAKE3 is used in
+/// HMac.
+///
+struct blake3
+{
+    constexpr static size_t kDigestSize = 64;
+    constexpr static size_t kBlockSize  = 64;
+    constexpr static size_t kChunkSize  = 1024;
+
+    /// @brief Maximum depth of the tree of chunks (inputs of at most 2^64
+    /// bytes)
+    constexpr static size_t kMaxDepth = 54;
+
+    /// @brief State of an incremental hash
+    struct state_type
+    {
+        /// @brief Chaining value of the current chunk
+        uint32_t cv[8];
+        /// @brief Index of the current chunk
+        uint64_t chunk_counter;
+        /// @brief Pending bytes of the current chunk
+        unsigned char buf[kBlockSize];
+        size_t        buf_len;
+        /// @brief Number of blocks of the current chunk already compressed
+        size_t blocks_compressed;
+        /// @brief Chaining values of the completed subtrees
+        uint32_t cv_stack[kMaxDepth][8];
+        size_t   cv_stack_len;
+    };
+
+    static void hash(const unsigned char* in,
+                     const size_t         len,
+                     unsigned char*       digest) noexcept;
+
+    /// @brief Initializes an incremental hash
+    static void init(state_type& state) noexcept;
+
+    /// @brief Absorbs len bytes in the state
+    static void update(state_type&          state,
+                       const unsigned char* in,
+                       const size_t         len) noexcept;
+
+    ///
+    /// @brief Absorbs a full block in the state
+    ///
+    /// Same as update(state, block, kBlockSize): BLAKE3 always keeps the last
+    /// block pending until more data comes in. See blake2b::absorb_block.
+    ///
+    static void absorb_block(state_type&          state,
+                             const unsigned char* block) noexcept;
+
+    /// @brief Writes the digest in the digest buffer and erases the state
+    static void final(state_type& state, unsigned char* digest) noexcept;
+
+    ///
+    /// @brief Absorbs and finalizes several messages from a common state
+    ///
+    /// Same as calling update() and final() on copies of the state, one
+    /// message after the other. See blake2b::update_final_many.
+    ///
+    static void update_final_many(const state_type&           state,
+                                  const unsigned char* const* ins,
+                                  const size_t*               lens,
+                                  unsigned char* const*       digests,
+                                  const size_t                n) noexcept;
+};
+
+} // namespace hash
+} // namespace crypto
+} // namespace sse
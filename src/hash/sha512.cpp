@@ -21,8 +21,16 @@
 #include "sha512.hpp"
 
 #include <cstdint>
+#include <cstring>
 
 #include <sodium/crypto_hash_sha512.h>
+#include <sodium/runtime.h>
+#include <sodium/utils.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SHA512_X86 1
+#include <immintrin.h>
+#endif
 
 
 namespace sse {
@@ -31,6 +39,238 @@ namespace crypto {
 
 namespace hash {
 
+// The single message functions go through libsodium. update_final_many() has a
+// multi-buffer AVX2 implementation, hashing 4 messages at once, selected at
+// runtime by init_dispatch().
+
+static bool use_avx2__ = false;
+
+#ifdef SHA512_X86
+
+static constexpr uint64_t sha512_k[80]
+    = {0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+       0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+       0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+       0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+       0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+       0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+       0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+       0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+       0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+       0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+       0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+       0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+       0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+       0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+       0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+       0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+       0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+       0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+       0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+       0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+       0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+       0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+       0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+       0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+       0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+       0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+       0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL};
+
+// Multi-buffer compression function. As for BLAKE2b, the states of the lanes
+// are stored "vertically": h[i][l] is the i-th word of the state of lane l,
+// and m[i][l] the i-th (big endian) word of its message block. The states of
+// the inactive lanes are left unchanged.
+struct sha512_lanes
+{
+    alignas(32) uint64_t h[8][sha512::kMaxLanes];
+    alignas(32) uint64_t m[16][sha512::kMaxLanes];
+    unsigned active;
+};
+
+#define SHA512_ROR_256(x, n)                                                   \
+    _mm256_or_si256(_mm256_srli_epi64((x), (n)), _mm256_slli_epi64((x), 64 - (n)))
+
+#define SHA512_XOR3_256(x, y, z) _mm256_xor_si256((x), _mm256_xor_si256((y), (z)))
+
+// Updates the t-th word of the message schedule, for t >= 16
+#define SHA512_SCHEDULE_X4(t)                                                  \
+    do {                                                                       \
+        const __m256i w15 = w[((t)-15) & 15];                                  \
+        const __m256i w2  = w[((t)-2) & 15];                                   \
+        const __m256i s0  = SHA512_XOR3_256(SHA512_ROR_256(w15, 1),            \
+                                           SHA512_ROR_256(w15, 8),            \
+                                           _mm256_srli_epi64(w15, 7));        \
+        const __m256i s1  = SHA512_XOR3_256(SHA512_ROR_256(w2, 19),            \
+                                           SHA512_ROR_256(w2, 61),            \
+                                           _mm256_srli_epi64(w2, 6));         \
+        w[(t)&15]         = _mm256_add_epi64(                                  \
+            _mm256_add_epi64(w[(t)&15], s0),                           \
+            _mm256_add_epi64(w[((t)-7) & 15], s1));                    \
+    } while (0)
+
+// One round: only d and h are updated, the rotation of the working variables
+// is done by the caller, by permuting the arguments
+#define SHA512_ROUND_X4(a, b, c, d, e, f, g, h, t)                             \
+    do {                                                                       \
+        const __m256i S1 = SHA512_XOR3_256(SHA512_ROR_256(e, 14),              \
+                                           SHA512_ROR_256(e, 18),              \
+                                           SHA512_ROR_256(e, 41));             \
+        const __m256i ch = _mm256_xor_si256(                                   \
+            g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));                   \
+        const __m256i t1 = _mm256_add_epi64(                                   \
+            _mm256_add_epi64(h, S1),                                           \
+            _mm256_add_epi64(                                                  \
+                ch,                                                            \
+                _mm256_add_epi64(w[(t)&15],                                    \
+                                 _mm256_set1_epi64x(                           \
+                                     static_cast<int64_t>(sha512_k[t])))));    \
+        const __m256i S0 = SHA512_XOR3_256(SHA512_ROR_256(a, 28),              \
+                                           SHA512_ROR_256(a, 34),              \
+                                           SHA512_ROR_256(a, 39));             \
+        const __m256i maj = _mm256_or_si256(                                   \
+            _mm256_and_si256(a, b),                                            \
+            _mm256_and_si256(c, _mm256_or_si256(a, b)));                       \
+        d = _mm256_add_epi64(d, t1);                                           \
+        h = _mm256_add_epi64(t1, _mm256_add_epi64(S0, maj));                   \
+    } while (0)
+
+__attribute__((target("avx2"))) static void sha512_compress_x4_avx2(
+    sha512_lanes& lanes) noexcept
+{
+    __m256i w[16];
+    __m256i v[8];
+
+    for (size_t i = 0; i < 16; i++) {
+        w[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.m[i]));
+    }
+    for (size_t i = 0; i < 8; i++) {
+        v[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.h[i]));
+    }
+
+    __m256i a = v[0], b = v[1], c = v[2], d = v[3];
+    __m256i e = v[4], f = v[5], g = v[6], h = v[7];
+
+    for (size_t t = 0; t < 80; t += 8) {
+        if (t >= 16) {
+            for (size_t j = t; j < t + 8; j++) {
+                SHA512_SCHEDULE_X4(j);
+            }
+        }
+        SHA512_ROUND_X4(a, b, c, d, e, f, g, h, t);
+        SHA512_ROUND_X4(h, a, b, c, d, e, f, g, t + 1);
+        SHA512_ROUND_X4(g, h, a, b, c, d, e, f, t + 2);
+        SHA512_ROUND_X4(f, g, h, a, b, c, d, e, t + 3);
+        SHA512_ROUND_X4(e, f, g, h, a, b, c, d, t + 4);
+        SHA512_ROUND_X4(d, e, f, g, h, a, b, c, t + 5);
+        SHA512_ROUND_X4(c, d, e, f, g, h, a, b, t + 6);
+        SHA512_ROUND_X4(b, c, d, e, f, g, h, a, t + 7);
+    }
+
+    const __m256i out[8] = {a, b, c, d, e, f, g, h};
+    const __m256i active = _mm256_set_epi64x(
+        -static_cast<int64_t>((lanes.active >> 3) & 1),
+        -static_cast<int64_t>((lanes.active >> 2) & 1),
+        -static_cast<int64_t>((lanes.active >> 1) & 1),
+        -static_cast<int64_t>(lanes.active & 1));
+
+    for (size_t i = 0; i < 8; i++) {
+        const __m256i next = _mm256_add_epi64(v[i], out[i]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes.h[i]),
+                           _mm256_blendv_epi8(v[i], next, active));
+    }
+
+    sodium_memzero(w, sizeof(w));
+    sodium_memzero(v, sizeof(v));
+}
+
+#undef SHA512_ROUND_X4
+#undef SHA512_SCHEDULE_X4
+#undef SHA512_XOR3_256
+#undef SHA512_ROR_256
+
+// Hashes n_lanes (at most kMaxLanes) messages from a common state without
+// pending bytes. x86 is little endian: the big endian words are loaded with
+// memcpy and byte-swapped.
+static void sha512_update_final_lanes(const sha512::state_type&   state,
+                                      const unsigned char* const* ins,
+                                      const size_t*               lens,
+                                      unsigned char* const*       digests,
+                                      const size_t                n_lanes)
+{
+    sha512_lanes  lanes;
+    unsigned char block[sha512::kBlockSize];
+    size_t        n_blocks[sha512::kMaxLanes];
+    uint64_t      bit_len[sha512::kMaxLanes][2];
+    size_t        max_blocks = 0;
+
+    memset(&lanes, 0, sizeof(lanes));
+    for (size_t l = 0; l < n_lanes; l++) {
+        // the padding takes at least 17 bytes: 0x80 and the 128 bits length
+        n_blocks[l] = (lens[l] + 17 + sha512::kBlockSize - 1) / sha512::kBlockSize;
+        max_blocks  = (n_blocks[l] > max_blocks) ? n_blocks[l] : max_blocks;
+
+        // libsodium counts bits, count[0] holding the high word
+        const uint64_t low = state.count[1] + (static_cast<uint64_t>(lens[l]) << 3);
+        bit_len[l][0] = state.count[0] + (static_cast<uint64_t>(lens[l]) >> 61)
+                        + ((low < state.count[1]) ? 1 : 0);
+        bit_len[l][1] = low;
+
+        for (size_t i = 0; i < 8; i++) {
+            lanes.h[i][l] = state.state[i];
+        }
+    }
+
+    for (size_t b = 0; b < max_blocks; b++) {
+        const size_t pos = b * sha512::kBlockSize;
+
+        lanes.active = 0;
+        for (size_t l = 0; l < n_lanes; l++) {
+            if (b >= n_blocks[l]) {
+                continue; // the message of this lane is fully absorbed
+            }
+
+            const unsigned char* src = ins[l] + pos;
+            if (pos + sha512::kBlockSize > lens[l]) {
+                // padding block
+                memset(block, 0, sha512::kBlockSize);
+                if (pos <= lens[l]) {
+                    memcpy(block, src, lens[l] - pos);
+                    block[lens[l] - pos] = 0x80;
+                }
+                if (b + 1 == n_blocks[l]) {
+                    for (size_t i = 0; i < 2; i++) {
+                        const uint64_t w = __builtin_bswap64(bit_len[l][i]);
+                        memcpy(block + sha512::kBlockSize - 16 + 8 * i,
+                               &w,
+                               sizeof(uint64_t));
+                    }
+                }
+                src = block;
+            }
+            for (size_t i = 0; i < 16; i++) {
+                uint64_t w;
+                memcpy(&w, src + 8 * i, sizeof(uint64_t));
+                lanes.m[i][l] = __builtin_bswap64(w);
+            }
+            lanes.active |= 1U << l;
+        }
+
+        sha512_compress_x4_avx2(lanes);
+    }
+
+    for (size_t l = 0; l < n_lanes; l++) {
+        for (size_t i = 0; i < 8; i++) {
+            const uint64_t w = __builtin_bswap64(lanes.h[i][l]);
+            memcpy(digests[l] + 8 * i, &w, sizeof(uint64_t));
+        }
+    }
+
+    sodium_memzero(&lanes, sizeof(lanes));
+    sodium_memzero(block, sizeof(block));
+}
+
+#endif
+
 void sha512::hash(const unsigned char* in,
                   const size_t         len,
                   unsigned char*       digest)
@@ -38,6 +278,67 @@ void sha512::hash(const unsigned char* in,
     crypto_hash_sha512(digest, in, len);
 }
 
+void sha512::init(state_type& state) noexcept
+{
+    crypto_hash_sha512_init(&state);
+}
+
+void sha512::update(state_type&          state,
+                    const unsigned char* in,
+                    const size_t         len) noexcept
+{
+    crypto_hash_sha512_update(&state, in, len);
+}
+
+void sha512::absorb_block(state_type&          state,
+                          const unsigned char* block) noexcept
+{
+    crypto_hash_sha512_update(&state, block, kBlockSize);
+}
+
+void sha512::final(state_type& state, unsigned char* digest) noexcept
+{
+    crypto_hash_sha512_final(&state, digest);
+    sodium_memzero(&state, sizeof(state));
+}
+
+void sha512::update_final_many(const state_type&           state,
+                               const unsigned char* const* ins,
+                               const size_t*               lens,
+                               unsigned char* const*       digests,
+                               const size_t                n) noexcept
+{
+    size_t i = 0;
+
+#ifdef SHA512_X86
+    // the lanes start from a block boundary
+    const bool aligned = ((state.count[1] >> 3) % kBlockSize) == 0;
+
+    if (use_avx2__ && aligned) {
+        // a single message is faster with the scalar implementation
+        while (i + 1 < n) {
+            const size_t n_lanes = (n - i < kMaxLanes) ? n - i : kMaxLanes;
+            sha512_update_final_lanes(
+                state, ins + i, lens + i, digests + i, n_lanes);
+            i += n_lanes;
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        state_type s = state;
+        update(s, ins[i], lens[i]);
+        final(s, digests[i]);
+    }
+}
+
+void sha512::init_dispatch() noexcept
+{
+#ifdef SHA512_X86
+    use_avx2__ = (sodium_runtime_has_avx2() == 1);
+#endif
+}
+
 } // namespace hash
 } // namespace crypto
 } // namespace sse
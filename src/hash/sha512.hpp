@@ -21,6 +21,8 @@
 
 #include <cstddef>
 
+#include <sodium/crypto_hash_sha512.h>
+
 namespace sse {
 
 namespace crypto {
@@ -32,9 +34,59 @@ struct sha512
     constexpr static size_t kDigestSize = 64;
     constexpr static size_t kBlockSize  = 128;
 
+    /// @brief State of an incremental hash
+    using state_type = crypto_hash_sha512_state;
+
     static void hash(const unsigned char* in,
                      const size_t         len,
                      unsigned char*       digest);
+
+    /// @brief Initializes an incremental hash
+    static void init(state_type& state) noexcept;
+
+    /// @brief Absorbs len bytes in the state
+    static void update(state_type&          state,
+                       const unsigned char* in,
+                       const size_t         len) noexcept;
+
+    ///
+    /// @brief Absorbs a full block in the state
+    ///
+    /// Same as update(state, block, kBlockSize): SHA-512 compresses the full
+    /// blocks as soon as they are absorbed. See blake2b::absorb_block.
+    ///
+    static void absorb_block(state_type&          state,
+                             const unsigned char* block) noexcept;
+
+    /// @brief Writes the digest in the digest buffer and erases the state
+    static void final(state_type& state, unsigned char* digest) noexcept;
+
+    /// @brief Maximum number of messages hashed in parallel
+    constexpr static size_t kMaxLanes = 4;
+
+    ///
+    /// @brief Absorbs and finalizes several messages from a common state
+    ///
+    /// Same as calling update() and final() on copies of the state. When the
+    /// CPU supports AVX2 and the number of bytes absorbed in the state is a
+    /// multiple of kBlockSize, the messages are processed kMaxLanes at a time,
+    /// in the lanes of a vectorized compression function. Otherwise, they are
+    /// hashed one after the other. The state is not modified.
+    ///
+    static void update_final_many(const state_type&           state,
+                                  const unsigned char* const* ins,
+                                  const size_t*               lens,
+                                  unsigned char* const*       digests,
+                                  const size_t                n) noexcept;
+
+    ///
+    /// @brief Selects the fastest implementation available on the CPU
+    ///
+    /// Must be called after libsodium has been initialized (this is done by
+    /// init_crypto_lib()). Before the first call, the messages given to
+    /// update_final_many() are hashed one after the other.
+    ///
+    static void init_dispatch() noexcept;
 };
 
 } // namespace hash
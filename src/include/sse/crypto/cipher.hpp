@@ -21,43 +21,109 @@
 #pragma once
 
 #include <sse/crypto/key.hpp>
+#include <sse/crypto/parallel.hpp>
 
 #include <cstdint>
 
 #include <array>
 #include <string>
+#include <type_traits>
 
 namespace sse {
 
 namespace crypto {
 
-/// @class Cipher
+/// @brief Cipher policy: ChaCha20+Poly1305 with nonce-derived keys (default)
+///
+/// Every message is encrypted with ChaCha20+Poly1305 under its own key,
+/// derived from the master key and a random 128 bits nonce with keyed BLAKE2b.
+/// The ciphertext is the nonce, followed by the encrypted message and the
+/// Poly1305 tag.
+///
+struct DerivedKeyCipherPolicy
+{
+};
+
+/// @brief Cipher policy: XChaCha20+Poly1305
+///
+/// The messages are encrypted with XChaCha20+Poly1305 under the master key,
+/// with a random 192 bits nonce. The nonce is expanded into a one-time key by
+/// HChaCha20, which is cheaper than the BLAKE2b key derivation of
+/// DerivedKeyCipherPolicy. The gain is noticeable on small messages only.
+///
+/// The ciphertexts start with a version header (kXChaCha20CipherVersion),
+/// followed by the nonce, the encrypted message and the Poly1305 tag. The
+/// header is authenticated. When a ciphertext does not carry the header (or
+/// fails to authenticate with it), the decryption functions taking strings
+/// fall back to DerivedKeyCipherPolicy: ciphertexts produced by Cipher with
+/// the same key still decrypt.
+///
+struct XChaCha20CipherPolicy
+{
+};
+
+/// @brief Version header of the XChaCha20CipherPolicy ciphertexts
+constexpr uint8_t kXChaCha20CipherVersion = 0x01;
+
+/// @class BasicCipher
 /// @brief Encryption and decryption.
 ///
-/// Cipher is an opaque class for symmetric encryption and decryption.
-/// It implements a Chacha20+Poly1305 with a nonce-derived key.
-/// This allows for larger nonces (128 bits) than the original
-/// Chacha20+Poly1305 construction (96 bits). As a consequence,
-/// nonces can be randomly generated, and the Cipher object does not
-/// need to keep a state to be secure.
+/// BasicCipher is an opaque class for symmetric encryption and decryption.
+/// The construction is selected by the Policy template parameter. With
+/// DerivedKeyCipherPolicy (the Cipher alias), it implements a
+/// Chacha20+Poly1305 with a nonce-derived key. This allows for larger nonces
+/// (128 bits) than the original Chacha20+Poly1305 construction (96 bits). As a
+/// consequence, nonces can be randomly generated, and the Cipher object does
+/// not need to keep a state to be secure. XChaCha20CipherPolicy (the
+/// XChaCha20Cipher alias) uses 192 bits random nonces and is faster on small
+/// messages.
+///
+/// The keys of both policies are interchangeable, but Wrapper uses distinct
+/// type bytes for the two policies.
+///
+/// @tparam Policy  The construction: DerivedKeyCipherPolicy or
+///                 XChaCha20CipherPolicy
 ///
 
-class Cipher
+template<class Policy>
+class BasicCipher
 {
     friend class Wrapper;
 
+    static_assert(std::is_same<Policy, DerivedKeyCipherPolicy>::value
+                      || std::is_same<Policy, XChaCha20CipherPolicy>::value,
+                  "Invalid Cipher policy");
+
+    /// @brief Set if the cipher uses XChaCha20CipherPolicy
+    static constexpr bool kIsXChaCha20
+        = std::is_same<Policy, XChaCha20CipherPolicy>::value;
+
 public:
     /// @brief Cipher key size (in bytes)
     static constexpr uint8_t kKeySize = 32;
 
     /// @brief  Number of additional bytes in a ciphertext generated by a Cipher
-    ///         object
-    static constexpr size_t kCiphertextExpansion = 32;
+    ///         object: the header, the nonce and the tag
+    static constexpr size_t kCiphertextExpansion = kIsXChaCha20 ? 41 : 32;
 
     /// @brief  Size (in bytes) of the public context (used to wrap a Prg
     ///         object).
     static constexpr size_t kPublicContextSize = 0;
 
+    /// @brief  Size (in bytes) of the header of a stream: the version, the
+    ///         chunk size and the salt
+    static constexpr size_t kStreamHeaderSize = 21;
+
+    /// @brief  Number of additional bytes in an encrypted chunk of a stream:
+    ///         the tag
+    static constexpr size_t kChunkExpansion = 16;
+
+    /// @brief Default size (in bytes) of the plaintext chunks of a stream
+    static constexpr size_t kDefaultChunkSize = 1UL << 16;
+
+    /// @brief Maximum size (in bytes) of the plaintext chunks of a stream
+    static constexpr size_t kMaxChunkSize = 1UL << 24;
+
 
     /// @brief The public context of a Cipher object. It is an empty array.
     static constexpr std::array<uint8_t, kPublicContextSize> public_context()
@@ -68,15 +134,15 @@ public:
         return std::array<uint8_t, kPublicContextSize>();
     }
 
-    Cipher() = delete;
+    BasicCipher() = delete;
 
     // we should not be able to duplicate Cipher objects
-    Cipher(const Cipher& c) = delete;
-    Cipher(Cipher& c)       = delete;
+    BasicCipher(const BasicCipher& c) = delete;
+    BasicCipher(BasicCipher& c)       = delete;
 
 
     // Again, avoid any assignement of Cipher objects
-    Cipher& operator=(const Cipher& h) = delete;
+    BasicCipher& operator=(const BasicCipher& h) = delete;
 
     ///
     /// @brief Constructor
@@ -88,10 +154,27 @@ public:
     /// @param k    The key used to initialize the cipher.
     ///             Upon return, k is empty
     ///
-    explicit Cipher(Key<kKeySize>&& k);
+    explicit BasicCipher(Key<kKeySize>&& k);
 
     /// @brief Move constructor
-    Cipher(Cipher&& c) noexcept = default;
+    BasicCipher(BasicCipher&& c) noexcept = default;
+
+    /// @brief RAII unlock session type of the cipher's master key
+    using UnlockSession = typename Key<kKeySize>::UnlockSession;
+
+    ///
+    /// @brief Opens an unlock session on the cipher's master key
+    ///
+    /// As long as the returned session is alive, the key is not locked again
+    /// after each encryption or decryption, saving two system calls per call
+    /// when memory locking is enabled. See Key::UnlockSession.
+    ///
+    /// @exception std::runtime_error The key cannot be unlocked.
+    ///
+    UnlockSession unlock_session() const
+    {
+        return key_.unlock_session();
+    }
 
     ///
     /// @brief Encrypt a plaintext
@@ -104,7 +187,7 @@ public:
     ///
     /// @exception std::invalid_argument The size of in is 0.
     ///
-    void encrypt(const std::string& in, std::string& out);
+    void encrypt(const std::string& in, std::string& out) const;
 
     ///
     /// @brief Decrypt a ciphertext
@@ -115,12 +198,15 @@ public:
     /// least (i.e. non-empty).
     /// @param out   The computed plaintext.
     ///
+    /// With XChaCha20CipherPolicy, the ciphertexts of DerivedKeyCipherPolicy
+    /// are also accepted.
+    ///
     /// @exception std::invalid_argument in is smaller than the size of the
     /// nonce
     /// + the size of the tag.
     /// @exception std::runtime_error       The decryption failed: invalid tag
     ///
-    void decrypt(const std::string& in, std::string& out);
+    void decrypt(const std::string& in, std::string& out) const;
 
     ///
     /// @brief Compute the length of a ciphertext
@@ -196,6 +282,394 @@ public:
         decrypt(in.data(), ciphertext_length(NBYTES), out.data());
     }
 
+    ///
+    /// @brief Encrypt a batch of plaintexts
+    ///
+    /// Encrypts the count plaintexts ins[0], ..., ins[count-1], of respective
+    /// lengths lens[0], ..., lens[count-1]. The ciphertexts are written one
+    /// after the other in the out arena: the i-th ciphertext starts at offset
+    /// ciphertext_length(lens[0]) + ... + ciphertext_length(lens[i-1]), and
+    /// out must be large enough for all the ciphertexts.
+    ///
+    /// The ciphertexts are the ones encrypt() would return, but the master
+    /// key is unlocked once for the whole batch and the nonces are drawn from
+    /// the random generator by blocks of messages.
+    ///
+    /// @param ins      The plaintexts. They must all be non-empty.
+    /// @param lens     The lengths of the plaintexts.
+    /// @param count    The number of plaintexts.
+    /// @param out      The output arena.
+    ///
+    /// @exception std::invalid_argument    ins, lens, out or one of the
+    ///                                     plaintexts is NULL, or a plaintext
+    ///                                     is empty
+    ///
+    void encrypt_many(const uint8_t* const* ins,
+                      const size_t*         lens,
+                      const size_t          count,
+                      uint8_t*              out) const;
+
+    ///
+    /// @brief Encrypt a batch of plaintexts, in parallel
+    ///
+    /// Same as encrypt_many(ins, lens, count, out), with the blocks of
+    /// messages encrypted as independent tasks of the executor.
+    ///
+    /// @param ins      The plaintexts. They must all be non-empty.
+    /// @param lens     The lengths of the plaintexts.
+    /// @param count    The number of plaintexts.
+    /// @param out      The output arena.
+    /// @param executor The executor running the tasks (see thread_executor()).
+    ///
+    /// @exception std::invalid_argument    ins, lens, out or one of the
+    ///                                     plaintexts is NULL, or a plaintext
+    ///                                     is empty
+    ///
+    void encrypt_many(const uint8_t* const* ins,
+                      const size_t*         lens,
+                      const size_t          count,
+                      uint8_t*              out,
+                      const Executor&       executor) const;
+
+    ///
+    /// @brief Decrypt a batch of ciphertexts
+    ///
+    /// Decrypts the count ciphertexts ins[0], ..., ins[count-1], of respective
+    /// lengths lens[0], ..., lens[count-1]. The plaintexts are written one
+    /// after the other in the out arena: the i-th plaintext starts at offset
+    /// plaintext_length(lens[0]) + ... + plaintext_length(lens[i-1]).
+    ///
+    /// A ciphertext that fails to decrypt (too short, or invalid tag) does not
+    /// interrupt the batch: valid[i] is set to false and the i-th slot of the
+    /// arena is zeroed. Unlike decrypt(const std::string&, std::string&), only
+    /// the ciphertexts of the cipher's own policy are accepted.
+    ///
+    /// @param ins      The ciphertexts.
+    /// @param lens     The lengths of the ciphertexts.
+    /// @param count    The number of ciphertexts.
+    /// @param out      The output arena.
+    /// @param valid    Array of count booleans, set to true for the
+    ///                 ciphertexts that were successfully decrypted.
+    ///
+    /// @return The number of ciphertexts that failed to decrypt.
+    ///
+    /// @exception std::invalid_argument    ins, lens, out, valid or one of the
+    ///                                     ciphertexts is NULL
+    ///
+    size_t decrypt_many(const uint8_t* const* ins,
+                        const size_t*         lens,
+                        const size_t          count,
+                        uint8_t*              out,
+                        bool*                 valid) const;
+
+    ///
+    /// @brief Decrypt a batch of ciphertexts, in parallel
+    ///
+    /// Same as decrypt_many(ins, lens, count, out, valid), with the blocks of
+    /// messages decrypted as independent tasks of the executor.
+    ///
+    /// @param ins      The ciphertexts.
+    /// @param lens     The lengths of the ciphertexts.
+    /// @param count    The number of ciphertexts.
+    /// @param out      The output arena.
+    /// @param valid    Array of count booleans, set to true for the
+    ///                 ciphertexts that were successfully decrypted.
+    /// @param executor The executor running the tasks (see thread_executor()).
+    ///
+    /// @return The number of ciphertexts that failed to decrypt.
+    ///
+    /// @exception std::invalid_argument    ins, lens, out, valid or one of the
+    ///                                     ciphertexts is NULL
+    ///
+    size_t decrypt_many(const uint8_t* const* ins,
+                        const size_t*         lens,
+                        const size_t          count,
+                        uint8_t*              out,
+                        bool*                 valid,
+                        const Executor&       executor) const;
+
+    ///
+    /// @brief Compute the length of an encrypted stream
+    ///
+    /// @param plaintext_len    Length of the plaintext.
+    /// @param chunk_size       Size of the plaintext chunks.
+    ///
+    /// @return Length of the stream, header included, when the plaintext is
+    ///         split in as few chunks as possible (as in encrypt_file).
+    ///
+    static constexpr size_t stream_ciphertext_length(
+        const size_t plaintext_len,
+        const size_t chunk_size) noexcept
+    {
+        return kStreamHeaderSize + plaintext_len
+               + ((plaintext_len == 0)
+                      ? 1
+                      : (plaintext_len + chunk_size - 1) / chunk_size)
+                     * kChunkExpansion;
+    }
+
+    /// @class StreamEncryptor
+    /// @brief Incremental encryption of a stream of chunks
+    ///
+    /// Large payloads are split in chunks of chunk_size() bytes, encrypted
+    /// one after the other with ChaCha20+Poly1305 under a key derived from
+    /// the master key and a random 128 bits salt. The nonce of a chunk is its
+    /// index and a flag marking the last chunk, and the stream header is
+    /// authenticated with every chunk: the chunks cannot be reordered,
+    /// dropped or truncated without the decryption failing.
+    ///
+    /// An encrypted stream is the header, followed by the encrypted chunks
+    /// (of chunk_size() + kChunkExpansion bytes, except for the last one).
+    /// The streaming format is the same for both Cipher policies.
+    ///
+    class StreamEncryptor
+    {
+        friend class BasicCipher;
+
+    public:
+        /// @brief Move constructor
+        StreamEncryptor(StreamEncryptor&& s) noexcept = default;
+
+        /// @brief Move assignment operator
+        StreamEncryptor& operator=(StreamEncryptor&& s) noexcept = default;
+
+        /// @brief The stream header. It must be stored before the chunks.
+        const std::array<uint8_t, kStreamHeaderSize>& header() const noexcept
+        {
+            return header_;
+        }
+
+        /// @brief The size of the plaintext chunks
+        size_t chunk_size() const noexcept
+        {
+            return chunk_size_;
+        }
+
+        /// @brief Returns true once the last chunk has been pushed
+        bool finalized() const noexcept
+        {
+            return finalized_;
+        }
+
+        ///
+        /// @brief Encrypt the next chunk
+        ///
+        /// @param in   The plaintext chunk. Can only be NULL if len is 0.
+        /// @param len  The size of the chunk: exactly chunk_size() bytes, or
+        ///             at most chunk_size() bytes (possibly 0) for the last
+        ///             chunk.
+        /// @param last Set for the last chunk of the stream.
+        /// @param out  The encrypted chunk, of len + kChunkExpansion bytes.
+        ///
+        /// @exception std::invalid_argument    out is NULL, in is NULL and
+        ///                                     len is not 0, or len is
+        ///                                     invalid
+        /// @exception std::runtime_error       The stream is finalized
+        ///
+        void push(const uint8_t* in,
+                  const size_t   len,
+                  const bool     last,
+                  uint8_t*       out);
+
+    private:
+        StreamEncryptor(Key<kKeySize>&&                               key,
+                        const std::array<uint8_t, kStreamHeaderSize>& header,
+                        const size_t chunk_size) noexcept;
+
+        Key<kKeySize>                          key_;
+        std::array<uint8_t, kStreamHeaderSize> header_;
+        size_t                                 chunk_size_;
+        uint64_t                               index_{0};
+        bool                                   finalized_{false};
+    };
+
+    /// @class StreamDecryptor
+    /// @brief Incremental and random-access decryption of a stream
+    ///
+    /// The chunks of a stream can be pulled in order, or decrypted
+    /// individually with decrypt_chunk(), without reading the rest of the
+    /// stream.
+    ///
+    class StreamDecryptor
+    {
+        friend class BasicCipher;
+
+    public:
+        /// @brief Move constructor
+        StreamDecryptor(StreamDecryptor&& s) noexcept = default;
+
+        /// @brief Move assignment operator
+        StreamDecryptor& operator=(StreamDecryptor&& s) noexcept = default;
+
+        /// @brief The size of the plaintext chunks
+        size_t chunk_size() const noexcept
+        {
+            return chunk_size_;
+        }
+
+        /// @brief Returns true once the last chunk has been pulled
+        bool finalized() const noexcept
+        {
+            return finalized_;
+        }
+
+        ///
+        /// @brief Decrypt the next chunk
+        ///
+        /// A stream is complete only once a chunk marked as the last one has
+        /// been pulled: a truncated stream never sets finalized().
+        ///
+        /// @param in   The encrypted chunk.
+        /// @param len  The size of the encrypted chunk.
+        /// @param out  The plaintext chunk, of len - kChunkExpansion bytes.
+        ///
+        /// @return true if the chunk is the last one of the stream.
+        ///
+        /// @exception std::invalid_argument    in or out is NULL, or len is
+        ///                                     invalid
+        /// @exception std::runtime_error       The stream is finalized, or
+        ///                                     the decryption failed
+        ///
+        bool pull(const uint8_t* in, const size_t len, uint8_t* out);
+
+        ///
+        /// @brief Number of chunks of a stream
+        ///
+        /// @param stream_len   The length of the stream, header included.
+        ///
+        /// @exception std::invalid_argument    stream_len is not the length
+        ///                                     of a stream with this chunk
+        ///                                     size
+        ///
+        uint64_t chunk_count(const size_t stream_len) const;
+
+        ///
+        /// @brief Offset of an encrypted chunk in a stream
+        ///
+        /// @param index    The index of the chunk.
+        ///
+        /// @return The offset, from the beginning of the stream (header
+        ///         included), of the index-th encrypted chunk.
+        ///
+        size_t chunk_offset(const uint64_t index) const noexcept
+        {
+            return kStreamHeaderSize
+                   + index * (chunk_size_ + kChunkExpansion);
+        }
+
+        ///
+        /// @brief Decrypt a single chunk
+        ///
+        /// Does not depend on, nor modify, the state of pull().
+        ///
+        /// @param index    The index of the chunk.
+        /// @param in       The encrypted chunk.
+        /// @param len      The size of the encrypted chunk.
+        /// @param last     Set if the chunk is the last one of the stream
+        ///                 (see chunk_count()).
+        /// @param out      The plaintext chunk, of len - kChunkExpansion
+        ///                 bytes.
+        ///
+        /// @exception std::invalid_argument    in or out is NULL, or len is
+        ///                                     invalid
+        /// @exception std::runtime_error       The decryption failed
+        ///
+        void decrypt_chunk(const uint64_t index,
+                           const uint8_t* in,
+                           const size_t   len,
+                           const bool     last,
+                           uint8_t*       out) const;
+
+    private:
+        StreamDecryptor(Key<kKeySize>&&                               key,
+                        const std::array<uint8_t, kStreamHeaderSize>& header,
+                        const size_t chunk_size) noexcept;
+
+        Key<kKeySize>                          key_;
+        std::array<uint8_t, kStreamHeaderSize> header_;
+        size_t                                 chunk_size_;
+        uint64_t                               index_{0};
+        bool                                   finalized_{false};
+    };
+
+    ///
+    /// @brief Start the encryption of a stream
+    ///
+    /// @param chunk_size   The size of the plaintext chunks, between 1 and
+    ///                     kMaxChunkSize.
+    ///
+    /// @exception std::invalid_argument    chunk_size is invalid
+    ///
+    StreamEncryptor stream_encryptor(
+        const size_t chunk_size = kDefaultChunkSize) const;
+
+    ///
+    /// @brief Start the decryption of a stream
+    ///
+    /// @param header   The header of the stream, of kStreamHeaderSize bytes.
+    ///
+    /// @exception std::invalid_argument    header is NULL, or is not a valid
+    ///                                     stream header
+    ///
+    StreamDecryptor stream_decryptor(const uint8_t* header) const;
+
+    ///
+    /// @brief Encrypt a file as a stream
+    ///
+    /// The file is read and encrypted chunk by chunk: the memory usage does
+    /// not depend on the size of the file.
+    ///
+    /// @param in_path      The path of the plaintext file.
+    /// @param out_path     The path of the encrypted file. It is created or
+    ///                     truncated.
+    /// @param chunk_size   The size of the plaintext chunks.
+    ///
+    /// @exception std::invalid_argument    chunk_size is invalid
+    /// @exception std::system_error        A file cannot be opened, read or
+    ///                                     written
+    ///
+    void encrypt_file(const std::string& in_path,
+                      const std::string& out_path,
+                      const size_t       chunk_size = kDefaultChunkSize) const;
+
+    ///
+    /// @brief Decrypt a file encrypted with encrypt_file
+    ///
+    /// The encrypted file is mapped in memory and decrypted chunk by chunk.
+    /// If a chunk fails to decrypt, or if the file is truncated, the output
+    /// file is removed.
+    ///
+    /// @param in_path      The path of the encrypted file.
+    /// @param out_path     The path of the plaintext file. It is created or
+    ///                     truncated.
+    ///
+    /// @exception std::invalid_argument    The file is not a valid stream
+    /// @exception std::runtime_error       The decryption failed
+    /// @exception std::system_error        A file cannot be opened, mapped
+    ///                                     or written
+    ///
+    void decrypt_file(const std::string& in_path,
+                      const std::string& out_path) const;
+
+    ///
+    /// @brief Decrypt a single chunk of a file encrypted with encrypt_file
+    ///
+    /// Only the header and the requested chunk are read from the file.
+    ///
+    /// @param path     The path of the encrypted file.
+    /// @param index    The index of the chunk.
+    /// @param out      The plaintext chunk.
+    ///
+    /// @exception std::out_of_range        index is larger than the number of
+    ///                                     chunks
+    /// @exception std::invalid_argument    The file is not a valid stream
+    /// @exception std::runtime_error       The decryption failed
+    /// @exception std::system_error        The file cannot be opened or read
+    ///
+    void decrypt_file_chunk(const std::string& path,
+                            const uint64_t     index,
+                            std::string&       out) const;
+
 private:
     void encrypt(const unsigned char* in,
                  const size_t&        len,
@@ -237,12 +711,37 @@ private:
     ///
     /// @exception  std::invalid_argument   The size of the in buffer (in_size)
     ///                                     is smaller than kKeySize
-    static Cipher deserialize(uint8_t*     in,
-                              const size_t in_size,
-                              size_t&      n_bytes_read);
+    static BasicCipher deserialize(uint8_t*     in,
+                                   const size_t in_size,
+                                   size_t&      n_bytes_read);
 
     Key<kKeySize> key_;
 };
 
+template<class Policy>
+constexpr uint8_t BasicCipher<Policy>::kKeySize;
+template<class Policy>
+constexpr size_t BasicCipher<Policy>::kCiphertextExpansion;
+template<class Policy>
+constexpr size_t BasicCipher<Policy>::kPublicContextSize;
+template<class Policy>
+constexpr size_t BasicCipher<Policy>::kStreamHeaderSize;
+template<class Policy>
+constexpr size_t BasicCipher<Policy>::kChunkExpansion;
+template<class Policy>
+constexpr size_t BasicCipher<Policy>::kDefaultChunkSize;
+template<class Policy>
+constexpr size_t BasicCipher<Policy>::kMaxChunkSize;
+
+// The policies are instantiated in cipher.cpp
+extern template class BasicCipher<DerivedKeyCipherPolicy>;
+extern template class BasicCipher<XChaCha20CipherPolicy>;
+
+/// @brief Encryption with ChaCha20+Poly1305 and nonce-derived keys
+using Cipher = BasicCipher<DerivedKeyCipherPolicy>;
+
+/// @brief Encryption with XChaCha20+Poly1305
+using XChaCha20Cipher = BasicCipher<XChaCha20CipherPolicy>;
+
 } // namespace crypto
 } // namespace sse
@@ -0,0 +1,169 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <stdexcept>
+
+#include <sodium/utils.h>
+
+namespace sse {
+namespace crypto {
+
+// forward declarations
+class Prg;
+
+template<uint16_t NBYTES>
+class RCPrfBase;
+template<uint16_t NBYTES>
+class ConstrainedRCPrf;
+
+void test_ephemeral_keys();
+
+/// @class EphemeralKey
+/// @brief A short-lived key stored in place.
+///
+/// Unlike Key<N>, which allocates guarded (and possibly mprotect'ed) memory,
+/// an EphemeralKey<N> stores its content in an aligned buffer inside the
+/// object itself, typically on the stack. Creating and destroying an
+/// EphemeralKey hence costs neither an allocation nor a system call. The
+/// content is zeroized when the key is destroyed, erased or moved from.
+///
+/// EphemeralKey is meant for the intermediate keys of derivation chains (e.g.
+/// the GGM tree walks of RCPrf) that never leave the function computing them.
+/// As its memory is neither locked nor protected, it must not be used to store
+/// long-term keys: use Key<N> instead. Like Key<N>, its content can only be
+/// accessed by the cryptographic toolkit.
+///
+/// @tparam N       Byte length of the key
+///
+template<size_t N>
+class EphemeralKey
+{
+    friend class Prg;
+
+    template<uint16_t NBYTES>
+    friend class RCPrfBase;
+    template<uint16_t NBYTES>
+    friend class ConstrainedRCPrf;
+
+    friend void test_ephemeral_keys();
+
+public:
+    static_assert(N > 0, "Empty ephemeral keys are not supported");
+
+    ///
+    /// @brief Constructor
+    ///
+    /// Creates a zero-filled key.
+    ///
+    EphemeralKey() noexcept
+    {
+        memset(content_, 0, N);
+    }
+
+    ///
+    /// @brief Constructor
+    ///
+    /// Initializes the key with the byte array given as argument.
+    /// The argument is set to zero.
+    ///
+    /// @param key    The input byte array. When the constructor returns,
+    /// key is set to 0.
+    ///
+    /// @exception std::invalid_argument    The input argument is nullptr.
+    ///
+    explicit EphemeralKey(uint8_t* const key)
+    {
+        if (key == nullptr) {
+            throw std::invalid_argument("Invalid key: key == nullptr");
+        }
+        memcpy(content_, key, N);
+        sodium_memzero(key, N);
+    }
+
+    EphemeralKey(const EphemeralKey<N>&) = delete;
+    EphemeralKey& operator=(const EphemeralKey<N>&) = delete;
+
+    ///
+    /// @brief Move constructor
+    ///
+    /// @param k    The moved key. Upon return, its content is zeroized.
+    ///
+    EphemeralKey(EphemeralKey<N>&& k) noexcept
+    {
+        memcpy(content_, k.content_, N);
+        k.erase();
+    }
+
+    ///
+    /// @brief Move assignment operator
+    ///
+    /// @param k    The moved key. Upon return, its content is zeroized.
+    ///
+    EphemeralKey& operator=(EphemeralKey<N>&& k) noexcept
+    {
+        if (this != &k) {
+            memcpy(content_, k.content_, N);
+            k.erase();
+        }
+        return *this;
+    }
+
+    ///
+    /// @brief Destructor
+    ///
+    /// Zeroizes the content of the key.
+    ///
+    ~EphemeralKey()
+    {
+        erase();
+    }
+
+    ///
+    /// @brief Erase the key
+    ///
+    /// Sets the key content to zero.
+    ///
+    void erase() noexcept
+    {
+        sodium_memzero(content_, N);
+    }
+
+private:
+    const uint8_t* data() const noexcept
+    {
+        return content_;
+    }
+
+    uint8_t* data() noexcept
+    {
+        return content_;
+    }
+
+    /// @brief Key content
+    alignas(16) uint8_t content_[N];
+};
+
+} // namespace crypto
+} // namespace sse
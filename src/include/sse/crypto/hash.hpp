@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <sse/crypto/parallel.hpp>
+
 #include <cstddef>
 
 #include <string>
@@ -29,23 +31,185 @@ namespace sse {
 
 namespace crypto {
 
-/// @class Hash
+/// @brief Hash backend: BLAKE2b (RFC 7693)
+///
+/// The compression function runs on AVX2 or AVX-512 when the CPU supports
+/// them: the fastest implementation is selected at runtime.
+///
+struct Blake2bBackend
+{
+    /// @brief Size of the blocks of the hash function (in bytes)
+    constexpr static size_t kBlockSize = 128;
+    /// @brief Size of the state of an incremental hash (in bytes)
+    constexpr static size_t kStateSize = 216;
+};
+
+/// @brief Hash backend: SHA-512 (FIPS 180-4)
+///
+/// Batches of messages (see BasicHash::update_final_many()) are hashed 4 at a
+/// time with AVX2 when the CPU supports it.
+///
+struct Sha512Backend
+{
+    /// @brief Size of the blocks of the hash function (in bytes)
+    constexpr static size_t kBlockSize = 128;
+    /// @brief Size of the state of an incremental hash (in bytes)
+    constexpr static size_t kStateSize = 208;
+};
+
+/// @brief Hash backend: BLAKE3, truncated to 64 bytes of output
+///
+/// Portable implementation. Its incremental state holds the chaining values of
+/// the tree of chunks, and is much larger than the ones of the other backends.
+///
+struct Blake3Backend
+{
+    /// @brief Size of the blocks of the hash function (in bytes)
+    constexpr static size_t kBlockSize = 64;
+    /// @brief Size of the state of an incremental hash (in bytes)
+    constexpr static size_t kStateSize = 1856;
+};
+
+#define SSE_CRYPTO_HASH_IMPL_BLAKE2B 1
+#define SSE_CRYPTO_HASH_IMPL_SHA512 2
+#define SSE_CRYPTO_HASH_IMPL_BLAKE3 3
+
+/*
+ * The default hash function (the one of Hash) is BLAKE2b.
+ * To use another one, pass the option
+ * -DSSE_CRYPTO_HASH_IMPL=SSE_CRYPTO_HASH_IMPL_SHA512 (or
+ * SSE_CRYPTO_HASH_IMPL_BLAKE3) to the compiler. This is done by the
+ * SSE_CRYPTO_HASH CMake option.
+ */
+#if !defined(SSE_CRYPTO_HASH_IMPL)
+#define SSE_CRYPTO_HASH_IMPL SSE_CRYPTO_HASH_IMPL_BLAKE2B
+#endif
+
+#if (SSE_CRYPTO_HASH_IMPL == SSE_CRYPTO_HASH_IMPL_SHA512)
+using DefaultHashBackend = Sha512Backend;
+#elif (SSE_CRYPTO_HASH_IMPL == SSE_CRYPTO_HASH_IMPL_BLAKE3)
+using DefaultHashBackend = Blake3Backend;
+#elif (SSE_CRYPTO_HASH_IMPL == SSE_CRYPTO_HASH_IMPL_BLAKE2B)
+using DefaultHashBackend = Blake2bBackend;
+#else
+#error("No valid hash implementation defined")
+#endif
+
+/// @class BasicHash
 /// @brief Cryptographic hashing
 ///
-/// Hash is an opaque class for cryptographic hashing.
-/// The hash function used is Blake2b.
+/// BasicHash is an opaque class for cryptographic hashing, with the hash
+/// function given by the Backend template parameter: Blake2bBackend,
+/// Sha512Backend or Blake3Backend. It is instantiated in the library for these
+/// three backends. Use the Hash alias for the default backend.
+///
 /// Digests are 512 bits (64 bytes) large, which ensures a 2^256 bits security
 /// against collisions (and more against pre-image and second pre-image
 /// attacks).
 ///
+/// As HMac is templated by the hash function, BasicHash can be used to
+/// instantiate HMac (and the Prf, see BasicHMacPrfPolicy) with any of the
+/// backends.
+///
+/// @tparam Backend The hash function
+///
 
-class Hash
+template<class Backend>
+class BasicHash
 {
 public:
     /// @brief Digest size (in bytes)
     constexpr static size_t kDigestSize = 64;
     /// @brief Size of the blocks in the hash function (in bytes)
-    constexpr static size_t kBlockSize = 128;
+    constexpr static size_t kBlockSize = Backend::kBlockSize;
+    /// @brief Size of the state of an incremental hash (in bytes)
+    constexpr static size_t kStateSize = Backend::kStateSize;
+
+    /// @brief Opaque state of an incremental hash computation
+    struct state_type
+    {
+        alignas(8) unsigned char opaque[kStateSize];
+    };
+
+    ///
+    /// @class State
+    /// @brief Streaming hash computation
+    ///
+    /// RAII wrapper around the incremental interface: the input is given piece
+    /// by piece to update(), and the digest is computed by final(). A State
+    /// can be copied, to hash several inputs sharing the same prefix. The
+    /// digest is the same as the one of hash() on the concatenation of the
+    /// pieces. The hash state is erased upon destruction.
+    ///
+    class State
+    {
+    public:
+        /// @brief Constructor: starts a new hash computation
+        State() noexcept;
+
+        /// @brief Copy constructor
+        State(const State& state) = default;
+
+        /// @brief Copy assignment operator
+        State& operator=(const State& state) = default;
+
+        ///
+        /// @brief Destructor
+        ///
+        /// Erases the hash state.
+        ///
+        ~State();
+
+        ///
+        /// @brief Absorb a piece of the input
+        ///
+        /// @param in       The input buffer. Can only be NULL if len is 0.
+        /// @param len      The size of the input buffer in bytes.
+        ///
+        /// @exception std::invalid_argument    in is NULL and len is not 0
+        /// @exception std::runtime_error       The state has already been
+        ///                                     finalized
+        ///
+        void update(const unsigned char* in, const size_t len);
+
+        ///
+        /// @brief Absorb a piece of the input
+        ///
+        /// @param in       The input string.
+        ///
+        /// @exception std::runtime_error       The state has already been
+        ///                                     finalized
+        ///
+        void update(const std::string& in);
+
+        ///
+        /// @brief Compute the digest of the absorbed input
+        ///
+        /// Places the digest, truncated to out_len bytes, in the output
+        /// buffer. The state cannot be used anymore.
+        ///
+        /// @param out      The output buffer. Must be non NULL, and larger
+        ///                 than out_len bytes.
+        /// @param out_len  The size of the output buffer in bytes. Must be
+        ///                 smaller than kDigestSize.
+        ///
+        /// @exception std::invalid_argument    out is NULL
+        /// @exception std::invalid_argument    out_len is larger than
+        ///                                     kDigestSize
+        /// @exception std::runtime_error       The state has already been
+        ///                                     finalized
+        ///
+        void final(unsigned char* out, const size_t out_len = kDigestSize);
+
+    private:
+        /// @brief The incremental hash state
+        state_type state_;
+        /// @brief Set when final() has been called
+        bool finalized_;
+    };
+
+    /// @brief Size (in bytes) of the leaves of the tree hashing mode
+    constexpr static size_t kTreeLeafSize = 1 << 20;
 
     ///
     /// @brief Hash a buffer
@@ -142,7 +306,171 @@ public:
     /// kDigestSize
     ///
     static std::string hash(const std::string& in, const size_t out_len);
+
+    ///
+    /// @brief Initialize an incremental hash
+    ///
+    /// The incremental interface computes the same digests as hash(), but the
+    /// input can be given piece by piece, using update(), and the digest is
+    /// computed by final(). A state can be copied, to hash several inputs
+    /// sharing the same prefix.
+    ///
+    /// @param state    The state to initialize.
+    ///
+    static void init(state_type& state) noexcept;
+
+    ///
+    /// @brief Absorb a buffer in an incremental hash
+    ///
+    /// @param state    The state of the incremental hash.
+    /// @param in       The input buffer. Can only be NULL if len is 0.
+    /// @param len      The size of the input buffer in bytes.
+    ///
+    /// @exception std::invalid_argument       in is NULL and len is not 0
+    ///
+    static void update(state_type&          state,
+                       const unsigned char* in,
+                       const size_t         len);
+
+    ///
+    /// @brief Absorb a full block in an incremental hash
+    ///
+    /// Same as update(state, block, kBlockSize), but the block is processed
+    /// right away. This is only valid when the number of bytes absorbed so far
+    /// is a multiple of kBlockSize, and when at least one more byte will be
+    /// absorbed before the call to final(). It is used by HMac to precompute
+    /// the states after the key pads.
+    ///
+    /// @param state    The state of the incremental hash.
+    /// @param block    The input block, kBlockSize bytes long. Must be non
+    ///                 NULL.
+    ///
+    /// @exception std::invalid_argument       block is NULL
+    ///
+    static void absorb_block(state_type& state, const unsigned char* block);
+
+    ///
+    /// @brief Finalize an incremental hash
+    ///
+    /// Writes the digest of the absorbed bytes in the output buffer. The state
+    /// is erased, and must be initialized again before being reused.
+    ///
+    /// @param state    The state of the incremental hash.
+    /// @param out      The output buffer. Must be non NULL, and larger than
+    ///                 kDigestSize bytes.
+    ///
+    /// @exception std::invalid_argument       out is NULL
+    ///
+    static void final(state_type& state, unsigned char* out);
+
+    ///
+    /// @brief Finalize several incremental hashes sharing a common prefix
+    ///
+    /// For each i < n, absorbs the lens[i] bytes of ins[i] in a copy of state,
+    /// and writes the digest to outs[i]. The result is the same as calling
+    /// update() and final() on copies of the state, but the messages are
+    /// hashed in parallel, using multi-buffer SIMD kernels when the CPU
+    /// supports them. It is used by HMac to evaluate the MAC of a batch of
+    /// messages.
+    ///
+    /// The SIMD kernels are only used when the bytes absorbed in state fill
+    /// whole blocks (e.g. when they were absorbed with absorb_block()).
+    /// Otherwise, the messages are hashed one after the other. The state is
+    /// not modified.
+    ///
+    /// @param state    The common state of the incremental hashes.
+    /// @param ins      The n input buffers. Must be non NULL.
+    /// @param lens     The n sizes of the input buffers in bytes. Must all be
+    ///                 strictly larger than 0.
+    /// @param outs     The n output buffers. Must be non NULL, and larger
+    ///                 than kDigestSize bytes.
+    /// @param n        The number of messages.
+    ///
+    /// @exception std::invalid_argument       One of ins, lens, outs, or one
+    ///                                        of the buffers is NULL
+    /// @exception std::invalid_argument       One of the messages is empty
+    ///
+    static void update_final_many(const state_type&           state,
+                                  const unsigned char* const* ins,
+                                  const size_t*               lens,
+                                  unsigned char* const*       outs,
+                                  const size_t                n);
+
+    ///
+    /// @brief Hash a buffer in tree mode
+    ///
+    /// Splits the input in leaves of kTreeLeafSize bytes (the last one can be
+    /// shorter, and an empty input is made of a single empty leaf), hashes
+    /// the leaves independently, and hashes the concatenation of the leaves'
+    /// digests in a root node. The leaves are hashed as independent tasks of
+    /// the executor, so that large inputs are hashed by all the cores.
+    ///
+    /// The nodes are hashed with BLAKE2b, whatever the hash function selected
+    /// at build time, using the tree parameters of the BLAKE2 parameter block
+    /// (unlimited fanout, depth 2, kTreeLeafSize bytes leaves, 64 bytes inner
+    /// digests, the node offset and depth of each node, and the last node
+    /// flag for the last leaf and the root). The digest hence differs from the
+    /// one of hash() on the same input, but does not depend on the executor or
+    /// on the number of threads.
+    ///
+    /// @param in       The input buffer. Can only be NULL if len is 0.
+    /// @param len      The size of the input buffer in bytes.
+    /// @param out      The output buffer. Must be non NULL, and larger than
+    ///                 kDigestSize bytes.
+    /// @param executor The executor hashing the leaves (see
+    ///                 thread_executor()).
+    ///
+    /// @exception std::invalid_argument       in is NULL and len is not 0
+    /// @exception std::invalid_argument       out is NULL
+    ///
+    static void tree_hash(const unsigned char* in,
+                          const size_t         len,
+                          unsigned char*       out,
+                          const Executor&      executor = thread_executor());
+
+    ///
+    /// @brief Hash a file in tree mode
+    ///
+    /// Computes the same digest as tree_hash() on the content of the file.
+    /// The file is memory-mapped: it is never copied in memory, and the pages
+    /// are read by the threads hashing them.
+    ///
+    /// @param path     The path of the file.
+    /// @param out      The output buffer. Must be non NULL, and larger than
+    ///                 kDigestSize bytes.
+    /// @param executor The executor hashing the leaves (see
+    ///                 thread_executor()).
+    ///
+    /// @exception std::invalid_argument       out is NULL
+    /// @exception std::system_error           The file cannot be opened or
+    ///                                        mapped in memory
+    ///
+    static void tree_hash_file(const std::string& path,
+                               unsigned char*     out,
+                               const Executor&    executor = thread_executor());
 };
 
+template<class Backend>
+constexpr size_t BasicHash<Backend>::kDigestSize;
+template<class Backend>
+constexpr size_t BasicHash<Backend>::kBlockSize;
+template<class Backend>
+constexpr size_t BasicHash<Backend>::kStateSize;
+template<class Backend>
+constexpr size_t BasicHash<Backend>::kTreeLeafSize;
+
+// The backends are instantiated in hash.cpp
+extern template class BasicHash<Blake2bBackend>;
+extern template class BasicHash<Sha512Backend>;
+extern template class BasicHash<Blake3Backend>;
+
+/// @brief Cryptographic hashing, with the hash function selected when building
+///        the library (BLAKE2b by default).
+///
+/// See BasicHash. The backend is selected with the SSE_CRYPTO_HASH CMake
+/// option.
+///
+using Hash = BasicHash<DefaultHashBackend>;
+
 } // namespace crypto
 } // namespace sse
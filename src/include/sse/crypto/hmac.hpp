@@ -30,6 +30,7 @@
 #include <array>
 #include <iomanip>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 
 #include <sodium/utils.h>
@@ -40,7 +41,7 @@ namespace sse {
 namespace crypto {
 
 // forward declare the Prf class so we can use is as a friend
-template<uint16_t NBYTES>
+template<uint16_t NBYTES, class Policy>
 class Prf;
 
 
@@ -51,6 +52,16 @@ class Prf;
 /// defined by Bellare, Canetti, and Krawczyk (cf. RFC 2104). The class can is
 /// templated with the underlying hash function, and the key size.
 ///
+/// The states of the hash function after the absorption of the inner and outer
+/// key pads are computed once, when the object is created, and kept in locked
+/// memory. An evaluation only clones these states and absorbs the message and
+/// the inner digest: for short messages, it runs half as many compression
+/// functions as the textbook construction, and does not allocate memory.
+///
+/// The hash function H must provide, on top of the one-shot hash() function,
+/// an incremental interface: a state_type, and the init(), update(),
+/// absorb_block() and final() functions (see Hash).
+///
 /// @tparam H   Hash function used to compute HMAC
 /// @tparam N   Key size (in bytes)
 ///
@@ -58,7 +69,7 @@ class Prf;
 template<class H, uint16_t N>
 class HMac
 {
-    template<uint16_t NBYTES>
+    template<uint16_t NBYTES, class Policy>
     friend class Prf;
 
 public:
@@ -81,12 +92,94 @@ public:
     /// @brief Digest (out) size (in bytes) of the H-HMac instantiation
     static constexpr uint8_t kDigestSize = H::kDigestSize;
 
+    static_assert(kDigestSize <= kHMACKeySize,
+                  "The hash digest is larger than the hash block.");
+
+    /// @brief Incremental state of the hash function
+    using hash_state_type = typename H::state_type;
+
+    ///
+    /// @class State
+    /// @brief Incremental evaluation of HMac
+    ///
+    /// A State is created by HMac::init(). The message is then given piece by
+    /// piece to update(), and the MAC is computed by final(). A State can be
+    /// copied, to evaluate HMac on several messages sharing the same prefix.
+    ///
+    /// A State points to the HMac object that created it: this object must
+    /// outlive the state, and must not be moved.
+    ///
+    class State
+    {
+        friend class HMac;
+
+    public:
+        /// @brief Copy constructor
+        State(const State& s) = default;
+
+        /// @brief Copy assignment operator
+        State& operator=(const State& s) = default;
+
+        ///
+        /// @brief Destructor
+        ///
+        /// Erases the hash state.
+        ///
+        ~State()
+        {
+            sodium_memzero(&inner_, sizeof(inner_));
+        }
+
+        ///
+        /// @brief Absorb a piece of the message
+        ///
+        /// @param in       The input buffer. Can only be NULL if length is 0.
+        /// @param length   The size of the input buffer in bytes.
+        ///
+        /// @exception std::invalid_argument    in is NULL and length is not 0
+        /// @exception std::runtime_error       The state has already been
+        ///                                     finalized
+        ///
+        void update(const unsigned char* in, const size_t length);
+
+        ///
+        /// @brief Compute the MAC of the absorbed message
+        ///
+        /// Places the MAC of the absorbed message in the output buffer (and
+        /// truncates it if necessary). The state cannot be used anymore.
+        ///
+        /// @param out      The output buffer. Must be non NULL, and larger
+        ///                 than out_len bytes.
+        /// @param out_len  The size of the output buffer in bytes. Must be
+        ///                 smaller than kDigestSize.
+        ///
+        /// @exception std::invalid_argument    out is NULL
+        /// @exception std::invalid_argument    out_len is larger than
+        ///                                     kDigestSize
+        /// @exception std::runtime_error       The state has already been
+        ///                                     finalized
+        ///
+        void final(unsigned char* out, const size_t out_len = kDigestSize);
+
+    private:
+        explicit State(const HMac<H, N>& hmac);
+
+        /// @brief The HMac object holding the outer state
+        const HMac<H, N>* hmac_;
+        /// @brief The inner hash state, after the inner pad
+        hash_state_type inner_;
+        /// @brief Set when at least one byte of the message was absorbed
+        bool absorbed_;
+        /// @brief Set when final() has been called
+        bool finalized_;
+    };
+
     ///
     /// @brief Constructor
     ///
     /// Creates a HMac object with a new randomly generated key.
     ///
-    HMac() : key_()
+    HMac() : key_(), pads_(compute_pads(key_))
     {
     }
 
@@ -102,11 +195,11 @@ public:
     /// @param key  The key used to initialize HMAC.
     ///             Upon return, k is empty
     ///
-    explicit HMac(Key<kKeySize>&& key) : key_(std::move(key))
+    /// @exception std::invalid_argument    The key is empty.
+    ///
+    explicit HMac(Key<kKeySize>&& key)
+        : key_(std::move(key)), pads_(compute_pads(key_))
     {
-        if (key_.is_empty()) {
-            throw std::invalid_argument("Invalid key: key is empty");
-        }
     }
 
     // deleted copy assignement operator
@@ -169,12 +262,191 @@ public:
     ///
     std::array<uint8_t, H::kDigestSize> hmac(const std::string& s) const;
 
+    ///
+    /// @brief Evaluate HMac on several messages
+    ///
+    /// For each i < count, evaluates HMac on the lens[i] bytes of ins[i], and
+    /// places the result, truncated to out_len bytes, at out + i * out_len.
+    /// The result is the same as calling hmac() on every message, but the
+    /// inner and outer hashes of the messages are computed in parallel (see
+    /// H::update_final_many()), and the key is only unlocked once.
+    ///
+    /// @param ins      The count input buffers. Must be non NULL.
+    /// @param lens     The count sizes of the input buffers in bytes.
+    /// @param count    The number of messages.
+    /// @param out      The output buffer. Must be non NULL, and larger than
+    ///                 count * out_len bytes.
+    /// @param out_len  The size of each output in bytes. Must be smaller than
+    ///                 kDigestSize.
+    ///
+    /// @exception std::invalid_argument       One of ins, lens, out, or one of
+    ///                                        the input buffers is NULL
+    /// @exception std::invalid_argument       out_len is larger than
+    ///                                        kDigestSize
+    ///
+    void hmac_batch(const unsigned char* const* ins,
+                    const size_t*               lens,
+                    const size_t                count,
+                    unsigned char*              out,
+                    const size_t                out_len = kDigestSize) const;
+
+    ///
+    /// @brief Start an incremental evaluation of HMac
+    ///
+    /// Returns a state in which the message can be absorbed piece by piece.
+    /// The result of State::final() is the same as the one of hmac() on the
+    /// concatenation of the pieces.
+    ///
+    /// @return     A new incremental state.
+    ///
+    State init() const;
+
+private:
+    /// @brief Size (in bytes) of the incremental hash state
+    static constexpr size_t kHashStateSize = sizeof(hash_state_type);
+
+    /// @brief Offset of the state after the inner pad in the pads
+    static constexpr size_t kInnerStateOffset = 0;
+    /// @brief Offset of the state after the outer pad in the pads
+    static constexpr size_t kOuterStateOffset = kHashStateSize;
+    /// @brief Offset of the inner digest of the empty message in the pads
+    static constexpr size_t kEmptyDigestOffset = 2 * kHashStateSize;
+    /// @brief Size (in bytes) of the precomputed pads
+    static constexpr size_t kPadsSize = kEmptyDigestOffset + kDigestSize;
+
+    /// @brief Number of messages processed at once by hmac_batch()
+    static constexpr size_t kBatchSize = 16;
+
+public:
+    /// @brief RAII unlock session type of the HMac precomputed key material
+    using UnlockSession = typename Key<kPadsSize>::UnlockSession;
+
+    ///
+    /// @brief Opens an unlock session on the HMac key
+    ///
+    /// As long as the returned session is alive, the key is not locked again
+    /// after each evaluation, saving two system calls per call when memory
+    /// locking is enabled. See Key::UnlockSession.
+    ///
+    /// @exception std::runtime_error The key cannot be unlocked.
+    ///
+    UnlockSession unlock_session() const
+    {
+        return pads_.unlock_session();
+    }
+
 private:
+    ///
+    /// @brief Precompute the hash states after the key pads
+    ///
+    /// Returns, in locked memory, the state of the hash function after the
+    /// absorption of the inner pad (key ^ 0x36...), the state after the outer
+    /// pad (key ^ 0x5c...), and the inner digest of the empty message. The
+    /// inner state can only be used for non-empty messages: the pad is
+    /// absorbed with H::absorb_block().
+    ///
+    /// Keys larger than the hash block are hashed first, as specified by RFC
+    /// 2104.
+    ///
+    /// @exception std::invalid_argument    The key is empty.
+    ///
+    static Key<kPadsSize> compute_pads(const Key<kKeySize>& key);
+
+    /// @brief Finalize the inner hash and compute the MAC
+    void finalize(hash_state_type* inner,
+                  unsigned char*   out,
+                  const size_t     out_len) const;
+
+    /// @brief The HMac key (kept for serialization)
     Key<kKeySize> key_;
+    /// @brief The precomputed pad states
+    Key<kPadsSize> pads_;
 };
 
 
 // HMac instantiation
+template<class H, uint16_t N>
+Key<HMac<H, N>::kPadsSize> HMac<H, N>::compute_pads(const Key<kKeySize>& key)
+{
+    if (key.is_empty()) {
+        throw std::invalid_argument("Invalid key: key is empty");
+    }
+
+    auto callback = [&key](uint8_t* pads) {
+        uint8_t         block[kHMACKeySize];
+        hash_state_type state;
+        size_t          key_len = kKeySize;
+
+        const uint8_t* key_data = key.unlock_get();
+        if (kKeySize > kHMACKeySize) {
+            H::hash(key_data, kKeySize, block);
+            key_len = kDigestSize;
+        } else {
+            memcpy(block,
+                   key_data,
+                   (kKeySize < kHMACKeySize) ? kKeySize : kHMACKeySize);
+        }
+        key.lock();
+
+        // set the other bytes to 0x00
+        memset(block + key_len, 0x00, kHMACKeySize - key_len);
+
+        // xor the magic number for input
+        for (uint16_t i = 0; i < kHMACKeySize; ++i) {
+            block[i] ^= 0x36;
+        }
+        H::init(state);
+        H::absorb_block(state, block);
+        memcpy(pads + kInnerStateOffset, &state, kHashStateSize);
+
+        // the inner state cannot be finalized without absorbing more bytes
+        H::hash(block, kHMACKeySize, pads + kEmptyDigestOffset);
+
+        // xor the magic number for output (and remove the input's one)
+        for (uint16_t i = 0; i < kHMACKeySize; ++i) {
+            block[i] ^= 0x36 ^ 0x5c;
+        }
+        H::init(state);
+        H::absorb_block(state, block);
+        memcpy(pads + kOuterStateOffset, &state, kHashStateSize);
+
+        sodium_memzero(block, kHMACKeySize);
+        sodium_memzero(&state, kHashStateSize);
+    };
+
+    return Key<kPadsSize>(callback);
+}
+
+template<class H, uint16_t N>
+void HMac<H, N>::finalize(hash_state_type* inner,
+                          unsigned char*   out,
+                          const size_t     out_len) const
+{
+    hash_state_type outer;
+    uint8_t         digest[kDigestSize];
+
+    {
+        UnlockSession  session = unlock_session();
+        const uint8_t* pads    = pads_.data();
+        if (inner == nullptr) {
+            // empty message
+            memcpy(digest, pads + kEmptyDigestOffset, kDigestSize);
+        }
+        memcpy(&outer, pads + kOuterStateOffset, kHashStateSize);
+    }
+
+    if (inner != nullptr) {
+        H::final(*inner, digest);
+    }
+
+    H::update(outer, digest, kDigestSize);
+    H::final(outer, digest);
+
+    memcpy(out, digest, out_len);
+
+    sodium_memzero(digest, kDigestSize);
+}
+
 template<class H, uint16_t N>
 void HMac<H, N>::hmac(const unsigned char* in,
                       const size_t         length,
@@ -194,75 +466,166 @@ void HMac<H, N>::hmac(const unsigned char* in,
         throw std::invalid_argument("out is NULL");
     }
 
-    uint8_t*         buffer;
-    size_t           i_len      = kHMACKeySize + length;
-    constexpr size_t tmp_len    = kHMACKeySize + kDigestSize;
-    size_t           buffer_len = (i_len > kDigestSize) ? i_len : (kDigestSize);
-
-    buffer = new uint8_t[buffer_len];
-    uint8_t tmp[tmp_len];
-
-    key_.unlock();
+    if (length == 0) {
+        finalize(nullptr, out, out_len);
+        return;
+    }
 
-    // copy the key to the buffer
-    memcpy(buffer, key_.data(), kKeySize);
+    hash_state_type inner;
 
-    // set the other bytes to 0x00
-    if (kKeySize < kHMACKeySize) {
-        memset(buffer + kKeySize, 0x00, kHMACKeySize - kKeySize);
+    {
+        UnlockSession session = unlock_session();
+        memcpy(&inner, pads_.data() + kInnerStateOffset, kHashStateSize);
     }
 
-    // xor the magic number for input
-    for (uint16_t i = 0; i < kHMACKeySize; ++i) {
-        buffer[i] ^= 0x36;
-    }
+    H::update(inner, in, length);
+    finalize(&inner, out, out_len);
+}
 
-    memcpy(buffer + kHMACKeySize, in, length);
+template<class H, uint16_t N>
+std::array<uint8_t, H::kDigestSize> HMac<H, N>::hmac(const unsigned char* in,
+                                                     const size_t length) const
+{
+    std::array<uint8_t, kDigestSize> result;
 
-    H::hash(buffer, i_len, buffer);
+    hmac(in, length, result.data(), kDigestSize);
+    return result;
+}
 
-    // prepend the key
-    memcpy(tmp, key_.data(), kKeySize);
-    // set the other bytes to 0x00
-    if (kKeySize < kHMACKeySize) {
-        memset(tmp + kKeySize, 0x00, kHMACKeySize - kKeySize);
-    }
+// Convienience function to run HMac over a C++ string
+template<class H, uint16_t N>
+std::array<uint8_t, H::kDigestSize> HMac<H, N>::hmac(const std::string& s) const
+{
+    return hmac(reinterpret_cast<const unsigned char*>(s.data()), s.length());
+}
 
-    // xor the magic number for output
-    for (uint16_t i = 0; i < kHMACKeySize; ++i) {
-        tmp[i] ^= 0x5c;
+template<class H, uint16_t N>
+void HMac<H, N>::hmac_batch(const unsigned char* const* ins,
+                            const size_t*               lens,
+                            const size_t                count,
+                            unsigned char*              out,
+                            const size_t                out_len) const
+{
+    if (out_len > kDigestSize) {
+        throw std::invalid_argument(
+            "Invalid output length: out_len > kDigestSize");
+    }
+    if (count == 0) {
+        return;
+    }
+    if (ins == nullptr || lens == nullptr || out == nullptr) {
+        throw std::invalid_argument("ins, lens or out is NULL");
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (ins[i] == nullptr) {
+            throw std::invalid_argument("ins[i] is NULL");
+        }
     }
 
-    memcpy(tmp + kHMACKeySize, buffer, kDigestSize);
+    hash_state_type inner;
+    hash_state_type outer;
+    uint8_t         empty_digest[kDigestSize];
 
-    H::hash(tmp, kHMACKeySize + kDigestSize, buffer);
+    {
+        UnlockSession  session = unlock_session();
+        const uint8_t* pads    = pads_.data();
+        memcpy(&inner, pads + kInnerStateOffset, kHashStateSize);
+        memcpy(&outer, pads + kOuterStateOffset, kHashStateSize);
+        memcpy(empty_digest, pads + kEmptyDigestOffset, kDigestSize);
+    }
 
+    const unsigned char* lane_ins[kBatchSize];
+    size_t               lane_lens[kBatchSize];
+    unsigned char*       lane_outs[kBatchSize];
+    uint8_t              digests[kBatchSize][kDigestSize];
+    uint8_t              macs[kBatchSize][kDigestSize];
+
+    for (size_t first = 0; first < count; first += kBatchSize) {
+        const size_t n_items
+            = (count - first < kBatchSize) ? count - first : kBatchSize;
+
+        // inner hashes. The empty messages cannot be absorbed in the inner
+        // state: their digest is precomputed.
+        size_t n_lanes = 0;
+        for (size_t j = 0; j < n_items; j++) {
+            if (lens[first + j] == 0) {
+                memcpy(digests[j], empty_digest, kDigestSize);
+                continue;
+            }
+            lane_ins[n_lanes]  = ins[first + j];
+            lane_lens[n_lanes] = lens[first + j];
+            lane_outs[n_lanes] = digests[j];
+            n_lanes++;
+        }
+        H::update_final_many(inner, lane_ins, lane_lens, lane_outs, n_lanes);
 
-    memcpy(out, buffer, out_len);
+        // outer hashes
+        for (size_t j = 0; j < n_items; j++) {
+            lane_ins[j]  = digests[j];
+            lane_lens[j] = kDigestSize;
+            lane_outs[j] = macs[j];
+        }
+        H::update_final_many(outer, lane_ins, lane_lens, lane_outs, n_items);
 
-    sodium_memzero(buffer, buffer_len);
-    delete[] buffer;
+        for (size_t j = 0; j < n_items; j++) {
+            memcpy(out + (first + j) * out_len, macs[j], out_len);
+        }
+    }
 
-    sodium_memzero(tmp, tmp_len);
+    sodium_memzero(&inner, kHashStateSize);
+    sodium_memzero(&outer, kHashStateSize);
+    sodium_memzero(empty_digest, kDigestSize);
+    sodium_memzero(digests, sizeof(digests));
+    sodium_memzero(macs, sizeof(macs));
+}
 
-    key_.lock();
+template<class H, uint16_t N>
+typename HMac<H, N>::State HMac<H, N>::init() const
+{
+    return State(*this);
 }
 
 template<class H, uint16_t N>
-std::array<uint8_t, H::kDigestSize> HMac<H, N>::hmac(const unsigned char* in,
-                                                     const size_t length) const
+HMac<H, N>::State::State(const HMac<H, N>& hmac)
+    : hmac_(&hmac), absorbed_(false), finalized_(false)
 {
-    std::array<uint8_t, kDigestSize> result;
+    UnlockSession session = hmac.unlock_session();
+    memcpy(&inner_, hmac.pads_.data() + kInnerStateOffset, kHashStateSize);
+}
 
-    hmac(in, length, result.data(), kDigestSize);
-    return result;
+template<class H, uint16_t N>
+void HMac<H, N>::State::update(const unsigned char* in, const size_t length)
+{
+    if (finalized_) {
+        throw std::runtime_error("HMac::State: the state is finalized");
+    }
+    if (length == 0) {
+        return;
+    }
+    if (in == nullptr) {
+        throw std::invalid_argument("in is NULL");
+    }
+
+    H::update(inner_, in, length);
+    absorbed_ = true;
 }
 
-// Convienience function to run HMac over a C++ string
 template<class H, uint16_t N>
-std::array<uint8_t, H::kDigestSize> HMac<H, N>::hmac(const std::string& s) const
+void HMac<H, N>::State::final(unsigned char* out, const size_t out_len)
 {
-    return hmac(reinterpret_cast<const unsigned char*>(s.data()), s.length());
+    if (finalized_) {
+        throw std::runtime_error("HMac::State: the state is finalized");
+    }
+    if (out_len > kDigestSize) {
+        throw std::invalid_argument(
+            "Invalid output length: out_len > kDigestSize");
+    }
+    if (out == nullptr) {
+        throw std::invalid_argument("out is NULL");
+    }
+
+    hmac_->finalize(absorbed_ ? &inner_ : nullptr, out, out_len);
+    finalized_ = true;
 }
 
 } // namespace crypto
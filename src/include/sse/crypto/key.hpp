@@ -20,14 +20,17 @@
 
 #pragma once
 
+#include <sse/crypto/key_arena.hpp>
 #include <sse/crypto/random.hpp>
 
 #include <cerrno>
 #include <cstdint>
 #include <cstring>
 
+#include <atomic>
 #include <functional>
 #include <new>
+#include <thread>
 
 #include <sodium/utils.h>
 
@@ -49,11 +52,128 @@ namespace crypto {
 // forward declare some templates
 template<class Hash, uint16_t key_size>
 class HMac;
-template<uint16_t NBYTES>
+struct HMacPrfPolicy;
+template<uint16_t NBYTES, class Policy = HMacPrfPolicy>
 class Prf;
+template<uint16_t NBYTES>
+class KeyedBlake2b;
+template<class Policy>
+class BasicCipher;
 
 void test_keys();
 
+/// @class SessionCounter
+/// @brief Reference count of the unlock sessions opened on protected memory
+///
+/// The memory is unlocked by the opening of the first session, and locked
+/// again by the closing of the last one. These two transitions are flagged in
+/// the counter, so that concurrent openings and closings wait until the memory
+/// protection has been changed. Used by Key and by the seeds of
+/// ConstrainedRCPrf.
+///
+class SessionCounter
+{
+public:
+    SessionCounter() noexcept = default;
+
+    SessionCounter(const SessionCounter&) = delete;
+    SessionCounter& operator=(const SessionCounter&) = delete;
+
+    ///
+    /// @brief Checks if at least one session is open
+    ///
+    bool is_open() const noexcept
+    {
+        return count_.load(std::memory_order_acquire) != 0;
+    }
+
+    ///
+    /// @brief Forgets all the sessions
+    ///
+    /// Only meant for the moves of the objects owning the counter.
+    ///
+    void reset() noexcept
+    {
+        count_.store(0, std::memory_order_release);
+    }
+
+    ///
+    /// @brief Opens a session
+    ///
+    /// Increments the counter, and calls unlock() if no session was open.
+    ///
+    /// @param unlock   The callable unlocking the memory. If it throws, the
+    ///                 session is not opened.
+    ///
+    template<class Unlock>
+    void open(Unlock&& unlock)
+    {
+        uint32_t state = count_.load(std::memory_order_acquire);
+        while (true) {
+            if ((state & kTransition) != 0) {
+                std::this_thread::yield();
+                state = count_.load(std::memory_order_acquire);
+            } else if (state == 0) {
+                if (count_.compare_exchange_weak(
+                        state, kTransition, std::memory_order_acquire)) {
+                    try {
+                        unlock();
+                    } catch (...) {
+                        /* LCOV_EXCL_START */
+                        count_.store(0, std::memory_order_release);
+                        throw;
+                        /* LCOV_EXCL_STOP */
+                    }
+                    count_.store(1, std::memory_order_release);
+                    return;
+                }
+            } else if (count_.compare_exchange_weak(
+                           state, state + 1, std::memory_order_acquire)) {
+                return;
+            }
+        }
+    }
+
+    ///
+    /// @brief Closes a session
+    ///
+    /// Decrements the counter, and calls lock() when the last session is
+    /// closed.
+    ///
+    /// @param lock The callable locking the memory. If it throws, there is
+    ///             nothing sensible to do: the program terminates.
+    ///
+    template<class Lock>
+    void close(Lock&& lock) noexcept
+    {
+        uint32_t state = count_.load(std::memory_order_acquire);
+        while (true) {
+            if ((state & kTransition) != 0) {
+                std::this_thread::yield();
+                state = count_.load(std::memory_order_acquire);
+            } else if (state == 1) {
+                if (count_.compare_exchange_weak(
+                        state, kTransition, std::memory_order_acquire)) {
+                    lock();
+                    count_.store(0, std::memory_order_release);
+                    return;
+                }
+            } else if (count_.compare_exchange_weak(
+                           state, state - 1, std::memory_order_release)) {
+                return;
+            }
+        }
+    }
+
+private:
+    /// @brief Flag set in the counter while the memory is being
+    /// unlocked/locked by the opening of the first session/closing of the last
+    /// session
+    static constexpr uint32_t kTransition = 0x80000000;
+    /// @brief Number of open sessions
+    std::atomic<uint32_t> count_{0};
+};
+
 /// @class Key
 /// @brief A class for keys represented as byte strings.
 ///
@@ -63,12 +183,23 @@ void test_keys();
 ///
 /// The Key<N> template wraps a pointer to memory allocated with sodium_malloc.
 /// It in particular means that the key memory is protected with no-access pages
-/// and a canary.
+/// and a canary. When the ENABLE_KEY_ARENA flag is set, small keys are instead
+/// carved out of the slabs of the KeyArena, which offer the same protections
+/// at the slab level (see KeyArena).
 ///
 /// Keys can only be accessed through a handler, which can only be used by the
 /// cryptographic toolkit: the toolkit user is not meant to read or write the
 /// keys. Also, a key is not copyable, only movable.
 ///
+/// The const operations of the objects holding keys (Prf, Prg, Prp, Cipher,
+/// ...) only read their keys within an UnlockSession. As sessions are
+/// reference counted, these operations can be called concurrently on a shared
+/// object, without external synchronization: the key is unlocked by the first
+/// session and locked again by the last one. Keeping a session open on a
+/// shared object (e.g. for the lifetime of a pool of workers) removes the
+/// memory protection changes from the evaluations: they are then reduced to
+/// an atomic increment and decrement of the session counter.
+///
 /// @tparam N       Byte length of the key
 ///
 ///
@@ -81,11 +212,15 @@ class Key
 
     template<class Hash, uint16_t key_size>
     friend class HMac;
-    template<uint16_t NBYTES>
+    template<uint16_t NBYTES, class Policy>
     friend class Prf;
+    template<uint16_t NBYTES>
+    friend class KeyedBlake2b;
     friend class Prg;
     friend class Prp;
-    friend class Cipher;
+    friend class RangePrp;
+    template<class Policy>
+    friend class BasicCipher;
     friend class Wrapper;
 
     template<size_t K_SIZE>
@@ -106,23 +241,11 @@ public:
     ///
     Key()
     {
-        content_ = static_cast<uint8_t*>(sodium_malloc(N));
-
-        if (content_ == nullptr) {
-            throw std::bad_alloc(); /* LCOV_EXCL_LINE */
-        }
-#ifdef ENABLE_MEMORY_LOCK
+        allocate_content();
 
         random_bytes(N, content_);
-        int err = sodium_mprotect_noaccess(content_);
-        if (err == -1 && errno != ENOSYS) {
-            /* LCOV_EXCL_START */
-            throw std::runtime_error("Error when locking memory: "
-                                     + std::string(strerror(errno)));
-            /* LCOV_EXCL_STOP */
-        }
-        is_locked_ = true;
-#endif
+
+        seal_content();
     }
 
     ///
@@ -143,25 +266,12 @@ public:
         if (key == nullptr) {
             throw std::invalid_argument("Invalid key: key == nullptr");
         }
-        content_ = static_cast<uint8_t*>(sodium_malloc(N));
-
-        if (content_ == nullptr) {
-            throw std::bad_alloc(); /* LCOV_EXCL_LINE */
-        }
+        allocate_content();
 
         memcpy(content_, key, N); // copy the content of the input key
         sodium_memzero(key, N);   // erase the content of the input key
 
-#ifdef ENABLE_MEMORY_LOCK
-        int err = sodium_mprotect_noaccess(content_);
-        if (err == -1 && errno != ENOSYS) {
-            /* LCOV_EXCL_START */
-            throw std::runtime_error("Error when locking memory: "
-                                     + std::string(strerror(errno)));
-            /* LCOV_EXCL_STOP */
-        }
-        is_locked_ = true;
-#endif
+        seal_content();
     }
 
 
@@ -172,10 +282,13 @@ public:
     ///
     /// @param k    The moved key
     ///
+    /// Moving a key with open unlock sessions is not supported.
     ///
-    Key(Key<N>&& k) noexcept : content_(k.content_), is_locked_(k.is_locked_)
+    Key(Key<N>&& k) noexcept
+        : content_(k.content_), slab_(k.slab_), is_locked_(k.is_locked_)
     {
         k.content_   = nullptr;
+        k.slab_      = nullptr;
         k.is_locked_ = true;
     }
 
@@ -187,11 +300,7 @@ public:
     ///
     ~Key()
     {
-        if (content_ != nullptr) {
-            sodium_free(content_);
-            content_   = nullptr;
-            is_locked_ = true;
-        }
+        free_content();
     }
 
     ///
@@ -208,14 +317,15 @@ public:
     Key& operator=(Key<N>&& other) noexcept
     {
         if (this != &other) {
-            if (content_ != nullptr) {
-                sodium_free(content_);
-            }
+            free_content();
 
             content_   = other.content_;
+            slab_      = other.slab_;
             is_locked_ = other.is_locked_;
+            sessions_.reset();
 
             other.content_   = nullptr;
+            other.slab_      = nullptr;
             other.is_locked_ = true;
         }
         return *this;
@@ -233,11 +343,75 @@ public:
 
     void erase()
     {
-        if (content_ != nullptr) {
-            sodium_free(content_);
-            content_   = nullptr;
-            is_locked_ = true;
+        free_content();
+    }
+
+    ///
+    /// @class UnlockSession
+    /// @brief RAII scope during which a key stays readable
+    ///
+    /// When memory locking is enabled, every cryptographic operation unlocks
+    /// its key before using it, and locks it again afterwards, i.e. issues two
+    /// mprotect system calls. An UnlockSession unlocks the key once, for the
+    /// whole lifetime of the session: within the session, the key is not
+    /// re-locked after each operation, and it is locked again when the last
+    /// session on the key is closed.
+    ///
+    /// Sessions are reference counted and can be nested, or opened
+    /// concurrently from several threads. The key must outlive its sessions,
+    /// and must not be moved while a session is open.
+    ///
+    class UnlockSession
+    {
+        friend class Key;
+
+    public:
+        UnlockSession(const UnlockSession&) = delete;
+        UnlockSession& operator=(const UnlockSession&) = delete;
+
+        ///
+        /// @brief Move constructor
+        ///
+        /// @param s    The moved session. It does not own the key's unlock
+        ///             anymore.
+        ///
+        UnlockSession(UnlockSession&& s) noexcept : key_(s.key_)
+        {
+            s.key_ = nullptr;
+        }
+
+        ///
+        /// @brief Destructor
+        ///
+        /// Closes the session, and locks the key if it was the last one.
+        ///
+        ~UnlockSession()
+        {
+            if (key_ != nullptr) {
+                key_->close_session();
+            }
         }
+
+    private:
+        explicit UnlockSession(const Key& key) : key_(&key)
+        {
+            key_->open_session();
+        }
+
+        const Key* key_;
+    };
+
+    ///
+    /// @brief Opens an unlock session on the key
+    ///
+    /// The key is kept unlocked until the returned session (and all the
+    /// other sessions opened on the key) is destroyed.
+    ///
+    /// @exception std::runtime_error The memory cannot be unlocked.
+    ///
+    UnlockSession unlock_session() const
+    {
+        return UnlockSession(*this);
     }
 
 private:
@@ -254,43 +428,160 @@ private:
     ///
     explicit Key(const std::function<void(uint8_t*)>& init_callback)
     {
+        allocate_content();
+
+        init_callback(content_); // use the callback to fill the key
+
+        seal_content();
+    }
+
+    ///
+    /// @brief Allocates the key's memory
+    ///
+    /// Allocates the memory used to store the key's content, either from the
+    /// key arena (when ENABLE_KEY_ARENA is set and the key is small enough) or
+    /// with sodium_malloc. Upon return, the memory is writable.
+    ///
+    /// @exception std::bad_alloc           Memory cannot be allocated.
+    /// @exception std::runtime_error       Memory could not be unprotected.
+    ///
+    void allocate_content()
+    {
+#ifdef ENABLE_KEY_ARENA
+        if (KeyArena::supports(N)) {
+            KeyArena::Allocation alloc = KeyArena::allocate(N);
+            try {
+                KeyArena::acquire_write(alloc.slab);
+            } catch (...) {
+                /* LCOV_EXCL_START */
+                KeyArena::deallocate(alloc, N);
+                throw;
+                /* LCOV_EXCL_STOP */
+            }
+            content_ = alloc.ptr;
+            slab_    = alloc.slab;
+            return;
+        }
+#endif
         content_ = static_cast<uint8_t*>(sodium_malloc(N));
 
         if (content_ == nullptr) {
             throw std::bad_alloc(); /* LCOV_EXCL_LINE */
         }
+    }
 
-        init_callback(content_); // use the callback to fill the key
-
+    ///
+    /// @brief Protects the freshly written key content
+    ///
+    /// Makes the key content neither readable or writable, and marks the key
+    /// as locked. Must be called once the key has been filled, after a call to
+    /// allocate_content().
+    ///
+    /// @exception std::runtime_error Memory cannot be locked.
+    ///
+    void seal_content()
+    {
+        if (slab_ != nullptr) {
+            KeyArena::release_write(slab_);
+        } else {
 #ifdef ENABLE_MEMORY_LOCK
-        int err = sodium_mprotect_noaccess(content_);
-        if (err == -1 && errno != ENOSYS) {
-            /* LCOV_EXCL_START */
-            throw std::runtime_error("Error when locking memory: "
-                                     + std::string(strerror(errno)));
-            /* LCOV_EXCL_STOP */
+            int err = sodium_mprotect_noaccess(content_);
+            if (err == -1 && errno != ENOSYS) {
+                /* LCOV_EXCL_START */
+                throw std::runtime_error("Error when locking memory: "
+                                         + std::string(strerror(errno)));
+                /* LCOV_EXCL_STOP */
+            }
+#endif
         }
+#ifdef ENABLE_MEMORY_LOCK
         is_locked_ = true;
 #endif
     }
 
+    ///
+    /// @brief Erases and frees the key's memory
+    ///
+    /// The key content is zeroized before being given back to the allocator
+    /// it comes from.
+    ///
+    void free_content() noexcept
+    {
+        if (content_ == nullptr) {
+            return;
+        }
+        if (slab_ != nullptr) {
+            if (!is_locked_) {
+                // the key still holds a read access to its slab
+                KeyArena::release_read(slab_);
+            }
+            KeyArena::deallocate(KeyArena::Allocation{content_, slab_}, N);
+        } else {
+            sodium_free(content_);
+        }
+        content_   = nullptr;
+        slab_      = nullptr;
+        is_locked_ = true;
+    }
+
     ///
     /// @brief Locks the key
     ///
-    /// Makes the key content neither readable or writable.
+    /// Makes the key content neither readable or writable. Has no effect while
+    /// an unlock session is open on the key.
     ///
     /// @exception std::runtime_error Memory cannot be locked.
     ///
     void lock() const
+    {
+        if (!sessions_.is_open()) {
+            lock_content();
+        }
+    }
+
+    ///
+    /// @brief Opens an unlock session
+    ///
+    /// Increments the session counter, and unlocks the key if no session
+    /// was open.
+    ///
+    /// @exception std::runtime_error Memory cannot be unlocked.
+    ///
+    void open_session() const
+    {
+        sessions_.open([this]() { unlock(); });
+    }
+
+    ///
+    /// @brief Closes an unlock session
+    ///
+    /// Decrements the session counter, and locks the key when the last
+    /// session is closed.
+    ///
+    void close_session() const noexcept
+    {
+        sessions_.close([this]() { lock_content(); });
+    }
+
+    ///
+    /// @brief Makes the key content neither readable or writable
+    ///
+    /// @exception std::runtime_error Memory cannot be locked.
+    ///
+    void lock_content() const
     {
 #ifdef ENABLE_MEMORY_LOCK
         if (content_ != nullptr && !is_locked_) {
-            int err = sodium_mprotect_noaccess(content_);
-            if (err == -1 && errno != ENOSYS) {
-                /* LCOV_EXCL_START */
-                throw std::runtime_error("Error when locking memory: "
-                                         + std::string(strerror(errno)));
-                /* LCOV_EXCL_STOP */
+            if (slab_ != nullptr) {
+                KeyArena::release_read(slab_);
+            } else {
+                int err = sodium_mprotect_noaccess(content_);
+                if (err == -1 && errno != ENOSYS) {
+                    /* LCOV_EXCL_START */
+                    throw std::runtime_error("Error when locking memory: "
+                                             + std::string(strerror(errno)));
+                    /* LCOV_EXCL_STOP */
+                }
             }
             is_locked_ = true;
         }
@@ -308,12 +599,16 @@ private:
     {
 #ifdef ENABLE_MEMORY_LOCK
         if (content_ != nullptr && is_locked_) {
-            int err = sodium_mprotect_readonly(content_);
-            if (err == -1 && errno != ENOSYS) {
-                /* LCOV_EXCL_START */
-                throw std::runtime_error("Error when locking memory: "
-                                         + std::string(strerror(errno)));
-                /* LCOV_EXCL_STOP */
+            if (slab_ != nullptr) {
+                KeyArena::acquire_read(slab_);
+            } else {
+                int err = sodium_mprotect_readonly(content_);
+                if (err == -1 && errno != ENOSYS) {
+                    /* LCOV_EXCL_START */
+                    throw std::runtime_error("Error when locking memory: "
+                                             + std::string(strerror(errno)));
+                    /* LCOV_EXCL_STOP */
+                }
             }
             is_locked_ = false;
         }
@@ -366,7 +661,9 @@ private:
     /// @brief Unlocks the key and gets its content
     ///
     /// Returns a pointer to the key data.
-    /// The caller has to re-lock the key after by calling unlock().
+    /// The caller has to re-lock the key after by calling lock().
+    /// Unlike unlock sessions, this is not safe if the key is used by other
+    /// threads: only use it on keys owned by the calling thread.
     ///
     /// @exception std::runtime_error The memory cannot be accessed: it is
     /// absent (happens when the key has been moved) or cannot be unlocked.
@@ -405,8 +702,17 @@ private:
 
     /// @brief Pointer to the key content
     uint8_t* content_{nullptr};
-    /// @brief Flag denoting if the content_ point is read_protected
+    /// @brief Slab of the key arena the content was allocated from (nullptr if
+    /// the content was allocated with sodium_malloc)
+    KeyArena::Slab* slab_{nullptr};
+    /// @brief Flag denoting if the content_ point is read_protected. Once the
+    /// key is constructed, it is only modified by the opening of the first
+    /// session and the closing of the last session, which are serialized by
+    /// sessions_.
     mutable bool is_locked_{false};
+
+    /// @brief Number of open unlock sessions on the key
+    mutable SessionCounter sessions_;
 };
 } // namespace crypto
 } // namespace sse
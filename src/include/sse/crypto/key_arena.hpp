@@ -0,0 +1,161 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sse {
+namespace crypto {
+
+/// @class KeyArena
+/// @brief Slab allocator for small keys.
+///
+/// Allocating a key with sodium_malloc maps several pages (the key's page, two
+/// guard pages and a canary page) and issues a few system calls. For small,
+/// short-lived keys, this cost dominates the cost of the cryptographic
+/// operations the key is used for.
+///
+/// The KeyArena carves small keys out of slabs. Each slab is a single
+/// sodium_malloc allocation: it is surrounded by guard pages, protected by a
+/// canary and locked in memory (mlock). Slots are handed out by size class
+/// (multiples of kSlotAlignment bytes) and are zeroized when they are given
+/// back to the arena. To avoid contention, every thread keeps a small cache of
+/// free slots for each size class.
+///
+/// When the ENABLE_MEMORY_LOCK flag is set, a slab is made inaccessible
+/// (mprotect'ed) as long as none of its slots is being read or written. As the
+/// protection granularity is the slab, unlocking a key makes all the keys of
+/// the same slab readable until it is locked again: this is the price to pay
+/// for the reduced number of mappings.
+///
+/// The arena is only used by the Key class when the ENABLE_KEY_ARENA flag is
+/// set (see the corresponding CMake option), and only for keys smaller than
+/// kMaxSlotSize bytes.
+///
+class KeyArena
+{
+public:
+    /// @brief Opaque type representing a slab.
+    class Slab;
+
+    /// @brief Alignment (in bytes) of the slots.
+    static constexpr size_t kSlotAlignment = 16;
+
+    /// @brief Size (in bytes) of the largest slot handed out by the arena.
+    static constexpr size_t kMaxSlotSize = 128;
+
+    /// @brief Size (in bytes) of a slab. Must be a multiple of the page size
+    /// for the slots to be correctly aligned.
+    static constexpr size_t kSlabSize = 16384;
+
+    /// @brief Maximum number of free slots cached by a thread, for each size
+    /// class.
+    static constexpr size_t kThreadCacheSize = 32;
+
+    /// @brief A slot allocated by the arena
+    struct Allocation
+    {
+        /// @brief Pointer to the slot's memory
+        uint8_t* ptr;
+        /// @brief Slab the slot belongs to
+        Slab* slab;
+    };
+
+    KeyArena() = delete;
+
+    ///
+    /// @brief Checks if the arena can allocate a slot of the given size
+    ///
+    /// @param size     The size (in bytes) of the slot.
+    ///
+    static constexpr bool supports(const size_t size) noexcept
+    {
+        return (size > 0) && (size <= kMaxSlotSize);
+    }
+
+    ///
+    /// @brief Allocates a slot
+    ///
+    /// Returns a slot of at least size bytes, aligned on kSlotAlignment bytes.
+    /// The content of the slot is not accessible until acquire_write() or
+    /// acquire_read() are called on the slot's slab.
+    ///
+    /// @param size     The size (in bytes) of the slot. Must be supported by
+    ///                 the arena.
+    ///
+    /// @exception std::invalid_argument    The size is not supported by the
+    ///                                     arena.
+    /// @exception std::bad_alloc           Memory cannot be allocated.
+    ///
+    static Allocation allocate(const size_t size);
+
+    ///
+    /// @brief Gives a slot back to the arena
+    ///
+    /// Zeroizes the slot and puts it back in the free slots of the calling
+    /// thread. The caller must not hold any read or write access to the slab
+    /// through this slot.
+    ///
+    /// @param alloc    The slot to be freed.
+    /// @param size     The size (in bytes) that was used to allocate the slot.
+    ///
+    static void deallocate(const Allocation& alloc, const size_t size) noexcept;
+
+    ///
+    /// @brief Makes a slab readable
+    ///
+    /// Calls to acquire_read() are reference counted: the slab becomes
+    /// inaccessible again once every reader (and writer) released its access.
+    ///
+    /// @exception std::runtime_error   Memory cannot be unprotected.
+    ///
+    static void acquire_read(Slab* slab);
+
+    ///
+    /// @brief Releases a read access to a slab
+    ///
+    /// @exception std::runtime_error   Memory cannot be protected.
+    ///
+    static void release_read(Slab* slab);
+
+    ///
+    /// @brief Makes a slab readable and writable
+    ///
+    /// @exception std::runtime_error   Memory cannot be unprotected.
+    ///
+    static void acquire_write(Slab* slab);
+
+    ///
+    /// @brief Releases a write access to a slab
+    ///
+    /// @exception std::runtime_error   Memory cannot be protected.
+    ///
+    static void release_write(Slab* slab);
+
+    ///
+    /// @brief Returns the number of slabs allocated by the arena.
+    ///
+    static size_t slab_count() noexcept;
+};
+
+} // namespace crypto
+} // namespace sse
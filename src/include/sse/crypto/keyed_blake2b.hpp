@@ -0,0 +1,287 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <sse/crypto/hash.hpp>
+#include <sse/crypto/key.hpp>
+
+#include <cstdint>
+#include <cstring>
+
+#include <stdexcept>
+
+namespace sse {
+
+namespace crypto {
+
+// forward declare the Prf class so we can use is as a friend
+template<uint16_t NBYTES, class Policy>
+class Prf;
+
+/// @class KeyedBlake2bParams
+/// @brief Parameters and non-template core of KeyedBlake2b
+///
+class KeyedBlake2bParams
+{
+public:
+    /// @brief Key size (in bytes)
+    static constexpr uint8_t kKeySize = 32;
+    /// @brief Output size (in bytes) of a single BLAKE2b evaluation
+    static constexpr size_t kDigestSize = 64;
+    /// @brief Size (in bytes) of the BLAKE2b personalization string
+    static constexpr size_t kPersonalizationSize = 16;
+    /// @brief Personalization string of the parameter blocks
+    static const uint8_t kPersonalization[kPersonalizationSize];
+
+protected:
+    /// @brief Size (in bytes) of the precomputed key material
+    static constexpr size_t kCacheSize
+        = Blake2bBackend::kStateSize + kDigestSize;
+
+    ///
+    /// @brief Precompute the hash state after the key block
+    ///
+    /// Writes in cache the BLAKE2b state after the absorption of the key
+    /// block, and the root digest of the empty message.
+    ///
+    /// @param key      The kKeySize bytes key.
+    /// @param out_len  The output length of the function.
+    /// @param cache    The output buffer, kCacheSize bytes long.
+    ///
+    static void precompute(const uint8_t* key,
+                           const size_t   out_len,
+                           uint8_t*       cache) noexcept;
+
+    ///
+    /// @brief Evaluate the function from the precomputed key material
+    ///
+    /// @param cache    The key material computed by precompute().
+    /// @param out_len  The output length of the function. Must be the one
+    ///                 given to precompute().
+    /// @param in       The input buffer.
+    /// @param length   The size of the input buffer in bytes.
+    /// @param out      The output buffer, out_len bytes long.
+    ///
+    static void eval(const uint8_t*       cache,
+                     const size_t         out_len,
+                     const unsigned char* in,
+                     const size_t         length,
+                     unsigned char*       out) noexcept;
+
+    ///
+    /// @brief Evaluate the function on several inputs
+    ///
+    /// Same as calling eval() on every input, but the inputs are hashed in
+    /// parallel (see hash::blake2b::update_final_many()).
+    ///
+    /// @param cache    The key material computed by precompute().
+    /// @param out_len  The output length of the function. Must be the one
+    ///                 given to precompute().
+    /// @param ins      The count input buffers.
+    /// @param lens     The count sizes of the input buffers in bytes.
+    /// @param count    The number of inputs.
+    /// @param out      The output buffer, count * out_len bytes long.
+    ///
+    static void eval_batch(const uint8_t*              cache,
+                           const size_t                out_len,
+                           const unsigned char* const* ins,
+                           const size_t*               lens,
+                           const size_t                count,
+                           unsigned char*              out) noexcept;
+};
+
+/// @class KeyedBlake2b
+/// @brief Pseudorandom function based on the keyed mode of BLAKE2b.
+///
+/// For outputs of at most kDigestSize (64) bytes, the function is BLAKE2b in
+/// keyed mode (RFC 7693), with an output length of NBYTES. Longer outputs are
+/// generated with BLAKE2Xb: the root digest is BLAKE2b in keyed mode, with
+/// NBYTES as the XOF length, and is then expanded by hashing it with the node
+/// offset set to the index of each 64 bytes output block.
+///
+/// In both cases, the personalization field of the parameter blocks is set to
+/// kPersonalization ("sse::crypto::Prf"), which separates this function from
+/// any other use of BLAKE2b, and in particular from HMac-BLAKE2b (whose
+/// parameter blocks have a null key length and personalization).
+///
+/// The hash state after the absorption of the key block is computed once,
+/// when the object is created, and kept in locked memory: evaluating the
+/// function on an input of at most 128 bytes runs a single compression
+/// function (plus one per 64 bytes output block for BLAKE2Xb), and does not
+/// allocate memory.
+///
+/// @tparam NBYTES  The output size (in bytes)
+///
+template<uint16_t NBYTES>
+class KeyedBlake2b : public KeyedBlake2bParams
+{
+    template<uint16_t N, class Policy>
+    friend class Prf;
+
+public:
+    static_assert(NBYTES != 0,
+                  "Output length invalid: length must be strictly larger "
+                  "than 0");
+
+    ///
+    /// @brief Constructor
+    ///
+    /// Creates a KeyedBlake2b object with a new randomly generated key.
+    ///
+    KeyedBlake2b() : key_(), cache_(compute_cache(key_))
+    {
+    }
+
+    ///
+    /// @brief Constructor
+    ///
+    /// Creates a KeyedBlake2b object from a kKeySize bytes key.
+    /// After a call to the constructor, the input key is held by the object,
+    /// and cannot be re-used.
+    ///
+    /// @param key  The key used to initialize the function.
+    ///             Upon return, key is empty
+    ///
+    /// @exception std::invalid_argument    The key is empty.
+    ///
+    explicit KeyedBlake2b(Key<kKeySize>&& key)
+        : key_(std::move(key)), cache_(compute_cache(key_))
+    {
+    }
+
+    KeyedBlake2b(const KeyedBlake2b<NBYTES>&) = delete;
+    KeyedBlake2b<NBYTES>& operator=(const KeyedBlake2b<NBYTES>&) = delete;
+
+    /// @brief Move constructor
+    KeyedBlake2b(KeyedBlake2b<NBYTES>&&) noexcept = default;
+
+    /// @brief Move assignment operator
+    KeyedBlake2b<NBYTES>& operator=(KeyedBlake2b<NBYTES>&&) noexcept
+        = default;
+
+    ///
+    /// @brief Evaluate the function
+    ///
+    /// @param in       The input buffer. Can only be NULL if length is 0.
+    /// @param length   The size of the input buffer in bytes.
+    /// @param out      The output buffer. Must be non NULL, and NBYTES bytes
+    ///                 long.
+    ///
+    /// @exception std::invalid_argument       in is NULL and length is not 0
+    /// @exception std::invalid_argument       out is NULL
+    ///
+    void eval(const unsigned char* in,
+              const size_t         length,
+              unsigned char*       out) const
+    {
+        if (in == nullptr && length != 0) {
+            throw std::invalid_argument("in is NULL");
+        }
+        if (out == nullptr) {
+            throw std::invalid_argument("out is NULL");
+        }
+
+        UnlockSession session = unlock_session();
+        KeyedBlake2bParams::eval(cache_.data(), NBYTES, in, length, out);
+    }
+
+    ///
+    /// @brief Evaluate the function on several inputs
+    ///
+    /// For each i < count, evaluates the function on the lens[i] bytes of
+    /// ins[i], and places the result at out + i * NBYTES. The result is the
+    /// same as calling eval() on every input, but the inputs are hashed in
+    /// parallel, using multi-buffer SIMD kernels when the CPU supports them,
+    /// and the key is only unlocked once.
+    ///
+    /// @param ins      The count input buffers. ins[i] can only be NULL if
+    ///                 lens[i] is 0.
+    /// @param lens     The count sizes of the input buffers in bytes.
+    /// @param count    The number of inputs.
+    /// @param out      The output buffer. Must be non NULL, and count * NBYTES
+    ///                 bytes long.
+    ///
+    /// @exception std::invalid_argument       One of ins, lens or out is NULL
+    /// @exception std::invalid_argument       ins[i] is NULL and lens[i] is
+    ///                                        not 0
+    ///
+    void eval_batch(const unsigned char* const* ins,
+                    const size_t*               lens,
+                    const size_t                count,
+                    unsigned char*              out) const
+    {
+        if (count == 0) {
+            return;
+        }
+        if (ins == nullptr || lens == nullptr || out == nullptr) {
+            throw std::invalid_argument("ins, lens or out is NULL");
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (ins[i] == nullptr && lens[i] != 0) {
+                throw std::invalid_argument("ins[i] is NULL");
+            }
+        }
+
+        UnlockSession session = unlock_session();
+        KeyedBlake2bParams::eval_batch(
+            cache_.data(), NBYTES, ins, lens, count, out);
+    }
+
+    /// @brief RAII unlock session type of the precomputed key material
+    using UnlockSession = typename Key<kCacheSize>::UnlockSession;
+
+    ///
+    /// @brief Opens an unlock session on the key
+    ///
+    /// As long as the returned session is alive, the key is not locked again
+    /// after each evaluation, saving two system calls per call when memory
+    /// locking is enabled. See Key::UnlockSession.
+    ///
+    /// @exception std::runtime_error The key cannot be unlocked.
+    ///
+    UnlockSession unlock_session() const
+    {
+        return cache_.unlock_session();
+    }
+
+private:
+    static Key<kCacheSize> compute_cache(const Key<kKeySize>& key)
+    {
+        if (key.is_empty()) {
+            throw std::invalid_argument("Invalid key: key is empty");
+        }
+
+        auto callback = [&key](uint8_t* cache) {
+            precompute(key.unlock_get(), NBYTES, cache);
+            key.lock();
+        };
+
+        return Key<kCacheSize>(callback);
+    }
+
+    /// @brief The key (kept for serialization)
+    Key<kKeySize> key_;
+    /// @brief The precomputed key material
+    Key<kCacheSize> cache_;
+};
+
+} // namespace crypto
+} // namespace sse
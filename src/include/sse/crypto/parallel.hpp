@@ -0,0 +1,85 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+
+#include <functional>
+
+namespace sse {
+namespace crypto {
+
+///
+/// @brief Executor of independent tasks
+///
+/// An Executor is called with a number of tasks n and a task function. It must
+/// call the task function exactly once for every index in [0, n), possibly
+/// concurrently, and return once all the calls have completed. If a task
+/// throws, the executor must rethrow one of the thrown exceptions after all
+/// the running tasks completed.
+///
+/// Executors let the users of the library plug their own thread pool in the
+/// parallel algorithms (e.g. RCPrf::eval_range). thread_executor() returns a
+/// default executor.
+///
+using Executor = std::function<void(size_t                             n_tasks,
+                                    const std::function<void(size_t)>& task)>;
+
+///
+/// @brief Run independent tasks on several threads
+///
+/// Calls task(i) for every i in [0, n_tasks), using n_threads threads (the
+/// calling thread included). The tasks are not statically assigned to the
+/// threads: every thread fetches the next task to run as soon as it is done
+/// with the previous one, so that threads that got cheap tasks pick up the
+/// remaining work.
+///
+/// @param n_tasks      The number of tasks.
+/// @param task         The task function.
+/// @param n_threads    The number of threads to use. If 0, use as many threads
+///                     as the number of hardware threads.
+///
+/// @exception  The first exception thrown by a task is rethrown once all the
+///             threads stopped. After a task failed, no other task is started.
+///
+void parallel_for(size_t                             n_tasks,
+                  const std::function<void(size_t)>& task,
+                  unsigned int                       n_threads = 0);
+
+///
+/// @brief Returns an executor running the tasks with parallel_for
+///
+/// @param n_threads    The number of threads to use. If 0, use as many threads
+///                     as the number of hardware threads.
+///
+Executor thread_executor(unsigned int n_threads = 0);
+
+///
+/// @brief Returns an executor running the tasks one after the other, in the
+/// calling thread
+///
+/// The first exception thrown by a task is propagated, and the remaining tasks
+/// are not run.
+///
+Executor serial_executor();
+
+} // namespace crypto
+} // namespace sse
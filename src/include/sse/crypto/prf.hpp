@@ -23,6 +23,7 @@
 #include <sse/crypto/hash.hpp>
 #include <sse/crypto/hmac.hpp>
 #include <sse/crypto/key.hpp>
+#include <sse/crypto/keyed_blake2b.hpp>
 #include <sse/crypto/random.hpp>
 
 #include <cstdint>
@@ -31,39 +32,139 @@
 #include <algorithm>
 #include <array>
 #include <string>
+#include <type_traits>
 
 namespace sse {
 
 namespace crypto {
 
 
+/// @brief Prf policy: HMac construction (default)
+///
+/// The PRF is HMac-H, where H is the hash function defined in hash.hpp
+/// (BLAKE2b). Outputs larger than the HMac digest are generated by blocks,
+/// using HMac in a counter mode, without heap allocation: the input is absorbed
+/// once, and the incremental HMac state is cloned for every block.
+///
+struct HMacPrfPolicy
+{
+};
+
+/// @brief Prf policy: HMac construction over a chosen hash backend
+///
+/// Same construction as HMacPrfPolicy, with HMac-H where H is the BasicHash
+/// given as template parameter (e.g. BasicHash<Blake3Backend>), independently
+/// of the hash function selected when building the library.
+/// Prf<N, BasicHMacPrfPolicy<Hash>> computes the same function as
+/// Prf<N, HMacPrfPolicy>.
+///
+/// @tparam H   The hash function: an instance of BasicHash
+///
+template<class H>
+struct BasicHMacPrfPolicy
+{
+};
+
+/// @brief Hash function of the HMac policies of Prf
+///
+/// Hash for the policies that do not choose the hash function.
+///
+template<class Policy>
+struct PrfPolicyHash
+{
+    using type = Hash;
+};
+
+template<class H>
+struct PrfPolicyHash<BasicHMacPrfPolicy<H>>
+{
+    using type = H;
+};
+
+/// @brief Prf policy: keyed BLAKE2b construction
+///
+/// The PRF is KeyedBlake2b<NBYTES>: BLAKE2b in keyed mode for outputs of at
+/// most 64 bytes, and BLAKE2Xb for larger outputs. On inputs of at most 128
+/// bytes, an evaluation runs a single compression function, against two for
+/// HMacPrfPolicy.
+///
+struct Blake2bPrfPolicy
+{
+};
+
 /// @class Prf
 /// @brief Pseudorandom function.
 ///
-/// The Prf templates realizes a pseudorandom function (PRF) using HMac-H, where
-/// H is the hash function defined in hash.hpp (Blake2b).
+/// The Prf templates realizes a pseudorandom function (PRF). The construction
+/// is selected by the Policy template parameter: HMac-H, where H is the hash
+/// function defined in hash.hpp (Blake2b), with HMacPrfPolicy (the default),
+/// or the keyed mode of BLAKE2b with Blake2bPrfPolicy. BasicHMacPrfPolicy
+/// uses HMac with another hash backend.
 ///
 /// It is templated according
 /// to the output length. The rationale behind templating according the output
 /// length is to avoid key-reuse across different calls to HMac with different
 /// output length. If the the output length (NBYTES) is larger than the HMac's
 /// digest, the output will be generated by blocks, using HMac in a counter
-/// mode.
+/// mode. With Blake2bPrfPolicy, the output length is part of the BLAKE2b
+/// parameter block.
+///
+/// The two constructions are domain separated: the parameter blocks of
+/// Blake2bPrfPolicy have a non-zero key length and the "sse::crypto::Prf"
+/// personalization string, while all the hashes of HMac-BLAKE2b are unkeyed
+/// and unpersonalized. Using the same key with both policies hence does not
+/// relate their outputs.
+///
+/// Migration notes: the two policies compute unrelated functions. Switching an
+/// existing Prf to Blake2bPrfPolicy changes all its outputs, even with the
+/// same key. Outputs persisted under HMacPrfPolicy (tokens, keys derived with
+/// derive_key(), ...) cannot be recomputed with Blake2bPrfPolicy: they must be
+/// re-derived (e.g. by rebuilding the index), or the HMacPrfPolicy Prf must be
+/// kept to access them. The serialized keys of both policies are
+/// interchangeable, but Wrapper uses distinct type bytes for the two policies,
+/// so that a key wrapped with one policy cannot be unwrapped with the other.
 ///
 /// @tparam NBYTES  The output size (in bytes)
+/// @tparam Policy  The construction: HMacPrfPolicy, BasicHMacPrfPolicy or
+///                 Blake2bPrfPolicy
 ///
 
-template<uint16_t NBYTES>
+template<uint16_t NBYTES, class Policy>
 class Prf
 {
     friend class Wrapper;
 
+    /// @brief Hash function of the HMac construction
+    using HMacHash = typename PrfPolicyHash<Policy>::type;
+
+    /// @brief Set if the PRF is based on HMac
+    static constexpr bool kIsHMac
+        = std::is_same<Policy, HMacPrfPolicy>::value
+          || std::is_same<Policy, BasicHMacPrfPolicy<HMacHash>>::value;
+
+    static_assert(kIsHMac || std::is_same<Policy, Blake2bPrfPolicy>::value,
+                  "Invalid PRF policy");
+
 public:
     /// @brief PRF key size (in bytes)
     static constexpr uint8_t kKeySize = 32;
 
-    static_assert(kKeySize <= Hash::kBlockSize,
+    static_assert(kKeySize <= HMacHash::kBlockSize,
                   "The PRF key is too large for the hash block size");
+    static_assert(kKeySize == KeyedBlake2bParams::kKeySize,
+                  "The PRF and KeyedBlake2b key sizes do not match");
+
+private:
+    /// @brief HMac implementation of the PRF
+    using HMacBase = HMac<HMacHash, kKeySize>;
+    /// @brief Keyed BLAKE2b implementation of the PRF
+    using Blake2bBase = KeyedBlake2b<NBYTES>;
+
+    /// @brief Inner implementation of the PRF
+    using PrfBase =
+        typename std::conditional<kIsHMac, HMacBase, Blake2bBase>::type;
+
+public:
 
     /// @brief  Size (in bytes) of the public context (used to wrap a Prf
     ///         object).
@@ -103,13 +204,14 @@ public:
 
 
     // delete the copy constructor
-    Prf(const Prf<NBYTES>& key) = delete;
+    Prf(const Prf<NBYTES, Policy>& key) = delete;
 
     /// @brief Move constructor
-    Prf(Prf<NBYTES>&& prf) noexcept = default;
+    Prf(Prf<NBYTES, Policy>&& prf) noexcept = default;
 
-    Prf<NBYTES>& operator=(Prf<NBYTES>&& prf) noexcept = default;
-    Prf<NBYTES>& operator=(const Prf<NBYTES>& prf) = delete;
+    Prf<NBYTES, Policy>& operator=(Prf<NBYTES, Policy>&& prf) noexcept
+        = default;
+    Prf<NBYTES, Policy>& operator=(const Prf<NBYTES, Policy>& prf) = delete;
 
     /// @brief Destructor.
     ~Prf() // NOLINT // using = default causes a linker error on Travis
@@ -162,6 +264,51 @@ public:
     template<size_t L>
     std::array<uint8_t, NBYTES> prf(const std::array<uint8_t, L>& in) const;
 
+    ///
+    /// @brief Evaluate the PRF on several inputs
+    ///
+    /// For each i < count, evaluates the PRF on the lens[i] bytes of ins[i],
+    /// and places the NBYTES bytes result at outs + i * NBYTES. The result is
+    /// the same as calling prf() on every input, but the inputs are hashed in
+    /// parallel, in the lanes of multi-buffer BLAKE2b kernels (4 lanes with
+    /// AVX2, 8 with AVX-512) when the CPU supports them, and the key is only
+    /// unlocked once.
+    ///
+    /// @param ins      The count input buffers. Must be non NULL.
+    /// @param lens     The count sizes of the input buffers in bytes.
+    /// @param count    The number of inputs.
+    /// @param outs     The output buffer. Must be non NULL, and count * NBYTES
+    ///                 bytes long.
+    ///
+    /// @exception std::invalid_argument       One of ins, lens, outs, or one
+    ///                                        of the input buffers is NULL
+    ///
+    void prf_batch(const uint8_t* const* ins,
+                   const size_t*         lens,
+                   const size_t          count,
+                   uint8_t*              outs) const;
+
+    ///
+    /// @brief Evaluate the PRF on several inputs of the same length
+    ///
+    /// For each i < count, evaluates the PRF on the length bytes starting at
+    /// ins + i * length, and places the NBYTES bytes result at
+    /// outs + i * NBYTES. See prf_batch() above.
+    ///
+    /// @param ins      The input buffer, count * length bytes long. Must be
+    ///                 non NULL.
+    /// @param length   The size of each input in bytes.
+    /// @param count    The number of inputs.
+    /// @param outs     The output buffer. Must be non NULL, and count * NBYTES
+    ///                 bytes long.
+    ///
+    /// @exception std::invalid_argument       ins or outs is NULL
+    ///
+    void prf_batch(const uint8_t* ins,
+                   const size_t   length,
+                   const size_t   count,
+                   uint8_t*       outs) const;
+
     ///
     /// @brief Derive a key using the PRF
     ///
@@ -207,6 +354,23 @@ public:
     template<size_t L>
     Key<NBYTES> derive_key(const std::array<uint8_t, L>& in) const;
 
+    /// @brief RAII unlock session type of the PRF key
+    using UnlockSession = typename PrfBase::UnlockSession;
+
+    ///
+    /// @brief Opens an unlock session on the PRF key
+    ///
+    /// As long as the returned session is alive, the key is not locked again
+    /// after each evaluation, saving two system calls per call when memory
+    /// locking is enabled. See Key::UnlockSession.
+    ///
+    /// @exception std::runtime_error The key cannot be unlocked.
+    ///
+    UnlockSession unlock_session() const
+    {
+        return base_.unlock_session();
+    }
+
 private:
     /// @internal
 
@@ -222,18 +386,17 @@ private:
 
     void serialize(uint8_t* out) const
     {
-        base_.key_.unlock();
+        const auto session = base_.key_.unlock_session();
         base_.key_.serialize(out);
-        base_.key_.lock();
     }
 
     // because in is not directly used by the function, clang-tidy thinks it is
     // ok to set is as pointer to const, while it will be erased by the Key
     // constructor
     // NOLINTNEXTLINE(readability-non-const-parameter)
-    static Prf<NBYTES> deserialize(uint8_t*     in,
-                                   const size_t in_size,
-                                   size_t&      n_bytes_read)
+    static Prf<NBYTES, Policy> deserialize(uint8_t*     in,
+                                           const size_t in_size,
+                                           size_t&      n_bytes_read)
     {
         if (in_size < kKeySize) {
             /* LCOV_EXCL_START */
@@ -243,23 +406,49 @@ private:
         }
         n_bytes_read = kKeySize;
 
-        return Prf<NBYTES>(Key<kKeySize>(in));
+        return Prf<NBYTES, Policy>(Key<kKeySize>(in));
     }
 
-    /// @brief Inner implementation of the PRF
-    using PrfBase = HMac<Hash, kKeySize>;
+    /// @brief Evaluate the PRF with HMac
+    static void evaluate(const HMacBase&      base,
+                         const unsigned char* in,
+                         const size_t         length,
+                         uint8_t*             out);
+
+    /// @brief Evaluate the PRF with keyed BLAKE2b
+    static void evaluate(const Blake2bBase&   base,
+                         const unsigned char* in,
+                         const size_t         length,
+                         uint8_t*             out);
+
+    /// @brief Evaluate the PRF on several inputs with HMac
+    static void evaluate_batch(const HMacBase&             base,
+                               const unsigned char* const* ins,
+                               const size_t*               lens,
+                               const size_t                count,
+                               uint8_t*                    outs);
+
+    /// @brief Evaluate the PRF on several inputs with keyed BLAKE2b
+    static void evaluate_batch(const Blake2bBase&          base,
+                               const unsigned char* const* ins,
+                               const size_t*               lens,
+                               const size_t                count,
+                               uint8_t*                    outs);
+
+    /// @brief Number of inputs of the same length evaluated at once
+    static constexpr size_t kBatchSize = 64;
 
     PrfBase base_;
 };
 
-template<uint16_t NBYTES>
-constexpr uint8_t Prf<NBYTES>::kKeySize;
+template<uint16_t NBYTES, class Policy>
+constexpr uint8_t Prf<NBYTES, Policy>::kKeySize;
 
 // PRF instantiation
-// For now, use HMAC-Hash where Hash is the hash function defined in hash.hpp
-template<uint16_t NBYTES>
-std::array<uint8_t, NBYTES> Prf<NBYTES>::prf(const unsigned char* in,
-                                             const size_t         length) const
+template<uint16_t NBYTES, class Policy>
+std::array<uint8_t, NBYTES> Prf<NBYTES, Policy>::prf(
+    const unsigned char* in,
+    const size_t         length) const
 {
     if (in == nullptr) {
         throw std::invalid_argument("in is NULL");
@@ -271,49 +460,149 @@ std::array<uint8_t, NBYTES> Prf<NBYTES>::prf(const unsigned char* in,
 
     std::array<uint8_t, NBYTES> result;
 
-    if (NBYTES > PrfBase::kDigestSize) {
-        unsigned char* tmp = new unsigned char[length + 1];
-        memcpy(tmp, in, length);
+    evaluate(base_, in, length, result.data());
+
+    return result;
+}
+
+// HMac-H, where H is the hash function of the policy
+template<uint16_t NBYTES, class Policy>
+void Prf<NBYTES, Policy>::evaluate(const HMacBase&      base,
+                                   const unsigned char* in,
+                                   const size_t         length,
+                                   uint8_t*             out)
+{
+    if (NBYTES > HMacBase::kDigestSize) {
+        // use a counter mode: the i-th block is HMac(in || i). The input is
+        // absorbed once, and the incremental state is cloned for every block,
+        // so that only the last block of the input is hashed again.
+        auto session = base.unlock_session();
+
+        typename HMacBase::State prefix = base.init();
+        prefix.update(in, length);
 
         uint16_t pos = 0;
         uint8_t  i   = 0;
-        for (; pos < NBYTES; pos += PrfBase::kDigestSize, i++) {
-            // use a counter mode
-            tmp[length] = i;
+        for (; pos < NBYTES; pos += HMacBase::kDigestSize, i++) {
+            typename HMacBase::State state(prefix);
+            state.update(&i, 1);
 
             // fill res
-            if (static_cast<size_t>(NBYTES - pos) >= PrfBase::kDigestSize) {
-                base_.hmac(
-                    tmp, length + 1, result.data() + pos, PrfBase::kDigestSize);
+            if (static_cast<size_t>(NBYTES - pos) >= HMacBase::kDigestSize) {
+                state.final(out + pos, HMacBase::kDigestSize);
             } else {
-                base_.hmac(tmp,
-                           length + 1,
-                           result.data() + pos,
-                           static_cast<size_t>(NBYTES - pos));
+                state.final(out + pos, static_cast<size_t>(NBYTES - pos));
             }
         }
+    } else if (NBYTES <= HMacBase::kDigestSize) {
+        // only need one output bloc of HMacBase.
+        base.hmac(in, length, out, NBYTES);
+    }
+}
+
+// keyed BLAKE2b, or BLAKE2Xb for outputs larger than 64 bytes
+template<uint16_t NBYTES, class Policy>
+void Prf<NBYTES, Policy>::evaluate(const Blake2bBase&   base,
+                                   const unsigned char* in,
+                                   const size_t         length,
+                                   uint8_t*             out)
+{
+    base.eval(in, length, out);
+}
+
+template<uint16_t NBYTES, class Policy>
+void Prf<NBYTES, Policy>::prf_batch(const uint8_t* const* ins,
+                                    const size_t*         lens,
+                                    const size_t          count,
+                                    uint8_t*              outs) const
+{
+    if (count == 0) {
+        return;
+    }
+    if (ins == nullptr || lens == nullptr || outs == nullptr) {
+        throw std::invalid_argument("ins, lens or outs is NULL");
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (ins[i] == nullptr) {
+            throw std::invalid_argument("ins[i] is NULL");
+        }
+    }
+
+    evaluate_batch(base_, ins, lens, count, outs);
+}
 
-        sodium_memzero(tmp, length + 1);
-        delete[] tmp;
-    } else if (NBYTES <= Hash::kDigestSize) {
-        // only need one output bloc of PrfBase.
-        base_.hmac(in, length, result.data(), result.size());
+template<uint16_t NBYTES, class Policy>
+void Prf<NBYTES, Policy>::prf_batch(const uint8_t* ins,
+                                    const size_t   length,
+                                    const size_t   count,
+                                    uint8_t*       outs) const
+{
+    if (count == 0) {
+        return;
+    }
+    if (ins == nullptr || outs == nullptr) {
+        throw std::invalid_argument("ins or outs is NULL");
     }
 
+    const uint8_t* lane_ins[kBatchSize];
+    size_t         lane_lens[kBatchSize];
 
-    return result;
+    for (size_t j = 0; j < kBatchSize; j++) {
+        lane_lens[j] = length;
+    }
+
+    auto session = unlock_session();
+    for (size_t first = 0; first < count; first += kBatchSize) {
+        const size_t n_items
+            = (count - first < kBatchSize) ? count - first : kBatchSize;
+
+        for (size_t j = 0; j < n_items; j++) {
+            lane_ins[j] = ins + (first + j) * length;
+        }
+        evaluate_batch(
+            base_, lane_ins, lane_lens, n_items, outs + first * NBYTES);
+    }
+}
+
+// HMac-Hash: the inner and outer hashes are batched when a single HMac block
+// is needed
+template<uint16_t NBYTES, class Policy>
+void Prf<NBYTES, Policy>::evaluate_batch(const HMacBase&             base,
+                                         const unsigned char* const* ins,
+                                         const size_t*               lens,
+                                         const size_t                count,
+                                         uint8_t*                    outs)
+{
+    if (NBYTES <= HMacBase::kDigestSize) {
+        base.hmac_batch(ins, lens, count, outs, NBYTES);
+    } else {
+        auto session = base.unlock_session();
+        for (size_t i = 0; i < count; i++) {
+            evaluate(base, ins[i], lens[i], outs + i * NBYTES);
+        }
+    }
+}
+
+template<uint16_t NBYTES, class Policy>
+void Prf<NBYTES, Policy>::evaluate_batch(const Blake2bBase&          base,
+                                         const unsigned char* const* ins,
+                                         const size_t*               lens,
+                                         const size_t                count,
+                                         uint8_t*                    outs)
+{
+    base.eval_batch(ins, lens, count, outs);
 }
 
 // Convienience function to run the PRF over a C++ string
-template<uint16_t NBYTES>
-std::array<uint8_t, NBYTES> Prf<NBYTES>::prf(const std::string& s) const
+template<uint16_t NBYTES, class Policy>
+std::array<uint8_t, NBYTES> Prf<NBYTES, Policy>::prf(const std::string& s) const
 {
     return prf(reinterpret_cast<const unsigned char*>(s.data()), s.length());
 }
 
-template<uint16_t NBYTES>
+template<uint16_t NBYTES, class Policy>
 template<size_t L>
-std::array<uint8_t, NBYTES> Prf<NBYTES>::prf(
+std::array<uint8_t, NBYTES> Prf<NBYTES, Policy>::prf(
     const std::array<uint8_t, L>& in) const
 {
     return prf(reinterpret_cast<const unsigned char*>(in.data()), L);
@@ -321,22 +610,23 @@ std::array<uint8_t, NBYTES> Prf<NBYTES>::prf(
 
 // derive a key using the PRF
 
-template<uint16_t NBYTES>
-Key<NBYTES> Prf<NBYTES>::derive_key(const unsigned char* in,
-                                    const size_t         length) const
+template<uint16_t NBYTES, class Policy>
+Key<NBYTES> Prf<NBYTES, Policy>::derive_key(const unsigned char* in,
+                                            const size_t         length) const
 {
     return Key<NBYTES>(prf(in, length).data());
 }
 
-template<uint16_t NBYTES>
-Key<NBYTES> Prf<NBYTES>::derive_key(const std::string& s) const
+template<uint16_t NBYTES, class Policy>
+Key<NBYTES> Prf<NBYTES, Policy>::derive_key(const std::string& s) const
 {
     return Key<NBYTES>(prf(s).data());
 }
 
-template<uint16_t NBYTES>
+template<uint16_t NBYTES, class Policy>
 template<size_t L>
-Key<NBYTES> Prf<NBYTES>::derive_key(const std::array<uint8_t, L>& in) const
+Key<NBYTES> Prf<NBYTES, Policy>::derive_key(
+    const std::array<uint8_t, L>& in) const
 {
     return Key<NBYTES>(prf(in).data());
 }
@@ -380,6 +670,14 @@ extern template Key<1024> Prf<1024>::derive_key(
     const std::array<uint8_t, 200>& in) const;
 
 extern template class Prf<2000>;
+
+extern template class Prf<16, Blake2bPrfPolicy>;
+extern template std::array<uint8_t, 16> Prf<16, Blake2bPrfPolicy>::prf(
+    const std::array<uint8_t, 20>& in) const;
+extern template Key<16> Prf<16, Blake2bPrfPolicy>::derive_key(
+    const std::array<uint8_t, 20>& in) const;
+
+extern template class Prf<200, Blake2bPrfPolicy>;
 } // namespace crypto
 } // namespace sse
 #endif
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <sse/crypto/ephemeral_key.hpp>
 #include <sse/crypto/key.hpp>
 
 #include <cstdint>
@@ -357,6 +358,109 @@ public:
         derive(std::move(k), offset, N, out.data());
     }
 
+    ///
+    /// @brief Fills a buffer with pseudorandom bytes from an ephemeral seed
+    ///
+    /// Fills the out buffer with len pseudorandom bytes, skipping the first
+    /// offset bytes of the pseudo-random generation, using k as a seed.
+    /// Contrary to the overloads taking a Key<kKeySize>, the seed is not
+    /// consumed: it is erased when it goes out of scope.
+    ///
+    /// @param k        The seed of the pseudo-random generation.
+    /// @param offset   The number of bytes to skip in the pseudo-random
+    ///                 sequence.
+    /// @param len      The number of pseudo-random bytes to generate.
+    /// @param out      The output buffer. Must be at least len bytes wide.
+    ///
+    /// @exception std::invalid_argument    out is NULL
+    ///
+    static void derive(const EphemeralKey<kKeySize>& k,
+                       const size_t                  offset,
+                       const size_t                  len,
+                       unsigned char*                out);
+
+    ///
+    /// @brief Derive an ephemeral key
+    ///
+    /// Fills out with a pseudo-randomly generated key. The pseudo-random
+    /// stream is cut in blocks of K bytes and the key_offset-th block is used
+    /// to initialize the key (starting from block 0). The derived key is the
+    /// same as the one returned by derive_key<K>(key_offset), but no memory is
+    /// allocated.
+    ///
+    /// @tparam K           The size of the generated key.
+    ///
+    /// @param key_offset   The number of the block used to initialize the key.
+    /// @param[out] out     The generated key.
+    ///
+    template<size_t K>
+    void derive_key(const uint16_t key_offset, EphemeralKey<K>& out) const;
+
+    ///
+    /// @brief Derive an ephemeral key from an ephemeral seed
+    ///
+    /// Fills out with a key pseudo-randomly generated from the seed k. The
+    /// pseudo-random stream is cut in blocks of K bytes and the key_offset-th
+    /// block is used to initialize the key (starting from block 0).
+    ///
+    /// @tparam K           The size of the generated key.
+    ///
+    /// @param k            The seed of the pseudo-random generation.
+    /// @param key_offset   The number of the block used to initialize the key.
+    /// @param[out] out     The generated key. Must be different from k.
+    ///
+    /// @exception std::invalid_argument    out and k are the same object.
+    ///
+    template<size_t K>
+    static void derive_key(const EphemeralKey<kKeySize>& k,
+                           const uint16_t                key_offset,
+                           EphemeralKey<K>&              out);
+
+    ///
+    /// @brief Fills buffers with pseudorandom bytes from multiple seeds
+    ///
+    /// For each i < n, fills the outs[i] buffer with len pseudorandom bytes,
+    /// skipping the first offsets[i] bytes of the pseudo-random generation,
+    /// using keys[i] as a seed. The result is the same as calling
+    /// derive(*keys[i], offsets[i], len, outs[i]) for every i, but the
+    /// ChaCha20 blocks of different seeds are computed in parallel, using
+    /// multi-buffer SIMD kernels when the CPU supports them.
+    ///
+    /// @param n        The number of seeds.
+    /// @param keys     The n seeds. The same seed can appear several times.
+    /// @param offsets  The n numbers of bytes to skip in the pseudo-random
+    ///                 sequences.
+    /// @param len      The number of pseudo-random bytes to generate for each
+    ///                 seed.
+    /// @param outs     The n output buffers. Each buffer must be at least len
+    ///                 bytes wide.
+    ///
+    /// @exception std::invalid_argument    One of keys, offsets, outs, or one
+    ///                                     of the output buffers is NULL
+    ///
+    static void derive_batch(const size_t                         n,
+                             const EphemeralKey<kKeySize>* const* keys,
+                             const size_t*                        offsets,
+                             const size_t                         len,
+                             unsigned char* const*                outs);
+
+    /// @brief RAII unlock session type of the PRG key
+    using UnlockSession = Key<kKeySize>::UnlockSession;
+
+    ///
+    /// @brief Opens an unlock session on the PRG key
+    ///
+    /// As long as the returned session is alive, the key is not locked again
+    /// after each derivation, saving two system calls per call when memory
+    /// locking is enabled. See Key::UnlockSession.
+    ///
+    /// @exception std::runtime_error The key cannot be unlocked.
+    ///
+    UnlockSession unlock_session() const
+    {
+        return key_.unlock_session();
+    }
+
 private:
     Prg duplicate() const;
 
@@ -437,6 +541,46 @@ Key<K> Prg::derive_key(Key<kKeySize>&& k, const uint16_t key_offset)
     return Key<K>(fill_callback);
 }
 
+template<size_t K>
+void Prg::derive_key(const uint16_t key_offset, EphemeralKey<K>& out) const
+{
+    static_assert(K < SIZE_MAX, "K is too large: K < SIZE_MAX");
+
+    if (key_offset > static_cast<size_t>(0U)
+        && K >= static_cast<size_t>(SIZE_MAX) / key_offset) {
+        /* LCOV_EXCL_START */
+        throw std::invalid_argument("Key offset too large."
+                                    " key_offset*K >= SIZE_MAX.");
+        /* LCOV_EXCL_STOP */
+    }
+
+    this->derive(key_offset * K, K, out.data());
+}
+
+template<size_t K>
+void Prg::derive_key(const EphemeralKey<kKeySize>& k,
+                     const uint16_t                key_offset,
+                     EphemeralKey<K>&              out)
+{
+    static_assert(K < SIZE_MAX, "K is too large: K < SIZE_MAX");
+
+    if (static_cast<const void*>(k.data())
+        == static_cast<const void*>(out.data())) {
+        throw std::invalid_argument(
+            "The output key must be different from the seed");
+    }
+
+    if (key_offset > static_cast<size_t>(0U)
+        && K >= static_cast<size_t>(SIZE_MAX) / key_offset) {
+        /* LCOV_EXCL_START */
+        throw std::invalid_argument("Key offset too large."
+                                    " key_offset*K >= SIZE_MAX.");
+        /* LCOV_EXCL_STOP */
+    }
+
+    derive(k, key_offset * K, K, out.data());
+}
+
 template<size_t K>
 std::vector<Key<K>> Prg::derive_keys(const uint16_t n_keys,
                                      const uint16_t key_offset)
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <sse/crypto/key.hpp>
+#include <sse/crypto/parallel.hpp>
 
 #include <cstdint>
 
@@ -45,6 +46,10 @@ namespace crypto {
 class Prp
 {
     friend class Wrapper;
+    friend class RangePrp;
+
+    /// @brief Size (in bytes) of the AEZ context
+    static constexpr uint8_t kContextSize = 112;
 
 public:
     /// @internal
@@ -115,6 +120,23 @@ public:
     ///
     Prp(Prp&& c) noexcept = default;
 
+    /// @brief RAII unlock session type of the PRP context
+    using UnlockSession = Key<kContextSize>::UnlockSession;
+
+    ///
+    /// @brief Opens an unlock session on the PRP context
+    ///
+    /// As long as the returned session is alive, the context is not locked
+    /// again after each evaluation, saving two system calls per call when
+    /// memory locking is enabled. See Key::UnlockSession.
+    ///
+    /// @exception std::runtime_error The context cannot be unlocked.
+    ///
+    UnlockSession unlock_session() const
+    {
+        return aez_ctx_.unlock_session();
+    }
+
     ///
     /// @brief PRP evaluation
     ///
@@ -125,7 +147,7 @@ public:
     ///
     /// @exception std::runtime_error The Prp class is not available.
     ///
-    void encrypt(const std::string& in, std::string& out);
+    void encrypt(const std::string& in, std::string& out) const;
 
     ///
     /// @brief PRP evaluation
@@ -137,7 +159,7 @@ public:
     ///
     /// @exception std::runtime_error The Prp class is not available.
     ///
-    std::string encrypt(const std::string& in);
+    std::string encrypt(const std::string& in) const;
 
     ///
     /// @brief PRP evaluation
@@ -149,7 +171,7 @@ public:
     ///
     /// @exception std::runtime_error The Prp class is not available.
     ///
-    uint32_t encrypt(const uint32_t in);
+    uint32_t encrypt(const uint32_t in) const;
 
     ///
     /// @brief PRP evaluation
@@ -163,7 +185,7 @@ public:
     /// @exception std::runtime_error The Prp class is not available.
     ///
 
-    void encrypt(const uint8_t* in, const unsigned int len, uint8_t* out);
+    void encrypt(const uint8_t* in, const unsigned int len, uint8_t* out) const;
     ///
     /// @brief PRP evaluation
     ///
@@ -175,7 +197,7 @@ public:
     ///
     /// @exception std::runtime_error The Prp class is not available.
     ///
-    uint64_t encrypt_64(const uint64_t in);
+    uint64_t encrypt_64(const uint64_t in) const;
 
     ///
     /// @brief PRP inversion
@@ -187,7 +209,7 @@ public:
     ///
     /// @exception std::runtime_error The Prp class is not available.
     ///
-    void decrypt(const std::string& in, std::string& out);
+    void decrypt(const std::string& in, std::string& out) const;
 
     ///
     /// @brief PRP inversion
@@ -199,7 +221,7 @@ public:
     ///
     /// @exception std::runtime_error The Prp class is not available.
     ///
-    std::string decrypt(const std::string& in);
+    std::string decrypt(const std::string& in) const;
 
 
     ///
@@ -213,7 +235,7 @@ public:
     ///
     /// @exception std::runtime_error The Prp class is not available.
     ///
-    void decrypt(const uint8_t* in, const unsigned int len, uint8_t* out);
+    void decrypt(const uint8_t* in, const unsigned int len, uint8_t* out) const;
 
     ///
     /// @brief PRP inversion
@@ -225,7 +247,7 @@ public:
     ///
     /// @exception std::runtime_error The Prp class is not available.
     ///
-    uint32_t decrypt(const uint32_t in);
+    uint32_t decrypt(const uint32_t in) const;
     ///
     /// @brief PRP inversion
     ///
@@ -236,15 +258,89 @@ public:
     ///
     /// @exception std::runtime_error The Prp class is not available.
     ///
-    uint64_t decrypt_64(const uint64_t in);
+    uint64_t decrypt_64(const uint64_t in) const;
+
+    ///
+    /// @brief Batched PRP evaluation
+    ///
+    /// Evaluates the pseudo random permutation on count 32 bits integers.
+    /// The outputs are the ones of count calls to encrypt(const uint32_t),
+    /// but the context is unlocked once for the whole batch and several
+    /// values are processed concurrently by the AES instructions.
+    ///
+    /// @param in           The inputs of the PRP.
+    /// @param count        The number of inputs.
+    /// @param[out] out     The evaluations of the PRP. Can be equal to in.
+    ///
+    /// @exception std::invalid_argument    in or out is NULL and count is not
+    ///                                     0
+    /// @exception std::runtime_error       The Prp class is not available.
+    ///
+    void encrypt_batch(const uint32_t* in,
+                       const size_t    count,
+                       uint32_t*       out) const;
+
+    ///
+    /// @brief Batched PRP evaluation
+    ///
+    /// Evaluates the pseudo random permutation on count 64 bits integers.
+    /// The outputs are the ones of count calls to encrypt_64, but the context
+    /// is unlocked once for the whole batch and several values are processed
+    /// concurrently by the AES instructions.
+    ///
+    /// @param in           The inputs of the PRP.
+    /// @param count        The number of inputs.
+    /// @param[out] out     The evaluations of the PRP. Can be equal to in.
+    ///
+    /// @exception std::invalid_argument    in or out is NULL and count is not
+    ///                                     0
+    /// @exception std::runtime_error       The Prp class is not available.
+    ///
+    void encrypt_64_batch(const uint64_t* in,
+                          const size_t    count,
+                          uint64_t*       out) const;
+
+    ///
+    /// @brief Batched PRP inversion
+    ///
+    /// Inverts the pseudo random permutation on count 32 bits integers, as
+    /// count calls to decrypt(const uint32_t) would.
+    ///
+    /// @param in           The inputs of the PRP inversion.
+    /// @param count        The number of inputs.
+    /// @param[out] out     The evaluations of PRP^{-1}. Can be equal to in.
+    ///
+    /// @exception std::invalid_argument    in or out is NULL and count is not
+    ///                                     0
+    /// @exception std::runtime_error       The Prp class is not available.
+    ///
+    void decrypt_batch(const uint32_t* in,
+                       const size_t    count,
+                       uint32_t*       out) const;
+
+    ///
+    /// @brief Batched PRP inversion
+    ///
+    /// Inverts the pseudo random permutation on count 64 bits integers, as
+    /// count calls to decrypt_64 would.
+    ///
+    /// @param in           The inputs of the PRP inversion.
+    /// @param count        The number of inputs.
+    /// @param[out] out     The evaluations of PRP^{-1}. Can be equal to in.
+    ///
+    /// @exception std::invalid_argument    in or out is NULL and count is not
+    ///                                     0
+    /// @exception std::runtime_error       The Prp class is not available.
+    ///
+    void decrypt_64_batch(const uint64_t* in,
+                          const size_t    count,
+                          uint64_t*       out) const;
 
     // Again, avoid any assignement of Cipher objects
     Prp& operator=(const Prp& h) = delete;
     Prp& operator=(Prp& h) = delete;
 
 private:
-    static constexpr uint8_t kContextSize = 112;
-
     Key<kContextSize> aez_ctx_;
 
     explicit Prp(Key<kContextSize>&& context);
@@ -252,6 +348,13 @@ private:
     static Key<kContextSize> init_random_aez_ctx();
     static Key<kContextSize> init_aez_ctx(Key<kKeySize>&& k);
 
+    // Evaluates the PRP (or its inverse) on count values of len bytes
+    void evaluate_batch(const bool     inverse,
+                        const uint8_t* in,
+                        const unsigned len,
+                        const size_t   count,
+                        uint8_t*       out) const;
+
     ///
     /// @brief Initialize the availability flag.
     ///
@@ -302,6 +405,208 @@ private:
     static bool is_available__;
 };
 
+/// @class RangePrp
+/// @brief Random permutation of an integer range.
+///
+/// RangePrp is a pseudorandom permutation of [0, n), for any n > 0 (e.g. to
+/// shuffle bucket indices or table slots). It is a balanced Feistel network
+/// on the smallest number of bits representing n-1 (at least 2), whose round
+/// function is the one of the Prp's AEZ context, tweaked by n. The values out
+/// of the range are mapped back in it by cycle walking: as the Feistel
+/// domain is less than twice as large as the range, an evaluation costs less
+/// than two Feistel evaluations on average.
+///
+/// As Prp, RangePrp requires support of AES-NI or of ARM NEON instructions.
+///
+
+class RangePrp
+{
+public:
+    /// @brief RangePrp key size (in bytes)
+    static constexpr uint8_t kKeySize = Prp::kKeySize;
+
+    ///
+    /// @brief Check availability of the RangePrp class
+    ///
+    /// @return true if the RangePrp class can be used, false otherwise.
+    ///
+    inline static bool is_available() noexcept
+    {
+        return Prp::is_available();
+    }
+
+    ///
+    /// @brief Constructor
+    ///
+    /// Creates a permutation of [0, n) with a new randomly generated key.
+    ///
+    /// @param n    The size of the domain.
+    ///
+    /// @exception std::invalid_argument    n is 0.
+    /// @exception std::runtime_error       The RangePrp class is not
+    ///                                     available.
+    ///
+    explicit RangePrp(const uint64_t n);
+
+    ///
+    /// @brief Constructor
+    ///
+    /// Creates a permutation of [0, n) from a 48 bytes (384 bits) key. The
+    /// same key with different domain sizes gives unrelated permutations.
+    ///
+    /// @param n    The size of the domain.
+    /// @param k    The key used to initialize the permutation.
+    ///             Upon return, k is empty
+    ///
+    /// @exception std::invalid_argument    n is 0.
+    /// @exception std::runtime_error       The RangePrp class is not
+    ///                                     available.
+    ///
+    RangePrp(const uint64_t n, Key<kKeySize>&& k);
+
+    RangePrp(const RangePrp& p) = delete;
+    RangePrp& operator=(const RangePrp& p) = delete;
+
+    ///
+    /// @brief Move constructor
+    ///
+    /// @param p The RangePrp object to be moved
+    ///
+    RangePrp(RangePrp&& p) noexcept = default;
+
+    /// @brief RAII unlock session type of the permutation's context
+    using UnlockSession = Prp::UnlockSession;
+
+    ///
+    /// @brief Opens an unlock session on the permutation's context
+    ///
+    /// See Prp::unlock_session.
+    ///
+    /// @exception std::runtime_error The context cannot be unlocked.
+    ///
+    UnlockSession unlock_session() const
+    {
+        return prp_.unlock_session();
+    }
+
+    ///
+    /// @brief Size of the permuted domain
+    ///
+    /// @return The n such that the object is a permutation of [0, n).
+    ///
+    uint64_t domain_size() const noexcept
+    {
+        return n_;
+    }
+
+    ///
+    /// @brief Permutation evaluation
+    ///
+    /// @param in    An element of [0, n).
+    /// @return      The image of in by the permutation.
+    ///
+    /// @exception std::invalid_argument    in is not smaller than n.
+    ///
+    uint64_t encrypt(const uint64_t in) const;
+
+    ///
+    /// @brief Permutation inversion
+    ///
+    /// @param in    An element of [0, n).
+    /// @return      The preimage of in by the permutation.
+    ///
+    /// @exception std::invalid_argument    in is not smaller than n.
+    ///
+    uint64_t decrypt(const uint64_t in) const;
+
+    ///
+    /// @brief Batched permutation evaluation
+    ///
+    /// Evaluates the permutation on count elements of [0, n). The outputs are
+    /// the ones of count calls to encrypt, but the context is unlocked once
+    /// and several values are processed concurrently by the AES instructions.
+    ///
+    /// @param in           The inputs of the permutation.
+    /// @param count        The number of inputs.
+    /// @param[out] out     The images of the inputs. Can be equal to in.
+    ///
+    /// @exception std::invalid_argument    in or out is NULL and count is not
+    ///                                     0, or one of the inputs is not
+    ///                                     smaller than n. In the latter case,
+    ///                                     out is left untouched.
+    ///
+    void encrypt_batch(const uint64_t* in,
+                       const size_t    count,
+                       uint64_t*       out) const;
+
+    ///
+    /// @brief Batched permutation inversion
+    ///
+    /// Inverts the permutation on count elements of [0, n), as count calls to
+    /// decrypt would.
+    ///
+    /// @param in           The inputs of the inversion.
+    /// @param count        The number of inputs.
+    /// @param[out] out     The preimages of the inputs. Can be equal to in.
+    ///
+    /// @exception std::invalid_argument    in or out is NULL and count is not
+    ///                                     0, or one of the inputs is not
+    ///                                     smaller than n. In the latter case,
+    ///                                     out is left untouched.
+    ///
+    void decrypt_batch(const uint64_t* in,
+                       const size_t    count,
+                       uint64_t*       out) const;
+
+    ///
+    /// @brief Permutes the whole domain
+    ///
+    /// Sets out[i] to encrypt(i) for every i in [0, n).
+    ///
+    /// @param[out] out     The output buffer. It must be n elements large.
+    ///
+    /// @exception std::invalid_argument    out is NULL.
+    ///
+    void permute_domain(uint64_t* out) const;
+
+    ///
+    /// @brief Permutes the whole domain in parallel
+    ///
+    /// Same as permute_domain(uint64_t*), with the domain split in chunks
+    /// evaluated as independent tasks of the executor (e.g. thread_executor()
+    /// to use all the cores). The context is unlocked once by the calling
+    /// thread, for the whole call.
+    ///
+    /// @param[out] out     The output buffer. It must be n elements large.
+    /// @param executor     The executor running the tasks.
+    ///
+    /// @exception std::invalid_argument    out is NULL.
+    ///
+    void permute_domain(uint64_t* out, const Executor& executor) const;
+
+private:
+    Prp      prp_;
+    uint64_t n_;
+    unsigned bits_;
+
+    // AEZ nonce of the Feistel network, encoding n
+    std::array<uint8_t, 16> nonce_;
+
+    void init_domain(const uint64_t n);
+
+    // Evaluates the permutation (or its inverse) on count values, with an
+    // unlocked AEZ context. The values must be in the domain.
+    void walk(const bool      inverse,
+              const uint8_t*  context,
+              const uint64_t* in,
+              const size_t    count,
+              uint64_t*       out) const;
+
+    void evaluate_batch(const bool      inverse,
+                        const uint64_t* in,
+                        const size_t    count,
+                        uint64_t*       out) const;
+};
 
 } // namespace crypto
 } // namespace sse
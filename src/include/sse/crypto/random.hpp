@@ -35,7 +35,14 @@ namespace crypto {
 
 /// @brief Generate random bytes
 ///
-/// Fills a buffer with random bytes
+/// Fills a buffer with random bytes.
+///
+/// The bytes come from a per-thread ChaCha20 generator with fast key erasure:
+/// it is seeded from the OS random generator, produces its keystream by
+/// chunks of 1 KiB (the first 32 bytes of a chunk being the key of the next
+/// one) and erases the bytes it outputs. Generators reseed from the OS after
+/// 16 MiB of output, and in the child process after a fork. Requests of more
+/// than 512 bytes are directly filled with the keystream of a one-time key.
 ///
 /// @param byte_count   Number of bytes to generate
 ///
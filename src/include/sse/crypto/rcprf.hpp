@@ -22,9 +22,11 @@
 #pragma once
 
 #include <sse/crypto/key.hpp>
+#include <sse/crypto/parallel.hpp>
 #include <sse/crypto/prg.hpp>
 
 #include <cassert>
+#include <cerrno>
 #include <cstring>
 
 #include <algorithm>
@@ -32,6 +34,8 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <new>
+#include <utility>
 #include <vector>
 
 namespace sse {
@@ -40,7 +44,19 @@ namespace crypto {
 template<uint16_t NBYTES>
 class ConstrainedRCPrfElement;
 template<uint16_t NBYTES>
+class ConstrainedRCPrfInnerElement;
+template<uint16_t NBYTES>
+class ConstrainedRCPrfLeafElement;
+template<uint16_t NBYTES>
 class ConstrainedRCPrf;
+template<uint16_t NBYTES>
+class ConstrainedRCPrfView;
+
+void test_constrained_rcprf_deserialization();
+template<uint16_t NBYTES>
+class RCPrf;
+template<uint16_t NBYTES>
+class RCPrfCursor;
 
 ///
 /// @class RCPrfParams
@@ -210,50 +226,261 @@ protected:
         return ((leaf & mask) == 0) ? LeftChild : RightChild;
     }
 
+    ///
+    /// @brief Derive bytes from the pseudo-random stream of a node
+    ///
+    /// The range evaluation and constrain functions take their starting node
+    /// either as a Prg object using the node's content as its key, or
+    /// directly as the node's seed. These overloads abstract the difference.
+    ///
+    static void derive_node(const Prg& node,
+                            size_t     offset,
+                            size_t     len,
+                            uint8_t*   out)
+    {
+        node.derive(offset, len, out);
+    }
+
+    static void derive_node(const EphemeralKey<kKeySize>& node,
+                            size_t                        offset,
+                            size_t                        len,
+                            uint8_t*                      out)
+    {
+        Prg::derive(node, offset, len, out);
+    }
+
+    ///
+    /// @brief Derive the seed of a child of a node
+    ///
+    static void derive_child(const Prg&              node,
+                             uint16_t                child,
+                             EphemeralKey<kKeySize>& out)
+    {
+        node.derive_key<kKeySize>(child, out);
+    }
+
+    static void derive_child(const EphemeralKey<kKeySize>& node,
+                             uint16_t                      child,
+                             EphemeralKey<kKeySize>&       out)
+    {
+        Prg::derive_key<kKeySize>(node, child, out);
+    }
+
+    ///
+    /// @brief Copy a node's seed from a byte buffer
+    ///
+    /// @param in      The kKeySize bytes of the seed. The buffer is left
+    ///                untouched.
+    /// @param seed    The seed.
+    ///
+    static void load_seed(const uint8_t* in, EphemeralKey<kKeySize>& seed)
+    {
+        memcpy(seed.data(), in, kKeySize);
+    }
+
+    ///
+    /// @brief Check the parameters of a constrained key element
+    ///
+    /// @param height          The height of the tree.
+    /// @param st_height       The height of the subtree represented by the
+    ///                        element.
+    /// @param min             The minimum leaf index spanned by the subtree.
+    /// @param max             The maximum leaf index spanned by the subtree.
+    ///
+    /// @exception std::invalid_argument       The subtree height is 0, or is
+    ///                                        not smaller than the tree
+    ///                                        height.
+    /// @exception std::invalid_argument       The maximum leaf index is
+    ///                                        strictly smaller than the
+    ///                                        minimum leaf index, or the range
+    ///                                        does not span 2^(st_height-1)
+    ///                                        leaves.
+    ///
+    static void check_element(depth_type height,
+                              depth_type st_height,
+                              uint64_t   min,
+                              uint64_t   max);
+
     ///
     /// @brief Derive a leaf from an inner node
     ///
-    /// Derive a leaf from an inner node represented by a Prg object. This Prg
-    /// uses the content of the node as its key.
+    /// Derive a leaf from an inner node, represented either by a Prg object
+    /// using the content of the node as its key, or by the node's seed.
     ///
-    /// @param base_prg    The Prg object representing the node and using the
-    ///                    node's content as its key.
+    /// @param base        The starting node.
     /// @param base_depth  The depth of the starting node (a 0
     ///                    depth points to the root, a tree_height-1 depth
     ///                    corresponds to a leaf).
     /// @param leaf        The leaf to derive.
     ///
     /// @return An NBYTES buffer with the leaf's value.
-    std::array<uint8_t, NBYTES> derive_leaf(const Prg& base_prg,
-                                            depth_type base_depth,
-                                            uint64_t   leaf) const;
+    template<class BaseNode>
+    std::array<uint8_t, NBYTES> derive_leaf(const BaseNode& base,
+                                            depth_type      base_depth,
+                                            uint64_t        leaf) const;
 
     ///
     /// @brief Derive all leaves in a range from an inner node
     ///
-    /// Derive all the leaves in the given range from an inner node represented
-    /// by a Prg object. This Prg uses the content of the node as its key.
+    /// Derive all the leaves in the given range from an inner node.
     /// For this function, the considered subtree is not only specified by its
     /// depth, but also by its offset, i.e. the minimum leaf index of the tree.
     /// The input range is given relatively to the considered subtree, and not
     /// absolutely in the tree. This changes from derive_leaf, where the
     /// evaluation point is a reference to a leaf in the global tree.
     ///
+    /// @param base        The starting node (a Prg object or a seed, see
+    ///                    derive_leaf).
+    /// @param base_depth  The depth of the starting node (a 0
+    ///                    depth points to the root, a tree_height-1 depth
+    ///                    corresponds to a leaf).
+    /// @param tree_offset The offset of the considered subtree.
+    /// @param min         The minimum leaf index of the range in the subtree.
+    /// @param max         The maximum leaf index of the range in the subtree.
+    /// @param callback    The function to be called for every leaf. It can be
+    ///                    any callable object taking as input the leaf's index
+    ///                    and its value.
+    ///
+    template<class BaseNode, class F>
+    void derive_leaf_range(const BaseNode& base,
+                           depth_type      base_depth,
+                           uint64_t        tree_offset,
+                           uint64_t        min,
+                           uint64_t        max,
+                           F&              callback) const;
+
+    ///
+    /// @brief Derive all leaves in a range from an inner node into a buffer
+    ///
+    /// Derive all the leaves in the given range from an inner node represented
+    /// by a Prg object, and write their values, in order, in the out buffer.
+    /// The range is given relatively to the considered subtree, as for
+    /// derive_leaf_range.
+    ///
     /// @param base_prg    The Prg object representing the node and using the
     ///                    node's content as its key.
     /// @param base_depth  The depth of the starting node (a 0
     ///                    depth points to the root, a tree_height-1 depth
     ///                    corresponds to a leaf).
-    /// @param tree_offset The offset of the considered subtree.
     /// @param min         The minimum leaf index of the range in the subtree.
     /// @param max         The maximum leaf index of the range in the subtree.
+    /// @param out         The output buffer. It must be (max-min+1)*NBYTES
+    ///                    bytes large.
+    ///
+    void derive_leaf_range_into(const Prg& base_prg,
+                                depth_type base_depth,
+                                uint64_t   min,
+                                uint64_t   max,
+                                uint8_t*   out) const;
+
+    /// @brief Maximum number of nodes whose children are derived at once
+    static constexpr uint64_t kBatchWidth = 32;
+
+    /// @brief Height of the subtrees (tiles) expanded at once by the range
+    ///        evaluation
+    ///
+    /// The range evaluation expands the tree breadth-first down to the roots
+    /// of subtrees with 2^kTileHeight leaves, and then expands these tiles
+    /// one after the other. The levels of a tile (at most 2^(kTileHeight-1)
+    /// seeds) then stay in the CPU caches.
+    static constexpr depth_type kTileHeight = 10;
+
+    /// @brief Number of levels expanded at once above the tiles
+    ///
+    /// Above the tiles, the tree is expanded breadth-first by windows of
+    /// kWindowHeight levels below a single node, subtree by subtree: at most
+    /// 2^kWindowHeight seeds of a level are stored at once, whatever the size
+    /// of the range, and the memory of an evaluation is
+    /// O(tree_height/kWindowHeight * 2^kWindowHeight) seeds.
+    static constexpr depth_type kWindowHeight = 10;
+
+    ///
+    /// @brief Breadth-first range evaluation engine
+    ///
+    /// Derive all the leaves in the given range from an inner node, tile by
+    /// tile. The levels of the tree are stored as contiguous arrays of seeds
+    /// (of at most 2^kWindowHeight elements, see kWindowHeight) and expanded
+    /// with Prg::derive_batch. For every tile, the leaves are
+    /// written in the buffer returned by sink.begin_tile(first_leaf, n_leaves)
+    /// and then passed to sink.end_tile(first_leaf, n_leaves, leaves).
+    ///
+    /// @param base        The starting node (a Prg object or a seed, see
+    ///                    derive_leaf).
+    /// @param base_depth  The depth of the starting node.
+    /// @param min         The minimum leaf index of the range in the subtree.
+    /// @param max         The maximum leaf index of the range in the subtree.
+    /// @param sink        The receiver of the tiles' leaves.
+    ///
+    template<class BaseNode, class TileSink>
+    void derive_leaf_tiles(const BaseNode& base,
+                           depth_type      base_depth,
+                           uint64_t        min,
+                           uint64_t        max,
+                           TileSink&       sink) const;
+
+    ///
+    /// @brief Expand consecutive nodes of a level down to the leaves
+    ///
+    /// Derive the leaves in [min, max] (indices in the subtree of the base
+    /// node of derive_leaf_tiles) from the nodes lo to hi of the level at
+    /// height shift above the leaves, stored in the nodes array, and pass
+    /// them to the sink, tile by tile.
+    ///
+    template<class TileSink>
+    void expand_nodes(const EphemeralKey<kKeySize>* nodes,
+                      uint64_t                      lo,
+                      uint64_t                      hi,
+                      depth_type                    shift,
+                      uint64_t                      min,
+                      uint64_t                      max,
+                      TileSink&                     sink) const;
+
+    /// @brief Number of tasks in which the parallel range evaluations try to
+    ///        split their range
+    static constexpr uint64_t kParallelTasks = 64;
+
+    ///
+    /// @brief Split a range for parallel evaluation
+    ///
+    /// Splits the range [min, max] along the boundaries of the subtrees of
+    /// height h (i.e. of the blocks of 2^h leaves), and appends the pieces to
+    /// chunks. h is the smallest height, larger than kTileHeight, such that an
+    /// evaluation of n_leaves leaves is split in at most kParallelTasks pieces.
+    ///
+    /// @param min          The minimum leaf index of the range.
+    /// @param max          The maximum leaf index of the range.
+    /// @param n_leaves     The total number of leaves of the evaluation.
+    /// @param chunks       The pieces of the range.
+    ///
+    static void split_range(
+        uint64_t                                    min,
+        uint64_t                                    max,
+        uint64_t                                    n_leaves,
+        std::vector<std::pair<uint64_t, uint64_t>>& chunks);
+
+    ///
+    /// @brief Derive a range of nodes from the previous level of the tree
+    ///
+    /// Writes the values of the nodes lo to hi (indices in their level) in
+    /// the out buffer, child_len bytes per node. The parents of these nodes
+    /// (lo/2 to hi/2) must be stored consecutively in the parents array, whose
+    /// first element is the node of index first_parent.
+    ///
+    /// @param parents      The seeds of the parent level.
+    /// @param first_parent The index of parents[0] in its level.
+    /// @param lo           The index of the first node to derive.
+    /// @param hi           The index of the last node to derive.
+    /// @param child_len    The size of a node's value (kKeySize for inner
+    ///                     nodes, NBYTES for leaves).
+    /// @param out          The output buffer. It must be
+    ///                     (hi-lo+1)*child_len bytes large.
     ///
-    void derive_leaf_range(const Prg&    base_prg,
-                           depth_type    base_depth,
-                           uint64_t      tree_offset,
-                           uint64_t      min,
-                           uint64_t      max,
-                           callback_type callback) const;
+    static void expand_level(const EphemeralKey<kKeySize>* parents,
+                             uint64_t                      first_parent,
+                             uint64_t                      lo,
+                             uint64_t                      hi,
+                             size_t                        child_len,
+                             uint8_t*                      out);
 
     ///
     /// @brief Generate the constrained key necessary to derive the tree's
@@ -316,31 +543,109 @@ protected:
             constrained_elements);
 
     ///
-    /// @brief Generate a leaf from its parent node.
+    /// @brief Generate the nodes necessary to derive the leaves in the
+    ///        specified range.
     ///
-    /// Computes the leaf given as input from its parent node, represented by
-    /// the base_prg object. This function is a specialization of the
-    /// generate_constrained_subkeys_from_node function for height 2 subtrees.
+    /// Generic version of generate_constrained_subkeys_from_node: the starting
+    /// node can be a Prg object or a seed, and the generated nodes are passed
+    /// to the sink object, that must provide the following functions:
+    ///     - add_inner(key, subtree_height, subtree_min, subtree_max), with key
+    ///       a pointer to the kKeySize bytes of an inner node;
+    ///     - add_leaf(value, leaf), with value a pointer to the NBYTES bytes of
+    ///       the leaf.
+    /// The buffers passed to the sink are zeroized afterwards. The nodes are
+    /// not generated in order.
     ///
-    /// @param base_prg        The Prg object representing the parent node of
-    ///                        the leaf to generate.
-    /// @param tree_height     The height of the tree.
+    /// @param base            The node to start the generation from.
+    /// @param subtree_height  The height of the base node rooted subtree.
     /// @param subtree_min     The minimum leaf index supported by the subtree
-    ///                        (of height two) rooted at the base node. The
-    ///                        subtree's maximum leaf index does not have to be
-    ///                        specified: we know it is subtree_min+1.
-    /// @param leaf            The index of the leaf to generate.
+    ///                        rooted at the base node.
+    /// @param subtree_max     The maximum leaf index supported by the subtree
+    ///                        rooted at the base node.
+    /// @param min             The minimum value of the leaves index being able
+    ///                        to be generated from the output of the algorithm.
+    /// @param max             The maximum value of the leaves index being able
+    ///                        to be generated from the output of the algorithm.
+    /// @param sink            The receiver of the generated nodes.
     ///
-    /// @param[out] constrained_elements   The vector of nodes in which the leaf
-    ///                                    to generate will be put.
+    template<class BaseNode, class Sink>
+    static void generate_constrained_nodes(const BaseNode&  base,
+                                           const depth_type subtree_height,
+                                           const uint64_t   subtree_min,
+                                           const uint64_t   subtree_max,
+                                           const uint64_t   min,
+                                           const uint64_t   max,
+                                           Sink&            sink);
+
     ///
-    static void generate_leaf_from_parent(
-        const Prg&       base_prg,
-        const depth_type tree_height,
-        const uint64_t   subtree_min,
-        const uint64_t   leaf,
-        std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>&
-            constrained_elements);
+    /// @brief Sink of generate_constrained_nodes appending the generated nodes
+    ///        to a vector of constrained key elements.
+    ///
+    class ElementVectorSink
+    {
+    public:
+        ElementVectorSink(
+            depth_type tree_height,
+            std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>&
+                elements)
+            : tree_height_(tree_height), elements_(elements),
+              first_(elements.size())
+        {
+        }
+
+        void add_inner(const uint8_t* key,
+                       depth_type     subtree_height,
+                       uint64_t       min,
+                       uint64_t       max)
+        {
+            std::array<uint8_t, kKeySize> buffer;
+            memcpy(buffer.data(), key, kKeySize);
+
+            // the Key constructor zeroizes the buffer
+            std::unique_ptr<ConstrainedRCPrfInnerElement<NBYTES>> elt(
+                new ConstrainedRCPrfInnerElement<NBYTES>(
+                    Key<kKeySize>(buffer.data()),
+                    tree_height_,
+                    subtree_height,
+                    min,
+                    max));
+            elements_.push_back(std::move(elt));
+        }
+
+        void add_leaf(const uint8_t* value, uint64_t leaf)
+        {
+            std::array<uint8_t, NBYTES> buffer;
+            memcpy(buffer.data(), value, NBYTES);
+
+            std::unique_ptr<ConstrainedRCPrfLeafElement<NBYTES>> elt(
+                new ConstrainedRCPrfLeafElement<NBYTES>(
+                    buffer, tree_height_, leaf));
+            elements_.push_back(std::move(elt));
+
+            sodium_memzero(buffer.data(), NBYTES);
+        }
+
+        /// @brief Sort the elements appended by the sink by increasing leaf
+        /// range
+        void sort_elements()
+        {
+            std::sort(
+                elements_.begin() + static_cast<std::ptrdiff_t>(first_),
+                elements_.end(),
+                [](const std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>& a,
+                   const std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>& b) {
+                    return a->min_leaf() < b->min_leaf();
+                });
+        }
+
+    private:
+        using element_vector
+            = std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>;
+
+        depth_type      tree_height_;
+        element_vector& elements_;
+        size_t          first_;
+    };
 
 private:
     depth_type tree_height_;
@@ -348,10 +653,40 @@ private:
 
 
 template<uint16_t NBYTES>
+void RCPrfBase<NBYTES>::check_element(depth_type height,
+                                      depth_type st_height,
+                                      uint64_t   min,
+                                      uint64_t   max)
+{
+    if (st_height == 0) {
+        throw std::invalid_argument("Subtree height should be strictly "
+                                    "larger than 0.");
+    }
+    if (st_height >= height) {
+        throw std::invalid_argument(
+            "Subtree height is not smaller than the tree height");
+    }
+    if (max < min) {
+        throw std::invalid_argument(
+            "Invalid range: min is larger than max: max=" + std::to_string(max)
+            + ", min=" + std::to_string(min));
+    }
+    if ((max - min) != RCPrfParams::max_leaf_index(st_height)) {
+        throw std::invalid_argument(
+            "Invalid range: the range's width "
+            "should be 2^(subtree_height - 1): range's width="
+            + std::to_string(max - min + 1) + "(max=" + std::to_string(max)
+            + ", min=" + std::to_string(min) + "), expected width = "
+            + std::to_string(RCPrfParams::max_leaf_index(st_height) + 1));
+    }
+}
+
+template<uint16_t NBYTES>
+template<class BaseNode>
 std::array<uint8_t, NBYTES> RCPrfBase<NBYTES>::derive_leaf(
-    const Prg& base_prg,
-    depth_type base_depth,
-    uint64_t   leaf) const
+    const BaseNode& base,
+    depth_type      base_depth,
+    uint64_t        leaf) const
 {
     assert(this->tree_height() >= 2); // this has to be an inner node
     // with the previous check, we can substract 1 without risking an underflow
@@ -363,8 +698,8 @@ std::array<uint8_t, NBYTES> RCPrfBase<NBYTES>::derive_leaf(
         std::array<uint8_t, NBYTES> result;
 
         // finish by evaluating the leaf
-        base_prg.derive(
-            static_cast<uint32_t>(child) * NBYTES, NBYTES, result.data());
+        derive_node(
+            base, static_cast<uint32_t>(child) * NBYTES, NBYTES, result.data());
 
         return result;
     }
@@ -372,15 +707,20 @@ std::array<uint8_t, NBYTES> RCPrfBase<NBYTES>::derive_leaf(
     // the previous test ensures that the tree_height is >= 2
     assert(this->tree_height() - 2 > base_depth);
 
-    // the first step is done from the base PRG
-    RCPrfTreeNodeChild child = get_child(leaf, base_depth);
-    Key<kKeySize>      subkey
-        = base_prg.derive_key<kKeySize>(static_cast<uint16_t>(child));
+    // the first step is done from the base node
+    // the intermediate keys never leave this function: use ephemeral keys to
+    // avoid allocating (and protecting) memory at each level
+    RCPrfTreeNodeChild     child = get_child(leaf, base_depth);
+    EphemeralKey<kKeySize> subkey;
+    EphemeralKey<kKeySize> next_subkey;
+
+    derive_child(base, static_cast<uint16_t>(child), subkey);
     // now proceed with the subkeys until we reach the leaf's parent
     for (uint8_t i = base_depth + 1; i < this->tree_height() - 2; i++) {
-        child  = get_child(leaf, i);
-        subkey = Prg::derive_key<kKeySize>(std::move(subkey),
-                                           static_cast<uint16_t>(child));
+        child = get_child(leaf, i);
+        Prg::derive_key<kKeySize>(
+            subkey, static_cast<uint16_t>(child), next_subkey);
+        subkey = std::move(next_subkey);
     }
 
     std::array<uint8_t, NBYTES> result;
@@ -388,94 +728,296 @@ std::array<uint8_t, NBYTES> RCPrfBase<NBYTES>::derive_leaf(
     // finish by evaluating the leaf
     child = get_child(leaf, tree_height() - 2);
 
-    Prg::derive(std::move(subkey),
-                static_cast<uint32_t>(child) * NBYTES,
-                NBYTES,
-                result.data());
+    Prg::derive(
+        subkey, static_cast<uint32_t>(child) * NBYTES, NBYTES, result.data());
 
     return result;
 }
 
 template<uint16_t NBYTES>
-void RCPrfBase<NBYTES>::derive_leaf_range(const Prg&    base_prg,
-                                          depth_type    base_depth,
-                                          uint64_t      tree_offset,
-                                          uint64_t      min,
-                                          uint64_t      max,
-                                          callback_type callback) const
+template<class BaseNode, class F>
+void RCPrfBase<NBYTES>::derive_leaf_range(const BaseNode& base,
+                                          depth_type      base_depth,
+                                          uint64_t        tree_offset,
+                                          uint64_t        min,
+                                          uint64_t        max,
+                                          F&              callback) const
+{
+    static_assert(sizeof(std::array<uint8_t, NBYTES>) == NBYTES,
+                  "The leaves of a tile must be stored contiguously");
+
+    // the leaves of every tile are generated in a block, and then passed one
+    // by one to the callback, without any copy
+    struct CallbackSink
+    {
+        uint64_t                                 tree_offset;
+        F&                                       callback;
+        std::vector<std::array<uint8_t, NBYTES>> block;
+
+        uint8_t* begin_tile(uint64_t, size_t)
+        {
+            return block[0].data();
+        }
+
+        void end_tile(uint64_t first, size_t n, const uint8_t*)
+        {
+            for (size_t i = 0; i < n; i++) {
+                callback(tree_offset + first + i,
+                         static_cast<const std::array<uint8_t, NBYTES>&>(
+                             block[i]));
+            }
+            sodium_memzero(block[0].data(), n * NBYTES);
+        }
+    };
+
+    const uint64_t tile_leaves = static_cast<uint64_t>(1) << kTileHeight;
+    const size_t   block_leaves
+        = static_cast<size_t>(std::min(max - min + 1, tile_leaves));
+
+    CallbackSink sink{tree_offset,
+                      callback,
+                      std::vector<std::array<uint8_t, NBYTES>>(block_leaves)};
+
+    derive_leaf_tiles(base, base_depth, min, max, sink);
+}
+
+template<uint16_t NBYTES>
+void RCPrfBase<NBYTES>::derive_leaf_range_into(const Prg& base_prg,
+                                               depth_type base_depth,
+                                               uint64_t   min,
+                                               uint64_t   max,
+                                               uint8_t*   out) const
+{
+    // the leaves are directly generated in the output buffer
+    struct BufferSink
+    {
+        uint64_t min;
+        uint8_t* out;
+
+        uint8_t* begin_tile(uint64_t first, size_t)
+        {
+            return out + (first - min) * NBYTES;
+        }
+
+        void end_tile(uint64_t, size_t, const uint8_t*)
+        {
+        }
+    };
+
+    BufferSink sink{min, out};
+
+    derive_leaf_tiles(base_prg, base_depth, min, max, sink);
+}
+
+template<uint16_t NBYTES>
+template<class BaseNode, class TileSink>
+void RCPrfBase<NBYTES>::derive_leaf_tiles(const BaseNode& base,
+                                          depth_type      base_depth,
+                                          uint64_t        min,
+                                          uint64_t        max,
+                                          TileSink&       sink) const
 {
+    static_assert(sizeof(EphemeralKey<kKeySize>) == kKeySize,
+                  "The seeds of a level must be stored contiguously");
+
     assert(max >= min);
     assert(this->tree_height() > base_depth + 1);
 
-    if (this->tree_height() == base_depth + 2) {
-        // we are at the last level befor the leaves
-        // there are 3 mutually exclusive possibilities: both leaves must be
-        // generated, or only the left one, or only the right one.
+    const depth_type leaf_depth = static_cast<depth_type>(tree_height() - 1);
 
-        assert((max - min) <= 1);
+    if (leaf_depth == base_depth + 1) {
+        // we are at the last level before the leaves: the leaves are
+        // consecutive in the base node's pseudo-random stream
+        assert(max <= 1);
 
+        const size_t n_leaves = static_cast<size_t>(max - min + 1);
+        uint8_t*     leaves   = sink.begin_tile(min, n_leaves);
 
-        // start with the min leaf
-        RCPrfTreeNodeChild          child = get_child(min, base_depth);
-        std::array<uint8_t, NBYTES> result;
+        derive_node(
+            base, static_cast<size_t>(min) * NBYTES, n_leaves * NBYTES, leaves);
+        sink.end_tile(min, n_leaves, leaves);
+        return;
+    }
 
-        // finish by evaluating the leaf
-        base_prg.derive(
-            static_cast<uint32_t>(child) * NBYTES, NBYTES, result.data());
+    // derive the children of the base node that cover the range.
+    // At any time, shift is the height of the current level above the leaves.
+    depth_type shift = static_cast<depth_type>(leaf_depth - base_depth - 1);
+    uint64_t   lo    = min >> shift;
+    uint64_t   hi    = max >> shift;
 
-        callback(tree_offset + min, result);
+    std::vector<EphemeralKey<kKeySize>> level(static_cast<size_t>(hi - lo + 1));
+    for (uint64_t c = lo; c <= hi; c++) {
+        derive_child(base, static_cast<uint16_t>(c), level[c - lo]);
+    }
 
-        if (min != max) {
-            // both leaves must be generated. The min leaf was the left leaf,
-            // generate the right leaf.
+    expand_nodes(level.data(), lo, hi, shift, min, max, sink);
+}
 
-            base_prg.derive(
-                static_cast<uint32_t>(RCPrfTreeNodeChild::RightChild) * NBYTES,
-                NBYTES,
-                result.data());
+template<uint16_t NBYTES>
+template<class TileSink>
+void RCPrfBase<NBYTES>::expand_nodes(const EphemeralKey<kKeySize>* nodes,
+                                     uint64_t                      lo,
+                                     uint64_t                      hi,
+                                     depth_type                    shift,
+                                     uint64_t                      min,
+                                     uint64_t                      max,
+                                     TileSink&                     sink) const
+{
+    if (shift > kTileHeight) {
+        // expand the subtree of every node, one after the other, by a window
+        // of at most kWindowHeight levels, but not below the roots of the
+        // tiles
+        const depth_type target = static_cast<depth_type>(
+            std::max<int>(kTileHeight, shift - kWindowHeight));
+        const size_t max_level_size = static_cast<size_t>(1)
+                                      << (shift - target);
+
+        std::vector<EphemeralKey<kKeySize>> buffers[2]
+            = {std::vector<EphemeralKey<kKeySize>>(max_level_size),
+               std::vector<EphemeralKey<kKeySize>>(max_level_size)};
+
+        for (uint64_t node = lo; node <= hi; node++) {
+            const uint64_t sub_min = std::max(min, node << shift);
+            const uint64_t sub_max = std::min(max, ((node + 1) << shift) - 1);
+
+            const EphemeralKey<kKeySize>* parents      = &nodes[node - lo];
+            uint64_t                      first_parent = node;
+
+            for (depth_type h = static_cast<depth_type>(shift - 1); h >= target;
+                 h--) {
+                std::vector<EphemeralKey<kKeySize>>& children = buffers[h & 1];
+
+                expand_level(parents,
+                             first_parent,
+                             sub_min >> h,
+                             sub_max >> h,
+                             kKeySize,
+                             children[0].data());
+
+                parents      = children.data();
+                first_parent = sub_min >> h;
+            }
 
-            callback(tree_offset + max, result);
+            expand_nodes(parents,
+                         sub_min >> target,
+                         sub_max >> target,
+                         target,
+                         sub_min,
+                         sub_max,
+                         sink);
         }
-
         return;
     }
 
-    assert(this->tree_height() - base_depth > 2);
+    // the nodes are the roots of the tiles: expand them one after the other.
+    // Their inner levels alternate between two buffers.
+    const size_t max_level_size = static_cast<size_t>(1) << (shift - 1);
+
+    std::vector<EphemeralKey<kKeySize>> buffers[2]
+        = {std::vector<EphemeralKey<kKeySize>>(max_level_size),
+           std::vector<EphemeralKey<kKeySize>>(max_level_size)};
+
+    for (uint64_t root = lo; root <= hi; root++) {
+        const uint64_t tile_min = std::max(min, root << shift);
+        const uint64_t tile_max = std::min(max, ((root + 1) << shift) - 1);
 
-    // The threshold variable represent the minimum leaf index of the right
-    // subtree
-    uint64_t threshold = max_leaf_index(this->tree_height() - base_depth - 1);
+        const EphemeralKey<kKeySize>* parents      = &nodes[root - lo];
+        uint64_t                      first_parent = root;
 
-    // start by looking for the left subpart of the tree
-    if (min <= threshold) {
-        Key<kKeySize> subkey = base_prg.derive_key<kKeySize>(
-            static_cast<uint16_t>(RCPrfTreeNodeChild::LeftChild));
+        for (depth_type h = static_cast<depth_type>(shift - 1); h > 0; h--) {
+            std::vector<EphemeralKey<kKeySize>>& children = buffers[h & 1];
 
-        derive_leaf_range(Prg(std::move(subkey)),
-                          base_depth + 1,
-                          tree_offset,
-                          min,
-                          std::min(max, threshold),
-                          callback);
+            const uint64_t c_lo = tile_min >> h;
+            const uint64_t c_hi = tile_max >> h;
+
+            expand_level(parents,
+                         first_parent,
+                         c_lo,
+                         c_hi,
+                         kKeySize,
+                         children[0].data());
+
+            parents      = children.data();
+            first_parent = c_lo;
+        }
+
+        const size_t n_leaves = static_cast<size_t>(tile_max - tile_min + 1);
+        uint8_t*     leaves   = sink.begin_tile(tile_min, n_leaves);
+
+        expand_level(parents, first_parent, tile_min, tile_max, NBYTES, leaves);
+        sink.end_tile(tile_min, n_leaves, leaves);
     }
+}
 
-    // now, time for the right subtree
-    if (max > threshold) {
-        Key<kKeySize> subkey = base_prg.derive_key<kKeySize>(
-            static_cast<uint16_t>(RCPrfTreeNodeChild::RightChild));
+template<uint16_t NBYTES>
+void RCPrfBase<NBYTES>::split_range(
+    uint64_t                                    min,
+    uint64_t                                    max,
+    uint64_t                                    n_leaves,
+    std::vector<std::pair<uint64_t, uint64_t>>& chunks)
+{
+    depth_type h = kTileHeight;
+    while (h < 63 && (n_leaves >> h) > kParallelTasks) {
+        h++;
+    }
 
-        // as we are moving to the right subtree, we have to update the offset
-        // and the range accordingly
-        uint64_t sub_min = (min <= threshold) ? 0 : (min - threshold - 1);
-        uint64_t sub_max = max - threshold - 1;
+    for (uint64_t t = min >> h; t <= (max >> h); t++) {
+        chunks.emplace_back(std::max(min, t << h),
+                            std::min(max, ((t + 1) << h) - 1));
+    }
+}
 
-        derive_leaf_range(Prg(std::move(subkey)),
-                          base_depth + 1,
-                          tree_offset + threshold + 1,
-                          sub_min,
-                          sub_max,
-                          callback);
+template<uint16_t NBYTES>
+void RCPrfBase<NBYTES>::expand_level(const EphemeralKey<kKeySize>* parents,
+                                     uint64_t first_parent,
+                                     uint64_t lo,
+                                     uint64_t hi,
+                                     size_t   child_len,
+                                     uint8_t* out)
+{
+    // parents with both children in the range
+    const EphemeralKey<kKeySize>* full_keys[kBatchWidth];
+    size_t                        full_offsets[kBatchWidth];
+    unsigned char*                full_outs[kBatchWidth];
+    size_t                        n_full = 0;
+
+    // the first and the last parents might have a single child in the range
+    const EphemeralKey<kKeySize>* partial_keys[2];
+    size_t                        partial_offsets[2];
+    unsigned char*                partial_outs[2];
+    size_t                        n_partial = 0;
+
+    for (uint64_t p = lo / 2; p <= hi / 2; p++) {
+        const uint64_t c_first = std::max(lo, 2 * p);
+        const uint64_t c_last  = std::min(hi, 2 * p + 1);
+
+        const EphemeralKey<kKeySize>* key = &parents[p - first_parent];
+        unsigned char*                dst = out + (c_first - lo) * child_len;
+
+        if (c_first != c_last) {
+            full_keys[n_full]    = key;
+            full_offsets[n_full] = 0;
+            full_outs[n_full]    = dst;
+            n_full++;
+
+            if (n_full == kBatchWidth) {
+                Prg::derive_batch(
+                    n_full, full_keys, full_offsets, 2 * child_len, full_outs);
+                n_full = 0;
+            }
+        } else {
+            assert(n_partial < 2);
+            partial_keys[n_partial]    = key;
+            partial_offsets[n_partial] = (c_first - 2 * p) * child_len;
+            partial_outs[n_partial]    = dst;
+            n_partial++;
+        }
     }
+
+    Prg::derive_batch(
+        n_full, full_keys, full_offsets, 2 * child_len, full_outs);
+    Prg::derive_batch(
+        n_partial, partial_keys, partial_offsets, child_len, partial_outs);
 }
 
 ///
@@ -493,6 +1035,7 @@ template<uint16_t NBYTES>
 class ConstrainedRCPrfElement : public RCPrfBase<NBYTES>
 {
     friend class ConstrainedRCPrf<NBYTES>;
+    friend class ConstrainedRCPrfView<NBYTES>;
 
 public:
     using callback_type = typename RCPrfBase<NBYTES>::callback_type;
@@ -526,32 +1069,7 @@ public:
         : RCPrfBase<NBYTES>(height), subtree_height_(st_height), min_leaf_(min),
           max_leaf_(max)
     {
-        if (st_height == 0) {
-            /* LCOV_EXCL_START */
-            // already covered by the subclasses
-            throw std::invalid_argument("Subtree height should be strictly "
-                                        "larger than 0.");
-            /* LCOV_EXCL_STOP */
-        }
-        if (st_height >= this->tree_height()) {
-            throw std::invalid_argument(
-                "Subtree height is not smaller than the tree height");
-        }
-        if (max < min) {
-            throw std::invalid_argument(
-                "Invalid range: min is larger than max: max="
-                + std::to_string(max) + ", min=" + std::to_string(min));
-        }
-        if ((max - min)
-            != RCPrfParams::max_leaf_index(this->subtree_height())) {
-            throw std::invalid_argument(
-                "Invalid range: the range's width "
-                "should be 2^(subtree_height - 1): range's width="
-                + std::to_string(max - min + 1) + "(max=" + std::to_string(max)
-                + ", min=" + std::to_string(min) + "), expected width = "
-                + std::to_string(
-                      RCPrfParams::max_leaf_index(this->subtree_height()) + 1));
-        }
+        RCPrfBase<NBYTES>::check_element(height, st_height, min, max);
     }
 
     /// @brief Copy constructor
@@ -613,6 +1131,24 @@ public:
                             uint64_t             max,
                             const callback_type& callback) const = 0;
 
+    ///
+    /// @brief Evaluate the RC-PRF on a range
+    ///
+    /// Same as the virtual eval_range function, but the callback can be any
+    /// callable object, whose calls can be inlined by the compiler. This is
+    /// faster than going through an std::function for every leaf.
+    ///
+    /// @param min      The minimum leaf index of the range.
+    /// @param max      The maximum leaf index of the range.
+    /// @param callback The function to be called for every generated value. The
+    ///                 callback must take as input the leaf's index and its
+    ///                 value
+    ///
+    /// @exception std::invalid_argument    max is smaller than min
+    /// @exception std::out_of_range        The range is not included in
+    ///                                     [min_leaf(),max_leaf()]
+    template<class F>
+    void eval_range(uint64_t min, uint64_t max, F&& callback) const;
 
 private:
     /// @brief Size of an element's basic informations. The element's
@@ -620,21 +1156,22 @@ private:
     static constexpr size_t kSerializedElementInfoSize
         = sizeof(RCPrfParams::depth_type) + 2 * sizeof(uint64_t);
 
-    /// @brief Copies the element's information in the buffer, starting with the
+    /// @brief Copies an element's information in the buffer, starting with the
     /// subtree height, the minimum leaf and the maximum leaf.
-    void serialize_element_info(uint8_t* out) const noexcept
+    static void serialize_element_info(RCPrfParams::depth_type subtree_height,
+                                       uint64_t                min_leaf,
+                                       uint64_t                max_leaf,
+                                       uint8_t*                out) noexcept
     {
-        memcpy(out, &this->subtree_height_, sizeof(this->subtree_height_));
-        memcpy(out + sizeof(this->subtree_height_),
-               &this->min_leaf_,
-               sizeof(this->min_leaf_));
-        memcpy(out + sizeof(this->subtree_height_) + sizeof(this->min_leaf_),
-               &this->max_leaf_,
-               sizeof(this->max_leaf_));
+        memcpy(out, &subtree_height, sizeof(subtree_height));
+        memcpy(out + sizeof(subtree_height), &min_leaf, sizeof(min_leaf));
+        memcpy(out + sizeof(subtree_height) + sizeof(min_leaf),
+               &max_leaf,
+               sizeof(max_leaf));
     }
 
     static void deserialize_element_info(
-        uint8_t*                 in,
+        const uint8_t*           in,
         RCPrfParams::depth_type& subtree_height,
         uint64_t&                min_leaf,
         uint64_t&                max_leaf) noexcept
@@ -782,6 +1319,10 @@ public:
                     uint64_t             max,
                     const callback_type& callback) const override;
 
+    // Already documented by the parent class
+    template<class F>
+    void eval_range(uint64_t min, uint64_t max, F&& callback) const;
+
     // Already documented by the parent class
     void generate_constrained_subkeys(
         const uint64_t min,
@@ -850,6 +1391,15 @@ void ConstrainedRCPrfInnerElement<NBYTES>::eval_range(
     uint64_t             min,
     uint64_t             max,
     const callback_type& callback) const
+{
+    this->template eval_range<const callback_type&>(min, max, callback);
+}
+
+template<uint16_t NBYTES>
+template<class F>
+void ConstrainedRCPrfInnerElement<NBYTES>::eval_range(uint64_t min,
+                                                      uint64_t max,
+                                                      F&&      callback) const
 {
     if (max < min) {
         throw std::invalid_argument(
@@ -985,6 +1535,10 @@ public:
                     uint64_t             max,
                     const callback_type& callback) const override;
 
+    // Already documented by the parent class
+    template<class F>
+    void eval_range(uint64_t min, uint64_t max, F&& callback) const;
+
     // Already documented by the parent class
     void generate_constrained_subkeys(
         const uint64_t min,
@@ -1047,6 +1601,15 @@ void ConstrainedRCPrfLeafElement<NBYTES>::eval_range(
     uint64_t             min,
     uint64_t             max,
     const callback_type& callback) const
+{
+    this->template eval_range<const callback_type&>(min, max, callback);
+}
+
+template<uint16_t NBYTES>
+template<class F>
+void ConstrainedRCPrfLeafElement<NBYTES>::eval_range(uint64_t min,
+                                                     uint64_t max,
+                                                     F&&      callback) const
 {
     if (max != min) {
         throw std::invalid_argument(
@@ -1064,6 +1627,23 @@ void ConstrainedRCPrfLeafElement<NBYTES>::eval_range(
     callback(min, leaf_buffer_);
 }
 
+template<uint16_t NBYTES>
+template<class F>
+void ConstrainedRCPrfElement<NBYTES>::eval_range(uint64_t min,
+                                                 uint64_t max,
+                                                 F&&      callback) const
+{
+    // the elements are either leaves (whose subtree height is 1), or inner
+    // nodes (see ConstrainedRCPrf::deserialize)
+    if (subtree_height() == 1) {
+        static_cast<const ConstrainedRCPrfLeafElement<NBYTES>*>(this)
+            ->eval_range(min, max, callback);
+    } else {
+        static_cast<const ConstrainedRCPrfInnerElement<NBYTES>*>(this)
+            ->eval_range(min, max, callback);
+    }
+}
+
 template<uint16_t NBYTES>
 void ConstrainedRCPrfLeafElement<NBYTES>::generate_constrained_subkeys(
     const uint64_t min,
@@ -1095,12 +1675,29 @@ void ConstrainedRCPrfLeafElement<NBYTES>::generate_constrained_subkeys(
 /// cannot evaluate the PRF on inputs outside of the specified range from the
 /// return ConstrainedRCPrf object
 ///
+/// The constrained key is a set of tree nodes (the elements), stored in a flat
+/// layout: the descriptors of the elements (subtree height, minimum and
+/// maximum leaf) are packed in an array, sorted by increasing leaf range, and
+/// the values of the elements (the seeds of the inner nodes and the values of
+/// the leaves) are stored in a single guarded buffer, allocated with
+/// sodium_malloc and zeroized when freed. Constraining, evaluating or
+/// (de)serializing the object hence does not cost an allocation per element.
+/// As the content of a Key, the seeds' buffer is mprotect'ed once the object
+/// is built, and only unlocked by reference counted sessions: an evaluation
+/// (or a parallel range evaluation) opens a single session, whatever the
+/// number of elements it reads, and a shared object can be evaluated
+/// concurrently.
+///
 /// @tparam NBYTES     The size in bytes of the generated leaf value.
 ///
 template<uint16_t NBYTES>
 class ConstrainedRCPrf : public RCPrfBase<NBYTES>
 {
+    friend void test_constrained_rcprf_deserialization();
+
     friend class Wrapper;
+    friend class RCPrfBase<NBYTES>;
+    friend class RCPrf<NBYTES>;
 
 public:
     using callback_type = typename RCPrfBase<NBYTES>::callback_type;
@@ -1128,7 +1725,8 @@ public:
     /// @brief Constructor
     ///
     /// Creates a ConstrainedRCPrf from a vector of key elements (i.e. a set
-    /// of tree nodes).
+    /// of tree nodes). The values of the elements are copied in the flat
+    /// representation of the constrained key.
     ///
     /// @param elements     The vector containing the key elements. The
     /// vector
@@ -1148,30 +1746,20 @@ public:
     explicit ConstrainedRCPrf(
         std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>&&
             elements)
-        : RCPrfBase<NBYTES>(get_element_height(elements)),
-          elements_(std::move(elements))
+        : ConstrainedRCPrf(get_element_height(elements), elements.size())
     {
-        // sort the elements
-        struct MinComparator
-        {
-            bool operator()(
-                const std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>& elt_1,
-                const std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>& elt_2)
-            {
-                return elt_1->min_leaf() < elt_2->min_leaf();
-            }
-        };
-        std::sort(elements_.begin(), elements_.end(), MinComparator());
-
-        // check that the elements are consecutive (if the elements_ array is
-        // non empty)
-        if (!is_empty()) {
-            for (auto it = elements_.begin() + 1; it != elements_.end(); ++it) {
-                if ((*(it - 1))->max_leaf() + 1 != (*it)->min_leaf()) {
-                    throw std::invalid_argument("Non consecutive elements");
-                }
-            }
+        for (const auto& elt : elements) {
+            // the serialization of an element is its value
+            assert(elt->serialized_size()
+                   == element_value_size(elt->subtree_height()));
+
+            elt->serialize(append_element(
+                elt->subtree_height(), elt->min_leaf(), elt->max_leaf()));
         }
+        elements.clear();
+
+        sort_elements();
+        seal_seeds();
     }
 
     ConstrainedRCPrf(const ConstrainedRCPrf<NBYTES>& cprf) = delete;
@@ -1181,38 +1769,59 @@ public:
     ///
     /// @brief Move constructor
     ///
-    /// @param cprf The ConstrainedRCPrfInnerElement to be moved
+    /// @param cprf The ConstrainedRCPrf to be moved. It must not be evaluated
+    ///             concurrently.
     ///
-    // The following implementation is equivalent to the defaulted
-    // move constructor. On gcc-4.8, there is a linkage issue when the
-    // constructor is defaulted.
     ConstrainedRCPrf(ConstrainedRCPrf<NBYTES>&& cprf) noexcept
         : RCPrfBase<NBYTES>(std::move(static_cast<RCPrfBase<NBYTES>&&>(cprf))),
-          elements_(std::move(cprf.elements_))
+          elements_(std::move(cprf.elements_)), seeds_(cprf.seeds_),
+          capacity_(cprf.capacity_), seeds_locked_(cprf.seeds_locked_)
     {
+        cprf.elements_.clear();
+        cprf.seeds_        = nullptr;
+        cprf.capacity_     = 0;
+        cprf.seeds_locked_ = false;
     }
 
     ///
     /// @brief Move assignment operator
     ///
-    /// @param cprf The ConstrainedRCPrfInnerElement to be moved
+    /// @param cprf The ConstrainedRCPrf to be moved
     ///
-    // The following implementation is equivalent to the defaulted
-    // move-assignment operator. Unfortunately, gcc-4.8 does not allow us to
-    // declare this operator noexcept by default. However, a hand-written
-    // implementation bypasses the problem.
     ConstrainedRCPrf& operator=(ConstrainedRCPrf<NBYTES>&& cprf) noexcept
     {
-        static_cast<RCPrfBase<NBYTES>&>(*this)
-            = static_cast<RCPrfBase<NBYTES>&>(cprf);
-        elements_ = std::move(cprf.elements_);
-
+        if (this != &cprf) {
+            static_cast<RCPrfBase<NBYTES>&>(*this)
+                = static_cast<RCPrfBase<NBYTES>&>(cprf);
+
+            free_seeds();
+            elements_     = std::move(cprf.elements_);
+            seeds_        = cprf.seeds_;
+            capacity_     = cprf.capacity_;
+            seeds_locked_ = cprf.seeds_locked_;
+            seed_sessions_.reset();
+
+            cprf.elements_.clear();
+            cprf.seeds_        = nullptr;
+            cprf.capacity_     = 0;
+            cprf.seeds_locked_ = false;
+        }
         return *this;
     }
     /* LCOV_EXCL_STOP */
 
-    /// @brief Check if the constrain is empty (i.e. the range of supported
-    /// leaves is empty)
+    ///
+    /// @brief Destructor
+    ///
+    /// Zeroizes and frees the values of the elements.
+    ///
+    ~ConstrainedRCPrf() override
+    {
+        free_seeds();
+    }
+
+    /// @brief Check if the constrain is empty (i.e. the range of supported
+    /// leaves is empty)
     ///
     bool is_empty() const
     {
@@ -1230,7 +1839,7 @@ public:
         if (is_empty()) {
             return UINT64_MAX;
         }
-        return elements_[0]->min_leaf();
+        return elements_[0].min_leaf;
     }
 
     /// @brief Returns the maximum leaf index supported by the constrained
@@ -1242,7 +1851,7 @@ public:
         if (is_empty()) {
             return 0;
         }
-        return elements_[elements_.size() - 1]->max_leaf();
+        return elements_[elements_.size() - 1].max_leaf;
     }
 
     /// @brief Evaluate the RC-RPF.
@@ -1282,6 +1891,52 @@ public:
                     uint64_t             max,
                     const callback_type& callback) const;
 
+    ///
+    /// @brief Evaluate the RC-PRF on a range
+    ///
+    /// Same as eval_range(min, max, callback) with an std::function callback,
+    /// but the callback can be any callable object, whose calls can be inlined
+    /// by the compiler. This is faster than going through an std::function for
+    /// every leaf.
+    ///
+    /// @param min      The minimum leaf index of the range.
+    /// @param max      The maximum leaf index of the range.
+    /// @param callback The function to be called for every generated value. The
+    ///                 callback must take as input the leaf's index and its
+    ///                 value
+    ///
+    /// @exception std::invalid_argument    max is smaller than min
+    /// @exception std::out_of_range        The range is not included in
+    ///                                     [min_leaf(),max_leaf()]
+    template<class F>
+    void eval_range(uint64_t min, uint64_t max, F&& callback) const;
+
+    ///
+    /// @brief Evaluate the RC-PRF on a range, in parallel
+    ///
+    /// Evaluates the Constrained RC-PRF on the input range as
+    /// eval_range(min, max, callback) does, but splits the range along the
+    /// boundaries of the elements' subtrees and runs the pieces as independent
+    /// tasks of the executor. As the tasks of all the elements are handed to
+    /// the executor at once, threads done with a small element pick up the
+    /// pieces of the larger ones.
+    ///
+    /// The callback is called concurrently from the executor's threads, and
+    /// the leaves are not passed in order: it must be thread-safe.
+    ///
+    /// @param min      The minimum leaf index of the range.
+    /// @param max      The maximum leaf index of the range.
+    /// @param callback The function to be called for every generated value.
+    /// @param executor The executor running the tasks (see thread_executor()).
+    ///
+    /// @exception std::invalid_argument    max is smaller than min
+    /// @exception std::out_of_range        The range is not included in
+    ///                                     [min_leaf(),max_leaf()]
+    void eval_range(uint64_t             min,
+                    uint64_t             max,
+                    const callback_type& callback,
+                    const Executor&      executor) const;
+
     ///
     /// @brief Reconstrain the PRF to a range.
     ///
@@ -1315,6 +1970,34 @@ public:
         std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>&
             constrained_elements) const override;
 
+    /// @brief  Returns the size (in bytes) of the serialized representation of
+    ///         the object
+    ///
+    /// @return The size in bytes of the buffer needed to serialize the object.
+    ///
+    size_t serialized_size() const noexcept;
+
+    /// @brief Serialize the object in the given buffer
+    ///
+    ///
+    /// The object is serialized as follows (the integers are in the host's
+    /// byte order):
+    ///     - the tree's depth (1 byte)
+    ///     - the number of elements (4 bytes)
+    ///     - for every element, by increasing leaf range:
+    ///         - the element's information: subtree height (1 byte), min and
+    ///           max leaf (8 bytes each)
+    ///         - the element's value: the kKeySize bytes seed of an inner node
+    ///           (subtree height > 1), or the NBYTES bytes of a leaf.
+    ///
+    /// The serialized object contains the secret seeds of the constrained key.
+    /// It can be evaluated in place, without any copy, by a
+    /// ConstrainedRCPrfView.
+    ///
+    /// @param[out] out The serialization buffer. It must be
+    ///                 at least serialized_size() bytes large.
+    void serialize(uint8_t* out) const;
+
 
     /// @brief  Size (in bytes) of the public context (used to wrap a
     ///         ConstrainedRCPrf object).
@@ -1330,34 +2013,295 @@ public:
     }
 
 private:
-    std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>> elements_;
+    using seed_type = EphemeralKey<RCPrfParams::kKeySize>;
+
+    /// @brief Descriptor of an element of the constrained key
+    struct ElementInfo
+    {
+        uint64_t                min_leaf;
+        uint64_t                max_leaf;
+        RCPrfParams::depth_type subtree_height;
+    };
+
+    /// @brief Number of seeds (of kKeySize bytes) used to store the value of
+    ///        an element: the seed of an inner node, or the NBYTES bytes of a
+    ///        leaf.
+    static constexpr size_t kSlotSeeds
+        = (NBYTES + RCPrfParams::kKeySize - 1) / RCPrfParams::kKeySize;
+
+    /// @brief The descriptors of the elements, sorted by increasing leaf range
+    std::vector<ElementInfo> elements_;
+    /// @brief The values of the elements: the value of elements_[i] starts at
+    ///        seeds_[i*kSlotSeeds].
+    seed_type* seeds_;
+    /// @brief Maximum number of elements that can be stored in seeds_
+    size_t capacity_;
+    /// @brief Flag denoting if seeds_ is read protected. Once the object is
+    ///        built, it is only modified by the opening of the first session
+    ///        and the closing of the last session, which are serialized by
+    ///        seed_sessions_.
+    mutable bool seeds_locked_{false};
+    /// @brief Number of open sessions on seeds_
+    mutable SessionCounter seed_sessions_;
+
+    ///
+    /// @class SeedsSession
+    /// @brief RAII scope during which the seeds are readable
+    ///
+    /// The counterpart of Key::UnlockSession for the seeds' buffer.
+    ///
+    class SeedsSession
+    {
+    public:
+        explicit SeedsSession(const ConstrainedRCPrf& cprf) : cprf_(cprf)
+        {
+            cprf_.seed_sessions_.open([this]() { cprf_.unlock_seeds(); });
+        }
+
+        SeedsSession(const SeedsSession&) = delete;
+        SeedsSession& operator=(const SeedsSession&) = delete;
+
+        ~SeedsSession()
+        {
+            cprf_.seed_sessions_.close([this]() { cprf_.lock_seeds(); });
+        }
+
+    private:
+        const ConstrainedRCPrf& cprf_;
+    };
 
-    /// @brief  Returns the size (in bytes) of the serialized representation of
-    ///         the object
     ///
-    /// @return The size in bytes of the buffer needed to serialize the object.
+    /// @brief Private constructor
     ///
-    size_t serialized_size() const noexcept;
+    /// Creates an empty constrained key for a tree of the given height, with
+    /// room for capacity elements. The elements are then added with
+    /// append_element (or add_inner and add_leaf), and must be sorted with
+    /// sort_elements, before the seeds are locked with seal_seeds.
+    ///
+    /// @exception std::bad_alloc   The memory of the elements' values cannot
+    ///                             be allocated.
+    ///
+    ConstrainedRCPrf(RCPrfParams::depth_type height, size_t capacity)
+        : RCPrfBase<NBYTES>(height), seeds_(nullptr), capacity_(0),
+          seeds_locked_(false)
+    {
+        static_assert(sizeof(seed_type) == RCPrfParams::kKeySize,
+                      "The seeds must be stored contiguously");
+
+        if (capacity == 0) {
+            return;
+        }
+
+        void* mem = sodium_allocarray(capacity, kSlotSeeds * sizeof(seed_type));
+        if (mem == nullptr) {
+            throw std::bad_alloc(); /* LCOV_EXCL_LINE */
+        }
+        seeds_ = static_cast<seed_type*>(mem);
+        for (size_t i = 0; i < capacity * kSlotSeeds; i++) {
+            new (seeds_ + i) seed_type();
+        }
+        capacity_ = capacity;
+        elements_.reserve(capacity);
+    }
+
+    /// @brief Zeroizes and frees the elements' values
+    void free_seeds() noexcept
+    {
+        if (seeds_ != nullptr) {
+#ifdef ENABLE_MEMORY_LOCK
+            if (seeds_locked_) {
+                // the seeds are zeroized by their destructors
+                sodium_mprotect_readwrite(seeds_);
+            }
+#endif
+            for (size_t i = 0; i < capacity_ * kSlotSeeds; i++) {
+                seeds_[i].~seed_type();
+            }
+            sodium_free(seeds_);
+        }
+        seeds_        = nullptr;
+        capacity_     = 0;
+        seeds_locked_ = false;
+    }
 
-    /// @brief Serialize the object in the given buffer
     ///
+    /// @brief Locks the freshly written seeds
     ///
-    /// The object is serialized as follows:
-    ///     - the tree's depth
-    ///     - the number of elements
-    ///     - for every element:
-    ///         - the element's information (subtree height, min and max leaf)
-    ///         - the element's serialization
+    /// Makes the seeds' buffer neither readable or writable. Must be called
+    /// once all the elements have been added and sorted: the seeds can then
+    /// only be read within a SeedsSession.
     ///
-    /// @param[out] out The serialization buffer. It must be
-    ///                 at least kSerializedSize bytes large.
-    void serialize(uint8_t* out) const;
+    /// @exception std::runtime_error Memory cannot be locked.
+    ///
+    void seal_seeds()
+    {
+        lock_seeds();
+    }
+
+    ///
+    /// @brief Makes the seeds neither readable or writable
+    ///
+    /// @exception std::runtime_error Memory cannot be locked.
+    ///
+    void lock_seeds() const
+    {
+#ifdef ENABLE_MEMORY_LOCK
+        if (seeds_ != nullptr && !seeds_locked_) {
+            int err = sodium_mprotect_noaccess(seeds_);
+            if (err == -1 && errno != ENOSYS) {
+                /* LCOV_EXCL_START */
+                throw std::runtime_error("Error when locking memory: "
+                                         + std::string(strerror(errno)));
+                /* LCOV_EXCL_STOP */
+            }
+            seeds_locked_ = true;
+        }
+#endif
+    }
+
+    ///
+    /// @brief Makes the seeds readable (but not writable)
+    ///
+    /// @exception std::runtime_error Memory cannot be unlocked.
+    ///
+    void unlock_seeds() const
+    {
+#ifdef ENABLE_MEMORY_LOCK
+        if (seeds_ != nullptr && seeds_locked_) {
+            int err = sodium_mprotect_readonly(seeds_);
+            if (err == -1 && errno != ENOSYS) {
+                /* LCOV_EXCL_START */
+                throw std::runtime_error("Error when unlocking memory: "
+                                         + std::string(strerror(errno)));
+                /* LCOV_EXCL_STOP */
+            }
+            seeds_locked_ = false;
+        }
+#endif
+    }
+
+    /// @brief Returns the seed of the i-th element, that must be an inner
+    ///        node
+    const seed_type& element_seed(size_t i) const noexcept
+    {
+        return seeds_[i * kSlotSeeds];
+    }
+
+    /// @brief Returns the buffer containing the value of the i-th element
+    uint8_t* element_value(size_t i) noexcept
+    {
+        return seeds_[i * kSlotSeeds].data();
+    }
+
+    /// @brief Returns the buffer containing the value of the i-th element
+    const uint8_t* element_value(size_t i) const noexcept
+    {
+        return seeds_[i * kSlotSeeds].data();
+    }
+
+    /// @brief Returns the size of the value of an element, given the height
+    ///        of its subtree
+    static size_t element_value_size(
+        RCPrfParams::depth_type subtree_height) noexcept
+    {
+        return (subtree_height == 1) ? NBYTES : RCPrfParams::kKeySize;
+    }
+
+    ///
+    /// @brief Add an element to the constrained key
+    ///
+    /// Appends the descriptor of a new element to the elements_ array, and
+    /// returns the buffer in which its value has to be written.
+    ///
+    /// @exception std::runtime_error   The capacity of the object is exceeded.
+    ///
+    uint8_t* append_element(RCPrfParams::depth_type subtree_height,
+                            uint64_t                min,
+                            uint64_t                max)
+    {
+        if (elements_.size() == capacity_) {
+            /* LCOV_EXCL_START */
+            throw std::runtime_error(
+                "ConstrainedRCPrf: the number of elements exceeds the "
+                "capacity of the object");
+            /* LCOV_EXCL_STOP */
+        }
+        elements_.push_back(ElementInfo{min, max, subtree_height});
+        return element_value(elements_.size() - 1);
+    }
+
+    // Sink interface of RCPrfBase::generate_constrained_nodes
+    void add_inner(const uint8_t*          key,
+                   RCPrfParams::depth_type subtree_height,
+                   uint64_t                min,
+                   uint64_t                max)
+    {
+        memcpy(append_element(subtree_height, min, max),
+               key,
+               RCPrfParams::kKeySize);
+    }
+
+    void add_leaf(const uint8_t* value, uint64_t leaf)
+    {
+        memcpy(append_element(1, leaf, leaf), value, NBYTES);
+    }
+
+    /// @brief Swaps the i-th and the j-th elements (descriptors and values)
+    void swap_elements(size_t i, size_t j) noexcept
+    {
+        std::swap(elements_[i], elements_[j]);
+        for (size_t k = 0; k < kSlotSeeds; k++) {
+            std::swap(seeds_[i * kSlotSeeds + k], seeds_[j * kSlotSeeds + k]);
+        }
+    }
+
+    ///
+    /// @brief Sort the elements by increasing leaf range
+    ///
+    /// @exception std::invalid_argument    The elements do not span over a
+    ///                                     single range: their spans are not
+    ///                                     consecutive.
+    ///
+    void sort_elements();
+
+    /// @brief Returns the index of the element containing the leaf, that must
+    ///        not be smaller than min_leaf()
+    size_t find_element(uint64_t leaf) const;
+
+    ///
+    /// @brief Check that the constrained key can be constrained to a range
+    ///
+    /// @exception std::invalid_argument    max is smaller than min
+    /// @exception std::out_of_range        The range is not included in
+    ///                                     [min_leaf(),max_leaf()]
+    ///
+    void check_constrain_range(uint64_t min, uint64_t max) const;
+
+    ///
+    /// @brief Generate the nodes of the constrained key for the given range
+    ///
+    /// Passes the nodes necessary to derive the leaves in [min, max] to the
+    /// sink object (see RCPrfBase::generate_constrained_nodes). The range must
+    /// have been checked by check_constrain_range.
+    ///
+    template<class Sink>
+    void constrain_into(uint64_t min, uint64_t max, Sink& sink) const;
+
+    ///
+    /// @brief Evaluate the RC-PRF on a range included in the i-th element
+    ///
+    template<class F>
+    void eval_element_range(size_t   i,
+                            uint64_t min,
+                            uint64_t max,
+                            F&       callback) const;
 
     /// @brief Deserialize a buffer into a ConstrainedRCPrf object
     ///
     /// This static function constructs a new ConstrainedRCPrf object out of the
     /// binary representation of the input buffer in. The in buffer must be at
-    /// least kSerializedSize bytes large.
+    /// least kSerializedSize bytes large. The seeds of the inner nodes are
+    /// zeroized in the input buffer.
     ///
     /// @param  in      The byte buffer containing the binary representation of
     ///                 the ConstrainedRCPrf object.
@@ -1367,6 +2311,8 @@ private:
     ///
     /// @exception  std::invalid_argument   The size of the in buffer (in_size)
     ///                                     is too small
+    /// @exception  std::invalid_argument   The elements of the constrained key
+    ///                                     are invalid
     ///
     /// @exception  std::runtime_error      An error has been encountered during
     ///                                     deserialization
@@ -1375,6 +2321,56 @@ private:
                                                 size_t&      n_bytes_read);
 };
 
+template<uint16_t NBYTES>
+void ConstrainedRCPrf<NBYTES>::sort_elements()
+{
+    // the number of elements comes from the serialized input when
+    // deserializing: sort the indices, and move every value at most once by
+    // following the cycles of the permutation
+    std::vector<size_t> order(elements_.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return elements_[a].min_leaf < elements_[b].min_leaf;
+    });
+
+    // the element at position order[i] must be moved to position i
+    for (size_t i = 0; i < order.size(); i++) {
+        size_t j = i;
+        while (order[j] != i) {
+            const size_t next = order[j];
+            swap_elements(j, next);
+            order[j] = j;
+            j        = next;
+        }
+        order[j] = j;
+    }
+
+    // check that the elements are consecutive
+    for (size_t i = 1; i < elements_.size(); i++) {
+        if (elements_[i - 1].max_leaf + 1 != elements_[i].min_leaf) {
+            throw std::invalid_argument("Non consecutive elements");
+        }
+    }
+}
+
+template<uint16_t NBYTES>
+size_t ConstrainedRCPrf<NBYTES>::find_element(uint64_t leaf) const
+{
+    assert(!is_empty() && leaf >= min_leaf());
+
+    // elements_ is ordered by increasing min_leaf: look for the last element
+    // starting before the leaf
+    auto it = std::upper_bound(
+        elements_.begin(),
+        elements_.end(),
+        leaf,
+        [](uint64_t l, const ElementInfo& elt) { return l < elt.min_leaf; });
+
+    return static_cast<size_t>(it - elements_.begin()) - 1;
+}
+
 template<uint16_t NBYTES>
 std::array<uint8_t, NBYTES> ConstrainedRCPrf<NBYTES>::eval(uint64_t leaf) const
 {
@@ -1384,20 +2380,77 @@ std::array<uint8_t, NBYTES> ConstrainedRCPrf<NBYTES>::eval(uint64_t leaf) const
             + ") out of constrained range (" + std::to_string(min_leaf()) + ", "
             + std::to_string(max_leaf()) + ")");
     }
-    for (const auto& elt : elements_) {
-        if (elt->min_leaf() <= leaf && leaf <= elt->max_leaf()) {
-            return elt->eval(leaf);
-        }
+
+    const size_t       i   = find_element(leaf);
+    const ElementInfo& elt = elements_[i];
+
+    if (leaf > elt.max_leaf) {
+        /* LCOV_EXCL_START */
+        throw std::runtime_error("ConstrainedRCPrf::eval: invalid state");
+        /* LCOV_EXCL_STOP */
     }
-    /* LCOV_EXCL_START */
-    throw std::runtime_error("ConstrainedRCPrf::eval: invalid state");
-    /* LCOV_EXCL_STOP */
+
+    SeedsSession session(*this);
+
+    if (elt.subtree_height == 1) {
+        std::array<uint8_t, NBYTES> result;
+        memcpy(result.data(), element_value(i), NBYTES);
+        return result;
+    }
+
+    const uint8_t base_depth
+        = static_cast<uint8_t>(this->tree_height() - elt.subtree_height);
+
+    return static_cast<const ConstrainedRCPrf<NBYTES>*>(this)
+        ->RCPrfBase<NBYTES>::derive_leaf(element_seed(i), base_depth, leaf);
+}
+
+template<uint16_t NBYTES>
+template<class F>
+void ConstrainedRCPrf<NBYTES>::eval_element_range(size_t   i,
+                                                  uint64_t min,
+                                                  uint64_t max,
+                                                  F&       callback) const
+{
+    const ElementInfo& elt = elements_[i];
+
+    if (elt.subtree_height == 1) {
+        // the element is a leaf, and min == max == elt.min_leaf
+        std::array<uint8_t, NBYTES> value;
+        memcpy(value.data(), element_value(i), NBYTES);
+
+        callback(elt.min_leaf,
+                 static_cast<const std::array<uint8_t, NBYTES>&>(value));
+
+        sodium_memzero(value.data(), NBYTES);
+        return;
+    }
+
+    const uint8_t base_depth
+        = static_cast<uint8_t>(this->tree_height() - elt.subtree_height);
+
+    static_cast<const ConstrainedRCPrf<NBYTES>*>(this)
+        ->RCPrfBase<NBYTES>::derive_leaf_range(element_seed(i),
+                                               base_depth,
+                                               elt.min_leaf,
+                                               min - elt.min_leaf,
+                                               max - elt.min_leaf,
+                                               callback);
 }
 
 template<uint16_t NBYTES>
 void ConstrainedRCPrf<NBYTES>::eval_range(uint64_t             min,
                                           uint64_t             max,
                                           const callback_type& callback) const
+{
+    this->template eval_range<const callback_type&>(min, max, callback);
+}
+
+template<uint16_t NBYTES>
+template<class F>
+void ConstrainedRCPrf<NBYTES>::eval_range(uint64_t min,
+                                          uint64_t max,
+                                          F&&      callback) const
 {
     if (max < min) {
         throw std::invalid_argument("ConstrainedRCPrf::eval_range: Invalid "
@@ -1412,78 +2465,185 @@ void ConstrainedRCPrf<NBYTES>::eval_range(uint64_t             min,
             + ") out of constrained range (" + std::to_string(min_leaf()) + ", "
             + std::to_string(max_leaf()) + ")");
     }
-    for (const auto& elt : elements_) {
-        uint64_t elt_min_leaf = elt->min_leaf();
-        uint64_t elt_max_leaf = elt->max_leaf();
 
-        // remember that elements_ is ordered by increasing min_leaf
-        if (max < elt_min_leaf) {
-            // we are passed the interesting elements
-            return;
-        }
-        if (RCPrfParams::ranges_intersect(
-                min, max, elt_min_leaf, elt_max_leaf)) {
-            elt->eval_range(std::max(min, elt_min_leaf),
-                            std::min(max, elt_max_leaf),
-                            callback);
-        }
+    SeedsSession session(*this);
+
+    // remember that elements_ is ordered by increasing min_leaf
+    for (size_t i = find_element(min);
+         i < elements_.size() && elements_[i].min_leaf <= max;
+         i++) {
+        eval_element_range(i,
+                           std::max(min, elements_[i].min_leaf),
+                           std::min(max, elements_[i].max_leaf),
+                           callback);
     }
 }
 
 template<uint16_t NBYTES>
-void ConstrainedRCPrf<NBYTES>::generate_constrained_subkeys(
-    const uint64_t min,
-    const uint64_t max,
-    std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>&
-        constrained_elements) const
+void ConstrainedRCPrf<NBYTES>::eval_range(uint64_t             min,
+                                          uint64_t             max,
+                                          const callback_type& callback,
+                                          const Executor&      executor) const
 {
-    if (min < this->min_leaf() || max > this->max_leaf()) {
+    if (max < min) {
+        throw std::invalid_argument("ConstrainedRCPrf::eval_range: Invalid "
+                                    "range: min is larger than max: max="
+                                    + std::to_string(max)
+                                    + ", min=" + std::to_string(min));
+    }
+    if (min < min_leaf() || max > max_leaf()) {
         throw std::out_of_range(
-            "ConstrainedRCPrf::generate_constrained_subkeys: the input range ("
+            "ConstrainedRCPrf::eval_range: evaluation range (="
             + std::to_string(min) + ", " + std::to_string(max)
-            + ") is out of the subtree range: ("
-            + std::to_string(this->min_leaf()) + ", "
-            + std::to_string(this->max_leaf()) + ").");
+            + ") out of constrained range (" + std::to_string(min_leaf()) + ", "
+            + std::to_string(max_leaf()) + ")");
     }
 
-    for (const auto& elt : elements_) {
-        uint64_t subrange_min = elt->min_leaf();
-        uint64_t subrange_max = elt->max_leaf();
-
-        if (RCPrfParams::ranges_intersect(
-                subrange_min, subrange_max, min, max)) {
-            subrange_min = std::max(min, elt->min_leaf());
-            subrange_max = std::min(max, elt->max_leaf());
-            elt->generate_constrained_subkeys(
-                subrange_min, subrange_max, constrained_elements);
-        }
+    // the pieces of the range, and the element each of them belongs to
+    std::vector<std::pair<uint64_t, uint64_t>> chunks;
+    std::vector<size_t>                        chunk_elements;
+
+    // remember that elements_ is ordered by increasing min_leaf
+    for (size_t i = find_element(min);
+         i < elements_.size() && elements_[i].min_leaf <= max;
+         i++) {
+        RCPrfBase<NBYTES>::split_range(std::max(min, elements_[i].min_leaf),
+                                       std::min(max, elements_[i].max_leaf),
+                                       max - min + 1,
+                                       chunks);
+        chunk_elements.resize(chunks.size(), i);
     }
-}
-
-template<uint16_t NBYTES>
-ConstrainedRCPrf<NBYTES> ConstrainedRCPrf<NBYTES>::constrain(uint64_t min,
-                                                             uint64_t max) const
-{
-    std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>
-        constrained_elements;
-    generate_constrained_subkeys(min, max, constrained_elements);
 
-    return ConstrainedRCPrf<NBYTES>(std::move(constrained_elements));
+    // a single session for all the tasks: the seeds are only read
+    SeedsSession session(*this);
+    executor(chunks.size(),
+             [this, &chunks, &chunk_elements, &callback](size_t c) {
+                 eval_element_range(chunk_elements[c],
+                                    chunks[c].first,
+                                    chunks[c].second,
+                                    callback);
+             });
 }
 
 template<uint16_t NBYTES>
-size_t ConstrainedRCPrf<NBYTES>::serialized_size() const noexcept
+void ConstrainedRCPrf<NBYTES>::check_constrain_range(uint64_t min,
+                                                     uint64_t max) const
 {
-    size_t total_size = 0;
-
-    total_size += sizeof(RCPrfParams::depth_type); // the tree depth
+    if (max < min) {
+        throw std::invalid_argument(
+            "ConstrainedRCPrf::constrain: Invalid range: min is larger than "
+            "max: max="
+            + std::to_string(max) + ", min=" + std::to_string(min));
+    }
+    if (min < this->min_leaf() || max > this->max_leaf()) {
+        throw std::out_of_range(
+            "ConstrainedRCPrf::constrain: the input range ("
+            + std::to_string(min) + ", " + std::to_string(max)
+            + ") is out of the subtree range: ("
+            + std::to_string(this->min_leaf()) + ", "
+            + std::to_string(this->max_leaf()) + ").");
+    }
+}
+
+template<uint16_t NBYTES>
+template<class Sink>
+void ConstrainedRCPrf<NBYTES>::constrain_into(uint64_t min,
+                                              uint64_t max,
+                                              Sink&    sink) const
+{
+    for (size_t i = find_element(min);
+         i < elements_.size() && elements_[i].min_leaf <= max;
+         i++) {
+        const ElementInfo& elt          = elements_[i];
+        const uint64_t     subrange_min = std::max(min, elt.min_leaf);
+        const uint64_t     subrange_max = std::min(max, elt.max_leaf);
+
+        if (elt.subtree_height == 1) {
+            sink.add_leaf(element_value(i), elt.min_leaf);
+        } else if (subrange_min == elt.min_leaf
+                   && subrange_max == elt.max_leaf) {
+            // not a constrain (at least not on this node)
+            sink.add_inner(element_value(i),
+                           elt.subtree_height,
+                           elt.min_leaf,
+                           elt.max_leaf);
+        } else {
+            RCPrfBase<NBYTES>::generate_constrained_nodes(element_seed(i),
+                                                          elt.subtree_height,
+                                                          elt.min_leaf,
+                                                          elt.max_leaf,
+                                                          subrange_min,
+                                                          subrange_max,
+                                                          sink);
+        }
+    }
+}
+
+template<uint16_t NBYTES>
+void ConstrainedRCPrf<NBYTES>::generate_constrained_subkeys(
+    const uint64_t min,
+    const uint64_t max,
+    std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>&
+        constrained_elements) const
+{
+    check_constrain_range(min, max);
+
+    typename RCPrfBase<NBYTES>::ElementVectorSink sink(this->tree_height(),
+                                                       constrained_elements);
+    {
+        SeedsSession session(*this);
+        constrain_into(min, max, sink);
+    }
+    sink.sort_elements();
+}
+
+template<uint16_t NBYTES>
+ConstrainedRCPrf<NBYTES> ConstrainedRCPrf<NBYTES>::constrain(uint64_t min,
+                                                             uint64_t max) const
+{
+    check_constrain_range(min, max);
+
+    // count the maximum number of elements of the result: an element is kept
+    // as is when its range is included in [min, max], or is replaced by at
+    // most two nodes per level of its subtree
+    size_t capacity = 0;
+    for (size_t i = find_element(min);
+         i < elements_.size() && elements_[i].min_leaf <= max;
+         i++) {
+        const ElementInfo& elt = elements_[i];
+
+        if (elt.subtree_height == 1
+            || (min <= elt.min_leaf && elt.max_leaf <= max)) {
+            capacity++;
+        } else {
+            capacity += 2 * static_cast<size_t>(elt.subtree_height - 1);
+        }
+    }
+
+    ConstrainedRCPrf<NBYTES> result(this->tree_height(), capacity);
+    {
+        SeedsSession session(*this);
+        constrain_into(min, max, result);
+    }
+    result.sort_elements();
+    result.seal_seeds();
+
+    return result;
+}
+
+template<uint16_t NBYTES>
+size_t ConstrainedRCPrf<NBYTES>::serialized_size() const noexcept
+{
+    size_t total_size = 0;
+
+    total_size += sizeof(RCPrfParams::depth_type); // the tree depth
     total_size += sizeof(uint32_t);                // the number of elements
 
     // for each element:
     for (const auto& elt : elements_) {
         total_size // the size of the element's information
             += ConstrainedRCPrfElement<NBYTES>::kSerializedElementInfoSize;
-        total_size += elt->serialized_size(); // the size of the element itself
+        total_size += element_value_size(elt.subtree_height); // its value
     }
 
     return total_size;
@@ -1494,16 +2654,13 @@ void ConstrainedRCPrf<NBYTES>::serialize(uint8_t* out) const
 {
     uint8_t* offset_out = out;
 
-    // *(reinterpret_cast<RCPrfParams::depth_type*>(offset_out))
-    // = this->tree_height();
+    SeedsSession session(*this);
 
     RCPrfParams::depth_type th = this->tree_height();
     memcpy(offset_out, &th,
            sizeof(RCPrfParams::depth_type)); // the tree depth
     offset_out += sizeof(RCPrfParams::depth_type);
 
-    // *(reinterpret_cast<uint32_t*>(offset_out)) = elements_.size();
-
     assert(elements_.size() <= UINT32_MAX);
     uint32_t elt_size = static_cast<uint32_t>(elements_.size());
     memcpy(offset_out, &elt_size,
@@ -1511,13 +2668,17 @@ void ConstrainedRCPrf<NBYTES>::serialize(uint8_t* out) const
     offset_out += sizeof(uint32_t); // the number of elements
 
     // for each element:
-    for (const auto& elt : elements_) {
-        elt->serialize_element_info(offset_out);
+    for (size_t i = 0; i < elements_.size(); i++) {
+        const ElementInfo& elt = elements_[i];
+
+        ConstrainedRCPrfElement<NBYTES>::serialize_element_info(
+            elt.subtree_height, elt.min_leaf, elt.max_leaf, offset_out);
         offset_out
             += ConstrainedRCPrfElement<NBYTES>::kSerializedElementInfoSize;
 
-        elt->serialize(offset_out);
-        offset_out += elt->serialized_size(); // the size of the element itself
+        const size_t value_size = element_value_size(elt.subtree_height);
+        memcpy(offset_out, element_value(i), value_size);
+        offset_out += value_size;
     }
 }
 
@@ -1548,25 +2709,31 @@ ConstrainedRCPrf<NBYTES> ConstrainedRCPrf<NBYTES>::deserialize(
     uint32_t                n_elts;
 
 
-    // = *(reinterpret_cast<RCPrfParams::depth_type*>(offset_in));
     memcpy(&tree_height, offset_in, sizeof(tree_height));
     offset_in += sizeof(tree_height);
     remaining_bytes -= sizeof(tree_height);
     n_bytes_read = sizeof(tree_height);
 
-    // uint32_t n_elts = *(reinterpret_cast<uint32_t*>(offset_in));
     memcpy(&n_elts, offset_in, sizeof(n_elts));
     offset_in += sizeof(n_elts);
     remaining_bytes -= sizeof(n_elts);
     n_bytes_read += sizeof(n_elts);
 
-
-    std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>
-        constrained_elements(n_elts);
-
     constexpr size_t kSerializedElementInfoSize
         = ConstrainedRCPrfElement<NBYTES>::kSerializedElementInfoSize;
 
+    // do not allocate more elements than the buffer can contain
+    if (n_elts > remaining_bytes / (kSerializedElementInfoSize + 1)) {
+        /* LCOV_EXCL_START */
+        throw std::runtime_error(
+            "ConstrainedRCPrf::deserialize: not enough bytes remaining to "
+            "deserialize "
+            + std::to_string(n_elts) + " tree elements");
+        /* LCOV_EXCL_STOP */
+    }
+
+    ConstrainedRCPrf<NBYTES> result(tree_height, n_elts);
+
     for (uint32_t i = 0; i < n_elts; i++) {
         /* LCOV_EXCL_START */
         if (remaining_bytes <= kSerializedElementInfoSize) {
@@ -1587,79 +2754,70 @@ ConstrainedRCPrf<NBYTES> ConstrainedRCPrf<NBYTES>::deserialize(
         remaining_bytes -= kSerializedElementInfoSize;
         n_bytes_read += kSerializedElementInfoSize;
 
-        size_t elt_read_bytes = 0;
-        if ((min_leaf == max_leaf) && (subtree_height == 1)) {
-            // it's a leaf
-            constrained_elements[i].reset(
-                new ConstrainedRCPrfLeafElement<NBYTES>(
-                    ConstrainedRCPrfLeafElement<NBYTES>::deserialize(
-                        tree_height,
-                        min_leaf,
-                        offset_in,
-                        remaining_bytes,
-                        elt_read_bytes)));
+        RCPrfBase<NBYTES>::check_element(
+            tree_height, subtree_height, min_leaf, max_leaf);
 
-            offset_in += elt_read_bytes;
-            remaining_bytes -= elt_read_bytes;
-            n_bytes_read += elt_read_bytes;
+        const size_t value_size = element_value_size(subtree_height);
+        /* LCOV_EXCL_START */
+        if (remaining_bytes < value_size) {
+            throw std::invalid_argument("ConstrainedRCPrf::deserialize: input "
+                                        "buffer too small");
+        }
+        /* LCOV_EXCL_STOP */
 
-        } else {
-            // it's an inner node
-            constrained_elements[i].reset(
-                new ConstrainedRCPrfInnerElement<NBYTES>(
-                    ConstrainedRCPrfInnerElement<NBYTES>::deserialize(
-                        tree_height,
-                        subtree_height,
-                        min_leaf,
-                        max_leaf,
-                        offset_in,
-                        remaining_bytes,
-                        elt_read_bytes)));
-
-            offset_in += elt_read_bytes;
-            remaining_bytes -= elt_read_bytes;
-            n_bytes_read += elt_read_bytes;
+        memcpy(result.append_element(subtree_height, min_leaf, max_leaf),
+               offset_in,
+               value_size);
+        if (subtree_height > 1) {
+            // as for Prg::deserialize, the input seeds cannot be reused
+            sodium_memzero(offset_in, value_size);
         }
+
+        offset_in += value_size;
+        remaining_bytes -= value_size;
+        n_bytes_read += value_size;
     }
 
-    return ConstrainedRCPrf<NBYTES>(std::move(constrained_elements));
+    result.sort_elements();
+    result.seal_seeds();
+
+    return result;
 }
 
 // RCPrfBase implementation
 
 template<uint16_t NBYTES>
-void RCPrfBase<NBYTES>::generate_leaf_from_parent(
+void RCPrfBase<NBYTES>::generate_constrained_subkeys_from_node(
     const Prg&       base_prg,
     const depth_type tree_height,
+    const depth_type subtree_height,
     const uint64_t   subtree_min,
-    const uint64_t   leaf,
+    const uint64_t   subtree_max,
+    const uint64_t   min,
+    const uint64_t   max,
     std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>&
         constrained_elements)
 {
-    RCPrfTreeNodeChild child = (leaf == subtree_min) ? LeftChild : RightChild;
-    std::array<uint8_t, NBYTES> buffer;
+    ElementVectorSink sink(tree_height, constrained_elements);
 
-    base_prg.derive(
-        static_cast<uint32_t>(child) * NBYTES, NBYTES, buffer.data());
+    generate_constrained_nodes(
+        base_prg, subtree_height, subtree_min, subtree_max, min, max, sink);
 
-
-    std::unique_ptr<ConstrainedRCPrfLeafElement<NBYTES>> elt(
-        new ConstrainedRCPrfLeafElement<NBYTES>(
-            std::move(buffer), tree_height, leaf));
-    constrained_elements.emplace_back(std::move(elt));
+    // the elements must be sorted by increasing leaf range (this is the order
+    // in which a depth-first traversal would have generated them)
+    sink.sort_elements();
 }
 
 template<uint16_t NBYTES>
-void RCPrfBase<NBYTES>::generate_constrained_subkeys_from_node(
-    const Prg&       base_prg,
-    const depth_type tree_height,
+template<class BaseNode, class Sink>
+void RCPrfBase<NBYTES>::generate_constrained_nodes(
+    const BaseNode&  base,
     const depth_type subtree_height,
     const uint64_t   subtree_min,
     const uint64_t   subtree_max,
     const uint64_t   min,
     const uint64_t   max,
-    std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>&
-        constrained_elements)
+    Sink&            sink)
 {
     if (subtree_height <= 2) {
         // we are in a 'special' case, that we want to separate to simplify the
@@ -1667,77 +2825,126 @@ void RCPrfBase<NBYTES>::generate_constrained_subkeys_from_node(
         // single leaf to generate
 
         assert(min == max);
-        RCPrfBase::generate_leaf_from_parent(
-            base_prg, tree_height, subtree_min, min, constrained_elements);
+        RCPrfTreeNodeChild child
+            = (min == subtree_min) ? LeftChild : RightChild;
+        std::array<uint8_t, NBYTES> buffer;
+
+        derive_node(
+            base, static_cast<uint32_t>(child) * NBYTES, NBYTES, buffer.data());
+        sink.add_leaf(buffer.data(), min);
+
+        sodium_memzero(buffer.data(), NBYTES);
         return;
     }
 
-    uint64_t subtree_mid = (subtree_max + subtree_min) / 2;
+    // The nodes of the constrained key are found level by level. At each
+    // level, at most two nodes have to be expanded (the ones on the paths to
+    // the min and max leaves): their children are derived together.
+    struct Node
+    {
+        uint64_t subtree_min;
+        uint64_t subtree_max;
+        uint64_t min;
+        uint64_t max;
+    };
 
-    if (min <= subtree_mid) {
-        // the selected range spans on the left subtree
-        Key<kKeySize> subkey
-            = base_prg.derive_key<kKeySize>(static_cast<uint16_t>(LeftChild));
+    Node    parents[2] = {{subtree_min, subtree_max, min, max}};
+    size_t  n_parents  = 1;
+    uint8_t children_buf[2][2 * kKeySize];
+
+    // the children of the first node are derived from the base node
+    derive_node(base, 0, sizeof(children_buf[0]), children_buf[0]);
+
+    // height of the children's subtrees
+    depth_type height = subtree_height - 1;
+
+    while (true) {
+        Node                   nodes[2];
+        EphemeralKey<kKeySize> node_keys[2];
+        size_t                 n_nodes = 0;
+
+        for (size_t k = 0; k < n_parents; k++) {
+            const Node&    p   = parents[k];
+            const uint64_t mid = (p.subtree_max + p.subtree_min) / 2;
+
+            if (p.min <= mid) {
+                // the selected range spans on the left subtree
+                uint8_t* left_key = children_buf[k];
+                if ((p.min == p.subtree_min) && (p.max >= mid)) {
+                    // if the subkey spans exactly the searched range, output
+                    // it and stop here
+                    sink.add_inner(left_key, height, p.subtree_min, mid);
+                } else {
+                    // otherwise, expand the left child at the next level
+                    assert(n_nodes < 2);
+                    nodes[n_nodes] = {
+                        p.subtree_min, mid, p.min, std::min(p.max, mid)};
+                    node_keys[n_nodes] = EphemeralKey<kKeySize>(left_key);
+                    n_nodes++;
+                }
+            }
+            if (p.max > mid) {
+                // the selected range spans on the right subtree
+                uint8_t* right_key = children_buf[k] + kKeySize;
+                if ((p.min <= mid + 1) && (p.max == p.subtree_max)) {
+                    sink.add_inner(right_key, height, mid + 1, p.subtree_max);
+                } else {
+                    assert(n_nodes < 2);
+                    const uint64_t first = std::max(p.min, mid + 1);
+                    nodes[n_nodes] = {mid + 1, p.subtree_max, first, p.max};
+                    node_keys[n_nodes] = EphemeralKey<kKeySize>(right_key);
+                    n_nodes++;
+                }
+            }
+        }
 
-        if ((min == subtree_min) && (max >= subtree_mid)) {
-            // if the subkey spans exactly the searched range, put it in the
-            // result vector and stop here
+        if (n_nodes == 0) {
+            break;
+        }
 
+        const EphemeralKey<kKeySize>* batch_keys[2]
+            = {&node_keys[0], &node_keys[1]};
+        size_t batch_offsets[2];
+
+        if (height <= 2) {
+            // the nodes are the parents of single leaves to generate
+            std::array<uint8_t, NBYTES> leaves[2];
+            unsigned char* batch_outs[2] = {leaves[0].data(), leaves[1].data()};
+
+            for (size_t k = 0; k < n_nodes; k++) {
+                assert(nodes[k].min == nodes[k].max);
+                RCPrfTreeNodeChild child
+                    = (nodes[k].min == nodes[k].subtree_min) ? LeftChild
+                                                             : RightChild;
+                batch_offsets[k] = static_cast<uint32_t>(child) * NBYTES;
+            }
+            Prg::derive_batch(
+                n_nodes, batch_keys, batch_offsets, NBYTES, batch_outs);
 
-            std::unique_ptr<ConstrainedRCPrfInnerElement<NBYTES>> elt(
-                new ConstrainedRCPrfInnerElement<NBYTES>(std::move(subkey),
-                                                         tree_height,
-                                                         subtree_height - 1,
-                                                         subtree_min,
-                                                         subtree_mid));
-            constrained_elements.push_back(std::move(elt));
-        } else {
-            // otherwise, recurse on the left subtree
-            // take care that the selected span for the left subtree can be
-            // [min, subtree_mid] if max > subtree_mid (i.e. the range spans on
-            // both subtrees)
-            RCPrfBase::generate_constrained_subkeys_from_node(
-                Prg(std::move(subkey)),
-                tree_height,
-                subtree_height - 1,
-                subtree_min,
-                subtree_mid,
-                min,
-                std::min(max, subtree_mid),
-                constrained_elements);
+            for (size_t k = 0; k < n_nodes; k++) {
+                sink.add_leaf(leaves[k].data(), nodes[k].min);
+            }
+            sodium_memzero(leaves, sizeof(leaves));
+            break;
         }
-    }
-
-    if (max > subtree_mid) {
-        // the selected range spans on the right subtree
-        Key<kKeySize> subkey
-            = base_prg.derive_key<kKeySize>(static_cast<uint16_t>(RightChild));
-        if ((min <= subtree_mid + 1) && (max == subtree_max)) {
-            // if the subkey spans exactly the searched range, put it in the
-            // result
-            // vector and stop here
 
-            std::unique_ptr<ConstrainedRCPrfInnerElement<NBYTES>> elt(
-                new ConstrainedRCPrfInnerElement<NBYTES>(std::move(subkey),
-                                                         tree_height,
-                                                         subtree_height - 1,
-                                                         subtree_mid + 1,
-                                                         subtree_max));
-            constrained_elements.push_back(std::move(elt));
-        } else {
-            // again, be careful with the min value of the selected range of the
-            // recursive call
-            RCPrfBase::generate_constrained_subkeys_from_node(
-                Prg(std::move(subkey)),
-                tree_height,
-                subtree_height - 1,
-                subtree_mid + 1,
-                subtree_max,
-                std::max(min, subtree_mid + 1),
-                max,
-                constrained_elements);
+        unsigned char* batch_outs[2] = {children_buf[0], children_buf[1]};
+        batch_offsets[0]             = 0;
+        batch_offsets[1]             = 0;
+        Prg::derive_batch(n_nodes,
+                          batch_keys,
+                          batch_offsets,
+                          sizeof(children_buf[0]),
+                          batch_outs);
+
+        for (size_t k = 0; k < n_nodes; k++) {
+            parents[k] = nodes[k];
         }
+        n_parents = n_nodes;
+        height--;
     }
+
+    sodium_memzero(children_buf, sizeof(children_buf));
 }
 
 
@@ -1756,6 +2963,7 @@ template<uint16_t NBYTES>
 class RCPrf : public RCPrfBase<NBYTES>
 {
     friend class Wrapper;
+    friend class RCPrfCursor<NBYTES>;
 
 public:
     using callback_type = typename RCPrfBase<NBYTES>::callback_type;
@@ -1825,6 +3033,70 @@ public:
                     uint64_t             max,
                     const callback_type& callback) const;
 
+    ///
+    /// @brief Evaluate the RC-PRF on a range
+    ///
+    /// Same as eval_range(min, max, callback) with an std::function callback,
+    /// but the callback can be any callable object, whose calls can be inlined
+    /// by the compiler. This is faster than going through an std::function for
+    /// every leaf.
+    ///
+    /// @param min      The minimum leaf index of the range.
+    /// @param max      The maximum leaf index of the range.
+    /// @param callback The function to be called for every generated value. The
+    ///                 callback must take as input the leaf's index and its
+    ///                 value
+    ///
+    /// @exception std::invalid_argument    max is smaller than min
+    /// @exception std::out_of_range        The range is not included in
+    ///                                     [0,max_leaf]
+    template<class F>
+    void eval_range(uint64_t min, uint64_t max, F&& callback) const;
+
+    ///
+    /// @brief Evaluate the RC-PRF on a range into a buffer
+    ///
+    /// Evaluates the RC-PRF on the input range by deriving all the leaves of
+    /// the tree whose indices are in the range, and writes their values, in
+    /// order, in the output buffer: the value of leaf i is written at
+    /// out+(i-min)*NBYTES. This avoids the per-leaf callback overhead of
+    /// eval_range for large ranges.
+    ///
+    /// @param min      The minimum leaf index of the range.
+    /// @param max      The maximum leaf index of the range.
+    /// @param out      The output buffer. It must be (max-min+1)*NBYTES bytes
+    ///                 large.
+    ///
+    /// @exception std::invalid_argument    max is smaller than min, or out is
+    ///                                     NULL
+    /// @exception std::out_of_range        The range is not included in
+    ///                                     [0,max_leaf]
+    void eval_range_into(uint64_t min, uint64_t max, uint8_t* out) const;
+
+    ///
+    /// @brief Evaluate the RC-PRF on a range, in parallel
+    ///
+    /// Evaluates the RC-PRF on the input range as eval_range(min, max,
+    /// callback) does, but splits the range along the boundaries of the
+    /// tree's subtrees and runs the pieces as independent tasks of the
+    /// executor.
+    ///
+    /// The callback is called concurrently from the executor's threads, and
+    /// the leaves are not passed in order: it must be thread-safe.
+    ///
+    /// @param min      The minimum leaf index of the range.
+    /// @param max      The maximum leaf index of the range.
+    /// @param callback The function to be called for every generated value.
+    /// @param executor The executor running the tasks (see thread_executor()).
+    ///
+    /// @exception std::invalid_argument    max is smaller than min
+    /// @exception std::out_of_range        The range is not included in
+    ///                                     [0,max_leaf]
+    void eval_range(uint64_t             min,
+                    uint64_t             max,
+                    const callback_type& callback,
+                    const Executor&      executor) const;
+
     ///
     /// @brief Constrain the PRF to a range.
     ///
@@ -1874,6 +3146,16 @@ public:
 private:
     Prg root_prg_;
 
+    ///
+    /// @brief Check that the RC-PRF can be constrained to a range
+    ///
+    /// @exception std::invalid_argument    max is smaller than min
+    /// @exception std::out_of_range        max is larger than the maximum
+    ///                                     leaf index, or the range is the
+    ///                                     complete range of the PRF.
+    ///
+    void check_constrain_range(uint64_t min, uint64_t max) const;
+
     /// @brief  Returns the size (in bytes) of the serialized representation of
     ///         the object
     ///
@@ -1950,6 +3232,13 @@ template<uint16_t NBYTES>
 void RCPrf<NBYTES>::eval_range(uint64_t             min,
                                uint64_t             max,
                                const callback_type& callback) const
+{
+    this->template eval_range<const callback_type&>(min, max, callback);
+}
+
+template<uint16_t NBYTES>
+template<class F>
+void RCPrf<NBYTES>::eval_range(uint64_t min, uint64_t max, F&& callback) const
 {
     if (max >> this->tree_height() != 0) {
         throw std::out_of_range("Invalid max index: max > 2^height -1.");
@@ -1965,15 +3254,86 @@ void RCPrf<NBYTES>::eval_range(uint64_t             min,
 }
 
 
+template<uint16_t NBYTES>
+void RCPrf<NBYTES>::eval_range(uint64_t             min,
+                               uint64_t             max,
+                               const callback_type& callback,
+                               const Executor&      executor) const
+{
+    if (max > RCPrfParams::max_leaf_index(this->tree_height())) {
+        throw std::out_of_range(
+            "Invalid max index: max > 2^(height-1) -1 (max="
+            + std::to_string(max) + ")");
+    }
+    if (max < min) {
+        throw std::invalid_argument(
+            "Invalid range: min is larger than max: max=" + std::to_string(max)
+            + ", min=" + std::to_string(min));
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> chunks;
+    RCPrfBase<NBYTES>::split_range(min, max, max - min + 1, chunks);
+
+    // the root key is read concurrently: keep it unlocked during the whole
+    // evaluation
+    auto session = root_prg_.unlock_session();
+
+    executor(chunks.size(), [this, &chunks, &callback](size_t i) {
+        static_cast<const RCPrf<NBYTES>*>(this)
+            ->RCPrfBase<NBYTES>::derive_leaf_range(root_prg_,
+                                                   0,
+                                                   0,
+                                                   chunks[i].first,
+                                                   chunks[i].second,
+                                                   callback);
+    });
+}
+
+template<uint16_t NBYTES>
+void RCPrf<NBYTES>::eval_range_into(uint64_t min,
+                                    uint64_t max,
+                                    uint8_t* out) const
+{
+    if (max > RCPrfParams::max_leaf_index(this->tree_height())) {
+        throw std::out_of_range(
+            "Invalid max index: max > 2^(height-1) -1 (max="
+            + std::to_string(max) + ")");
+    }
+    if (max < min) {
+        throw std::invalid_argument(
+            "Invalid range: min is larger than max: max=" + std::to_string(max)
+            + ", min=" + std::to_string(min));
+    }
+    if (out == nullptr) {
+        throw std::invalid_argument("Invalid output buffer: out is NULL");
+    }
+    static_cast<const RCPrf<NBYTES>*>(this)
+        ->RCPrfBase<NBYTES>::derive_leaf_range_into(
+            root_prg_, 0, min, max, out);
+}
+
 template<uint16_t NBYTES>
 ConstrainedRCPrf<NBYTES> RCPrf<NBYTES>::constrain(uint64_t min,
                                                   uint64_t max) const
 {
-    std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>
-        constrained_elements;
-    generate_constrained_subkeys(min, max, constrained_elements);
+    check_constrain_range(min, max);
+
+    // at most two nodes are generated per level of the tree
+    ConstrainedRCPrf<NBYTES> result(
+        this->tree_height(), 2 * static_cast<size_t>(this->tree_height() - 1));
+
+    RCPrfBase<NBYTES>::generate_constrained_nodes(
+        root_prg_,
+        this->tree_height(),
+        0,
+        RCPrfParams::max_leaf_index(this->tree_height()),
+        min,
+        max,
+        result);
+    result.sort_elements();
+    result.seal_seeds();
 
-    return ConstrainedRCPrf<NBYTES>(std::move(constrained_elements));
+    return result;
 }
 
 template<uint16_t NBYTES>
@@ -1982,6 +3342,23 @@ void RCPrf<NBYTES>::generate_constrained_subkeys(
     const uint64_t max,
     std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>&
         constrained_elements) const
+{
+    check_constrain_range(min, max);
+
+    uint64_t max_range = RCPrfParams::max_leaf_index(this->tree_height());
+    RCPrfBase<NBYTES>::generate_constrained_subkeys_from_node(
+        root_prg_,
+        this->tree_height(),
+        this->tree_height(),
+        0,
+        max_range,
+        min,
+        max,
+        constrained_elements);
+}
+
+template<uint16_t NBYTES>
+void RCPrf<NBYTES>::check_constrain_range(uint64_t min, uint64_t max) const
 {
     if (min > max) {
         throw std::invalid_argument(
@@ -2003,17 +3380,6 @@ void RCPrf<NBYTES>::generate_constrained_subkeys(
             + std::to_string(max)
             + ") is the complete range supported by the PRF.");
     }
-
-    uint64_t max_range = RCPrfParams::max_leaf_index(this->tree_height());
-    RCPrfBase<NBYTES>::generate_constrained_subkeys_from_node(
-        root_prg_,
-        this->tree_height(),
-        this->tree_height(),
-        0,
-        max_range,
-        min,
-        max,
-        constrained_elements);
 }
 template<uint16_t NBYTES>
 RCPrf<NBYTES> RCPrf<NBYTES>::deserialize(uint8_t*     in,
@@ -2044,16 +3410,746 @@ RCPrf<NBYTES> RCPrf<NBYTES>::deserialize(uint8_t*     in,
     return result;
 }
 
+///
+/// @class RCPrfCursor
+/// @brief Cached RC-PRF evaluation on nearby leaves.
+///
+/// RCPrf::eval derives the whole root-to-leaf path for every evaluated leaf,
+/// i.e. tree_height-1 PRG calls. A RCPrfCursor keeps the path of the last leaf
+/// it evaluated: evaluating a new leaf only derives the nodes below the common
+/// ancestor of the two leaves. When the leaves are evaluated in sequence (leaf
+/// i, then leaf i+1, ...), this amounts to two PRG calls per leaf on average.
+///
+/// The cached nodes are stored in guarded memory (allocated with
+/// sodium_malloc). They are overwritten when they are evicted from the path,
+/// and zeroized by reset() and when the cursor is destroyed.
+///
+/// A cursor holds a reference to the RCPrf object it was created from: this
+/// object must outlive the cursor. A cursor must not be used from several
+/// threads at once.
+///
+/// @tparam NBYTES  The output size (in bytes)
+///
+template<uint16_t NBYTES>
+class RCPrfCursor
+{
+public:
+    ///
+    /// @brief Constructor
+    ///
+    /// Creates a cursor over the given RC-PRF, with an empty path cache.
+    ///
+    /// @param rcprf    The RC-PRF to evaluate.
+    ///
+    /// @exception std::bad_alloc   The memory of the cache cannot be allocated.
+    ///
+    explicit RCPrfCursor(const RCPrf<NBYTES>& rcprf)
+        : rcprf_(&rcprf), path_(nullptr), last_leaf_(0), cached_depth_(0)
+    {
+        static_assert(sizeof(Path) % 16 == 0,
+                      "The cached path must be aligned in guarded memory");
+
+        void* mem = sodium_malloc(sizeof(Path));
+        if (mem == nullptr) {
+            throw std::bad_alloc(); /* LCOV_EXCL_LINE */
+        }
+        path_ = new (mem) Path();
+    }
+
+    RCPrfCursor(const RCPrfCursor<NBYTES>&) = delete;
+    RCPrfCursor& operator=(const RCPrfCursor<NBYTES>&) = delete;
+
+    ///
+    /// @brief Move constructor
+    ///
+    /// @param c    The moved cursor. Upon return, it cannot be used anymore.
+    ///
+    RCPrfCursor(RCPrfCursor<NBYTES>&& c) noexcept
+        : rcprf_(c.rcprf_), path_(c.path_), last_leaf_(c.last_leaf_),
+          cached_depth_(c.cached_depth_)
+    {
+        c.path_         = nullptr;
+        c.cached_depth_ = 0;
+    }
+
+    ///
+    /// @brief Destructor
+    ///
+    /// Zeroizes and frees the cached path.
+    ///
+    ~RCPrfCursor()
+    {
+        if (path_ != nullptr) {
+            path_->~Path();
+            sodium_free(path_);
+        }
+    }
+
+    ///
+    /// @brief Evaluate the RC-PRF
+    ///
+    /// Evaluates the RC-PRF on the input leaf, re-using the nodes shared with
+    /// the path of the previously evaluated leaf. The result is the same as
+    /// RCPrf::eval(leaf).
+    ///
+    /// @param leaf The index of the leaf to derive. Must be less or equal than
+    ///             2^(height-1) -1.
+    ///
+    /// @return     An std::array of NBYTES bytes containing the result of the
+    ///             evaluation
+    ///
+    /// @exception std::out_of_range    leaf is too large
+    /// @exception std::runtime_error   The cursor has been moved.
+    ///
+    std::array<uint8_t, NBYTES> eval(uint64_t leaf);
+
+    ///
+    /// @brief Clears the path cache
+    ///
+    /// Zeroizes all the cached nodes. The next evaluation derives its whole
+    /// root-to-leaf path.
+    ///
+    void reset() noexcept;
+
+    ///
+    /// @brief Returns the number of cached inner nodes
+    ///
+    /// The nodes of the path of the last evaluated leaf, from depth 1 to the
+    /// returned depth, are cached.
+    ///
+    RCPrfParams::depth_type cached_depth() const noexcept
+    {
+        return cached_depth_;
+    }
+
+private:
+    /// @brief The nodes of a root-to-leaf path: nodes[d-1] is the node of
+    ///        depth d
+    struct Path
+    {
+        EphemeralKey<RCPrfParams::kKeySize> nodes[RCPrfParams::kMaxHeight];
+    };
+
+    const RCPrf<NBYTES>*    rcprf_;
+    Path*                   path_;
+    uint64_t                last_leaf_;
+    RCPrfParams::depth_type cached_depth_;
+};
+
+template<uint16_t NBYTES>
+std::array<uint8_t, NBYTES> RCPrfCursor<NBYTES>::eval(uint64_t leaf)
+{
+    if (path_ == nullptr) {
+        throw std::runtime_error("RCPrfCursor::eval: the cursor was moved");
+    }
+
+    const RCPrfParams::depth_type height = rcprf_->tree_height();
+
+    if (leaf > RCPrfParams::max_leaf_index(height)) {
+        throw std::out_of_range(
+            "RCPrfCursor::eval: Invalid leaf index: leaf > 2^(height-1) -1 "
+            "(leaf="
+            + std::to_string(leaf) + ")");
+    }
+    if (height <= 2) {
+        // there is no inner node to cache
+        return rcprf_->eval(leaf);
+    }
+
+    // depth of the leaf's parent
+    const RCPrfParams::depth_type parent_depth
+        = static_cast<RCPrfParams::depth_type>(height - 2);
+
+    if (cached_depth_ > 0 && leaf != last_leaf_) {
+        // the nodes of depth d are shared by the two paths iff the leaves
+        // indices are equal once shifted by height-1-d bits: keep the nodes
+        // above the highest bit that differs
+        const uint64_t          diff = leaf ^ last_leaf_;
+        RCPrfParams::depth_type high_bit = 0;
+        while ((diff >> (high_bit + 1)) != 0) {
+            high_bit++;
+        }
+        const RCPrfParams::depth_type shared
+            = (high_bit < parent_depth)
+                  ? static_cast<RCPrfParams::depth_type>(parent_depth
+                                                         - high_bit)
+                  : 0;
+        cached_depth_ = std::min(cached_depth_, shared);
+    }
+    last_leaf_ = leaf;
+
+    // derive the missing nodes
+    for (RCPrfParams::depth_type d = static_cast<RCPrfParams::depth_type>(
+             cached_depth_ + 1);
+         d <= parent_depth;
+         d++) {
+        const uint16_t child
+            = static_cast<uint16_t>((leaf >> (height - 1 - d)) & 1);
+
+        if (d == 1) {
+            rcprf_->root_prg_.template derive_key<RCPrfParams::kKeySize>(
+                child, path_->nodes[0]);
+        } else {
+            Prg::derive_key<RCPrfParams::kKeySize>(
+                path_->nodes[d - 2], child, path_->nodes[d - 1]);
+        }
+        cached_depth_ = d;
+    }
+
+    std::array<uint8_t, NBYTES> result;
+    Prg::derive(path_->nodes[parent_depth - 1],
+                static_cast<size_t>(leaf & 1) * NBYTES,
+                NBYTES,
+                result.data());
+
+    return result;
+}
+
+template<uint16_t NBYTES>
+void RCPrfCursor<NBYTES>::reset() noexcept
+{
+    if (path_ != nullptr) {
+        for (auto& node : path_->nodes) {
+            node.erase();
+        }
+    }
+    cached_depth_ = 0;
+}
+
+///
+/// @class ConstrainedRCPrfView
+/// @brief Read-only view of a serialized constrained RC-PRF.
+///
+/// A ConstrainedRCPrfView evaluates a constrained RC-PRF directly from its
+/// serialized representation (see ConstrainedRCPrf::serialize), in a buffer
+/// owned by the caller. The buffer is validated once, by the constructor, and
+/// then only read: the seeds are neither copied in newly allocated keys nor
+/// zeroized, and the caller is free to keep the buffer in locked memory. The
+/// seed of an element is only copied on the stack for the duration of its
+/// evaluation.
+///
+/// The view holds a pointer to the buffer: the buffer must outlive the view,
+/// and must not be modified while the view is used. A view can be evaluated
+/// from several threads at once.
+///
+/// @tparam NBYTES     The size in bytes of the generated leaf value.
+///
+template<uint16_t NBYTES>
+class ConstrainedRCPrfView : public RCPrfBase<NBYTES>
+{
+public:
+    using callback_type = typename RCPrfBase<NBYTES>::callback_type;
+
+    ///
+    /// @brief Constructor
+    ///
+    /// Creates a view of the serialized constrained RC-PRF at the beginning of
+    /// the input buffer, after having checked that the buffer is a valid
+    /// serialization: the buffer must be large enough for all the elements,
+    /// the elements must be consistent with the tree height, and be sorted by
+    /// increasing and consecutive leaf ranges. The buffer can be larger than
+    /// the serialization: the number of bytes used by the view is returned by
+    /// serialized_size().
+    ///
+    /// @param in       The buffer containing the serialized constrained RC-PRF.
+    /// @param in_size  The size of the in buffer.
+    ///
+    /// @exception std::invalid_argument    in is NULL, or the buffer is too
+    ///                                     small.
+    /// @exception std::invalid_argument    The tree height is larger than 64,
+    ///                                     or an element is invalid.
+    /// @exception std::invalid_argument    The elements are not sorted, or do
+    ///                                     not span over a single range.
+    ///
+    ConstrainedRCPrfView(const uint8_t* in, size_t in_size);
+
+    /// @brief Returns the number of bytes of the serialized constrained RC-PRF
+    size_t serialized_size() const noexcept
+    {
+        return size_;
+    }
+
+    /// @brief Check if the constrain is empty (i.e. the range of supported
+    /// leaves is empty)
+    bool is_empty() const noexcept
+    {
+        return n_elements_ == 0;
+    }
+
+    /// @brief Returns the minimum leaf index supported by the constrained
+    /// RC-PRF.
+    ///
+    /// If the constrain is empty, returns UINT64_MAX.
+    uint64_t min_leaf() const noexcept
+    {
+        return min_leaf_;
+    }
+
+    /// @brief Returns the maximum leaf index supported by the constrained
+    /// RC-PRF.
+    ///
+    /// If the constrain is empty, returns 0.
+    uint64_t max_leaf() const noexcept
+    {
+        return max_leaf_;
+    }
+
+    /// @brief Evaluate the RC-RPF.
+    ///
+    /// Same as ConstrainedRCPrf::eval.
+    ///
+    /// @param leaf The index of the leaf to evaluate.
+    ///
+    /// @return An array containing the value of the leaf.
+    ///
+    /// @exception std::out_of_range    The input leaf is out of the constrained
+    ///                                 range.
+    ///
+    std::array<uint8_t, NBYTES> eval(uint64_t leaf) const;
+
+    ///
+    /// @brief Evaluate the RC-PRF on a range
+    ///
+    /// Same as ConstrainedRCPrf::eval_range.
+    ///
+    /// @param min      The minimum leaf index of the range.
+    /// @param max      The maximum leaf index of the range.
+    /// @param callback The function to be called for every generated value. The
+    ///                 callback must take as input the leaf's index and its
+    ///                 value
+    ///
+    /// @exception std::invalid_argument    max is smaller than min
+    /// @exception std::out_of_range        The range is not included in
+    ///                                     [min_leaf(),max_leaf()]
+    void eval_range(uint64_t             min,
+                    uint64_t             max,
+                    const callback_type& callback) const;
+
+    ///
+    /// @brief Evaluate the RC-PRF on a range
+    ///
+    /// Same as eval_range(min, max, callback) with an std::function callback,
+    /// but the callback can be any callable object.
+    ///
+    /// @param min      The minimum leaf index of the range.
+    /// @param max      The maximum leaf index of the range.
+    /// @param callback The function to be called for every generated value. The
+    ///                 callback must take as input the leaf's index and its
+    ///                 value
+    ///
+    /// @exception std::invalid_argument    max is smaller than min
+    /// @exception std::out_of_range        The range is not included in
+    ///                                     [min_leaf(),max_leaf()]
+    template<class F>
+    void eval_range(uint64_t min, uint64_t max, F&& callback) const;
+
+    ///
+    /// @brief Evaluate the RC-PRF on a range, in parallel
+    ///
+    /// Same as ConstrainedRCPrf::eval_range(min, max, callback, executor).
+    /// The callback is called concurrently from the executor's threads, and
+    /// the leaves are not passed in order: it must be thread-safe.
+    ///
+    /// @param min      The minimum leaf index of the range.
+    /// @param max      The maximum leaf index of the range.
+    /// @param callback The function to be called for every generated value.
+    /// @param executor The executor running the tasks (see thread_executor()).
+    ///
+    /// @exception std::invalid_argument    max is smaller than min
+    /// @exception std::out_of_range        The range is not included in
+    ///                                     [min_leaf(),max_leaf()]
+    void eval_range(uint64_t             min,
+                    uint64_t             max,
+                    const callback_type& callback,
+                    const Executor&      executor) const;
+
+    // Already documented by the parent class
+    void generate_constrained_subkeys(
+        const uint64_t min,
+        const uint64_t max,
+        std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>&
+            constrained_elements) const override;
+
+private:
+    /// @brief An element of the serialized constrained key
+    struct Element
+    {
+        const uint8_t*          value;
+        uint64_t                min_leaf;
+        uint64_t                max_leaf;
+        RCPrfParams::depth_type subtree_height;
+    };
+
+    /// @brief Size of the header of the serialization: the tree height and
+    ///        the number of elements
+    static constexpr size_t kHeaderSize
+        = sizeof(RCPrfParams::depth_type) + sizeof(uint32_t);
+
+    ///
+    /// @brief Read the element whose serialization starts at record
+    ///
+    /// @return A pointer to the serialization of the next element.
+    ///
+    static const uint8_t* read_element(const uint8_t* record,
+                                       Element&       elt) noexcept;
+
+    /// @brief Returns the size of the value of an element, given the height
+    ///        of its subtree
+    static size_t element_value_size(
+        RCPrfParams::depth_type subtree_height) noexcept
+    {
+        return (subtree_height == 1) ? NBYTES : RCPrfParams::kKeySize;
+    }
+
+    ///
+    /// @brief Check that a range is included in the constrained range
+    ///
+    /// @exception std::invalid_argument    max is smaller than min
+    /// @exception std::out_of_range        The range is not included in
+    ///                                     [min_leaf(),max_leaf()]
+    ///
+    void check_range(uint64_t min, uint64_t max) const;
+
+    ///
+    /// @brief Evaluate the RC-PRF on a range included in an element
+    ///
+    template<class F>
+    void eval_element_range(const Element& elt,
+                            uint64_t       min,
+                            uint64_t       max,
+                            F&             callback) const;
+
+    /// @brief Parse the header of the serialization, to initialize the base
+    ///        class
+    static RCPrfParams::depth_type read_tree_height(const uint8_t* in,
+                                                    size_t         in_size);
+
+    const uint8_t* elements_;
+    uint32_t       n_elements_;
+    uint64_t       min_leaf_;
+    uint64_t       max_leaf_;
+    size_t         size_;
+};
+
+template<uint16_t NBYTES>
+RCPrfParams::depth_type ConstrainedRCPrfView<NBYTES>::read_tree_height(
+    const uint8_t* in,
+    size_t         in_size)
+{
+    if (in == nullptr) {
+        throw std::invalid_argument(
+            "ConstrainedRCPrfView: the input buffer is NULL");
+    }
+    if (in_size < kHeaderSize) {
+        throw std::invalid_argument(
+            "ConstrainedRCPrfView: invalid input buffer size. The input buffer "
+            "must at least be "
+            + std::to_string(kHeaderSize) + " bytes wide");
+    }
+
+    RCPrfParams::depth_type tree_height;
+    memcpy(&tree_height, in, sizeof(tree_height));
+
+    if (tree_height > 64) {
+        throw std::invalid_argument(
+            "ConstrainedRCPrfView: invalid tree height ("
+            + std::to_string(tree_height) + ")");
+    }
+    return tree_height;
+}
+
+template<uint16_t NBYTES>
+ConstrainedRCPrfView<NBYTES>::ConstrainedRCPrfView(const uint8_t* in,
+                                                   size_t         in_size)
+    : RCPrfBase<NBYTES>(read_tree_height(in, in_size)),
+      elements_(in + kHeaderSize), n_elements_(0), min_leaf_(UINT64_MAX),
+      max_leaf_(0), size_(kHeaderSize)
+{
+    constexpr size_t kSerializedElementInfoSize
+        = ConstrainedRCPrfElement<NBYTES>::kSerializedElementInfoSize;
+
+    uint32_t n_elts;
+    memcpy(&n_elts, in + sizeof(RCPrfParams::depth_type), sizeof(n_elts));
+
+    const uint8_t* record = elements_;
+
+    for (uint32_t i = 0; i < n_elts; i++) {
+        if (in_size - size_ < kSerializedElementInfoSize) {
+            throw std::invalid_argument(
+                "ConstrainedRCPrfView: not enough bytes remaining to read a "
+                "tree element");
+        }
+
+        Element elt;
+        ConstrainedRCPrfElement<NBYTES>::deserialize_element_info(
+            record, elt.subtree_height, elt.min_leaf, elt.max_leaf);
+
+        RCPrfBase<NBYTES>::check_element(this->tree_height(),
+                                         elt.subtree_height,
+                                         elt.min_leaf,
+                                         elt.max_leaf);
+
+        const size_t record_size = kSerializedElementInfoSize
+                                   + element_value_size(elt.subtree_height);
+        if (in_size - size_ < record_size) {
+            throw std::invalid_argument(
+                "ConstrainedRCPrfView: not enough bytes remaining to read a "
+                "tree element");
+        }
+
+        if (i == 0) {
+            min_leaf_ = elt.min_leaf;
+        } else if (max_leaf_ + 1 != elt.min_leaf) {
+            throw std::invalid_argument(
+                "ConstrainedRCPrfView: the elements are not sorted, or are not "
+                "consecutive");
+        }
+        max_leaf_ = elt.max_leaf;
+
+        record += record_size;
+        size_ += record_size;
+    }
+
+    n_elements_ = n_elts;
+}
+
+template<uint16_t NBYTES>
+const uint8_t* ConstrainedRCPrfView<NBYTES>::read_element(
+    const uint8_t* record,
+    Element&       elt) noexcept
+{
+    // the record has been validated by the constructor
+    ConstrainedRCPrfElement<NBYTES>::deserialize_element_info(
+        record, elt.subtree_height, elt.min_leaf, elt.max_leaf);
+
+    elt.value
+        = record + ConstrainedRCPrfElement<NBYTES>::kSerializedElementInfoSize;
+
+    return elt.value + element_value_size(elt.subtree_height);
+}
+
+template<uint16_t NBYTES>
+void ConstrainedRCPrfView<NBYTES>::check_range(uint64_t min,
+                                               uint64_t max) const
+{
+    if (max < min) {
+        throw std::invalid_argument("ConstrainedRCPrfView: Invalid "
+                                    "range: min is larger than max: max="
+                                    + std::to_string(max)
+                                    + ", min=" + std::to_string(min));
+    }
+    if (min < min_leaf() || max > max_leaf()) {
+        throw std::out_of_range(
+            "ConstrainedRCPrfView: range (=" + std::to_string(min) + ", "
+            + std::to_string(max) + ") out of constrained range ("
+            + std::to_string(min_leaf()) + ", " + std::to_string(max_leaf())
+            + ")");
+    }
+}
+
+template<uint16_t NBYTES>
+std::array<uint8_t, NBYTES> ConstrainedRCPrfView<NBYTES>::eval(
+    uint64_t leaf) const
+{
+    check_range(leaf, leaf);
+
+    // the view is not empty: there is at least one element
+    Element        elt;
+    const uint8_t* record = read_element(elements_, elt);
+    for (uint32_t i = 1; i < n_elements_ && elt.max_leaf < leaf; i++) {
+        record = read_element(record, elt);
+    }
+
+    std::array<uint8_t, NBYTES> result;
+
+    if (elt.subtree_height == 1) {
+        memcpy(result.data(), elt.value, NBYTES);
+        return result;
+    }
+
+    EphemeralKey<RCPrfParams::kKeySize> seed;
+    RCPrfBase<NBYTES>::load_seed(elt.value, seed);
+
+    const uint8_t base_depth
+        = static_cast<uint8_t>(this->tree_height() - elt.subtree_height);
+
+    return static_cast<const ConstrainedRCPrfView<NBYTES>*>(this)
+        ->RCPrfBase<NBYTES>::derive_leaf(seed, base_depth, leaf);
+}
+
+template<uint16_t NBYTES>
+template<class F>
+void ConstrainedRCPrfView<NBYTES>::eval_element_range(const Element& elt,
+                                                      uint64_t       min,
+                                                      uint64_t       max,
+                                                      F& callback) const
+{
+    if (elt.subtree_height == 1) {
+        // the element is a leaf, and min == max == elt.min_leaf
+        std::array<uint8_t, NBYTES> value;
+        memcpy(value.data(), elt.value, NBYTES);
+
+        callback(elt.min_leaf,
+                 static_cast<const std::array<uint8_t, NBYTES>&>(value));
+
+        sodium_memzero(value.data(), NBYTES);
+        return;
+    }
+
+    EphemeralKey<RCPrfParams::kKeySize> seed;
+    RCPrfBase<NBYTES>::load_seed(elt.value, seed);
+
+    const uint8_t base_depth
+        = static_cast<uint8_t>(this->tree_height() - elt.subtree_height);
+
+    static_cast<const ConstrainedRCPrfView<NBYTES>*>(this)
+        ->RCPrfBase<NBYTES>::derive_leaf_range(seed,
+                                               base_depth,
+                                               elt.min_leaf,
+                                               min - elt.min_leaf,
+                                               max - elt.min_leaf,
+                                               callback);
+}
+
+template<uint16_t NBYTES>
+void ConstrainedRCPrfView<NBYTES>::eval_range(
+    uint64_t             min,
+    uint64_t             max,
+    const callback_type& callback) const
+{
+    this->template eval_range<const callback_type&>(min, max, callback);
+}
+
+template<uint16_t NBYTES>
+template<class F>
+void ConstrainedRCPrfView<NBYTES>::eval_range(uint64_t min,
+                                              uint64_t max,
+                                              F&&      callback) const
+{
+    check_range(min, max);
+
+    Element        elt;
+    const uint8_t* record = elements_;
+    for (uint32_t i = 0; i < n_elements_; i++) {
+        record = read_element(record, elt);
+
+        // the elements are ordered by increasing min_leaf
+        if (max < elt.min_leaf) {
+            break;
+        }
+        if (RCPrfParams::ranges_intersect(
+                min, max, elt.min_leaf, elt.max_leaf)) {
+            eval_element_range(elt,
+                               std::max(min, elt.min_leaf),
+                               std::min(max, elt.max_leaf),
+                               callback);
+        }
+    }
+}
+
+template<uint16_t NBYTES>
+void ConstrainedRCPrfView<NBYTES>::eval_range(
+    uint64_t             min,
+    uint64_t             max,
+    const callback_type& callback,
+    const Executor&      executor) const
+{
+    check_range(min, max);
+
+    // the pieces of the range, and the element each of them belongs to
+    std::vector<std::pair<uint64_t, uint64_t>> chunks;
+    std::vector<Element>                       chunk_elements;
+
+    Element        elt;
+    const uint8_t* record = elements_;
+    for (uint32_t i = 0; i < n_elements_; i++) {
+        record = read_element(record, elt);
+
+        if (max < elt.min_leaf) {
+            break;
+        }
+        if (RCPrfParams::ranges_intersect(
+                min, max, elt.min_leaf, elt.max_leaf)) {
+            RCPrfBase<NBYTES>::split_range(std::max(min, elt.min_leaf),
+                                           std::min(max, elt.max_leaf),
+                                           max - min + 1,
+                                           chunks);
+            chunk_elements.resize(chunks.size(), elt);
+        }
+    }
+
+    executor(chunks.size(),
+             [this, &chunks, &chunk_elements, &callback](size_t c) {
+                 eval_element_range(chunk_elements[c],
+                                    chunks[c].first,
+                                    chunks[c].second,
+                                    callback);
+             });
+}
+
+template<uint16_t NBYTES>
+void ConstrainedRCPrfView<NBYTES>::generate_constrained_subkeys(
+    const uint64_t min,
+    const uint64_t max,
+    std::vector<std::unique_ptr<ConstrainedRCPrfElement<NBYTES>>>&
+        constrained_elements) const
+{
+    check_range(min, max);
+
+    typename RCPrfBase<NBYTES>::ElementVectorSink sink(this->tree_height(),
+                                                       constrained_elements);
+
+    Element        elt;
+    const uint8_t* record = elements_;
+    for (uint32_t i = 0; i < n_elements_; i++) {
+        record = read_element(record, elt);
+
+        if (max < elt.min_leaf) {
+            break;
+        }
+        if (!RCPrfParams::ranges_intersect(
+                min, max, elt.min_leaf, elt.max_leaf)) {
+            continue;
+        }
+
+        const uint64_t subrange_min = std::max(min, elt.min_leaf);
+        const uint64_t subrange_max = std::min(max, elt.max_leaf);
+
+        if (elt.subtree_height == 1) {
+            sink.add_leaf(elt.value, elt.min_leaf);
+        } else if (subrange_min == elt.min_leaf
+                   && subrange_max == elt.max_leaf) {
+            sink.add_inner(
+                elt.value, elt.subtree_height, elt.min_leaf, elt.max_leaf);
+        } else {
+            EphemeralKey<RCPrfParams::kKeySize> seed;
+            RCPrfBase<NBYTES>::load_seed(elt.value, seed);
+
+            RCPrfBase<NBYTES>::generate_constrained_nodes(seed,
+                                                          elt.subtree_height,
+                                                          elt.min_leaf,
+                                                          elt.max_leaf,
+                                                          subrange_min,
+                                                          subrange_max,
+                                                          sink);
+        }
+    }
+    sink.sort_elements();
+}
 
 extern template class ConstrainedRCPrfLeafElement<16>;
 extern template class ConstrainedRCPrfInnerElement<16>;
 extern template class ConstrainedRCPrf<16>;
 extern template class RCPrf<16>;
+extern template class RCPrfCursor<16>;
+extern template class ConstrainedRCPrfView<16>;
 
 extern template class ConstrainedRCPrfLeafElement<32>;
 extern template class ConstrainedRCPrfInnerElement<32>;
 extern template class ConstrainedRCPrf<32>;
 extern template class RCPrf<32>;
+extern template class RCPrfCursor<32>;
+extern template class ConstrainedRCPrfView<32>;
 
 } // namespace crypto
 } // namespace sse
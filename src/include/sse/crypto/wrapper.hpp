@@ -233,12 +233,14 @@ std::vector<uint8_t> Wrapper::wrap(const CryptoClass& c) const
     std::copy_n(tag.begin(), kTagSize, out.end() - kTagSize);
 
     // encrypt the secret part of the buffer
-    crypto_stream_chacha20_ietf_xor(out.data() + kRandomIVSize,
-                                    buffer + serialization_offset,
-                                    serialized_size,
-                                    tag.data(),
-                                    encryption_key_.unlock_get());
-    encryption_key_.lock();
+    {
+        const auto session = encryption_key_.unlock_session();
+        crypto_stream_chacha20_ietf_xor(out.data() + kRandomIVSize,
+                                        buffer + serialization_offset,
+                                        serialized_size,
+                                        tag.data(),
+                                        encryption_key_.data());
+    }
 
     sodium_free(buffer);
 
@@ -283,12 +285,14 @@ CryptoClass Wrapper::unwrap(std::vector<uint8_t>& c_rep) const
     constexpr size_t serialization_offset
         = +kRandomIVSize + 1 + CryptoClass::kPublicContextSize;
 
-    crypto_stream_chacha20_ietf_xor(buffer + serialization_offset,
-                                    c_rep.data() + kRandomIVSize,
-                                    data_size,
-                                    expected_tag.data(),
-                                    encryption_key_.unlock_get());
-    encryption_key_.lock();
+    {
+        const auto session = encryption_key_.unlock_session();
+        crypto_stream_chacha20_ietf_xor(buffer + serialization_offset,
+                                        c_rep.data() + kRandomIVSize,
+                                        data_size,
+                                        expected_tag.data(),
+                                        encryption_key_.data());
+    }
 
 
     // re-compute the tag
@@ -328,21 +332,36 @@ CryptoClass Wrapper::unwrap(std::vector<uint8_t>& c_rep) const
 
 // Specializations of the Wrapper::TypeByte<CryptoClass> template
 
-class Cipher;
+template<class Policy>
+class BasicCipher;
+struct DerivedKeyCipherPolicy;
+struct XChaCha20CipherPolicy;
 template<>
-struct Wrapper::TypeByte<Cipher>
+struct Wrapper::TypeByte<BasicCipher<DerivedKeyCipherPolicy>>
 {
     static constexpr uint8_t value = 0x01;
 };
 
-template<uint16_t NBYTES>
+template<>
+struct Wrapper::TypeByte<BasicCipher<XChaCha20CipherPolicy>>
+{
+    static constexpr uint8_t value = 0x09;
+};
+
+template<uint16_t NBYTES, class Policy>
 class Prf;
 template<uint16_t NBYTES>
-struct Wrapper::TypeByte<Prf<NBYTES>>
+struct Wrapper::TypeByte<Prf<NBYTES, HMacPrfPolicy>>
 {
     static constexpr uint8_t value = 0x02;
 };
 
+template<uint16_t NBYTES>
+struct Wrapper::TypeByte<Prf<NBYTES, Blake2bPrfPolicy>>
+{
+    static constexpr uint8_t value = 0x08;
+};
+
 class Prg;
 template<>
 struct Wrapper::TypeByte<Prg>
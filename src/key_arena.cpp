@@ -0,0 +1,356 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "key_arena.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sodium/utils.h>
+
+namespace sse {
+namespace crypto {
+
+static_assert(KeyArena::kMaxSlotSize % KeyArena::kSlotAlignment == 0,
+              "The maximum slot size must be a multiple of the slot alignment");
+static_assert(KeyArena::kSlabSize % KeyArena::kMaxSlotSize == 0,
+              "The slab size must be a multiple of the maximum slot size");
+
+class KeyArena::Slab
+{
+public:
+    explicit Slab(uint8_t* base) : base_(base)
+    {
+    }
+
+    void acquire(const bool write);
+    void release(const bool write);
+
+private:
+    // Sets the protection of the slab according to its access counters.
+    // Must be called with mtx_ held.
+    void update_protection();
+
+    uint8_t* const base_;
+
+    std::mutex mtx_;
+    size_t     readers_{0};
+    size_t     writers_{0};
+};
+
+void KeyArena::Slab::update_protection()
+{
+#ifdef ENABLE_MEMORY_LOCK
+    int err;
+    if (writers_ > 0) {
+        err = sodium_mprotect_readwrite(base_);
+    } else if (readers_ > 0) {
+        err = sodium_mprotect_readonly(base_);
+    } else {
+        err = sodium_mprotect_noaccess(base_);
+    }
+    if (err == -1 && errno != ENOSYS) {
+        /* LCOV_EXCL_START */
+        throw std::runtime_error("Error when changing memory protection: "
+                                 + std::string(strerror(errno)));
+        /* LCOV_EXCL_STOP */
+    }
+#else
+    (void)base_;
+#endif
+}
+
+void KeyArena::Slab::acquire(const bool write)
+{
+#ifdef ENABLE_MEMORY_LOCK
+    std::lock_guard<std::mutex> lock(mtx_);
+
+    if (write) {
+        writers_++;
+        if (writers_ == 1) {
+            update_protection();
+        }
+    } else {
+        readers_++;
+        if (readers_ == 1 && writers_ == 0) {
+            update_protection();
+        }
+    }
+#else
+    (void)write;
+#endif
+}
+
+void KeyArena::Slab::release(const bool write)
+{
+#ifdef ENABLE_MEMORY_LOCK
+    std::lock_guard<std::mutex> lock(mtx_);
+
+    if (write) {
+        if (writers_ == 0) {
+            /* LCOV_EXCL_START */
+            throw std::runtime_error("Unbalanced write release on key slab");
+            /* LCOV_EXCL_STOP */
+        }
+        writers_--;
+        if (writers_ == 0) {
+            update_protection();
+        }
+    } else {
+        if (readers_ == 0) {
+            /* LCOV_EXCL_START */
+            throw std::runtime_error("Unbalanced read release on key slab");
+            /* LCOV_EXCL_STOP */
+        }
+        readers_--;
+        if (readers_ == 0 && writers_ == 0) {
+            update_protection();
+        }
+    }
+#else
+    (void)write;
+#endif
+}
+
+namespace {
+
+constexpr size_t kClassCount = KeyArena::kMaxSlotSize / KeyArena::kSlotAlignment;
+
+size_t size_class(const size_t size)
+{
+    return (size + KeyArena::kSlotAlignment - 1) / KeyArena::kSlotAlignment
+           - 1;
+}
+
+size_t class_slot_size(const size_t size_class)
+{
+    return (size_class + 1) * KeyArena::kSlotAlignment;
+}
+
+// Arena state shared by all the threads
+struct ArenaState
+{
+    std::mutex                       mtx;
+    std::vector<KeyArena::Slab*>     slabs;
+    std::vector<KeyArena::Allocation> free_slots[kClassCount];
+};
+
+// The state is never destroyed: keys with static storage duration can be
+// destroyed after the arena would have been, and slabs cannot be freed while
+// some of their slots are still in use anyway.
+ArenaState& arena_state()
+{
+    static ArenaState* state = new ArenaState();
+    return *state;
+}
+
+// Must be called with the arena's mutex held
+void new_slab(ArenaState& state, const size_t size_class)
+{
+    uint8_t* base = static_cast<uint8_t*>(sodium_malloc(KeyArena::kSlabSize));
+    if (base == nullptr) {
+        throw std::bad_alloc(); /* LCOV_EXCL_LINE */
+    }
+
+#ifdef ENABLE_MEMORY_LOCK
+    int err = sodium_mprotect_noaccess(base);
+    if (err == -1 && errno != ENOSYS) {
+        /* LCOV_EXCL_START */
+        sodium_free(base);
+        throw std::runtime_error("Error when locking memory: "
+                                 + std::string(strerror(errno)));
+        /* LCOV_EXCL_STOP */
+    }
+#endif
+
+    KeyArena::Slab* slab = new KeyArena::Slab(base);
+    state.slabs.push_back(slab);
+
+    const size_t slot_size = class_slot_size(size_class);
+    const size_t n_slots   = KeyArena::kSlabSize / slot_size;
+
+    std::vector<KeyArena::Allocation>& free_slots
+        = state.free_slots[size_class];
+    free_slots.reserve(free_slots.size() + n_slots);
+
+    // push the slots in reverse order so that they are handed out by
+    // increasing addresses
+    for (size_t i = n_slots; i > 0; i--) {
+        free_slots.push_back(
+            KeyArena::Allocation{base + (i - 1) * slot_size, slab});
+    }
+}
+
+// Set when the cache of the thread has been destroyed. The thread_local objects
+// destroyed after it (and, for the main thread, the static objects) can still
+// hold keys: their slots then go directly through the arena. As it is trivially
+// destructible, the flag remains valid until the thread is gone.
+thread_local bool thread_cache_destroyed = false;
+
+// Per-thread cache of free slots
+struct ThreadCache
+{
+    KeyArena::Allocation slots[kClassCount][KeyArena::kThreadCacheSize];
+    size_t               counts[kClassCount];
+
+    ThreadCache() : counts()
+    {
+    }
+
+    // Moves n cached slots of the size class back to the arena
+    void flush(const size_t size_class, const size_t n)
+    {
+        ArenaState&                 state = arena_state();
+        std::lock_guard<std::mutex> lock(state.mtx);
+
+        for (size_t i = 0; i < n; i++) {
+            counts[size_class]--;
+            state.free_slots[size_class].push_back(
+                slots[size_class][counts[size_class]]);
+        }
+    }
+
+    // Fetches half a cache of slots from the arena
+    void refill(const size_t size_class)
+    {
+        ArenaState&                 state = arena_state();
+        std::lock_guard<std::mutex> lock(state.mtx);
+
+        std::vector<KeyArena::Allocation>& free_slots
+            = state.free_slots[size_class];
+        if (free_slots.empty()) {
+            new_slab(state, size_class);
+        }
+
+        const size_t n
+            = std::min(KeyArena::kThreadCacheSize / 2, free_slots.size());
+        for (size_t i = 0; i < n; i++) {
+            slots[size_class][counts[size_class]] = free_slots.back();
+            counts[size_class]++;
+            free_slots.pop_back();
+        }
+    }
+
+    // Gives all the cached slots back to the arena when the thread exits
+    ~ThreadCache()
+    {
+        for (size_t c = 0; c < kClassCount; c++) {
+            flush(c, counts[c]);
+        }
+        thread_cache_destroyed = true;
+    }
+};
+
+thread_local ThreadCache thread_cache;
+
+} // namespace
+
+KeyArena::Allocation KeyArena::allocate(const size_t size)
+{
+    if (!supports(size)) {
+        throw std::invalid_argument("Invalid size: the key arena only handles "
+                                    "sizes between 1 and "
+                                    + std::to_string(kMaxSlotSize) + " bytes");
+    }
+
+    const size_t c = size_class(size);
+
+    if (thread_cache_destroyed) {
+        ArenaState&                 state = arena_state();
+        std::lock_guard<std::mutex> lock(state.mtx);
+
+        if (state.free_slots[c].empty()) {
+            new_slab(state, c);
+        }
+        const Allocation alloc = state.free_slots[c].back();
+        state.free_slots[c].pop_back();
+        return alloc;
+    }
+
+    if (thread_cache.counts[c] == 0) {
+        thread_cache.refill(c);
+    }
+    thread_cache.counts[c]--;
+
+    return thread_cache.slots[c][thread_cache.counts[c]];
+}
+
+void KeyArena::deallocate(const Allocation& alloc, const size_t size) noexcept
+{
+    const size_t c = size_class(size);
+
+    // If the slab cannot be made writable, there is no way to erase the slot:
+    // failing (and terminating) is the only safe option.
+    acquire_write(alloc.slab);
+    sodium_memzero(alloc.ptr, class_slot_size(c));
+    release_write(alloc.slab);
+
+    if (thread_cache_destroyed) {
+        ArenaState&                 state = arena_state();
+        std::lock_guard<std::mutex> lock(state.mtx);
+
+        state.free_slots[c].push_back(alloc);
+        return;
+    }
+
+    if (thread_cache.counts[c] == kThreadCacheSize) {
+        thread_cache.flush(c, kThreadCacheSize / 2);
+    }
+    thread_cache.slots[c][thread_cache.counts[c]] = alloc;
+    thread_cache.counts[c]++;
+}
+
+void KeyArena::acquire_read(Slab* slab)
+{
+    slab->acquire(false);
+}
+
+void KeyArena::release_read(Slab* slab)
+{
+    slab->release(false);
+}
+
+void KeyArena::acquire_write(Slab* slab)
+{
+    slab->acquire(true);
+}
+
+void KeyArena::release_write(Slab* slab)
+{
+    slab->release(true);
+}
+
+size_t KeyArena::slab_count() noexcept
+{
+    ArenaState&                 state = arena_state();
+    std::lock_guard<std::mutex> lock(state.mtx);
+
+    return state.slabs.size();
+}
+
+} // namespace crypto
+} // namespace sse
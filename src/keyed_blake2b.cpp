@@ -0,0 +1,245 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "keyed_blake2b.hpp"
+
+#include "hash/blake2b.hpp"
+
+#include <cstring>
+
+#include <sodium/utils.h>
+
+namespace sse {
+
+namespace crypto {
+
+constexpr uint8_t KeyedBlake2bParams::kKeySize;
+constexpr size_t  KeyedBlake2bParams::kDigestSize;
+constexpr size_t  KeyedBlake2bParams::kPersonalizationSize;
+constexpr size_t  KeyedBlake2bParams::kCacheSize;
+
+const uint8_t KeyedBlake2bParams::kPersonalization[kPersonalizationSize]
+    = {'s', 's', 'e', ':', ':', 'c', 'r', 'y',
+       'p', 't', 'o', ':', ':', 'P', 'r', 'f'};
+
+static_assert(sizeof(hash::blake2b::state_type) <= Blake2bBackend::kStateSize,
+              "Blake2bBackend::kStateSize is too small for BLAKE2b's state");
+static_assert(KeyedBlake2bParams::kDigestSize == hash::blake2b::kDigestSize,
+              "Invalid BLAKE2b digest size");
+
+// Offsets of the fields of the parameter block (RFC 7693 and BLAKE2X)
+static constexpr size_t kParamDigestLength = 0;
+static constexpr size_t kParamKeyLength    = 1;
+static constexpr size_t kParamFanout       = 2;
+static constexpr size_t kParamDepth        = 3;
+static constexpr size_t kParamLeafLength   = 4;
+static constexpr size_t kParamNodeOffset   = 8;
+static constexpr size_t kParamXofLength    = 12;
+static constexpr size_t kParamInnerLength  = 17;
+static constexpr size_t kParamPersonal     = 48;
+
+// Number of inputs processed at once by eval_batch()
+static constexpr size_t kBatchSize = 16;
+
+static void store32(unsigned char* dst, const uint32_t w) noexcept
+{
+    dst[0] = static_cast<unsigned char>(w);
+    dst[1] = static_cast<unsigned char>(w >> 8);
+    dst[2] = static_cast<unsigned char>(w >> 16);
+    dst[3] = static_cast<unsigned char>(w >> 24);
+}
+
+// Parameter block of the root hash: keyed BLAKE2b, with a XOF length when the
+// output is longer than a single digest (BLAKE2Xb)
+static void root_param(const size_t out_len, unsigned char* param) noexcept
+{
+    memset(param, 0, hash::blake2b::kParamSize);
+
+    param[kParamKeyLength] = KeyedBlake2bParams::kKeySize;
+    param[kParamFanout]    = 1;
+    param[kParamDepth]     = 1;
+    if (out_len <= KeyedBlake2bParams::kDigestSize) {
+        param[kParamDigestLength] = static_cast<unsigned char>(out_len);
+    } else {
+        param[kParamDigestLength] = KeyedBlake2bParams::kDigestSize;
+        store32(param + kParamXofLength, static_cast<uint32_t>(out_len));
+    }
+    memcpy(param + kParamPersonal,
+           KeyedBlake2bParams::kPersonalization,
+           KeyedBlake2bParams::kPersonalizationSize);
+}
+
+void KeyedBlake2bParams::precompute(const uint8_t* key,
+                                    const size_t   out_len,
+                                    uint8_t*       cache) noexcept
+{
+    unsigned char             param[hash::blake2b::kParamSize];
+    unsigned char             block[hash::blake2b::kBlockSize];
+    hash::blake2b::state_type state;
+
+    root_param(out_len, param);
+
+    memset(block, 0, hash::blake2b::kBlockSize);
+    memcpy(block, key, kKeySize);
+
+    hash::blake2b::init_param(state, param);
+    hash::blake2b::absorb_block(state, block);
+    memcpy(cache, &state, sizeof(state));
+
+    // the key block of the empty message is the last block: it cannot be
+    // absorbed with absorb_block()
+    hash::blake2b::init_param(state, param);
+    hash::blake2b::update(state, block, hash::blake2b::kBlockSize);
+    hash::blake2b::final(state, cache + Blake2bBackend::kStateSize);
+
+    sodium_memzero(block, sizeof(block));
+    sodium_memzero(&state, sizeof(state));
+}
+
+// BLAKE2Xb expansion of n (at most kBatchSize) root digests: the i-th block of
+// an output is the (unkeyed) hash of the root digest, with i as node offset.
+// The blocks of the different outputs are computed in parallel.
+static void expand(const unsigned char* const* roots,
+                   const size_t                n,
+                   const size_t                out_len,
+                   unsigned char* const*       outs) noexcept
+{
+    unsigned char             param[hash::blake2b::kParamSize];
+    unsigned char             blocks[kBatchSize][KeyedBlake2bParams::kDigestSize];
+    size_t                    lens[kBatchSize];
+    unsigned char*            block_outs[kBatchSize];
+    hash::blake2b::state_type state;
+
+    memset(param, 0, hash::blake2b::kParamSize);
+    store32(param + kParamLeafLength, KeyedBlake2bParams::kDigestSize);
+    store32(param + kParamXofLength, static_cast<uint32_t>(out_len));
+    param[kParamInnerLength] = KeyedBlake2bParams::kDigestSize;
+    memcpy(param + kParamPersonal,
+           KeyedBlake2bParams::kPersonalization,
+           KeyedBlake2bParams::kPersonalizationSize);
+
+    for (size_t l = 0; l < n; l++) {
+        lens[l]       = KeyedBlake2bParams::kDigestSize;
+        block_outs[l] = blocks[l];
+    }
+
+    uint32_t i = 0;
+    for (size_t pos = 0; pos < out_len;
+         pos += KeyedBlake2bParams::kDigestSize, i++) {
+        const size_t block_len
+            = (out_len - pos < KeyedBlake2bParams::kDigestSize)
+                  ? out_len - pos
+                  : KeyedBlake2bParams::kDigestSize;
+
+        param[kParamDigestLength] = static_cast<unsigned char>(block_len);
+        store32(param + kParamNodeOffset, i);
+
+        hash::blake2b::init_param(state, param);
+        hash::blake2b::update_final_many(state, roots, lens, block_outs, n);
+        for (size_t l = 0; l < n; l++) {
+            memcpy(outs[l] + pos, blocks[l], block_len);
+        }
+    }
+
+    sodium_memzero(blocks, sizeof(blocks));
+}
+
+void KeyedBlake2bParams::eval(const uint8_t*       cache,
+                              const size_t         out_len,
+                              const unsigned char* in,
+                              const size_t         length,
+                              unsigned char*       out) noexcept
+{
+    unsigned char root[kDigestSize];
+
+    if (length == 0) {
+        memcpy(root, cache + Blake2bBackend::kStateSize, kDigestSize);
+    } else {
+        hash::blake2b::state_type state;
+
+        memcpy(&state, cache, sizeof(state));
+        hash::blake2b::update(state, in, length);
+        hash::blake2b::final(state, root);
+    }
+
+    if (out_len <= kDigestSize) {
+        memcpy(out, root, out_len);
+    } else {
+        const unsigned char* root_ptr = root;
+        expand(&root_ptr, 1, out_len, &out);
+    }
+
+    sodium_memzero(root, kDigestSize);
+}
+
+void KeyedBlake2bParams::eval_batch(const uint8_t*              cache,
+                                    const size_t                out_len,
+                                    const unsigned char* const* ins,
+                                    const size_t*               lens,
+                                    const size_t                count,
+                                    unsigned char*              out) noexcept
+{
+    hash::blake2b::state_type state;
+    unsigned char             roots[kBatchSize][kDigestSize];
+    const unsigned char*      lane_ins[kBatchSize];
+    size_t                    lane_lens[kBatchSize];
+    unsigned char*            lane_outs[kBatchSize];
+
+    memcpy(&state, cache, sizeof(state));
+
+    for (size_t first = 0; first < count; first += kBatchSize) {
+        const size_t n_items
+            = (count - first < kBatchSize) ? count - first : kBatchSize;
+
+        // the empty inputs cannot be absorbed after the key block: their root
+        // digest is precomputed
+        size_t n_lanes = 0;
+        for (size_t j = 0; j < n_items; j++) {
+            if (lens[first + j] == 0) {
+                memcpy(roots[j], cache + Blake2bBackend::kStateSize, kDigestSize);
+                continue;
+            }
+            lane_ins[n_lanes]  = ins[first + j];
+            lane_lens[n_lanes] = lens[first + j];
+            lane_outs[n_lanes] = roots[j];
+            n_lanes++;
+        }
+        hash::blake2b::update_final_many(
+            state, lane_ins, lane_lens, lane_outs, n_lanes);
+
+        if (out_len <= kDigestSize) {
+            for (size_t j = 0; j < n_items; j++) {
+                memcpy(out + (first + j) * out_len, roots[j], out_len);
+            }
+        } else {
+            for (size_t j = 0; j < n_items; j++) {
+                lane_ins[j]  = roots[j];
+                lane_outs[j] = out + (first + j) * out_len;
+            }
+            expand(lane_ins, n_items, out_len, lane_outs);
+        }
+    }
+
+    sodium_memzero(&state, sizeof(state));
+    sodium_memzero(roots, sizeof(roots));
+}
+
+} // namespace crypto
+} // namespace sse
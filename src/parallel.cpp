@@ -0,0 +1,112 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace sse {
+namespace crypto {
+
+void parallel_for(size_t                             n_tasks,
+                  const std::function<void(size_t)>& task,
+                  unsigned int                       n_threads)
+{
+    if (n_tasks == 0) {
+        return;
+    }
+    if (n_threads == 0) {
+        n_threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    n_threads = static_cast<unsigned int>(
+        std::min(static_cast<size_t>(n_threads), n_tasks));
+
+    std::atomic<size_t> next_task(0);
+    std::atomic<bool>   failed(false);
+    std::exception_ptr  error;
+    std::mutex          error_mtx;
+
+    auto worker = [&]() {
+        while (!failed.load(std::memory_order_relaxed)) {
+            const size_t i = next_task.fetch_add(1, std::memory_order_relaxed);
+            if (i >= n_tasks) {
+                return;
+            }
+            try {
+                task(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mtx);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(n_threads - 1);
+    for (unsigned int t = 1; t < n_threads; t++) {
+        try {
+            threads.emplace_back(worker);
+        } catch (const std::system_error&) {
+            /* LCOV_EXCL_START */
+            // the thread could not be started: run with fewer threads
+            break;
+            /* LCOV_EXCL_STOP */
+        }
+    }
+    // the calling thread also works
+    worker();
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+Executor thread_executor(unsigned int n_threads)
+{
+    return [n_threads](size_t                             n_tasks,
+                       const std::function<void(size_t)>& task) {
+        parallel_for(n_tasks, task, n_threads);
+    };
+}
+
+Executor serial_executor()
+{
+    return [](size_t n_tasks, const std::function<void(size_t)>& task) {
+        for (size_t i = 0; i < n_tasks; i++) {
+            task(i);
+        }
+    };
+}
+
+} // namespace crypto
+} // namespace sse
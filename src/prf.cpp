@@ -54,6 +54,14 @@ template Key<1024> Prf<1024>::derive_key(
     const std::array<uint8_t, 200>& in) const;
 
 template class Prf<2000>;
+
+template class Prf<16, Blake2bPrfPolicy>;
+template std::array<uint8_t, 16> Prf<16, Blake2bPrfPolicy>::prf(
+    const std::array<uint8_t, 20>& in) const;
+template Key<16> Prf<16, Blake2bPrfPolicy>::derive_key(
+    const std::array<uint8_t, 20>& in) const;
+
+template class Prf<200, Blake2bPrfPolicy>;
 } // namespace crypto
 } // namespace sse
 #endif
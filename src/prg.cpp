@@ -21,9 +21,13 @@
 
 #include "prg.hpp"
 
+#include "chacha/chacha20_multi.hpp"
+
 #include <cassert>
 #include <cstring>
 
+#include <algorithm>
+
 #include <sodium/crypto_stream_chacha20.h>
 
 
@@ -134,8 +138,8 @@ void Prg::derive(const size_t   offset,
         return;
     }
 
-    prg_derivation(key_.unlock_get(), offset, len, out);
-    key_.lock();
+    const auto session = key_.unlock_session();
+    prg_derivation(key_.data(), offset, len, out);
 }
 
 void Prg::derive(Key<kKeySize>&& k, const size_t len, std::string& out)
@@ -166,6 +170,112 @@ void Prg::derive(Key<kKeySize>&& k,
     local_key.lock();
 }
 
+void Prg::derive(const EphemeralKey<kKeySize>& k,
+                 const size_t                  offset,
+                 const size_t                  len,
+                 unsigned char*                out)
+{
+    if (len == 0) {
+        return;
+    }
+
+    prg_derivation(k.data(), offset, len, out);
+}
+
+void Prg::derive_batch(const size_t                         n,
+                       const EphemeralKey<kKeySize>* const* keys,
+                       const size_t*                        offsets,
+                       const size_t                         len,
+                       unsigned char* const*                outs)
+{
+    if (n == 0 || len == 0) {
+        return;
+    }
+    if (keys == nullptr || offsets == nullptr || outs == nullptr) {
+        throw std::invalid_argument("keys, offsets or outs is NULL");
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (keys[i] == nullptr || outs[i] == nullptr) {
+            throw std::invalid_argument("keys[i] or outs[i] is NULL");
+        }
+    }
+
+    constexpr size_t kLanes = 2 * chacha::kMaxLanes;
+
+    const uint8_t* lane_keys[kLanes];
+    uint64_t       lane_counters[kLanes];
+    uint8_t*       lane_outs[kLanes];
+    size_t         lane_items[kLanes];
+
+    // blocks that only partially belong to the output are generated in this
+    // buffer first
+    alignas(32) uint8_t buffer[kLanes][CHACHA20_BLOCK_SIZE];
+
+    // the seeds are processed kLanes by kLanes. For each group of seeds, the
+    // b-th blocks of the outputs are generated at once.
+    for (size_t first = 0; first < n; first += kLanes) {
+        const size_t n_items = std::min(kLanes, n - first);
+
+        size_t max_blocks = 0;
+        for (size_t i = first; i < first + n_items; i++) {
+            const size_t mod_offset = offsets[i] % CHACHA20_BLOCK_SIZE;
+            max_blocks              = std::max(
+                max_blocks,
+                (mod_offset + len + CHACHA20_BLOCK_SIZE - 1)
+                    / CHACHA20_BLOCK_SIZE);
+        }
+
+        for (size_t b = 0; b < max_blocks; b++) {
+            // position of the block in the pseudo-random stream, relative to
+            // the beginning of the first block
+            const size_t block_pos = b * CHACHA20_BLOCK_SIZE;
+            size_t       n_lanes   = 0;
+
+            for (size_t i = first; i < first + n_items; i++) {
+                const size_t mod_offset = offsets[i] % CHACHA20_BLOCK_SIZE;
+                if (block_pos >= mod_offset + len) {
+                    continue; // the output of this seed is complete
+                }
+
+                lane_keys[n_lanes]     = keys[i]->data();
+                lane_counters[n_lanes] = offsets[i] / CHACHA20_BLOCK_SIZE + b;
+                lane_items[n_lanes]    = i;
+
+                if (block_pos >= mod_offset
+                    && block_pos - mod_offset + CHACHA20_BLOCK_SIZE <= len) {
+                    // the block entirely belongs to the output
+                    lane_outs[n_lanes] = outs[i] + block_pos - mod_offset;
+                } else {
+                    lane_outs[n_lanes] = buffer[n_lanes];
+                }
+                n_lanes++;
+            }
+
+            chacha::keystream_blocks(
+                lane_keys, lane_counters, lane_outs, n_lanes);
+
+            for (size_t l = 0; l < n_lanes; l++) {
+                if (lane_outs[l] != buffer[l]) {
+                    continue;
+                }
+                const size_t i          = lane_items[l];
+                const size_t mod_offset = offsets[i] % CHACHA20_BLOCK_SIZE;
+
+                const size_t src_begin
+                    = (block_pos < mod_offset) ? mod_offset - block_pos : 0;
+                const size_t dst_begin = block_pos + src_begin - mod_offset;
+                const size_t copy_len  = std::min(
+                    CHACHA20_BLOCK_SIZE - src_begin, len - dst_begin);
+
+                memcpy(outs[i] + dst_begin, buffer[l] + src_begin, copy_len);
+            }
+        }
+    }
+
+    // zeroize the buffer
+    sodium_memzero(buffer, sizeof(buffer));
+}
+
 void Prg::derive(Key<kKeySize>&& k,
                  const size_t    offset,
                  const size_t    len,
@@ -202,17 +312,18 @@ Prg Prg::duplicate() const
 {
     std::array<uint8_t, kKeySize> buffer;
 
-    memcpy(buffer.data(), key_.unlock_get(), kKeySize);
-    key_.lock();
+    {
+        const auto session = key_.unlock_session();
+        memcpy(buffer.data(), key_.data(), kKeySize);
+    }
 
     return Prg(Key<kKeySize>(buffer.data()));
 }
 
 void Prg::serialize(uint8_t* out) const
 {
-    key_.unlock();
+    const auto session = key_.unlock_session();
     key_.serialize(out);
-    key_.lock();
 }
 
 Prg Prg::deserialize(uint8_t* in, const size_t in_size, size_t& n_bytes_read)
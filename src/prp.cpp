@@ -29,8 +29,10 @@
 #include <climits>
 #include <cstring>
 
+#include <algorithm>
 #include <exception>
 #include <iomanip>
+#include <numeric>
 
 #include <sodium/runtime.h>
 
@@ -51,6 +53,7 @@ void Prp::compute_is_available() noexcept
 #if __AES__ || __ARM_FEATURE_CRYPTO
     is_available__
         = (sodium_runtime_has_aesni() == 1) || (sodium_runtime_has_neon() == 1);
+    aez_init_dispatch();
 #else
     is_available__ = false;
 #endif
@@ -113,14 +116,14 @@ Prp::Prp(Key<kContextSize>&& context) : aez_ctx_(std::move(context))
     }
 }
 
-std::string Prp::encrypt(const std::string& in)
+std::string Prp::encrypt(const std::string& in) const
 {
     std::string out;
     encrypt(in, out);
     return out;
 }
 
-uint32_t Prp::encrypt(const uint32_t in)
+uint32_t Prp::encrypt(const uint32_t in) const
 {
     uint32_t out;
     encrypt(reinterpret_cast<const unsigned char*>(&in),
@@ -129,7 +132,7 @@ uint32_t Prp::encrypt(const uint32_t in)
     return out;
 }
 
-uint64_t Prp::encrypt_64(const uint64_t in)
+uint64_t Prp::encrypt_64(const uint64_t in) const
 {
     uint64_t out;
     encrypt(reinterpret_cast<const unsigned char*>(&in),
@@ -139,14 +142,14 @@ uint64_t Prp::encrypt_64(const uint64_t in)
 }
 
 
-std::string Prp::decrypt(const std::string& in)
+std::string Prp::decrypt(const std::string& in) const
 {
     std::string out;
     decrypt(in, out);
     return out;
 }
 
-uint32_t Prp::decrypt(const uint32_t in)
+uint32_t Prp::decrypt(const uint32_t in) const
 {
     uint32_t out;
     decrypt(reinterpret_cast<const unsigned char*>(&in),
@@ -155,7 +158,7 @@ uint32_t Prp::decrypt(const uint32_t in)
     return out;
 }
 
-uint64_t Prp::decrypt_64(const uint64_t in)
+uint64_t Prp::decrypt_64(const uint64_t in) const
 {
     uint64_t out;
     decrypt(reinterpret_cast<const unsigned char*>(&in),
@@ -164,7 +167,7 @@ uint64_t Prp::decrypt_64(const uint64_t in)
     return out;
 }
 
-void Prp::encrypt(const uint8_t* in, const unsigned int len, uint8_t* out)
+void Prp::encrypt(const uint8_t* in, const unsigned int len, uint8_t* out) const
 {
     if (!Prp::is_available()) {
         /* LCOV_EXCL_START */
@@ -188,7 +191,8 @@ void Prp::encrypt(const uint8_t* in, const unsigned int len, uint8_t* out)
                    0x00,
                    0x00,
                    0x00};
-    aez_encrypt(reinterpret_cast<const aez_ctx_t*>(aez_ctx_.unlock_get()),
+    UnlockSession session = unlock_session();
+    aez_encrypt(reinterpret_cast<const aez_ctx_t*>(aez_ctx_.data()),
                 iv,
                 16,
                 0,
@@ -197,7 +201,61 @@ void Prp::encrypt(const uint8_t* in, const unsigned int len, uint8_t* out)
                 reinterpret_cast<char*>(out));
 }
 
-void Prp::encrypt(const std::string& in, std::string& out)
+void Prp::evaluate_batch(const bool     inverse,
+                         const uint8_t* in,
+                         const unsigned len,
+                         const size_t   count,
+                         uint8_t*       out) const
+{
+    if (!Prp::is_available()) {
+        /* LCOV_EXCL_START */
+        throw std::runtime_error("PRP is unavailable: AES hardware "
+                                 "acceleration not supported by the CPU");
+        /* LCOV_EXCL_STOP */
+    }
+    if (count == 0) {
+        return;
+    }
+    if (in == nullptr || out == nullptr) {
+        throw std::invalid_argument("in or out is NULL");
+    }
+
+    // same null IV as for the single evaluations
+    char iv[16] = {0x00};
+    UnlockSession session = unlock_session();
+    aez_tiny_many(reinterpret_cast<const aez_ctx_t*>(aez_ctx_.data()),
+                  iv,
+                  16,
+                  inverse ? 1 : 0,
+                  reinterpret_cast<const char*>(in),
+                  len,
+                  count,
+                  reinterpret_cast<char*>(out));
+}
+
+void Prp::encrypt_batch(const uint32_t* in,
+                        const size_t    count,
+                        uint32_t*       out) const
+{
+    evaluate_batch(false,
+                   reinterpret_cast<const uint8_t*>(in),
+                   sizeof(uint32_t),
+                   count,
+                   reinterpret_cast<uint8_t*>(out));
+}
+
+void Prp::encrypt_64_batch(const uint64_t* in,
+                           const size_t    count,
+                           uint64_t*       out) const
+{
+    evaluate_batch(false,
+                   reinterpret_cast<const uint8_t*>(in),
+                   sizeof(uint64_t),
+                   count,
+                   reinterpret_cast<uint8_t*>(out));
+}
+
+void Prp::encrypt(const std::string& in, std::string& out) const
 {
     if (!Prp::is_available()) {
         /* LCOV_EXCL_START */
@@ -225,7 +283,7 @@ void Prp::encrypt(const std::string& in, std::string& out)
     delete[] data;
 }
 
-void Prp::decrypt(const uint8_t* in, const unsigned int len, uint8_t* out)
+void Prp::decrypt(const uint8_t* in, const unsigned int len, uint8_t* out) const
 {
     if (!Prp::is_available()) {
         /* LCOV_EXCL_START */
@@ -250,18 +308,39 @@ void Prp::decrypt(const uint8_t* in, const unsigned int len, uint8_t* out)
                    0x00,
                    0x00,
                    0x00};
-    aez_decrypt(reinterpret_cast<const aez_ctx_t*>(aez_ctx_.unlock_get()),
+    UnlockSession session = unlock_session();
+    aez_decrypt(reinterpret_cast<const aez_ctx_t*>(aez_ctx_.data()),
                 iv,
                 16,
                 0,
                 reinterpret_cast<const char*>(in),
                 len,
                 reinterpret_cast<char*>(out));
+}
 
-    aez_ctx_.lock();
+void Prp::decrypt_batch(const uint32_t* in,
+                        const size_t    count,
+                        uint32_t*       out) const
+{
+    evaluate_batch(true,
+                   reinterpret_cast<const uint8_t*>(in),
+                   sizeof(uint32_t),
+                   count,
+                   reinterpret_cast<uint8_t*>(out));
 }
 
-void Prp::decrypt(const std::string& in, std::string& out)
+void Prp::decrypt_64_batch(const uint64_t* in,
+                           const size_t    count,
+                           uint64_t*       out) const
+{
+    evaluate_batch(true,
+                   reinterpret_cast<const uint8_t*>(in),
+                   sizeof(uint64_t),
+                   count,
+                   reinterpret_cast<uint8_t*>(out));
+}
+
+void Prp::decrypt(const std::string& in, std::string& out) const
 {
     if (!Prp::is_available()) {
         /* LCOV_EXCL_START */
@@ -298,9 +377,8 @@ void Prp::serialize(uint8_t* out) const
                                  "acceleration not supported by the CPU");
         /* LCOV_EXCL_STOP */
     }
-    aez_ctx_.unlock();
+    UnlockSession session = unlock_session();
     aez_ctx_.serialize(out);
-    aez_ctx_.lock();
 }
 
 Prp Prp::deserialize(uint8_t* in, const size_t in_size, size_t& n_bytes_read)
@@ -323,5 +401,168 @@ Prp Prp::deserialize(uint8_t* in, const size_t in_size, size_t& n_bytes_read)
 }
 
 
+// Number of values walked together: bounds the size of the stack buffers of
+// RangePrp::walk, and is the size of the tasks of RangePrp::permute_domain
+static constexpr size_t kRangeBatchSize = 1024;
+
+constexpr uint8_t RangePrp::kKeySize;
+
+RangePrp::RangePrp(const uint64_t n) : prp_()
+{
+    init_domain(n);
+}
+
+RangePrp::RangePrp(const uint64_t n, Key<kKeySize>&& k) : prp_(std::move(k))
+{
+    init_domain(n);
+}
+
+void RangePrp::init_domain(const uint64_t n)
+{
+    if (n == 0) {
+        throw std::invalid_argument("RangePrp: the domain cannot be empty");
+    }
+    n_ = n;
+
+    // number of bits of n-1, and at least 2 to have two non-empty halves
+    bits_ = 2;
+    while (bits_ < 64 && ((n - 1) >> bits_) != 0) {
+        bits_++;
+    }
+
+    // "RangePrp" || LE64(n)
+    const char label[8] = {'R', 'a', 'n', 'g', 'e', 'P', 'r', 'p'};
+    std::copy(label, label + 8, nonce_.begin());
+    for (size_t i = 0; i < 8; i++) {
+        nonce_[8 + i] = static_cast<uint8_t>(n >> (8 * i));
+    }
+}
+
+void RangePrp::walk(const bool      inverse,
+                    const uint8_t*  context,
+                    const uint64_t* in,
+                    const size_t    count,
+                    uint64_t*       out) const
+{
+    const aez_ctx_t* ctx   = reinterpret_cast<const aez_ctx_t*>(context);
+    const char*      nonce = reinterpret_cast<const char*>(nonce_.data());
+    const int        d     = inverse ? 1 : 0;
+
+    uint64_t pending_values[kRangeBatchSize];
+    size_t   pending_index[kRangeBatchSize];
+
+    for (size_t begin = 0; begin < count; begin += kRangeBatchSize) {
+        const size_t m = std::min(kRangeBatchSize, count - begin);
+        aez_feistel_many(ctx, nonce, 16, d, bits_, in + begin, m, out + begin);
+
+        // cycle walking on the values that left the domain
+        size_t n_pending = 0;
+        for (size_t i = begin; i < begin + m; i++) {
+            if (out[i] >= n_) {
+                pending_index[n_pending]  = i;
+                pending_values[n_pending] = out[i];
+                n_pending++;
+            }
+        }
+        while (n_pending != 0) {
+            aez_feistel_many(ctx,
+                             nonce,
+                             16,
+                             d,
+                             bits_,
+                             pending_values,
+                             n_pending,
+                             pending_values);
+            size_t still_pending = 0;
+            for (size_t j = 0; j < n_pending; j++) {
+                if (pending_values[j] >= n_) {
+                    pending_index[still_pending]  = pending_index[j];
+                    pending_values[still_pending] = pending_values[j];
+                    still_pending++;
+                } else {
+                    out[pending_index[j]] = pending_values[j];
+                }
+            }
+            n_pending = still_pending;
+        }
+    }
+}
+
+void RangePrp::evaluate_batch(const bool      inverse,
+                              const uint64_t* in,
+                              const size_t    count,
+                              uint64_t*       out) const
+{
+    if (count == 0) {
+        return;
+    }
+    if (in == nullptr || out == nullptr) {
+        throw std::invalid_argument("RangePrp: in and out cannot be NULL");
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (in[i] >= n_) {
+            throw std::invalid_argument(
+                "RangePrp: input out of the permutation domain");
+        }
+    }
+
+    UnlockSession session = unlock_session();
+    walk(inverse, prp_.aez_ctx_.data(), in, count, out);
+}
+
+uint64_t RangePrp::encrypt(const uint64_t in) const
+{
+    uint64_t out;
+    evaluate_batch(false, &in, 1, &out);
+    return out;
+}
+
+uint64_t RangePrp::decrypt(const uint64_t in) const
+{
+    uint64_t out;
+    evaluate_batch(true, &in, 1, &out);
+    return out;
+}
+
+void RangePrp::encrypt_batch(const uint64_t* in,
+                             const size_t    count,
+                             uint64_t*       out) const
+{
+    evaluate_batch(false, in, count, out);
+}
+
+void RangePrp::decrypt_batch(const uint64_t* in,
+                             const size_t    count,
+                             uint64_t*       out) const
+{
+    evaluate_batch(true, in, count, out);
+}
+
+void RangePrp::permute_domain(uint64_t* out) const
+{
+    permute_domain(out, serial_executor());
+}
+
+void RangePrp::permute_domain(uint64_t* out, const Executor& executor) const
+{
+    if (out == nullptr) {
+        throw std::invalid_argument("RangePrp: out cannot be NULL");
+    }
+
+    const size_t n       = static_cast<size_t>(n_);
+    const size_t n_tasks = (n + kRangeBatchSize - 1) / kRangeBatchSize;
+
+    UnlockSession  session = unlock_session();
+    const uint8_t* context = prp_.aez_ctx_.data();
+
+    executor(n_tasks, [this, context, n, out](size_t t) {
+        const size_t begin = t * kRangeBatchSize;
+        const size_t end   = std::min(begin + kRangeBatchSize, n);
+
+        std::iota(out + begin, out + end, static_cast<uint64_t>(begin));
+        walk(false, context, out + begin, end - begin, out + begin);
+    });
+}
+
 } // namespace crypto
 } // namespace sse
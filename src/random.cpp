@@ -20,15 +20,179 @@
 
 #include "random.hpp"
 
+#include "chacha/chacha20_multi.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+
+#include <pthread.h>
 #include <sodium/randombytes.h>
+#include <sodium/utils.h>
 
 namespace sse {
 
 namespace crypto {
 
+namespace {
+
+// Size of the keystream buffer of a generator
+constexpr size_t kBufferSize = 16 * chacha::kBlockSize;
+
+// Number of bytes a generator outputs before being reseeded from the OS
+constexpr uint64_t kReseedInterval = uint64_t(1) << 24;
+
+// Requests larger than this are not served from the buffer, but from a
+// keystream generated directly in the output
+constexpr size_t kDirectThreshold = kBufferSize / 2;
+
+// Incremented in the child process after a fork, to make the generators
+// inherited from the parent reseed before their next output
+std::atomic<uint64_t> fork_generation{0};
+
+void on_fork_child()
+{
+    fork_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Fills out with the ChaCha20 keystream of key (zero nonce, counter starting
+// at 0), computing the blocks chacha::kMaxLanes at a time
+void fill_keystream(const uint8_t* key, uint8_t* out, const size_t len)
+{
+    const uint8_t* keys[chacha::kMaxLanes];
+    uint64_t       counters[chacha::kMaxLanes];
+    uint8_t*       outs[chacha::kMaxLanes];
+    uint8_t        tail[chacha::kBlockSize];
+
+    std::fill(keys, keys + chacha::kMaxLanes, key);
+
+    const size_t n_blocks = (len + chacha::kBlockSize - 1) / chacha::kBlockSize;
+    for (size_t b = 0; b < n_blocks; b += chacha::kMaxLanes) {
+        const size_t n = std::min(chacha::kMaxLanes, n_blocks - b);
+        for (size_t i = 0; i < n; i++) {
+            counters[i] = b + i;
+            outs[i]     = out + (b + i) * chacha::kBlockSize;
+        }
+        // the last block can be partial
+        const bool partial = (b + n == n_blocks)
+                             && (len % chacha::kBlockSize != 0);
+        if (partial) {
+            outs[n - 1] = tail;
+        }
+
+        chacha::keystream_blocks(keys, counters, outs, n);
+
+        if (partial) {
+            memcpy(out + (n_blocks - 1) * chacha::kBlockSize,
+                   tail,
+                   len % chacha::kBlockSize);
+            sodium_memzero(tail, sizeof(tail));
+        }
+    }
+}
+
+// Fast-key-erasure generator: every refill of the buffer generates the key of
+// the next refill, and the bytes are erased as soon as they are output, so
+// that the state of the generator never reveals past outputs.
+struct Generator
+{
+    uint8_t  key[chacha::kKeySize]{};
+    uint8_t  buffer[kBufferSize]{};
+    size_t   available{0}; // unused bytes at the end of the buffer
+    uint64_t output_count{0};
+    uint64_t generation{0};
+    bool     seeded{false};
+
+    void reseed() noexcept
+    {
+        // registered once, before the first output of any generator
+        static const bool fork_handler_set
+            = (pthread_atfork(nullptr, nullptr, on_fork_child) == 0);
+        (void)fork_handler_set;
+
+        uint8_t seed[chacha::kKeySize];
+        randombytes_buf(seed, sizeof(seed));
+        // the fresh entropy is mixed with the current key
+        for (size_t i = 0; i < sizeof(seed); i++) {
+            key[i] ^= seed[i];
+        }
+        sodium_memzero(seed, sizeof(seed));
+
+        // discard the keystream generated with the previous key
+        sodium_memzero(buffer, sizeof(buffer));
+        available    = 0;
+        output_count = 0;
+        generation   = fork_generation.load(std::memory_order_relaxed);
+        seeded       = true;
+    }
+
+    void refill() noexcept
+    {
+        fill_keystream(key, buffer, kBufferSize);
+
+        memcpy(key, buffer, chacha::kKeySize);
+        sodium_memzero(buffer, chacha::kKeySize);
+        available = kBufferSize - chacha::kKeySize;
+    }
+
+    void take(uint8_t* out, size_t len) noexcept
+    {
+        while (len > 0) {
+            if (available == 0) {
+                refill();
+            }
+            const size_t n   = std::min(len, available);
+            uint8_t*     src = buffer + kBufferSize - available;
+
+            memcpy(out, src, n);
+            sodium_memzero(src, n);
+
+            available -= n;
+            out += n;
+            len -= n;
+        }
+    }
+
+    void generate(uint8_t* out, const size_t len) noexcept
+    {
+        if (!seeded
+            || generation != fork_generation.load(std::memory_order_relaxed)
+            || output_count >= kReseedInterval) {
+            reseed();
+        }
+        output_count += len;
+
+        if (len <= kDirectThreshold) {
+            take(out, len);
+        } else {
+            // one-time key for the whole request
+            uint8_t direct_key[chacha::kKeySize];
+            take(direct_key, sizeof(direct_key));
+            fill_keystream(direct_key, out, len);
+            sodium_memzero(direct_key, sizeof(direct_key));
+        }
+    }
+
+    ~Generator()
+    {
+        sodium_memzero(key, sizeof(key));
+        sodium_memzero(buffer, sizeof(buffer));
+        available = 0;
+        seeded    = false;
+    }
+};
+
+thread_local Generator generator;
+
+} // namespace
+
 void random_bytes(const size_t byte_count, unsigned char* out) noexcept
 {
-    randombytes_buf(out, byte_count);
+    if (byte_count == 0) {
+        return;
+    }
+    generator.generate(out, byte_count);
 }
 
 } // namespace crypto
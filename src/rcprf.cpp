@@ -33,10 +33,14 @@ template class ConstrainedRCPrfLeafElement<16>;
 template class ConstrainedRCPrfInnerElement<16>;
 template class ConstrainedRCPrf<16>;
 template class RCPrf<16>;
+template class RCPrfCursor<16>;
+template class ConstrainedRCPrfView<16>;
 
 template class ConstrainedRCPrfLeafElement<32>;
 template class ConstrainedRCPrfInnerElement<32>;
 template class ConstrainedRCPrf<32>;
 template class RCPrf<32>;
+template class RCPrfCursor<32>;
+template class ConstrainedRCPrfView<32>;
 } // namespace crypto
 } // namespace sse
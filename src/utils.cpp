@@ -20,6 +20,9 @@
 
 #include "utils.hpp"
 
+#include "chacha/chacha20_multi.hpp"
+#include "hash/blake2b.hpp"
+#include "hash/sha512.hpp"
 #include "ppke/relic_wrapper/relic_api.h"
 #include "prp.hpp"
 
@@ -223,6 +226,9 @@ void init_crypto_lib()
     sodium_set_misuse_handler(sodium_misuse_handler);
 
     Prp::compute_is_available();
+    chacha::init_dispatch();
+    hash::blake2b::init_dispatch();
+    hash::sha512::init_dispatch();
 }
 
 void cleanup_crypto_lib()
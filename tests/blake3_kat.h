@@ -0,0 +1,308 @@
+#ifndef BLAKE3_KAT_H
+#define BLAKE3_KAT_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * BLAKE3 test vectors: the inputs are the bytes i % 251, for the lengths of
+ * blake3_kat_lengths, and the digests are the first 64 bytes of the output.
+ */
+
+#define BLAKE3_KAT_COUNT 28
+#define BLAKE3_OUTBYTES 64
+
+static const size_t blake3_kat_lengths[BLAKE3_KAT_COUNT] =
+{
+    0, 1, 63, 64, 65, 127, 128,
+    129, 1023, 1024, 1025, 2048, 2049, 3072,
+    3073, 4096, 4097, 5120, 5121, 6144, 6145,
+    7168, 7169, 8192, 8193, 16384, 31744, 102400,
+};
+
+static const uint8_t blake3_kat[BLAKE3_KAT_COUNT][BLAKE3_OUTBYTES] =
+{
+    {
+        0xAF, 0x13, 0x49, 0xB9, 0xF5, 0xF9, 0xA1, 0xA6,
+        0xA0, 0x40, 0x4D, 0xEA, 0x36, 0xDC, 0xC9, 0x49,
+        0x9B, 0xCB, 0x25, 0xC9, 0xAD, 0xC1, 0x12, 0xB7,
+        0xCC, 0x9A, 0x93, 0xCA, 0xE4, 0x1F, 0x32, 0x62,
+        0xE0, 0x0F, 0x03, 0xE7, 0xB6, 0x9A, 0xF2, 0x6B,
+        0x7F, 0xAA, 0xF0, 0x9F, 0xCD, 0x33, 0x30, 0x50,
+        0x33, 0x8D, 0xDF, 0xE0, 0x85, 0xB8, 0xCC, 0x86,
+        0x9C, 0xA9, 0x8B, 0x20, 0x6C, 0x08, 0x24, 0x3A
+    },
+    {
+        0x2D, 0x3A, 0xDE, 0xDF, 0xF1, 0x1B, 0x61, 0xF1,
+        0x4C, 0x88, 0x6E, 0x35, 0xAF, 0xA0, 0x36, 0x73,
+        0x6D, 0xCD, 0x87, 0xA7, 0x4D, 0x27, 0xB5, 0xC1,
+        0x51, 0x02, 0x25, 0xD0, 0xF5, 0x92, 0xE2, 0x13,
+        0xC3, 0xA6, 0xCB, 0x8B, 0xF6, 0x23, 0xE2, 0x0C,
+        0xDB, 0x53, 0x5F, 0x8D, 0x1A, 0x5F, 0xFB, 0x86,
+        0x34, 0x2D, 0x9C, 0x0B, 0x64, 0xAC, 0xA3, 0xBC,
+        0xE1, 0xD3, 0x1F, 0x60, 0xAD, 0xFA, 0x13, 0x7B
+    },
+    {
+        0xE9, 0xBC, 0x37, 0xA5, 0x94, 0xDA, 0xAD, 0x83,
+        0xBE, 0x94, 0x70, 0xDF, 0x7F, 0x7B, 0x37, 0x98,
+        0x29, 0x7C, 0x3D, 0x83, 0x4C, 0xE8, 0x0B, 0xA8,
+        0x5D, 0x6E, 0x20, 0x76, 0x27, 0xB7, 0xDB, 0x7B,
+        0x11, 0x97, 0x01, 0x2B, 0x1E, 0x7D, 0x9A, 0xF4,
+        0xD7, 0xCB, 0x7B, 0xDD, 0x1F, 0x3B, 0xB4, 0x9A,
+        0x90, 0xA9, 0xB5, 0xDE, 0xC3, 0xEA, 0x2B, 0xBC,
+        0x6E, 0xAE, 0xBC, 0xE7, 0x7F, 0x4E, 0x47, 0x0C
+    },
+    {
+        0x4E, 0xED, 0x71, 0x41, 0xEA, 0x4A, 0x5C, 0xD4,
+        0xB7, 0x88, 0x60, 0x6B, 0xD2, 0x3F, 0x46, 0xE2,
+        0x12, 0xAF, 0x9C, 0xAC, 0xEB, 0xAC, 0xDC, 0x7D,
+        0x1F, 0x4C, 0x6D, 0xC7, 0xF2, 0x51, 0x1B, 0x98,
+        0xFC, 0x9C, 0xC5, 0x6C, 0xB8, 0x31, 0xFF, 0xE3,
+        0x3E, 0xA8, 0xE7, 0xE1, 0xD1, 0xDF, 0x09, 0xB2,
+        0x6E, 0xFD, 0x27, 0x67, 0x67, 0x00, 0x66, 0xAA,
+        0x82, 0xD0, 0x23, 0xB1, 0xDF, 0xE8, 0xAB, 0x1B
+    },
+    {
+        0xDE, 0x1E, 0x5F, 0xA0, 0xBE, 0x70, 0xDF, 0x6D,
+        0x2B, 0xE8, 0xFF, 0xFD, 0x0E, 0x99, 0xCE, 0xAA,
+        0x8E, 0xB6, 0xE8, 0xC9, 0x3A, 0x63, 0xF2, 0xD8,
+        0xD1, 0xC3, 0x0E, 0xCB, 0x6B, 0x26, 0x3D, 0xEE,
+        0x0E, 0x16, 0xE0, 0xA4, 0x74, 0x9D, 0x68, 0x11,
+        0xDD, 0x1D, 0x6D, 0x12, 0x65, 0xC2, 0x97, 0x29,
+        0xB1, 0xB7, 0x5A, 0x9A, 0xC3, 0x46, 0xCF, 0x93,
+        0xF0, 0xE1, 0xD7, 0x29, 0x6D, 0xFC, 0xFD, 0x43
+    },
+    {
+        0xD8, 0x12, 0x93, 0xFD, 0xA8, 0x63, 0xF0, 0x08,
+        0xC0, 0x9E, 0x92, 0xFC, 0x38, 0x2A, 0x81, 0xF5,
+        0xA0, 0xB4, 0xA1, 0x25, 0x1C, 0xBA, 0x16, 0x34,
+        0x01, 0x6A, 0x0F, 0x86, 0xA6, 0xBD, 0x64, 0x0D,
+        0xE3, 0x13, 0x7D, 0x47, 0x71, 0x56, 0xD1, 0xFD,
+        0xE5, 0x6B, 0x0C, 0xF3, 0x6F, 0x8E, 0xF1, 0x8B,
+        0x44, 0xB2, 0xD7, 0x98, 0x97, 0xBE, 0xCE, 0x12,
+        0x22, 0x75, 0x39, 0xAC, 0x9A, 0xE0, 0xA5, 0x11
+    },
+    {
+        0xF1, 0x7E, 0x57, 0x05, 0x64, 0xB2, 0x65, 0x78,
+        0xC3, 0x3B, 0xB7, 0xF4, 0x46, 0x43, 0xF5, 0x39,
+        0x62, 0x4B, 0x05, 0xDF, 0x1A, 0x76, 0xC8, 0x1F,
+        0x30, 0xAC, 0xD5, 0x48, 0xC4, 0x4B, 0x45, 0xEF,
+        0xA6, 0x9F, 0xAB, 0xA0, 0x91, 0x42, 0x7F, 0x9C,
+        0x5C, 0x4C, 0xAA, 0x87, 0x3A, 0xA0, 0x78, 0x28,
+        0x65, 0x1F, 0x19, 0xC5, 0x5B, 0xAD, 0x85, 0xC4,
+        0x7D, 0x13, 0x68, 0xB1, 0x1C, 0x6F, 0xD9, 0x9E
+    },
+    {
+        0x68, 0x3A, 0xAA, 0xE9, 0xF3, 0xC5, 0xBA, 0x37,
+        0xEA, 0xAF, 0x07, 0x2A, 0xED, 0x0F, 0x9E, 0x30,
+        0xBA, 0xC0, 0x86, 0x51, 0x37, 0xBA, 0xE6, 0x8B,
+        0x1F, 0xDE, 0x4C, 0xA2, 0xAE, 0xBD, 0xCB, 0x12,
+        0xF9, 0x6F, 0xFA, 0x7B, 0x36, 0xDD, 0x78, 0xBA,
+        0x32, 0x1B, 0xE7, 0xE8, 0x42, 0xD3, 0x64, 0xA6,
+        0x2A, 0x42, 0xE3, 0x74, 0x66, 0x81, 0xC8, 0xBA,
+        0xCE, 0x18, 0xA4, 0xA8, 0xA7, 0x96, 0x49, 0x28
+    },
+    {
+        0x10, 0x10, 0x89, 0x70, 0xEE, 0xDA, 0x3E, 0xB9,
+        0x32, 0xBA, 0xAC, 0x14, 0x28, 0xC7, 0xA2, 0x16,
+        0x3B, 0x0E, 0x92, 0x4C, 0x9A, 0x9E, 0x25, 0xB3,
+        0x5B, 0xBA, 0x72, 0xB2, 0x8F, 0x70, 0xBD, 0x11,
+        0xA1, 0x82, 0xD2, 0x7A, 0x59, 0x1B, 0x05, 0x59,
+        0x2B, 0x15, 0x60, 0x75, 0x00, 0xE1, 0xE8, 0xDD,
+        0x56, 0xBC, 0x6C, 0x7F, 0xC0, 0x63, 0x71, 0x5B,
+        0x7A, 0x1D, 0x73, 0x7D, 0xF5, 0xBA, 0xD3, 0x33
+    },
+    {
+        0x42, 0x21, 0x47, 0x39, 0xF0, 0x95, 0xA4, 0x06,
+        0xF3, 0xFC, 0x83, 0xDE, 0xB8, 0x89, 0x74, 0x4A,
+        0xC0, 0x0D, 0xF8, 0x31, 0xC1, 0x0D, 0xAA, 0x55,
+        0x18, 0x9B, 0x5D, 0x12, 0x1C, 0x85, 0x5A, 0xF7,
+        0x1C, 0xF8, 0x10, 0x72, 0x65, 0xEC, 0xDA, 0xF8,
+        0x50, 0x5B, 0x95, 0xD8, 0xFC, 0xEC, 0x83, 0xA9,
+        0x8A, 0x6A, 0x96, 0xEA, 0x51, 0x09, 0xD2, 0xC1,
+        0x79, 0xC4, 0x7A, 0x38, 0x7F, 0xFB, 0xB4, 0x04
+    },
+    {
+        0xD0, 0x02, 0x78, 0xAE, 0x47, 0xEB, 0x27, 0xB3,
+        0x4F, 0xAE, 0xCF, 0x67, 0xB4, 0xFE, 0x26, 0x3F,
+        0x82, 0xD5, 0x41, 0x29, 0x16, 0xC1, 0xFF, 0xD9,
+        0x7C, 0x8C, 0xB7, 0xFB, 0x81, 0x4B, 0x84, 0x44,
+        0xF4, 0xC4, 0xA2, 0x2B, 0x4B, 0x39, 0x91, 0x55,
+        0x35, 0x8A, 0x99, 0x4E, 0x52, 0xBF, 0x25, 0x5D,
+        0xE6, 0x00, 0x35, 0x74, 0x2E, 0xC7, 0x1B, 0xD0,
+        0x8A, 0xC2, 0x75, 0xA1, 0xB5, 0x1C, 0xC6, 0xBF
+    },
+    {
+        0xE7, 0x76, 0xB6, 0x02, 0x8C, 0x7C, 0xD2, 0x2A,
+        0x4D, 0x0B, 0xA1, 0x82, 0xA8, 0xBF, 0x62, 0x20,
+        0x5D, 0x2E, 0xF5, 0x76, 0x46, 0x7E, 0x83, 0x8E,
+        0xD6, 0xF2, 0x52, 0x9B, 0x85, 0xFB, 0xA2, 0x4A,
+        0x9A, 0x60, 0xBF, 0x80, 0x00, 0x14, 0x10, 0xEC,
+        0x9E, 0xEA, 0x66, 0x98, 0xCD, 0x53, 0x79, 0x39,
+        0xFA, 0xD4, 0x74, 0x9E, 0xDD, 0x48, 0x4C, 0xB5,
+        0x41, 0xAC, 0xED, 0x55, 0xCD, 0x9B, 0xF5, 0x47
+    },
+    {
+        0x5F, 0x4D, 0x72, 0xF4, 0x0D, 0x7A, 0x5F, 0x82,
+        0xB1, 0x5C, 0xA2, 0xB2, 0xE4, 0x4B, 0x1D, 0xE3,
+        0xC2, 0xEF, 0x86, 0xC4, 0x26, 0xC9, 0x5C, 0x1A,
+        0xF0, 0xB6, 0x87, 0x95, 0x22, 0x56, 0x30, 0x30,
+        0x96, 0xDE, 0x31, 0xD7, 0x1D, 0x74, 0x10, 0x34,
+        0x03, 0x82, 0x2A, 0x2E, 0x0B, 0xC1, 0xEB, 0x19,
+        0x3E, 0x7A, 0xEC, 0xC9, 0x64, 0x3A, 0x76, 0xB7,
+        0xBB, 0xC0, 0xC9, 0xF9, 0xC5, 0x2E, 0x87, 0x83
+    },
+    {
+        0xB9, 0x8C, 0xB0, 0xFF, 0x36, 0x23, 0xBE, 0x03,
+        0x32, 0x6B, 0x37, 0x3D, 0xE6, 0xB9, 0x09, 0x52,
+        0x18, 0x51, 0x3E, 0x64, 0xF1, 0xEE, 0x2E, 0xDD,
+        0x25, 0x25, 0xC7, 0xAD, 0x1E, 0x5C, 0xFF, 0xD2,
+        0x9A, 0x3F, 0x6B, 0x0B, 0x97, 0x8D, 0x66, 0x08,
+        0x33, 0x5C, 0x09, 0xDC, 0x94, 0xCC, 0xF6, 0x82,
+        0xF9, 0x95, 0x1C, 0xDF, 0xC5, 0x01, 0xBF, 0xE4,
+        0x7B, 0x9C, 0x91, 0x89, 0xA6, 0xFC, 0x7B, 0x40
+    },
+    {
+        0x71, 0x24, 0xB4, 0x95, 0x01, 0x01, 0x2F, 0x81,
+        0xCC, 0x7F, 0x11, 0xCA, 0x06, 0x9E, 0xC9, 0x22,
+        0x6C, 0xEC, 0xB8, 0xA2, 0xC8, 0x50, 0xCF, 0xE6,
+        0x44, 0xE3, 0x27, 0xD2, 0x2D, 0x3E, 0x1C, 0xD3,
+        0x9A, 0x27, 0xAE, 0x3B, 0x79, 0xD6, 0x8D, 0x89,
+        0xDA, 0x9B, 0xF2, 0x5B, 0xC2, 0x71, 0x39, 0xAE,
+        0x65, 0xA3, 0x24, 0x91, 0x8A, 0x5F, 0x9B, 0x78,
+        0x28, 0x18, 0x1E, 0x52, 0xCF, 0x37, 0x3C, 0x84
+    },
+    {
+        0x01, 0x50, 0x94, 0x01, 0x3F, 0x57, 0xA5, 0x27,
+        0x7B, 0x59, 0xD8, 0x47, 0x5C, 0x05, 0x01, 0x04,
+        0x2C, 0x0B, 0x64, 0x2E, 0x53, 0x1B, 0x0A, 0x1C,
+        0x8F, 0x58, 0xD2, 0x16, 0x32, 0x29, 0xE9, 0x69,
+        0x02, 0x89, 0xE9, 0x40, 0x9D, 0xDB, 0x1B, 0x99,
+        0x76, 0x8E, 0xAF, 0xE1, 0x62, 0x3D, 0xA8, 0x96,
+        0xFA, 0xF7, 0xE1, 0x11, 0x4B, 0xEB, 0xEA, 0xDC,
+        0x1B, 0xE3, 0x08, 0x29, 0xB6, 0xF8, 0xAF, 0x70
+    },
+    {
+        0x9B, 0x40, 0x52, 0xB3, 0x8F, 0x1C, 0x5F, 0xC8,
+        0xB1, 0xF9, 0xFF, 0x7A, 0xC7, 0xB2, 0x7C, 0xD2,
+        0x42, 0x48, 0x7B, 0x3D, 0x89, 0x0D, 0x15, 0xC9,
+        0x6A, 0x1C, 0x25, 0xB8, 0xAA, 0x0F, 0xB9, 0x95,
+        0x05, 0xF9, 0x1B, 0x0B, 0x56, 0x00, 0xA1, 0x12,
+        0x51, 0x65, 0x2E, 0xAC, 0xFA, 0x94, 0x97, 0xB3,
+        0x1C, 0xD3, 0xC4, 0x09, 0xCE, 0x2E, 0x45, 0xCF,
+        0xE6, 0xC0, 0xA0, 0x16, 0x96, 0x73, 0x16, 0xC4
+    },
+    {
+        0x9C, 0xAD, 0xC1, 0x5F, 0xED, 0x8B, 0x5D, 0x85,
+        0x45, 0x62, 0xB2, 0x6A, 0x95, 0x36, 0xD9, 0x70,
+        0x7C, 0xAD, 0xED, 0xA9, 0xB1, 0x43, 0x97, 0x8F,
+        0x31, 0x9A, 0xB3, 0x42, 0x30, 0x53, 0x58, 0x33,
+        0xAC, 0xC6, 0x1C, 0x8F, 0xDC, 0x11, 0x4A, 0x20,
+        0x10, 0xCE, 0x80, 0x38, 0xC8, 0x53, 0xE1, 0x21,
+        0xE1, 0x54, 0x49, 0x85, 0x13, 0x3F, 0xCC, 0xDD,
+        0x0A, 0x2D, 0x50, 0x7E, 0x8E, 0x61, 0x5E, 0x61
+    },
+    {
+        0x62, 0x8B, 0xD2, 0xCB, 0x20, 0x04, 0x69, 0x4A,
+        0xDA, 0xAB, 0x7B, 0xBD, 0x77, 0x8A, 0x25, 0xDF,
+        0x25, 0xC4, 0x7B, 0x9D, 0x41, 0x55, 0xA5, 0x5F,
+        0x8F, 0xBD, 0x79, 0xF2, 0xFE, 0x15, 0x4C, 0xFF,
+        0x96, 0xAD, 0xAA, 0xB0, 0x61, 0x3A, 0x61, 0x46,
+        0xCD, 0xAA, 0xBE, 0x49, 0x8C, 0x3A, 0x94, 0xE5,
+        0x29, 0xD3, 0xFC, 0x1D, 0xA2, 0xBD, 0x08, 0xED,
+        0xF5, 0x4E, 0xD6, 0x4D, 0x40, 0xDC, 0xD6, 0x77
+    },
+    {
+        0x3E, 0x2E, 0x5B, 0x74, 0xE0, 0x48, 0xF3, 0xAD,
+        0xD6, 0xD2, 0x1F, 0xAA, 0xB3, 0xF8, 0x3A, 0xA4,
+        0x4D, 0x3B, 0x22, 0x78, 0xAF, 0xB8, 0x3B, 0x80,
+        0xB3, 0xC3, 0x51, 0x64, 0xEB, 0xEC, 0xA2, 0x05,
+        0x4D, 0x74, 0x20, 0x22, 0xDA, 0x6F, 0xDD, 0xA4,
+        0x44, 0xEB, 0xC3, 0x84, 0xB0, 0x4A, 0x54, 0xC3,
+        0xAC, 0x58, 0x39, 0xB4, 0x9D, 0xA7, 0xD3, 0x9F,
+        0x6D, 0x8A, 0x9D, 0xB0, 0x3D, 0xEA, 0xB3, 0x2A
+    },
+    {
+        0xF1, 0x32, 0x3A, 0x86, 0x31, 0x44, 0x6C, 0xC5,
+        0x05, 0x36, 0xA9, 0xF7, 0x05, 0xEE, 0x5C, 0xB6,
+        0x19, 0x42, 0x4D, 0x46, 0x88, 0x7F, 0x3C, 0x37,
+        0x6C, 0x69, 0x5B, 0x70, 0xE0, 0xF0, 0x50, 0x7F,
+        0x18, 0xA2, 0xCF, 0xDD, 0x73, 0xC6, 0xE3, 0x9D,
+        0xD7, 0x5C, 0xE7, 0xC1, 0xC6, 0xE3, 0xEF, 0x23,
+        0x8F, 0xD5, 0x44, 0x65, 0xF0, 0x53, 0xB2, 0x5D,
+        0x21, 0x04, 0x4C, 0xCB, 0x20, 0x93, 0xBE, 0xB0
+    },
+    {
+        0x61, 0xDA, 0x95, 0x7E, 0xC2, 0x49, 0x9A, 0x95,
+        0xD6, 0xB8, 0x02, 0x3E, 0x2B, 0x0E, 0x60, 0x4E,
+        0xC7, 0xF6, 0xB5, 0x0E, 0x80, 0xA9, 0x67, 0x8B,
+        0x89, 0xD2, 0x62, 0x8E, 0x99, 0xAD, 0xA7, 0x7A,
+        0x57, 0x07, 0xC3, 0x21, 0xC8, 0x33, 0x61, 0x79,
+        0x3B, 0x9A, 0xF6, 0x2A, 0x40, 0xF4, 0x3B, 0x52,
+        0x3D, 0xF1, 0xC8, 0x63, 0x3C, 0xEC, 0xB4, 0xCD,
+        0x14, 0xD0, 0x0B, 0xDC, 0x79, 0xC7, 0x8F, 0xCA
+    },
+    {
+        0xA0, 0x03, 0xFC, 0x7A, 0x51, 0x75, 0x4A, 0x9B,
+        0x3C, 0x7F, 0xAE, 0x03, 0x67, 0xAB, 0x3D, 0x78,
+        0x2D, 0xCC, 0xF2, 0x88, 0x55, 0xA0, 0x3D, 0x43,
+        0x5F, 0x8C, 0xFE, 0x74, 0x60, 0x5E, 0x78, 0x17,
+        0x98, 0xA8, 0xB2, 0x05, 0x34, 0xBE, 0x1C, 0xA9,
+        0xEB, 0x2A, 0xE2, 0xDF, 0x3F, 0xAE, 0x2E, 0xA6,
+        0x0E, 0x48, 0xC6, 0xFB, 0x0B, 0x85, 0x0B, 0x13,
+        0x85, 0xB5, 0xDE, 0x0F, 0xE4, 0x60, 0xDB, 0xE9
+    },
+    {
+        0xAA, 0xE7, 0x92, 0x48, 0x4C, 0x8E, 0xFE, 0x4F,
+        0x19, 0xE2, 0xCA, 0x7D, 0x37, 0x1D, 0x8C, 0x46,
+        0x7F, 0xFB, 0x10, 0x74, 0x8D, 0x8A, 0x5A, 0x1A,
+        0xE5, 0x79, 0x94, 0x8F, 0x71, 0x8A, 0x2A, 0x63,
+        0x5F, 0xE5, 0x1A, 0x27, 0xDB, 0x04, 0x5A, 0x56,
+        0x7C, 0x1A, 0xD5, 0x1B, 0xE5, 0xAA, 0x34, 0xC0,
+        0x1C, 0x66, 0x51, 0xC4, 0xD9, 0xB5, 0xB5, 0xAC,
+        0x5D, 0x0F, 0xD5, 0x8C, 0xF1, 0x8D, 0xD6, 0x1A
+    },
+    {
+        0xBA, 0xB6, 0xC0, 0x9C, 0xB8, 0xCE, 0x8C, 0xF4,
+        0x59, 0x26, 0x13, 0x98, 0xD2, 0xE7, 0xAE, 0xF3,
+        0x57, 0x00, 0xBF, 0x48, 0x81, 0x16, 0xCE, 0xB9,
+        0x4A, 0x36, 0xD0, 0xF5, 0xF1, 0xB7, 0xBC, 0x3B,
+        0xB2, 0x28, 0x2A, 0xA6, 0x9B, 0xE0, 0x89, 0x35,
+        0x9E, 0xA1, 0x15, 0x4B, 0x9A, 0x92, 0x86, 0xC4,
+        0xA5, 0x6A, 0xF4, 0xDE, 0x97, 0x5A, 0x9A, 0xA4,
+        0xA5, 0xC4, 0x97, 0x65, 0x49, 0x14, 0xD2, 0x79
+    },
+    {
+        0xF8, 0x75, 0xD6, 0x64, 0x6D, 0xE2, 0x89, 0x85,
+        0x64, 0x6F, 0x34, 0xEE, 0x13, 0xBE, 0x9A, 0x57,
+        0x6F, 0xD5, 0x15, 0xF7, 0x6B, 0x5B, 0x0A, 0x26,
+        0xBB, 0x32, 0x47, 0x35, 0x04, 0x1D, 0xDD, 0xE4,
+        0x9D, 0x76, 0x4C, 0x27, 0x01, 0x76, 0xE5, 0x3E,
+        0x97, 0xBD, 0xFF, 0xA5, 0x8D, 0x54, 0x90, 0x73,
+        0xF2, 0xC6, 0x60, 0xBE, 0x0E, 0x81, 0x29, 0x37,
+        0x67, 0xED, 0x4E, 0x49, 0x29, 0xF9, 0xAD, 0x34
+    },
+    {
+        0x62, 0xB6, 0x96, 0x0E, 0x1A, 0x44, 0xBC, 0xC1,
+        0xEB, 0x1A, 0x61, 0x1A, 0x8D, 0x62, 0x35, 0xB6,
+        0xB4, 0xB7, 0x8F, 0x32, 0xE7, 0xAB, 0xC4, 0xFB,
+        0x4C, 0x6C, 0xDC, 0xCE, 0x94, 0x89, 0x5C, 0x47,
+        0x86, 0x0C, 0xC5, 0x1F, 0x2B, 0x0C, 0x28, 0xA7,
+        0xB7, 0x73, 0x04, 0xBD, 0x55, 0xFE, 0x73, 0xAF,
+        0x66, 0x3C, 0x02, 0xD3, 0xF5, 0x2E, 0xA0, 0x53,
+        0xBA, 0x43, 0x43, 0x1C, 0xA5, 0xBA, 0xB7, 0xBF
+    },
+    {
+        0xBC, 0x3E, 0x3D, 0x41, 0xA1, 0x14, 0x6B, 0x06,
+        0x9A, 0xBF, 0xFA, 0xD3, 0xC0, 0xD4, 0x48, 0x60,
+        0xCF, 0x66, 0x43, 0x90, 0xAF, 0xCE, 0x4D, 0x96,
+        0x61, 0xF7, 0x90, 0x2E, 0x79, 0x43, 0xE0, 0x85,
+        0xE0, 0x1C, 0x59, 0xDA, 0xB9, 0x08, 0xC0, 0x4C,
+        0x33, 0x42, 0xB8, 0x16, 0x94, 0x1A, 0x26, 0xD6,
+        0x9C, 0x26, 0x05, 0xEB, 0xEE, 0x5E, 0xC5, 0x29,
+        0x1C, 0xC5, 0x5E, 0x15, 0xB7, 0x61, 0x46, 0xE6
+    },
+};
+
+#endif
@@ -27,11 +27,18 @@
  ********/
 
 #include <sse/crypto/cipher.hpp>
+#include <sse/crypto/random.hpp>
 #include <sse/crypto/wrapper.hpp>
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -94,6 +101,28 @@ TEST(encryption, compat)
     EXPECT_EQ(in_dec_s, std::string(in_dec.begin(), in_dec.end()));
 }
 
+// The input and output strings can be the same object
+TEST(encryption, in_place)
+{
+    sse::crypto::Cipher          cipher((sse::crypto::Key<kCipherKeySize>()));
+    sse::crypto::XChaCha20Cipher x_cipher(
+        (sse::crypto::Key<kCipherKeySize>()));
+
+    const string in  = "This is a test input.";
+    string       buf = in;
+
+    cipher.encrypt(buf, buf);
+    ASSERT_EQ(buf.size(), sse::crypto::Cipher::ciphertext_length(in.size()));
+    cipher.decrypt(buf, buf);
+    ASSERT_EQ(buf, in);
+
+    x_cipher.encrypt(buf, buf);
+    ASSERT_EQ(buf.size(),
+              sse::crypto::XChaCha20Cipher::ciphertext_length(in.size()));
+    x_cipher.decrypt(buf, buf);
+    ASSERT_EQ(buf, in);
+}
+
 TEST(encryption, wrapping)
 {
     std::string in = "This is a test input.";
@@ -144,3 +173,632 @@ TEST(encryption, exception)
     in_dec = string(300, 'a'); // long enough to be a 'valid' ciphertext
     ASSERT_THROW(cipher.decrypt(in_dec, out_dec), std::runtime_error);
 }
+
+TEST(encryption_xchacha20, correctness)
+{
+    array<uint8_t, kCipherKeySize> k;
+    k.fill(0x00);
+
+    sse::crypto::XChaCha20Cipher cipher(
+        sse::crypto::Key<kCipherKeySize>(k.data()));
+
+    for (size_t len : {1, 16, 40, 200, 1000}) {
+        string in_enc = sse::crypto::random_string(len);
+        string out_enc, out_dec;
+
+        cipher.encrypt(in_enc, out_enc);
+        ASSERT_EQ(out_enc.size(),
+                  sse::crypto::XChaCha20Cipher::ciphertext_length(len));
+        ASSERT_EQ(static_cast<uint8_t>(out_enc[0]),
+                  sse::crypto::kXChaCha20CipherVersion);
+
+        cipher.decrypt(out_enc, out_dec);
+        ASSERT_EQ(in_enc, out_dec);
+    }
+
+    std::array<uint8_t, 16> in, in_dec;
+    std::array<uint8_t, 57> out;
+
+    memset(in.data(), 0xFF, in.size());
+    cipher.encrypt(in, out);
+    cipher.decrypt(out, in_dec);
+
+    ASSERT_EQ(in, in_dec);
+}
+
+// Ciphertexts of Cipher still decrypt with XChaCha20Cipher and the same key
+TEST(encryption_xchacha20, legacy_ciphertexts)
+{
+    array<uint8_t, kCipherKeySize> k;
+    sse::crypto::random_bytes(k);
+    array<uint8_t, kCipherKeySize> k_cp = k;
+
+    sse::crypto::Cipher cipher(sse::crypto::Key<kCipherKeySize>(k.data()));
+    sse::crypto::XChaCha20Cipher x_cipher(
+        sse::crypto::Key<kCipherKeySize>(k_cp.data()));
+
+    for (size_t len : {1, 8, 9, 16, 40, 200}) {
+        string in = sse::crypto::random_string(len);
+        string legacy_enc, dec;
+
+        cipher.encrypt(in, legacy_enc);
+
+        x_cipher.decrypt(legacy_enc, dec);
+        ASSERT_EQ(in, dec);
+
+        // a tampered nonce is still detected after the fallback
+        string enc = legacy_enc;
+        enc[0]     = static_cast<char>(enc[0] ^ 0x01);
+        ASSERT_THROW(x_cipher.decrypt(enc, dec), std::runtime_error);
+
+        // the converse does not hold
+        string x_enc;
+        x_cipher.encrypt(in, x_enc);
+        ASSERT_THROW(cipher.decrypt(x_enc, dec), std::runtime_error);
+    }
+
+    // legacy ciphertexts whose first nonce byte is the version header
+    string in = "This is a test input.";
+    string legacy_enc, dec;
+    do {
+        cipher.encrypt(in, legacy_enc);
+    } while (static_cast<uint8_t>(legacy_enc[0])
+             != sse::crypto::kXChaCha20CipherVersion);
+
+    x_cipher.decrypt(legacy_enc, dec);
+    ASSERT_EQ(in, dec);
+}
+
+TEST(encryption_xchacha20, header)
+{
+    sse::crypto::XChaCha20Cipher cipher((sse::crypto::Key<kCipherKeySize>()));
+
+    string in = "This is a test input.";
+    string enc, dec;
+    cipher.encrypt(in, enc);
+
+    // the header is authenticated
+    enc[0] = 0x02;
+    ASSERT_THROW(cipher.decrypt(enc, dec), std::runtime_error);
+
+    std::array<uint8_t, 16> in_arr, dec_arr;
+    std::array<uint8_t, 57> enc_arr;
+    sse::crypto::random_bytes(in_arr);
+
+    cipher.encrypt(in_arr, enc_arr);
+    enc_arr[0] = 0x00;
+    ASSERT_THROW(cipher.decrypt(enc_arr, dec_arr), std::runtime_error);
+}
+
+TEST(encryption_xchacha20, wrapping)
+{
+    std::string in = "This is a test input.";
+    std::string out1, out2, dec1, dec2;
+
+    sse::crypto::XChaCha20Cipher cipher((sse::crypto::Key<kCipherKeySize>()));
+
+    sse::crypto::Wrapper wrapper(
+        (sse::crypto::Key<sse::crypto::Wrapper::kKeySize>()));
+
+    auto wrapped_cipher = wrapper.wrap(cipher);
+
+    sse::crypto::XChaCha20Cipher unwrapped_cipher
+        = wrapper.unwrap<sse::crypto::XChaCha20Cipher>(wrapped_cipher);
+
+    cipher.encrypt(in, out1);
+    unwrapped_cipher.encrypt(in, out2);
+
+    cipher.decrypt(out2, dec2);
+    unwrapped_cipher.decrypt(out1, dec1);
+
+    ASSERT_EQ(in, dec1);
+    ASSERT_EQ(in, dec2);
+
+    // the two policies have distinct type bytes
+    ASSERT_THROW(wrapper.unwrap<sse::crypto::Cipher>(wrapped_cipher),
+                 std::runtime_error);
+}
+
+TEST(encryption_xchacha20, exception)
+{
+    ASSERT_EQ(sse::crypto::XChaCha20Cipher::plaintext_length(
+                  sse::crypto::XChaCha20Cipher::ciphertext_length(10)),
+              10);
+
+    sse::crypto::XChaCha20Cipher cipher((sse::crypto::Key<kCipherKeySize>()));
+
+    string out_enc, out_dec;
+    ASSERT_THROW(cipher.encrypt("", out_enc), std::invalid_argument);
+    ASSERT_THROW(cipher.decrypt(string(3, 'a'), out_dec),
+                 std::invalid_argument);
+    ASSERT_THROW(cipher.decrypt(string(300, 'a'), out_dec),
+                 std::runtime_error);
+}
+
+// Encrypt and decrypt a batch of messages of various lengths, across several
+// tasks, and check that the batch functions agree with encrypt and decrypt
+template<class CipherType>
+static void test_batch(const sse::crypto::Executor& executor)
+{
+    constexpr size_t kCount = 1000;
+
+    CipherType cipher((sse::crypto::Key<kCipherKeySize>()));
+
+    vector<string>         plaintexts(kCount);
+    vector<const uint8_t*> ins(kCount);
+    vector<size_t>         lens(kCount);
+    size_t                 c_total = 0;
+    for (size_t i = 0; i < kCount; i++) {
+        plaintexts[i] = sse::crypto::random_string(1 + (i * 7) % 100);
+        ins[i]        = reinterpret_cast<const uint8_t*>(plaintexts[i].data());
+        lens[i]       = plaintexts[i].size();
+        c_total += CipherType::ciphertext_length(lens[i]);
+    }
+
+    vector<uint8_t> ciphertexts(c_total);
+    cipher.encrypt_many(
+        ins.data(), lens.data(), kCount, ciphertexts.data(), executor);
+
+    // every ciphertext decrypts with decrypt
+    vector<const uint8_t*> c_ins(kCount);
+    vector<size_t>         c_lens(kCount);
+    size_t                 offset = 0;
+    for (size_t i = 0; i < kCount; i++) {
+        c_ins[i]  = ciphertexts.data() + offset;
+        c_lens[i] = CipherType::ciphertext_length(lens[i]);
+        offset += c_lens[i];
+
+        string enc(reinterpret_cast<const char*>(c_ins[i]), c_lens[i]);
+        string dec;
+        cipher.decrypt(enc, dec);
+        ASSERT_EQ(plaintexts[i], dec);
+    }
+
+    // the nonces are distinct
+    ASSERT_NE(string(reinterpret_cast<const char*>(c_ins[0]), 16),
+              string(reinterpret_cast<const char*>(c_ins[1]), 16));
+
+    // tamper with some of the ciphertexts
+    vector<uint8_t> tampered(ciphertexts);
+    for (size_t i = 0; i < kCount; i += 3) {
+        tampered[c_ins[i] - ciphertexts.data() + c_lens[i] - 1] ^= 0x01;
+        c_ins[i] = tampered.data() + (c_ins[i] - ciphertexts.data());
+    }
+    // ... and truncate one of them
+    c_lens[1] = CipherType::kCiphertextExpansion;
+
+    vector<uint8_t>    decrypted(c_total, 0xFF);
+    unique_ptr<bool[]> valid(new bool[kCount]);
+    size_t             n_failures = cipher.decrypt_many(c_ins.data(),
+                                            c_lens.data(),
+                                            kCount,
+                                            decrypted.data(),
+                                            valid.get(),
+                                            executor);
+
+    ASSERT_EQ(n_failures, (kCount + 2) / 3 + 1);
+
+    offset = 0;
+    for (size_t i = 0; i < kCount; i++) {
+        const size_t p_len = CipherType::plaintext_length(c_lens[i]);
+        string dec(reinterpret_cast<const char*>(decrypted.data() + offset),
+                   p_len);
+        offset += p_len;
+
+        if (i % 3 == 0 || i == 1) {
+            ASSERT_FALSE(valid[i]);
+            ASSERT_EQ(dec, string(p_len, '\0'));
+        } else {
+            ASSERT_TRUE(valid[i]);
+            ASSERT_EQ(plaintexts[i], dec);
+        }
+    }
+}
+
+TEST(encryption, batch)
+{
+    test_batch<sse::crypto::Cipher>(sse::crypto::thread_executor(4));
+
+    // sequential version, on a single task
+    sse::crypto::Cipher cipher((sse::crypto::Key<kCipherKeySize>()));
+
+    array<uint8_t, 16>     in_1, in_2;
+    array<uint8_t, 2 * 48> enc;
+    array<uint8_t, 32>     dec;
+    bool                   valid[2];
+    sse::crypto::random_bytes(in_1);
+    sse::crypto::random_bytes(in_2);
+
+    const uint8_t* ins[2]  = {in_1.data(), in_2.data()};
+    const size_t   lens[2] = {16, 16};
+    cipher.encrypt_many(ins, lens, 2, enc.data());
+
+    const uint8_t* c_ins[2]  = {enc.data(), enc.data() + 48};
+    const size_t   c_lens[2] = {48, 48};
+    ASSERT_EQ(cipher.decrypt_many(c_ins, c_lens, 2, dec.data(), valid), 0);
+    ASSERT_TRUE(valid[0] && valid[1]);
+    ASSERT_TRUE(std::equal(in_1.begin(), in_1.end(), dec.begin()));
+    ASSERT_TRUE(std::equal(in_2.begin(), in_2.end(), dec.begin() + 16));
+
+    // empty batches
+    cipher.encrypt_many(nullptr, nullptr, 0, nullptr);
+    ASSERT_EQ(cipher.decrypt_many(nullptr, nullptr, 0, nullptr, nullptr), 0);
+}
+
+TEST(encryption, batch_exception)
+{
+    sse::crypto::Cipher cipher((sse::crypto::Key<kCipherKeySize>()));
+
+    array<uint8_t, 16> in;
+    array<uint8_t, 48> out;
+    bool               valid;
+    in.fill(0x00);
+
+    const uint8_t* ins[1]       = {in.data()};
+    const uint8_t* null_ins[1]  = {nullptr};
+    const size_t   lens[1]      = {16};
+    const size_t   zero_lens[1] = {0};
+
+    ASSERT_THROW(cipher.encrypt_many(nullptr, lens, 1, out.data()),
+                 std::invalid_argument);
+    ASSERT_THROW(cipher.encrypt_many(ins, nullptr, 1, out.data()),
+                 std::invalid_argument);
+    ASSERT_THROW(cipher.encrypt_many(ins, lens, 1, nullptr),
+                 std::invalid_argument);
+    ASSERT_THROW(cipher.encrypt_many(null_ins, lens, 1, out.data()),
+                 std::invalid_argument);
+    ASSERT_THROW(cipher.encrypt_many(ins, zero_lens, 1, out.data()),
+                 std::invalid_argument);
+
+    ASSERT_THROW(cipher.decrypt_many(nullptr, lens, 1, out.data(), &valid),
+                 std::invalid_argument);
+    ASSERT_THROW(cipher.decrypt_many(ins, nullptr, 1, out.data(), &valid),
+                 std::invalid_argument);
+    ASSERT_THROW(cipher.decrypt_many(ins, lens, 1, nullptr, &valid),
+                 std::invalid_argument);
+    ASSERT_THROW(cipher.decrypt_many(ins, lens, 1, out.data(), nullptr),
+                 std::invalid_argument);
+    ASSERT_THROW(cipher.decrypt_many(null_ins, lens, 1, out.data(), &valid),
+                 std::invalid_argument);
+}
+
+TEST(encryption_xchacha20, batch)
+{
+    test_batch<sse::crypto::XChaCha20Cipher>(sse::crypto::thread_executor(4));
+
+    // legacy ciphertexts are not accepted by decrypt_many
+    array<uint8_t, kCipherKeySize> k;
+    sse::crypto::random_bytes(k);
+    array<uint8_t, kCipherKeySize> k_cp = k;
+
+    sse::crypto::Cipher cipher(sse::crypto::Key<kCipherKeySize>(k.data()));
+    sse::crypto::XChaCha20Cipher x_cipher(
+        sse::crypto::Key<kCipherKeySize>(k_cp.data()));
+
+    array<uint8_t, 60> in;
+    array<uint8_t, 92> enc;
+    array<uint8_t, 51> dec;
+    bool               valid = true;
+    sse::crypto::random_bytes(in);
+
+    const uint8_t* ins[1]    = {in.data()};
+    const size_t   lens[1]   = {in.size()};
+    const uint8_t* c_ins[1]  = {enc.data()};
+    const size_t   c_lens[1] = {enc.size()};
+
+    // the slot can hold the plaintext of a previous batch
+    dec.fill(0xFF);
+
+    cipher.encrypt_many(ins, lens, 1, enc.data());
+    ASSERT_EQ(x_cipher.decrypt_many(c_ins, c_lens, 1, dec.data(), &valid), 1);
+    ASSERT_FALSE(valid);
+
+    // the header mismatch is detected before decryption: the slot must still
+    // be zeroed
+    ASSERT_TRUE(std::all_of(
+        dec.begin(), dec.end(), [](uint8_t b) { return b == 0; }));
+}
+
+// Encrypt a payload with push, in chunks of chunk_size bytes, and an
+// optional empty last chunk
+static vector<uint8_t> push_stream(sse::crypto::Cipher::StreamEncryptor& enc,
+                                   const vector<uint8_t>&                in,
+                                   bool empty_last_chunk)
+{
+    const size_t    chunk_size = enc.chunk_size();
+    vector<uint8_t> stream(enc.header().begin(), enc.header().end());
+
+    size_t offset = 0;
+    while (!enc.finalized()) {
+        size_t len  = std::min(chunk_size, in.size() - offset);
+        bool   last = (offset + len == in.size())
+                    && !(empty_last_chunk && len == chunk_size);
+
+        vector<uint8_t> chunk(len + sse::crypto::Cipher::kChunkExpansion);
+        enc.push(in.data() + offset, len, last, chunk.data());
+        stream.insert(stream.end(), chunk.begin(), chunk.end());
+        offset += len;
+    }
+    return stream;
+}
+
+TEST(encryption_stream, push_pull)
+{
+    using sse::crypto::Cipher;
+
+    Cipher cipher((sse::crypto::Key<kCipherKeySize>()));
+
+    for (size_t len : {0, 1, 99, 100, 101, 1000}) {
+        for (bool empty_last_chunk : {false, true}) {
+            vector<uint8_t> in(len);
+            sse::crypto::random_bytes(in.size(), in.data());
+
+            auto            enc    = cipher.stream_encryptor(100);
+            vector<uint8_t> stream = push_stream(enc, in, empty_last_chunk);
+
+            if (!empty_last_chunk) {
+                ASSERT_EQ(stream.size(),
+                          Cipher::stream_ciphertext_length(len, 100));
+            }
+
+            auto dec = cipher.stream_decryptor(stream.data());
+            ASSERT_EQ(dec.chunk_size(), 100);
+
+            vector<uint8_t> out;
+            size_t          offset = Cipher::kStreamHeaderSize;
+            bool            last   = false;
+            while (!last) {
+                size_t c_len = std::min(100 + Cipher::kChunkExpansion,
+                                        stream.size() - offset);
+                vector<uint8_t> chunk(c_len - Cipher::kChunkExpansion);
+                last = dec.pull(stream.data() + offset, c_len, chunk.data());
+                out.insert(out.end(), chunk.begin(), chunk.end());
+                offset += c_len;
+            }
+            ASSERT_TRUE(dec.finalized());
+            ASSERT_EQ(offset, stream.size());
+            ASSERT_EQ(in, out);
+
+            ASSERT_THROW(dec.pull(stream.data() + Cipher::kStreamHeaderSize,
+                                  Cipher::kChunkExpansion,
+                                  out.data()),
+                         std::runtime_error);
+            ASSERT_THROW(enc.push(in.data(), 0, true, stream.data()),
+                         std::runtime_error);
+        }
+    }
+}
+
+TEST(encryption_stream, random_access)
+{
+    using sse::crypto::Cipher;
+
+    Cipher cipher((sse::crypto::Key<kCipherKeySize>()));
+
+    vector<uint8_t> in(1050);
+    sse::crypto::random_bytes(in.size(), in.data());
+
+    auto            enc    = cipher.stream_encryptor(100);
+    vector<uint8_t> stream = push_stream(enc, in, false);
+
+    auto dec = cipher.stream_decryptor(stream.data());
+    ASSERT_EQ(dec.chunk_count(stream.size()), 11);
+
+    // decrypt the chunks in reverse order
+    for (uint64_t i = 11; i-- > 0;) {
+        const bool   last   = (i == 10);
+        const size_t offset = dec.chunk_offset(i);
+        const size_t c_len  = last ? stream.size() - offset
+                                   : 100 + Cipher::kChunkExpansion;
+
+        vector<uint8_t> chunk(c_len - Cipher::kChunkExpansion);
+        dec.decrypt_chunk(i, stream.data() + offset, c_len, last, chunk.data());
+        ASSERT_TRUE(std::equal(
+            chunk.begin(), chunk.end(), in.begin() + 100 * i));
+
+        // the chunk index and the last chunk flag are authenticated
+        if (!last) {
+            ASSERT_THROW(
+                dec.decrypt_chunk(
+                    i + 1, stream.data() + offset, c_len, last, chunk.data()),
+                std::runtime_error);
+            ASSERT_THROW(
+                dec.decrypt_chunk(
+                    i, stream.data() + offset, c_len, true, chunk.data()),
+                std::runtime_error);
+        }
+    }
+
+    // a truncated stream never finalizes
+    auto trunc_dec = cipher.stream_decryptor(stream.data());
+    vector<uint8_t> chunk(100);
+    for (size_t i = 0; i < 10; i++) {
+        ASSERT_FALSE(trunc_dec.pull(stream.data() + dec.chunk_offset(i),
+                                    100 + Cipher::kChunkExpansion,
+                                    chunk.data()));
+    }
+    ASSERT_FALSE(trunc_dec.finalized());
+
+    // the last full chunk of a stream cut at a chunk boundary does not pass
+    // as a last chunk
+    ASSERT_THROW(dec.decrypt_chunk(9,
+                                   stream.data() + dec.chunk_offset(9),
+                                   100 + Cipher::kChunkExpansion,
+                                   true,
+                                   chunk.data()),
+                 std::runtime_error);
+}
+
+TEST(encryption_stream, tampering)
+{
+    using sse::crypto::Cipher;
+
+    Cipher cipher((sse::crypto::Key<kCipherKeySize>()));
+
+    vector<uint8_t> in(250);
+    sse::crypto::random_bytes(in.size(), in.data());
+
+    auto            enc    = cipher.stream_encryptor(100);
+    vector<uint8_t> stream = push_stream(enc, in, false);
+    vector<uint8_t> chunk(100);
+
+    // tampered chunk
+    vector<uint8_t> tampered(stream);
+    tampered[Cipher::kStreamHeaderSize + 3] ^= 0x01;
+    auto dec = cipher.stream_decryptor(tampered.data());
+    ASSERT_THROW(dec.pull(tampered.data() + Cipher::kStreamHeaderSize,
+                          100 + Cipher::kChunkExpansion,
+                          chunk.data()),
+                 std::runtime_error);
+
+    // tampered salt: the stream key changes
+    tampered = stream;
+    tampered[Cipher::kStreamHeaderSize - 1] ^= 0x01;
+    dec = cipher.stream_decryptor(tampered.data());
+    ASSERT_THROW(dec.pull(tampered.data() + Cipher::kStreamHeaderSize,
+                          100 + Cipher::kChunkExpansion,
+                          chunk.data()),
+                 std::runtime_error);
+
+    // swapped chunks
+    tampered = stream;
+    std::swap_ranges(tampered.begin() + Cipher::kStreamHeaderSize,
+                     tampered.begin() + Cipher::kStreamHeaderSize + 116,
+                     tampered.begin() + Cipher::kStreamHeaderSize + 116);
+    dec = cipher.stream_decryptor(tampered.data());
+    ASSERT_THROW(dec.pull(tampered.data() + Cipher::kStreamHeaderSize,
+                          100 + Cipher::kChunkExpansion,
+                          chunk.data()),
+                 std::runtime_error);
+
+    // different key
+    Cipher other((sse::crypto::Key<kCipherKeySize>()));
+    dec = other.stream_decryptor(stream.data());
+    ASSERT_THROW(dec.pull(stream.data() + Cipher::kStreamHeaderSize,
+                          100 + Cipher::kChunkExpansion,
+                          chunk.data()),
+                 std::runtime_error);
+}
+
+TEST(encryption_stream, file)
+{
+    using sse::crypto::Cipher;
+
+    const std::string path     = "stream_plain.bin";
+    const std::string enc_path = "stream_enc.bin";
+    const std::string dec_path = "stream_dec.bin";
+
+    Cipher cipher((sse::crypto::Key<kCipherKeySize>()));
+
+    vector<uint8_t> in(3 * 1000 + 17);
+    sse::crypto::random_bytes(in.size(), in.data());
+
+    for (size_t len : {size_t(0), size_t(1000), in.size()}) {
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(in.data()),
+                       static_cast<std::streamsize>(len));
+        }
+
+        cipher.encrypt_file(path, enc_path, 1000);
+
+        std::ifstream   enc_file(enc_path, std::ios::binary);
+        vector<uint8_t> stream((std::istreambuf_iterator<char>(enc_file)),
+                               std::istreambuf_iterator<char>());
+        ASSERT_EQ(stream.size(), Cipher::stream_ciphertext_length(len, 1000));
+
+        cipher.decrypt_file(enc_path, dec_path);
+
+        std::ifstream   dec_file(dec_path, std::ios::binary);
+        vector<uint8_t> out((std::istreambuf_iterator<char>(dec_file)),
+                            std::istreambuf_iterator<char>());
+        ASSERT_TRUE(len == out.size()
+                    && std::equal(out.begin(), out.end(), in.begin()));
+
+        // random access
+        auto           dec      = cipher.stream_decryptor(stream.data());
+        const uint64_t n_chunks = dec.chunk_count(stream.size());
+        for (uint64_t i = 0; i < n_chunks; i++) {
+            string chunk;
+            cipher.decrypt_file_chunk(enc_path, i, chunk);
+            ASSERT_EQ(chunk,
+                      string(reinterpret_cast<const char*>(in.data())
+                                 + 1000 * i,
+                             std::min<size_t>(1000, len - 1000 * i)));
+        }
+        string chunk;
+        ASSERT_THROW(cipher.decrypt_file_chunk(enc_path, n_chunks, chunk),
+                     std::out_of_range);
+    }
+
+    // truncated file: the output is removed
+    {
+        std::ifstream   enc_file(enc_path, std::ios::binary);
+        vector<uint8_t> stream((std::istreambuf_iterator<char>(enc_file)),
+                               std::istreambuf_iterator<char>());
+        std::ofstream   file(enc_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(stream.data()),
+                   static_cast<std::streamsize>(stream.size() - 17));
+    }
+    ASSERT_THROW(cipher.decrypt_file(enc_path, dec_path), std::runtime_error);
+    ASSERT_FALSE(std::ifstream(dec_path).good());
+
+    string chunk;
+    ASSERT_THROW(cipher.decrypt_file_chunk(enc_path, 3, chunk),
+                 std::runtime_error);
+    ASSERT_TRUE(chunk.empty());
+
+    std::remove(path.c_str());
+    std::remove(enc_path.c_str());
+    ASSERT_THROW(cipher.encrypt_file(path, enc_path), std::system_error);
+    ASSERT_THROW(cipher.decrypt_file(enc_path, dec_path), std::system_error);
+    ASSERT_THROW(cipher.decrypt_file_chunk(enc_path, 0, chunk),
+                 std::system_error);
+}
+
+TEST(encryption_stream, exceptions)
+{
+    using sse::crypto::Cipher;
+
+    Cipher cipher((sse::crypto::Key<kCipherKeySize>()));
+
+    ASSERT_THROW(cipher.stream_encryptor(0), std::invalid_argument);
+    ASSERT_THROW(cipher.stream_encryptor(Cipher::kMaxChunkSize + 1),
+                 std::invalid_argument);
+
+    auto            enc = cipher.stream_encryptor(100);
+    vector<uint8_t> in(101), out(200);
+
+    ASSERT_THROW(enc.push(nullptr, 100, false, out.data()),
+                 std::invalid_argument);
+    ASSERT_THROW(enc.push(in.data(), 100, false, nullptr),
+                 std::invalid_argument);
+    ASSERT_THROW(enc.push(in.data(), 99, false, out.data()),
+                 std::invalid_argument);
+    ASSERT_THROW(enc.push(in.data(), 101, true, out.data()),
+                 std::invalid_argument);
+
+    std::array<uint8_t, Cipher::kStreamHeaderSize> header = enc.header();
+    ASSERT_THROW(cipher.stream_decryptor(nullptr), std::invalid_argument);
+    header[0] = 0x02;
+    ASSERT_THROW(cipher.stream_decryptor(header.data()),
+                 std::invalid_argument);
+    header    = enc.header();
+    header[1] = header[2] = header[3] = header[4] = 0;
+    ASSERT_THROW(cipher.stream_decryptor(header.data()),
+                 std::invalid_argument);
+
+    auto dec = cipher.stream_decryptor(enc.header().data());
+    ASSERT_THROW(dec.pull(nullptr, 116, out.data()), std::invalid_argument);
+    ASSERT_THROW(dec.pull(in.data(), 116, nullptr), std::invalid_argument);
+    ASSERT_THROW(dec.pull(in.data(), 15, out.data()), std::invalid_argument);
+    ASSERT_THROW(dec.pull(in.data(), 117, out.data()), std::invalid_argument);
+    ASSERT_THROW(dec.decrypt_chunk(0, in.data(), 115, false, out.data()),
+                 std::invalid_argument);
+    ASSERT_THROW(dec.decrypt_chunk(0, nullptr, 116, false, out.data()),
+                 std::invalid_argument);
+    ASSERT_THROW(dec.chunk_count(Cipher::kStreamHeaderSize + 15),
+                 std::invalid_argument);
+    ASSERT_THROW(dec.chunk_count(Cipher::kStreamHeaderSize + 116 + 15),
+                 std::invalid_argument);
+}
@@ -27,15 +27,24 @@
  ********/
 
 #include "blake2_kat.h"
+#include "blake3_kat.h"
 #include "hash/blake2b.hpp"
+#include "hash/blake3.hpp"
 #include "hash/sha512.hpp"
 
 #include <sse/crypto/hash.hpp>
+#include <sse/crypto/random.hpp>
 
+#include <algorithm>
 #include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <system_error>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -199,6 +208,248 @@ TEST(blake2, blake2b)
 }
 
 
+TEST(blake2, blake2b_incremental)
+{
+    constexpr size_t IN_LENGTH = 256;
+
+    uint8_t in[IN_LENGTH] = {0};
+    for (size_t i = 0; i < sizeof(in); ++i) {
+        in[i] = static_cast<uint8_t>(i);
+    }
+
+    using blake2b = sse::crypto::hash::blake2b;
+
+    for (size_t i = 0; i < sizeof(in); ++i) {
+        string ref_string(reinterpret_cast<const char*>(blake2b_kat[i]),
+                          blake2b::kDigestSize);
+
+        for (size_t chunk : {1, 7, 64, 128, 129}) {
+            blake2b::state_type state;
+            uint8_t             hash[blake2b::kDigestSize];
+
+            blake2b::init(state);
+            for (size_t pos = 0; pos < i; pos += chunk) {
+                blake2b::update(state, in + pos, std::min(chunk, i - pos));
+            }
+            blake2b::final(state, hash);
+
+            ASSERT_EQ(ref_string,
+                      string(reinterpret_cast<const char*>(hash),
+                             blake2b::kDigestSize));
+        }
+
+        // the first block can be absorbed right away when more bytes follow
+        if (i > blake2b::kBlockSize) {
+            blake2b::state_type state;
+            uint8_t             hash[blake2b::kDigestSize];
+
+            blake2b::init(state);
+            blake2b::absorb_block(state, in);
+            blake2b::update(
+                state, in + blake2b::kBlockSize, i - blake2b::kBlockSize);
+            blake2b::final(state, hash);
+
+            ASSERT_EQ(ref_string,
+                      string(reinterpret_cast<const char*>(hash),
+                             blake2b::kDigestSize));
+        }
+    }
+}
+
+TEST(blake3, blake3)
+{
+    // use the test vectors in header blake3_kat.h
+    using blake3 = sse::crypto::hash::blake3;
+
+    std::vector<uint8_t> in(blake3_kat_lengths[BLAKE3_KAT_COUNT - 1]);
+    for (size_t i = 0; i < in.size(); ++i) {
+        in[i] = static_cast<uint8_t>(i % 251);
+    }
+
+    for (size_t k = 0; k < BLAKE3_KAT_COUNT; ++k) {
+        const size_t len = blake3_kat_lengths[k];
+        uint8_t      hash[blake3::kDigestSize];
+
+        string ref_string(reinterpret_cast<const char*>(blake3_kat[k]),
+                          blake3::kDigestSize);
+
+        blake3::hash(in.data(), len, hash);
+        ASSERT_EQ(ref_string,
+                  string(reinterpret_cast<const char*>(hash),
+                         blake3::kDigestSize));
+
+        // chunks crossing the block and chunk boundaries
+        for (size_t chunk : {1, 7, 64, 65, 1024, 1025}) {
+            blake3::state_type state;
+
+            blake3::init(state);
+            for (size_t pos = 0; pos < len; pos += chunk) {
+                blake3::update(
+                    state, in.data() + pos, std::min(chunk, len - pos));
+            }
+            blake3::final(state, hash);
+
+            ASSERT_EQ(ref_string,
+                      string(reinterpret_cast<const char*>(hash),
+                             blake3::kDigestSize));
+        }
+
+        if (len > blake3::kBlockSize) {
+            blake3::state_type state;
+
+            blake3::init(state);
+            blake3::absorb_block(state, in.data());
+            blake3::update(state,
+                           in.data() + blake3::kBlockSize,
+                           len - blake3::kBlockSize);
+            blake3::final(state, hash);
+
+            ASSERT_EQ(ref_string,
+                      string(reinterpret_cast<const char*>(hash),
+                             blake3::kDigestSize));
+        }
+    }
+}
+
+// Messages of different lengths, hashed in the lanes of the same kernel calls
+TEST(blake2, blake2b_update_final_many)
+{
+    constexpr size_t IN_LENGTH = 256;
+
+    uint8_t in[IN_LENGTH] = {0};
+    for (size_t i = 0; i < sizeof(in); ++i) {
+        in[i] = static_cast<uint8_t>(i);
+    }
+
+    using blake2b = sse::crypto::hash::blake2b;
+
+    std::vector<const unsigned char*> ins;
+    std::vector<size_t>               lens;
+    std::vector<unsigned char*>       outs;
+    std::vector<uint8_t> digests((IN_LENGTH - 1) * blake2b::kDigestSize);
+
+    for (size_t i = 1; i < IN_LENGTH; ++i) {
+        ins.push_back(in);
+        lens.push_back(i);
+        outs.push_back(digests.data() + (i - 1) * blake2b::kDigestSize);
+    }
+
+    blake2b::state_type state;
+    blake2b::init(state);
+
+    // every batch size, to go through the incomplete groups of lanes
+    for (size_t n = 1; n <= 2 * blake2b::kMaxLanes + 1; ++n) {
+        for (size_t first = 0; first + n <= ins.size(); first += n) {
+            blake2b::update_final_many(
+                state, &ins[first], &lens[first], &outs[first], n);
+        }
+        for (size_t i = 0; i < ins.size() - ins.size() % n; ++i) {
+            ASSERT_EQ(0,
+                      memcmp(outs[i], blake2b_kat[i + 1], blake2b::kDigestSize))
+                << "n = " << n << ", length = " << lens[i];
+        }
+    }
+
+    // from a state in which a block was absorbed
+    blake2b::absorb_block(state, in);
+    for (size_t i = 1; i < IN_LENGTH - blake2b::kBlockSize; ++i) {
+        ins[i - 1] = in + blake2b::kBlockSize;
+    }
+    blake2b::update_final_many(state,
+                               ins.data(),
+                               lens.data(),
+                               outs.data(),
+                               IN_LENGTH - blake2b::kBlockSize - 1);
+    for (size_t i = 1; i < IN_LENGTH - blake2b::kBlockSize; ++i) {
+        ASSERT_EQ(0,
+                  memcmp(outs[i - 1],
+                         blake2b_kat[blake2b::kBlockSize + i],
+                         blake2b::kDigestSize));
+    }
+}
+
+TEST(sha_512, incremental)
+{
+    using sha512 = sse::crypto::hash::sha512;
+
+    std::array<uint8_t, 300> in;
+    for (size_t i = 0; i < in.size(); ++i) {
+        in[i] = static_cast<uint8_t>(3 * i + 1);
+    }
+
+    for (size_t i = 0; i < in.size(); ++i) {
+        std::array<uint8_t, sha512::kDigestSize> ref;
+        std::array<uint8_t, sha512::kDigestSize> out;
+        sha512::hash(in.data(), i, ref.data());
+
+        sha512::state_type state;
+        sha512::init(state);
+        size_t pos = 0;
+        if (i > sha512::kBlockSize) {
+            sha512::absorb_block(state, in.data());
+            pos = sha512::kBlockSize;
+        }
+        for (; pos < i; pos += 13) {
+            sha512::update(
+                state, in.data() + pos, std::min<size_t>(13, i - pos));
+        }
+        sha512::final(state, out.data());
+
+        ASSERT_EQ(ref, out);
+    }
+}
+
+// Multi-buffer SHA-512, compared to libsodium's implementation
+TEST(sha_512, update_final_many)
+{
+    using sha512 = sse::crypto::hash::sha512;
+
+    std::array<uint8_t, 400> in;
+    for (size_t i = 0; i < in.size(); ++i) {
+        in[i] = static_cast<uint8_t>(7 * i + 3);
+    }
+
+    // lengths around the padding and block boundaries
+    std::vector<const unsigned char*> ins;
+    std::vector<size_t>               lens;
+    std::vector<unsigned char*>       outs;
+    std::vector<uint8_t>              digests(in.size() * sha512::kDigestSize);
+
+    for (size_t i = 0; i < in.size() - sha512::kBlockSize; ++i) {
+        ins.push_back(in.data() + i % 5);
+        lens.push_back(i);
+        outs.push_back(digests.data() + i * sha512::kDigestSize);
+    }
+
+    sha512::state_type init_state;
+    sha512::init(init_state);
+
+    sha512::state_type block_state = init_state;
+    sha512::absorb_block(block_state, in.data());
+
+    // pending bytes: the messages are hashed one after the other
+    sha512::state_type pending_state = init_state;
+    sha512::update(pending_state, in.data(), 3);
+
+    for (const auto& state : {init_state, block_state, pending_state}) {
+        for (size_t n = 1; n <= 2 * sha512::kMaxLanes + 1; ++n) {
+            for (size_t first = 0; first + n <= ins.size(); first += n) {
+                sha512::update_final_many(
+                    state, &ins[first], &lens[first], &outs[first], n);
+            }
+            for (size_t i = 0; i < ins.size() - ins.size() % n; ++i) {
+                sha512::state_type copy = state;
+                uint8_t            ref[sha512::kDigestSize];
+
+                sha512::update(copy, ins[i], lens[i]);
+                sha512::final(copy, ref);
+                ASSERT_EQ(0, memcmp(outs[i], ref, sha512::kDigestSize))
+                    << "n = " << n << ", length = " << lens[i];
+            }
+        }
+    }
+}
+
 TEST(hash, consistency)
 {
     for (size_t i = 1; i < sse::crypto::Hash::kDigestSize; i++) {
@@ -225,6 +476,408 @@ TEST(hash, consistency)
     }
 }
 
+TEST(hash, incremental)
+{
+    std::string in       = sse::crypto::random_string(1000);
+    const auto* in_bytes = reinterpret_cast<const unsigned char*>(in.data());
+
+    for (size_t len : {0, 1, 63, 128, 129, 256, 1000}) {
+        std::array<uint8_t, sse::crypto::Hash::kDigestSize> ref;
+        std::array<uint8_t, sse::crypto::Hash::kDigestSize> out;
+        std::array<uint8_t, sse::crypto::Hash::kDigestSize> copy_out;
+
+        sse::crypto::Hash::hash(in_bytes, len, ref.data());
+
+        sse::crypto::Hash::state_type state;
+        sse::crypto::Hash::init(state);
+        sse::crypto::Hash::update(state, in_bytes, len / 2);
+
+        // the state can be copied
+        sse::crypto::Hash::state_type copy = state;
+
+        sse::crypto::Hash::update(state, in_bytes + len / 2, len - len / 2);
+        sse::crypto::Hash::final(state, out.data());
+        ASSERT_EQ(ref, out);
+
+        sse::crypto::Hash::update(copy, in_bytes + len / 2, len - len / 2);
+        sse::crypto::Hash::final(copy, copy_out.data());
+        ASSERT_EQ(ref, copy_out);
+    }
+
+    // several messages from a common prefix
+    {
+        std::array<const unsigned char*, 3> ins  = {{in_bytes + 200,
+                                                    in_bytes + 300,
+                                                    in_bytes + 400}};
+        std::array<size_t, 3>               lens = {{1, 130, 600}};
+        std::array<std::array<uint8_t, sse::crypto::Hash::kDigestSize>, 3>
+                                            outs;
+        std::array<unsigned char*, 3>       out_ptrs
+            = {{outs[0].data(), outs[1].data(), outs[2].data()}};
+
+        sse::crypto::Hash::state_type state;
+        sse::crypto::Hash::init(state);
+        sse::crypto::Hash::absorb_block(state, in_bytes);
+        sse::crypto::Hash::update_final_many(
+            state, ins.data(), lens.data(), out_ptrs.data(), ins.size());
+
+        for (size_t i = 0; i < ins.size(); i++) {
+            sse::crypto::Hash::state_type copy = state;
+            std::array<uint8_t, sse::crypto::Hash::kDigestSize> ref;
+
+            sse::crypto::Hash::update(copy, ins[i], lens[i]);
+            sse::crypto::Hash::final(copy, ref.data());
+            ASSERT_EQ(ref, outs[i]);
+        }
+
+        lens[1] = 0;
+        ASSERT_THROW(sse::crypto::Hash::update_final_many(
+                         state, ins.data(), lens.data(), out_ptrs.data(), 3),
+                     std::invalid_argument);
+        ASSERT_THROW(sse::crypto::Hash::update_final_many(
+                         state, nullptr, lens.data(), out_ptrs.data(), 3),
+                     std::invalid_argument);
+    }
+
+    sse::crypto::Hash::state_type state;
+    sse::crypto::Hash::init(state);
+    ASSERT_THROW(sse::crypto::Hash::update(state, nullptr, 1),
+                 std::invalid_argument);
+    ASSERT_THROW(sse::crypto::Hash::absorb_block(state, nullptr),
+                 std::invalid_argument);
+    ASSERT_THROW(sse::crypto::Hash::final(state, nullptr),
+                 std::invalid_argument);
+}
+
+namespace tests {
+
+// Checks a hash backend against the digest of "abc", and the consistency of
+// its incremental interfaces
+template<class Backend>
+void test_hash_backend(const uint8_t (&abc_digest)[64])
+{
+    using H = sse::crypto::BasicHash<Backend>;
+
+    ASSERT_EQ(H::hash("abc"),
+              string(reinterpret_cast<const char*>(abc_digest), 64));
+
+    std::string in       = sse::crypto::random_string(3000);
+    const auto* in_bytes = reinterpret_cast<const unsigned char*>(in.data());
+
+    for (size_t len : {0, 1, 63, 64, 65, 128, 129, 1024, 1025, 3000}) {
+        std::array<uint8_t, H::kDigestSize> ref;
+        std::array<uint8_t, H::kDigestSize> out;
+
+        H::hash(in_bytes, len, ref.data());
+
+        typename H::State state;
+        state.update(in_bytes, len / 3);
+        state.update(in_bytes + len / 3, len - len / 3);
+        state.final(out.data());
+        ASSERT_EQ(ref, out);
+    }
+
+    std::array<const unsigned char*, 5> ins
+        = {{in_bytes, in_bytes + 1, in_bytes + 2, in_bytes + 3, in_bytes + 4}};
+    std::array<size_t, 5> lens = {{1, 64, 129, 1025, 2500}};
+    std::array<std::array<uint8_t, H::kDigestSize>, 5> outs;
+    std::array<unsigned char*, 5>                      out_ptrs
+        = {{outs[0].data(),
+            outs[1].data(),
+            outs[2].data(),
+            outs[3].data(),
+            outs[4].data()}};
+
+    typename H::state_type state;
+    H::init(state);
+    H::update_final_many(
+        state, ins.data(), lens.data(), out_ptrs.data(), ins.size());
+
+    for (size_t i = 0; i < ins.size(); i++) {
+        std::array<uint8_t, H::kDigestSize> ref;
+
+        H::hash(ins[i], lens[i], ref.data());
+        ASSERT_EQ(ref, outs[i]);
+    }
+
+    // common prefix which does not end on a block boundary
+    constexpr size_t kMessages = 8;
+    std::array<const unsigned char*, kMessages> prefixed_ins;
+    std::array<size_t, kMessages>               prefixed_lens;
+    std::array<std::array<uint8_t, H::kDigestSize>, kMessages> prefixed_outs;
+    std::array<unsigned char*, kMessages>                      prefixed_ptrs;
+    for (size_t i = 0; i < kMessages; i++) {
+        prefixed_ins[i]  = in_bytes + 100 + i;
+        prefixed_lens[i] = 1 + 97 * i;
+        prefixed_ptrs[i] = prefixed_outs[i].data();
+    }
+
+    H::init(state);
+    H::update(state, in_bytes, 10);
+    H::update_final_many(state,
+                         prefixed_ins.data(),
+                         prefixed_lens.data(),
+                         prefixed_ptrs.data(),
+                         kMessages);
+
+    for (size_t i = 0; i < kMessages; i++) {
+        std::string message(reinterpret_cast<const char*>(in_bytes), 10);
+        message.append(reinterpret_cast<const char*>(prefixed_ins[i]),
+                       prefixed_lens[i]);
+        ASSERT_EQ(H::hash(message),
+                  string(reinterpret_cast<const char*>(prefixed_outs[i].data()),
+                         H::kDigestSize));
+    }
+}
+
+} // namespace tests
+
+TEST(hash, backends)
+{
+    const uint8_t sha512_abc[64]
+        = {0xdd, 0xaf, 0x35, 0xa1, 0x93, 0x61, 0x7a, 0xba, 0xcc, 0x41, 0x73,
+           0x49, 0xae, 0x20, 0x41, 0x31, 0x12, 0xe6, 0xfa, 0x4e, 0x89, 0xa9,
+           0x7e, 0xa2, 0x0a, 0x9e, 0xee, 0xe6, 0x4b, 0x55, 0xd3, 0x9a, 0x21,
+           0x92, 0x99, 0x2a, 0x27, 0x4f, 0xc1, 0xa8, 0x36, 0xba, 0x3c, 0x23,
+           0xa3, 0xfe, 0xeb, 0xbd, 0x45, 0x4d, 0x44, 0x23, 0x64, 0x3c, 0xe8,
+           0x0e, 0x2a, 0x9a, 0xc9, 0x4f, 0xa5, 0x4c, 0xa4, 0x9f};
+    const uint8_t blake2b_abc[64]
+        = {0xba, 0x80, 0xa5, 0x3f, 0x98, 0x1c, 0x4d, 0x0d, 0x6a, 0x27, 0x97,
+           0xb6, 0x9f, 0x12, 0xf6, 0xe9, 0x4c, 0x21, 0x2f, 0x14, 0x68, 0x5a,
+           0xc4, 0xb7, 0x4b, 0x12, 0xbb, 0x6f, 0xdb, 0xff, 0xa2, 0xd1, 0x7d,
+           0x87, 0xc5, 0x39, 0x2a, 0xab, 0x79, 0x2d, 0xc2, 0x52, 0xd5, 0xde,
+           0x45, 0x33, 0xcc, 0x95, 0x18, 0xd3, 0x8a, 0xa8, 0xdb, 0xf1, 0x92,
+           0x5a, 0xb9, 0x23, 0x86, 0xed, 0xd4, 0x00, 0x99, 0x23};
+    const uint8_t blake3_abc[64]
+        = {0x64, 0x37, 0xb3, 0xac, 0x38, 0x46, 0x51, 0x33, 0xff, 0xb6, 0x3b,
+           0x75, 0x27, 0x3a, 0x8d, 0xb5, 0x48, 0xc5, 0x58, 0x46, 0x5d, 0x79,
+           0xdb, 0x03, 0xfd, 0x35, 0x9c, 0x6c, 0xd5, 0xbd, 0x9d, 0x85, 0x1f,
+           0xb2, 0x50, 0xae, 0x73, 0x93, 0xf5, 0xd0, 0x28, 0x13, 0xb6, 0x5d,
+           0x52, 0x1a, 0x0d, 0x49, 0x2d, 0x9b, 0xa0, 0x9c, 0xf7, 0xce, 0x7f,
+           0x4c, 0xff, 0xd9, 0x00, 0xf2, 0x33, 0x74, 0xbf, 0x0b};
+
+    tests::test_hash_backend<sse::crypto::Blake2bBackend>(blake2b_abc);
+    tests::test_hash_backend<sse::crypto::Sha512Backend>(sha512_abc);
+    tests::test_hash_backend<sse::crypto::Blake3Backend>(blake3_abc);
+
+    // the tree mode is BLAKE2b, whatever the backend
+    std::string in = sse::crypto::random_string(1000);
+    std::array<uint8_t, sse::crypto::Hash::kDigestSize> tree_blake2b;
+    std::array<uint8_t, sse::crypto::Hash::kDigestSize> tree_blake3;
+
+    sse::crypto::BasicHash<sse::crypto::Blake2bBackend>::tree_hash(
+        reinterpret_cast<const unsigned char*>(in.data()),
+        in.size(),
+        tree_blake2b.data());
+    sse::crypto::BasicHash<sse::crypto::Blake3Backend>::tree_hash(
+        reinterpret_cast<const unsigned char*>(in.data()),
+        in.size(),
+        tree_blake3.data());
+    ASSERT_EQ(tree_blake2b, tree_blake3);
+}
+
+TEST(hash, streaming)
+{
+    std::string in       = sse::crypto::random_string(1000);
+    const auto* in_bytes = reinterpret_cast<const unsigned char*>(in.data());
+
+    for (size_t len : {0, 1, 63, 128, 129, 256, 1000}) {
+        std::array<uint8_t, sse::crypto::Hash::kDigestSize> ref;
+        std::array<uint8_t, sse::crypto::Hash::kDigestSize> out;
+        std::array<uint8_t, sse::crypto::Hash::kDigestSize> copy_out;
+
+        sse::crypto::Hash::hash(in_bytes, len, ref.data());
+
+        sse::crypto::Hash::State state;
+        for (size_t pos = 0; pos < len / 2; pos += 7) {
+            state.update(in_bytes + pos, std::min<size_t>(7, len / 2 - pos));
+        }
+
+        // the state can be copied
+        sse::crypto::Hash::State copy(state);
+
+        state.update(in_bytes + len / 2, len - len / 2);
+        state.final(out.data());
+        ASSERT_EQ(ref, out);
+
+        copy.update(in.substr(len / 2, len - len / 2));
+        copy.final(copy_out.data(), len % sse::crypto::Hash::kDigestSize);
+        ASSERT_TRUE(std::equal(copy_out.begin(),
+                               copy_out.begin()
+                                   + len % sse::crypto::Hash::kDigestSize,
+                               ref.begin()));
+
+        // the state cannot be used after finalization
+        ASSERT_THROW(state.update(in_bytes, 1), std::runtime_error);
+        ASSERT_THROW(state.final(out.data()), std::runtime_error);
+    }
+
+    sse::crypto::Hash::State state;
+    uint8_t                  out[sse::crypto::Hash::kDigestSize + 1];
+    ASSERT_THROW(state.update(nullptr, 1), std::invalid_argument);
+    ASSERT_THROW(state.final(nullptr), std::invalid_argument);
+    ASSERT_THROW(state.final(out, sse::crypto::Hash::kDigestSize + 1),
+                 std::invalid_argument);
+}
+
+// Tree mode: the leaves and the root are hashed with the tree parameters
+static void tree_hash_reference(const unsigned char* in,
+                                const size_t         len,
+                                unsigned char*       out)
+{
+    using sse::crypto::hash::blake2b;
+    constexpr size_t kLeafSize = sse::crypto::Hash::kTreeLeafSize;
+
+    const size_t n_leaves = (len == 0) ? 1 : (len + kLeafSize - 1) / kLeafSize;
+    std::vector<unsigned char> digests(n_leaves * blake2b::kDigestSize);
+
+    unsigned char param[blake2b::kParamSize] = {0};
+    param[0]                                 = blake2b::kDigestSize;
+    param[3]                                 = 2;
+    memcpy(param + 4, "\x00\x00\x10\x00", 4); // 1 MiB leaves
+    param[17] = blake2b::kDigestSize;
+
+    for (size_t i = 0; i < n_leaves; i++) {
+        blake2b::state_type state;
+
+        param[8] = static_cast<unsigned char>(i & 0xFF);
+        param[9] = static_cast<unsigned char>(i >> 8);
+        blake2b::init_param(state, param);
+        blake2b::update(state,
+                        in + i * kLeafSize,
+                        std::min(kLeafSize, len - i * kLeafSize));
+        blake2b::final(state,
+                       digests.data() + i * blake2b::kDigestSize,
+                       i + 1 == n_leaves);
+    }
+
+    blake2b::state_type root;
+    param[8]  = 0;
+    param[9]  = 0;
+    param[16] = 1;
+    blake2b::init_param(root, param);
+    blake2b::update(root, digests.data(), digests.size());
+    blake2b::final(root, out, true);
+}
+
+TEST(hash, tree)
+{
+    constexpr size_t kLeafSize = sse::crypto::Hash::kTreeLeafSize;
+    ASSERT_EQ(kLeafSize, 1U << 20);
+
+    std::vector<unsigned char> in(3 * kLeafSize + 5);
+    sse::crypto::random_bytes(in.size(), in.data());
+
+    for (size_t len : {size_t(0),
+                       size_t(1),
+                       size_t(1000),
+                       kLeafSize,
+                       kLeafSize + 1,
+                       3 * kLeafSize + 5}) {
+        std::array<uint8_t, sse::crypto::Hash::kDigestSize> ref;
+        std::array<uint8_t, sse::crypto::Hash::kDigestSize> out;
+        std::array<uint8_t, sse::crypto::Hash::kDigestSize> out_1;
+        std::array<uint8_t, sse::crypto::Hash::kDigestSize> plain;
+
+        tree_hash_reference(in.data(), len, ref.data());
+
+        sse::crypto::Hash::tree_hash(in.data(), len, out.data());
+        ASSERT_EQ(ref, out);
+
+        // the digest does not depend on the number of threads
+        sse::crypto::Hash::tree_hash(
+            in.data(), len, out_1.data(), sse::crypto::thread_executor(1));
+        ASSERT_EQ(ref, out_1);
+
+        // the tree mode is separated from the sequential mode
+        sse::crypto::Hash::hash(in.data(), len, plain.data());
+        ASSERT_NE(plain, out);
+    }
+
+    std::array<uint8_t, sse::crypto::Hash::kDigestSize> out;
+    ASSERT_NO_THROW(sse::crypto::Hash::tree_hash(nullptr, 0, out.data()));
+    ASSERT_THROW(sse::crypto::Hash::tree_hash(nullptr, 1, out.data()),
+                 std::invalid_argument);
+    ASSERT_THROW(sse::crypto::Hash::tree_hash(in.data(), 1, nullptr),
+                 std::invalid_argument);
+}
+
+// Known answers of the tree mode, computed with an independent implementation
+// of the BLAKE2 tree parameters (Python's hashlib)
+TEST(hash, tree_vectors)
+{
+    constexpr size_t kLeafSize = sse::crypto::Hash::kTreeLeafSize;
+
+    // the input bytes are i % 251
+    std::vector<unsigned char> in(2 * kLeafSize + 100);
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = static_cast<unsigned char>(i % 251);
+    }
+
+    const uint8_t empty_digest[64]
+        = {0xdd, 0x8a, 0x26, 0x39, 0xc9, 0x0f, 0x07, 0xd7, 0xfb, 0xf7, 0x72,
+           0x6d, 0xae, 0x63, 0x17, 0xa3, 0x27, 0x90, 0x29, 0x32, 0x9b, 0xe4,
+           0x22, 0x43, 0x29, 0xaf, 0x27, 0xa9, 0x2b, 0x8b, 0x40, 0x14, 0xef,
+           0xac, 0xb9, 0x3f, 0x28, 0x91, 0x20, 0x6f, 0x9e, 0x06, 0x01, 0xbc,
+           0x7a, 0xdd, 0xe1, 0x63, 0xe9, 0xaa, 0x70, 0xf3, 0x2d, 0x33, 0x47,
+           0x31, 0x11, 0xf3, 0xd6, 0x63, 0x96, 0x93, 0x19, 0x19};
+    const uint8_t short_digest[64]
+        = {0x2f, 0xdb, 0x37, 0x57, 0x2e, 0xd7, 0x66, 0xbb, 0x63, 0x31, 0x6a,
+           0x63, 0xd0, 0x22, 0xca, 0x41, 0xc9, 0x01, 0x83, 0x59, 0xe9, 0x63,
+           0x3b, 0xc8, 0xc2, 0xb6, 0x0b, 0x51, 0x5a, 0x49, 0xb9, 0x99, 0x5a,
+           0x68, 0x91, 0x67, 0xa1, 0xf4, 0x21, 0x57, 0x42, 0xae, 0xe5, 0xf4,
+           0x06, 0xd4, 0xec, 0x53, 0x71, 0x3e, 0x37, 0x8f, 0xa0, 0xc9, 0xac,
+           0xed, 0x48, 0xb9, 0x8e, 0x90, 0x7e, 0x1d, 0x05, 0x96};
+    const uint8_t three_leaves_digest[64]
+        = {0x69, 0x1b, 0xee, 0x2e, 0x11, 0x81, 0x9b, 0x90, 0xac, 0xa0, 0x16,
+           0x7a, 0xd8, 0xe7, 0x32, 0x97, 0x73, 0xc4, 0x1f, 0xd1, 0x2c, 0x06,
+           0x34, 0x44, 0x33, 0x52, 0xa7, 0x9c, 0x41, 0x1b, 0xc6, 0xe9, 0xf1,
+           0x3a, 0x8a, 0xcf, 0xe7, 0xbb, 0x75, 0x9f, 0xb5, 0x68, 0x05, 0xdc,
+           0x50, 0x3a, 0x51, 0x71, 0x9f, 0xd2, 0x90, 0x29, 0xf3, 0xf0, 0x7d,
+           0xf3, 0x29, 0x7e, 0x6c, 0x43, 0xdd, 0xa9, 0xa4, 0xeb};
+
+    std::array<uint8_t, sse::crypto::Hash::kDigestSize> out;
+
+    sse::crypto::Hash::tree_hash(in.data(), 0, out.data());
+    ASSERT_EQ(memcmp(out.data(), empty_digest, out.size()), 0);
+
+    sse::crypto::Hash::tree_hash(in.data(), 3, out.data());
+    ASSERT_EQ(memcmp(out.data(), short_digest, out.size()), 0);
+
+    sse::crypto::Hash::tree_hash(in.data(), in.size(), out.data());
+    ASSERT_EQ(memcmp(out.data(), three_leaves_digest, out.size()), 0);
+}
+
+TEST(hash, tree_file)
+{
+    const std::string path = "hash_tree_file.bin";
+
+    std::vector<unsigned char> in(2 * sse::crypto::Hash::kTreeLeafSize + 17);
+    sse::crypto::random_bytes(in.size(), in.data());
+
+    for (size_t len : {size_t(0), size_t(100), in.size()}) {
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(in.data()),
+                       static_cast<std::streamsize>(len));
+        }
+
+        std::array<uint8_t, sse::crypto::Hash::kDigestSize> ref;
+        std::array<uint8_t, sse::crypto::Hash::kDigestSize> out;
+
+        sse::crypto::Hash::tree_hash(in.data(), len, ref.data());
+        sse::crypto::Hash::tree_hash_file(path, out.data());
+        ASSERT_EQ(ref, out);
+    }
+
+    std::array<uint8_t, sse::crypto::Hash::kDigestSize> out;
+    ASSERT_THROW(sse::crypto::Hash::tree_hash_file(path, nullptr),
+                 std::invalid_argument);
+    std::remove(path.c_str());
+    ASSERT_THROW(sse::crypto::Hash::tree_hash_file(path, out.data()),
+                 std::system_error);
+}
+
 TEST(hash, exceptions)
 {
     std::string in;
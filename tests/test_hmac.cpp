@@ -32,12 +32,17 @@
 
 #include "hash/sha512.hpp"
 
+#include <sse/crypto/hash.hpp>
 #include <sse/crypto/hmac.hpp>
 #include <sse/crypto/key.hpp>
+#include <sse/crypto/random.hpp>
 
+#include <algorithm>
+#include <array>
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -155,6 +160,163 @@ TEST(hmac_sha_512, test_vector_4)
     ASSERT_EQ(result_64, reference);
 }
 
+// Textbook HMAC (RFC 2104) computed with the one-shot hash function
+template<class H>
+static std::array<uint8_t, H::kDigestSize> reference_hmac(
+    const std::vector<uint8_t>& key,
+    const std::vector<uint8_t>& in)
+{
+    std::vector<uint8_t> key_block(H::kBlockSize, 0x00);
+    if (key.size() > H::kBlockSize) {
+        H::hash(key.data(), key.size(), key_block.data());
+    } else {
+        std::copy(key.begin(), key.end(), key_block.begin());
+    }
+
+    std::vector<uint8_t> inner(key_block);
+    for (auto& b : inner) {
+        b ^= 0x36;
+    }
+    inner.insert(inner.end(), in.begin(), in.end());
+
+    std::vector<uint8_t> outer(key_block);
+    for (auto& b : outer) {
+        b ^= 0x5c;
+    }
+    outer.resize(H::kBlockSize + H::kDigestSize);
+    H::hash(inner.data(), inner.size(), outer.data() + H::kBlockSize);
+
+    std::array<uint8_t, H::kDigestSize> result;
+    H::hash(outer.data(), outer.size(), result.data());
+    return result;
+}
+
+template<class H, uint16_t N>
+static void test_hmac_reference()
+{
+    std::vector<uint8_t> key(N);
+    for (size_t i = 0; i < N; i++) {
+        key[i] = static_cast<uint8_t>(7 * i + 3);
+    }
+    std::vector<uint8_t> key_copy(key);
+
+    sse::crypto::HMac<H, N> hmac(sse::crypto::Key<N>(key_copy.data()));
+
+    for (size_t len = 0; len <= 2 * H::kBlockSize + 1; len++) {
+        std::vector<uint8_t> in(len);
+        for (size_t i = 0; i < len; i++) {
+            in[i] = static_cast<uint8_t>(i ^ len);
+        }
+        uint8_t c      = 0;
+        auto    result = hmac.hmac((len == 0) ? &c : in.data(), in.size());
+
+        ASSERT_EQ(result, reference_hmac<H>(key, in));
+    }
+}
+
+TEST(hmac, reference)
+{
+    test_hmac_reference<sse::crypto::Hash, 16>();
+    test_hmac_reference<sse::crypto::Hash, 32>();
+    test_hmac_reference<sse::crypto::Hash, 128>();
+    test_hmac_reference<sse::crypto::Hash, 200>();
+    test_hmac_reference<sse::crypto::hash::sha512, 25>();
+    test_hmac_reference<sse::crypto::hash::sha512, 150>();
+}
+
+TEST(hmac, incremental)
+{
+    HMAC_SHA512<25> hmac;
+    std::string     in = sse::crypto::random_string(300);
+    const auto*     in_bytes
+        = reinterpret_cast<const unsigned char*>(in.data());
+
+    for (size_t len : {0, 1, 50, 128, 129, 300}) {
+        const auto reference = hmac.hmac(in_bytes, len);
+
+        for (size_t cut = 0; cut <= len; cut += 7) {
+            auto state = hmac.init();
+            state.update(in_bytes, cut);
+
+            // a copy shares the absorbed prefix
+            auto copy = state;
+
+            std::array<uint8_t, HMAC_SHA512<25>::kDigestSize> out;
+            state.update(in_bytes + cut, len - cut);
+            state.final(out.data());
+            ASSERT_EQ(out, reference);
+
+            // truncated output
+            std::array<uint8_t, 20> truncated;
+            copy.update(in_bytes + cut, len - cut);
+            copy.final(truncated.data(), truncated.size());
+            ASSERT_TRUE(
+                std::equal(truncated.begin(), truncated.end(), out.begin()));
+        }
+    }
+
+    auto                                              state = hmac.init();
+    std::array<uint8_t, HMAC_SHA512<25>::kDigestSize> out;
+    ASSERT_THROW(state.update(nullptr, 1), std::invalid_argument);
+    ASSERT_THROW(state.final(nullptr), std::invalid_argument);
+    ASSERT_THROW(state.final(out.data(), HMAC_SHA512<25>::kDigestSize + 1),
+                 std::invalid_argument);
+
+    state.final(out.data());
+    ASSERT_THROW(state.update(in_bytes, 1), std::runtime_error);
+    ASSERT_THROW(state.final(out.data()), std::runtime_error);
+}
+
+template<class H, uint16_t N>
+void test_hmac_batch()
+{
+    sse::crypto::HMac<H, N> hmac;
+    std::string             in = sse::crypto::random_string(1000);
+    const auto* in_bytes = reinterpret_cast<const unsigned char*>(in.data());
+
+    std::vector<const unsigned char*> ins;
+    std::vector<size_t>               lens;
+    for (size_t len = 0; len < 300; len += 3) {
+        ins.push_back(in_bytes + len);
+        lens.push_back(len);
+    }
+
+    std::vector<uint8_t> out(ins.size() * H::kDigestSize);
+    hmac.hmac_batch(ins.data(), lens.data(), ins.size(), out.data());
+
+    constexpr size_t     kTruncatedSize = 20;
+    std::vector<uint8_t> truncated(ins.size() * kTruncatedSize);
+    hmac.hmac_batch(
+        ins.data(), lens.data(), ins.size(), truncated.data(), kTruncatedSize);
+
+    for (size_t i = 0; i < ins.size(); i++) {
+        const auto reference = hmac.hmac(ins[i], lens[i]);
+        ASSERT_TRUE(std::equal(
+            reference.begin(), reference.end(), out.begin() + i * H::kDigestSize));
+        ASSERT_TRUE(std::equal(reference.begin(),
+                               reference.begin() + kTruncatedSize,
+                               truncated.begin() + i * kTruncatedSize));
+    }
+}
+
+TEST(hmac, batch)
+{
+    test_hmac_batch<sse::crypto::Hash, 32>();
+    test_hmac_batch<sse::crypto::Hash, 200>();
+    test_hmac_batch<sse::crypto::hash::sha512, 25>();
+
+    HMAC_SHA512<25>      hmac;
+    const unsigned char* in  = nullptr;
+    size_t               len = 0;
+    uint8_t              out[HMAC_SHA512<25>::kDigestSize];
+
+    ASSERT_NO_THROW(hmac.hmac_batch(nullptr, nullptr, 0, nullptr));
+    ASSERT_THROW(hmac.hmac_batch(&in, &len, 1, out), std::invalid_argument);
+    ASSERT_THROW(hmac.hmac_batch(nullptr, &len, 1, out), std::invalid_argument);
+    ASSERT_THROW(hmac.hmac_batch(&in, &len, 1, out, sizeof(out) + 1),
+                 std::invalid_argument);
+}
+
 TEST(hmac, exception)
 {
     ASSERT_THROW(HMAC_SHA512<25> hmac(sse::crypto::Key<25>(NULL)),
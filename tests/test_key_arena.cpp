@@ -0,0 +1,225 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <sse/crypto/key_arena.hpp>
+#include <sse/crypto/prf.hpp>
+#include <sse/crypto/prg.hpp>
+
+#include <cstring>
+
+#include <array>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using sse::crypto::KeyArena;
+
+TEST(key_arena, allocation)
+{
+    std::vector<KeyArena::Allocation> allocs;
+    std::set<uint8_t*>                ptrs;
+
+    for (size_t i = 0; i < 3 * KeyArena::kThreadCacheSize; i++) {
+        KeyArena::Allocation a = KeyArena::allocate(32);
+
+        ASSERT_NE(a.ptr, nullptr);
+        ASSERT_NE(a.slab, nullptr);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(a.ptr) % KeyArena::kSlotAlignment,
+                  0);
+        // slots must not be handed out twice
+        EXPECT_TRUE(ptrs.insert(a.ptr).second);
+
+        allocs.push_back(a);
+    }
+    EXPECT_GE(KeyArena::slab_count(), 1);
+
+    for (const auto& a : allocs) {
+        KeyArena::acquire_write(a.slab);
+        memset(a.ptr, 0xFF, 32);
+        KeyArena::release_write(a.slab);
+    }
+
+    for (const auto& a : allocs) {
+        KeyArena::deallocate(a, 32);
+    }
+
+    // freed slots are reused and zeroized
+    KeyArena::Allocation a = KeyArena::allocate(32);
+    EXPECT_TRUE(ptrs.find(a.ptr) != ptrs.end());
+
+    std::array<uint8_t, 32> zero;
+    zero.fill(0x00);
+
+    KeyArena::acquire_read(a.slab);
+    EXPECT_EQ(memcmp(a.ptr, zero.data(), zero.size()), 0);
+    KeyArena::release_read(a.slab);
+
+    KeyArena::deallocate(a, 32);
+}
+
+TEST(key_arena, size_classes)
+{
+    EXPECT_FALSE(KeyArena::supports(0));
+    EXPECT_TRUE(KeyArena::supports(1));
+    EXPECT_TRUE(KeyArena::supports(KeyArena::kMaxSlotSize));
+    EXPECT_FALSE(KeyArena::supports(KeyArena::kMaxSlotSize + 1));
+
+    for (size_t size = 1; size <= KeyArena::kMaxSlotSize; size++) {
+        KeyArena::Allocation a = KeyArena::allocate(size);
+
+        KeyArena::acquire_write(a.slab);
+        memset(a.ptr, 0xAA, size);
+        KeyArena::release_write(a.slab);
+
+        KeyArena::deallocate(a, size);
+    }
+}
+
+TEST(key_arena, nested_access)
+{
+    KeyArena::Allocation a = KeyArena::allocate(16);
+
+    KeyArena::acquire_read(a.slab);
+    KeyArena::acquire_read(a.slab);
+    KeyArena::acquire_write(a.slab);
+    memset(a.ptr, 0x11, 16);
+    KeyArena::release_write(a.slab);
+    // still readable as two readers remain
+    EXPECT_EQ(a.ptr[0], 0x11);
+    KeyArena::release_read(a.slab);
+    EXPECT_EQ(a.ptr[15], 0x11);
+    KeyArena::release_read(a.slab);
+
+    KeyArena::deallocate(a, 16);
+}
+
+TEST(key_arena, threads)
+{
+    constexpr size_t kThreads = 4;
+    constexpr size_t kRounds  = 1000;
+
+    auto job = []() {
+        for (size_t i = 0; i < kRounds; i++) {
+            KeyArena::Allocation a = KeyArena::allocate(48);
+            KeyArena::acquire_write(a.slab);
+            memset(a.ptr, static_cast<int>(i), 48);
+            KeyArena::release_write(a.slab);
+            KeyArena::deallocate(a, 48);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < kThreads; t++) {
+        threads.emplace_back(job);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+// Slots freed by the destructor of a thread_local object constructed before
+// the thread cache of the arena, and hence destroyed after it
+struct LateFrees
+{
+    std::vector<KeyArena::Allocation> allocs;
+
+    ~LateFrees()
+    {
+        for (const auto& a : allocs) {
+            KeyArena::deallocate(a, KeyArena::kMaxSlotSize);
+        }
+
+        // allocations are served by the arena as well
+        KeyArena::deallocate(KeyArena::allocate(KeyArena::kMaxSlotSize),
+                             KeyArena::kMaxSlotSize);
+    }
+};
+
+thread_local LateFrees late_frees;
+
+TEST(key_arena, late_deallocation)
+{
+    constexpr size_t kRounds = 40;
+
+    auto job = []() {
+        // construct late_frees before the first allocation of the thread
+        late_frees.allocs.reserve(2 * KeyArena::kThreadCacheSize);
+
+        for (size_t i = 0; i < 2 * KeyArena::kThreadCacheSize; i++) {
+            late_frees.allocs.push_back(
+                KeyArena::allocate(KeyArena::kMaxSlotSize));
+        }
+    };
+
+    // the first round fills the arena with the slots it needs
+    std::thread(job).join();
+    const size_t slabs = KeyArena::slab_count();
+
+    for (size_t r = 1; r < kRounds; r++) {
+        std::thread(job).join();
+    }
+
+    // the slots were given back to the arena, and reused by the next rounds
+    EXPECT_LE(KeyArena::slab_count(), slabs + 1);
+}
+
+TEST(key_arena, exceptions)
+{
+    EXPECT_THROW(KeyArena::allocate(0), std::invalid_argument);
+    EXPECT_THROW(KeyArena::allocate(KeyArena::kMaxSlotSize + 1),
+                 std::invalid_argument);
+}
+
+// The following tests go through the Key class, and hence use the arena only
+// when ENABLE_KEY_ARENA is set. They must succeed in both configurations.
+TEST(key_arena, keys)
+{
+    std::array<uint8_t, 32> k{{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                               0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+                               0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+                               0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f}};
+    std::array<uint8_t, 32> k_cp = k;
+
+    sse::crypto::Prf<16> prf_1(sse::crypto::Key<32>(k.data()));
+    sse::crypto::Prf<16> prf_2(sse::crypto::Key<32>(k_cp.data()));
+
+    // many keys are alive at the same time: some of them share a slab
+    std::vector<sse::crypto::Prg> prgs;
+    for (size_t i = 0; i < 2 * KeyArena::kThreadCacheSize; i++) {
+        prgs.emplace_back(sse::crypto::Key<sse::crypto::Prg::kKeySize>());
+    }
+
+    EXPECT_EQ(prf_1.prf(std::string("input")),
+              prf_2.prf(std::string("input")));
+
+    for (auto& prg : prgs) {
+        std::string out_1 = prg.derive(32);
+        std::string out_2 = prg.derive(32);
+        EXPECT_EQ(out_1, out_2);
+    }
+
+    // moved keys keep their content
+    sse::crypto::Prf<16> prf_3(std::move(prf_2));
+    EXPECT_EQ(prf_1.prf(std::string("input")),
+              prf_3.prf(std::string("input")));
+}
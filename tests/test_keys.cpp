@@ -0,0 +1,271 @@
+//
+// libsse_crypto - An abstraction layer for high level cryptographic features.
+// Copyright (C) 2015-2017 Raphael Bost
+//
+// This file is part of libsse_crypto.
+//
+// libsse_crypto is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// libsse_crypto is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <sse/crypto/cipher.hpp>
+#include <sse/crypto/ephemeral_key.hpp>
+#include <sse/crypto/key.hpp>
+#include <sse/crypto/prf.hpp>
+#include <sse/crypto/prg.hpp>
+#include <sse/crypto/prp.hpp>
+
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace sse {
+namespace crypto {
+
+void test_keys()
+{
+    Key<32> key;
+
+#ifdef ENABLE_MEMORY_LOCK
+    EXPECT_TRUE(key.is_locked());
+#endif
+
+    {
+        auto session = key.unlock_session();
+        EXPECT_FALSE(key.is_locked());
+
+        // lock() has no effect during a session
+        key.unlock_get();
+        key.lock();
+        EXPECT_FALSE(key.is_locked());
+
+        {
+            // nested session
+            auto nested = key.unlock_session();
+            EXPECT_FALSE(key.is_locked());
+        }
+        EXPECT_FALSE(key.is_locked());
+
+        // moved sessions do not close the session twice
+        auto moved = std::move(session);
+        EXPECT_FALSE(key.is_locked());
+    }
+
+#ifdef ENABLE_MEMORY_LOCK
+    EXPECT_TRUE(key.is_locked());
+#endif
+
+    // sessions opened concurrently
+    constexpr size_t kThreads = 4;
+    constexpr size_t kRounds  = 1000;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < kThreads; t++) {
+        threads.emplace_back([&key]() {
+            for (size_t i = 0; i < kRounds; i++) {
+                auto session = key.unlock_session();
+                // the key must be readable
+                volatile uint8_t b = key.data()[i % 32];
+                (void)b;
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+#ifdef ENABLE_MEMORY_LOCK
+    EXPECT_TRUE(key.is_locked());
+#endif
+}
+
+void test_ephemeral_keys()
+{
+    constexpr uint16_t kKeys = 10;
+
+    Prg prg((Key<Prg::kKeySize>()));
+
+    std::array<uint8_t, 32> zero;
+    zero.fill(0x00);
+
+    for (uint16_t i = 0; i < kKeys; i++) {
+        // derivation from a Prg object
+        EphemeralKey<32> k;
+        prg.derive_key<32>(i, k);
+        std::string expected = prg.derive(32 * i, 32);
+        EXPECT_EQ(memcmp(k.data(), expected.data(), 32), 0);
+
+        // derivation from an ephemeral seed must match the derivation from
+        // a Prg object with the same key
+        std::array<uint8_t, 32> buf;
+        memcpy(buf.data(), k.data(), 32);
+        Prg sub_prg((Key<Prg::kKeySize>(buf.data())));
+
+        EphemeralKey<16> sub_k;
+        Prg::derive_key<16>(k, i, sub_k);
+        expected = sub_prg.derive(16 * i, 16);
+        EXPECT_EQ(memcmp(sub_k.data(), expected.data(), 16), 0);
+
+        std::array<uint8_t, 50> out;
+        Prg::derive(k, i, out.size(), out.data());
+        expected = sub_prg.derive(i, out.size());
+        EXPECT_EQ(memcmp(out.data(), expected.data(), out.size()), 0);
+
+        // moved keys are zeroized
+        EphemeralKey<32> moved(std::move(k));
+        EXPECT_EQ(memcmp(k.data(), zero.data(), 32), 0);
+        EXPECT_NE(memcmp(moved.data(), zero.data(), 32), 0);
+
+        moved.erase();
+        EXPECT_EQ(memcmp(moved.data(), zero.data(), 32), 0);
+    }
+
+    // the output of a derivation cannot be its seed
+    EphemeralKey<32> k;
+    EXPECT_THROW(Prg::derive_key<32>(k, 0, k), std::invalid_argument);
+    EXPECT_THROW(EphemeralKey<32>(nullptr), std::invalid_argument);
+}
+
+} // namespace crypto
+} // namespace sse
+
+TEST(keys, unlock_session)
+{
+    sse::crypto::test_keys();
+}
+
+TEST(keys, ephemeral)
+{
+    sse::crypto::test_ephemeral_keys();
+}
+
+TEST(keys, session_consistency)
+{
+    constexpr size_t kRounds = 100;
+
+    sse::crypto::Prf<32> prf;
+    sse::crypto::Prg     prg((sse::crypto::Key<sse::crypto::Prg::kKeySize>()));
+    sse::crypto::Cipher  cipher(
+        (sse::crypto::Key<sse::crypto::Cipher::kKeySize>()));
+
+    std::vector<std::array<uint8_t, 32>> prf_out;
+    std::vector<std::string>             prg_out;
+    std::vector<std::string>             ciphertexts;
+
+    for (size_t i = 0; i < kRounds; i++) {
+        prf_out.push_back(prf.prf(std::to_string(i)));
+        prg_out.push_back(prg.derive(i, 32));
+    }
+
+    {
+        auto prf_session    = prf.unlock_session();
+        auto prg_session    = prg.unlock_session();
+        auto cipher_session = cipher.unlock_session();
+
+        for (size_t i = 0; i < kRounds; i++) {
+            EXPECT_EQ(prf.prf(std::to_string(i)), prf_out[i]);
+            EXPECT_EQ(prg.derive(i, 32), prg_out[i]);
+
+            std::string ct;
+            cipher.encrypt(std::to_string(i), ct);
+            ciphertexts.push_back(ct);
+        }
+    }
+
+    for (size_t i = 0; i < kRounds; i++) {
+        std::string pt;
+        cipher.decrypt(ciphertexts[i], pt);
+        EXPECT_EQ(pt, std::to_string(i));
+    }
+}
+
+// Primitives shared by several threads, without any external synchronization.
+// Run with the thread sanitizer to check that the read paths are race-free.
+TEST(keys, shared_primitives)
+{
+    constexpr size_t kThreads = 4;
+    constexpr size_t kRounds  = 200;
+
+    const sse::crypto::Prf<32>  prf;
+    const sse::crypto::Prg      prg(
+        (sse::crypto::Key<sse::crypto::Prg::kKeySize>()));
+    const sse::crypto::Cipher   cipher(
+        (sse::crypto::Key<sse::crypto::Cipher::kKeySize>()));
+    const sse::crypto::Prp      prp;
+    const sse::crypto::RangePrp range_prp(1000);
+
+    std::vector<std::array<uint8_t, 32>> prf_out;
+    std::vector<std::string>             prg_out;
+    std::vector<std::string>             ciphertexts;
+    std::vector<uint64_t>                prp_out;
+    std::vector<uint64_t>                range_out;
+
+    for (size_t i = 0; i < kRounds; i++) {
+        std::string ct;
+        cipher.encrypt(std::to_string(i), ct);
+
+        prf_out.push_back(prf.prf(std::to_string(i)));
+        prg_out.push_back(prg.derive(i, 32));
+        ciphertexts.push_back(ct);
+        prp_out.push_back(prp.encrypt_64(i));
+        range_out.push_back(range_prp.encrypt(i));
+    }
+
+    auto job = [&]() {
+        for (size_t i = 0; i < kRounds; i++) {
+            std::string ct, pt;
+            cipher.encrypt(std::to_string(i), ct);
+            cipher.decrypt(ct, pt);
+            EXPECT_EQ(pt, std::to_string(i));
+            cipher.decrypt(ciphertexts[i], pt);
+            EXPECT_EQ(pt, std::to_string(i));
+
+            EXPECT_EQ(prf.prf(std::to_string(i)), prf_out[i]);
+            EXPECT_EQ(prg.derive(i, 32), prg_out[i]);
+            EXPECT_EQ(prp.encrypt_64(i), prp_out[i]);
+            EXPECT_EQ(prp.decrypt_64(prp_out[i]), i);
+            EXPECT_EQ(range_prp.encrypt(i), range_out[i]);
+        }
+    };
+
+    // every evaluation opens and closes its own unlock session
+    {
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < kThreads; t++) {
+            threads.emplace_back(job);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    // the keys stay unlocked for the whole computation
+    {
+        auto prf_session    = prf.unlock_session();
+        auto prg_session    = prg.unlock_session();
+        auto cipher_session = cipher.unlock_session();
+        auto prp_session    = prp.unlock_session();
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < kThreads; t++) {
+            threads.emplace_back(job);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+}
@@ -23,19 +23,22 @@
 #include <sse/crypto/random.hpp>
 #include <sse/crypto/wrapper.hpp>
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
+#include <sodium/crypto_generichash_blake2b.h>
 
 using namespace std;
 namespace tests {
 
-template<size_t N>
+template<size_t N, class Policy = sse::crypto::HMacPrfPolicy>
 void test_prf_consistency(size_t input_size)
 {
-    sse::crypto::Prf<N> prf;
+    sse::crypto::Prf<N, Policy> prf;
 
     string in_s  = sse::crypto::random_string(input_size);
     auto   out_s = prf.prf(in_s);
@@ -46,10 +49,10 @@ void test_prf_consistency(size_t input_size)
     ASSERT_EQ(out_s, out_buf);
 }
 
-template<size_t N, size_t L>
+template<size_t N, size_t L, class Policy = sse::crypto::HMacPrfPolicy>
 void test_prf_consistency_array()
 {
-    sse::crypto::Prf<N> prf;
+    sse::crypto::Prf<N, Policy> prf;
 
     std::array<uint8_t, L> in_arr;
     sse::crypto::random_bytes(in_arr);
@@ -106,7 +109,7 @@ void test_key_derivation_consistency_array()
     out_key.lock();
 }
 
-template<size_t N>
+template<size_t N, class Policy = sse::crypto::HMacPrfPolicy>
 void test_wrapping()
 {
     constexpr size_t kNTests = 1000;
@@ -115,15 +118,15 @@ void test_wrapping()
         (sse::crypto::Key<sse::crypto::Wrapper::kKeySize>()));
 
     // Create a Prg object
-    sse::crypto::Prf<N> base_prf;
+    sse::crypto::Prf<N, Policy> base_prf;
 
 
     // wrap the object
     auto prf_rep = wrapper.wrap(base_prf);
 
     // unwrap the object
-    sse::crypto::Prf<N> unwrapped_prf
-        = wrapper.unwrap<sse::crypto::Prf<N>>(prf_rep);
+    sse::crypto::Prf<N, Policy> unwrapped_prf
+        = wrapper.unwrap<sse::crypto::Prf<N, Policy>>(prf_rep);
 
 
     for (size_t i = 1; i < kNTests + 1; i++) {
@@ -135,6 +138,107 @@ void test_wrapping()
     }
 }
 
+template<size_t N>
+void test_blake2b_reference()
+{
+    using Blake2bPrf = sse::crypto::Prf<N, sse::crypto::Blake2bPrfPolicy>;
+
+    std::array<uint8_t, Blake2bPrf::kKeySize> k;
+    sse::crypto::random_bytes(k);
+
+    const std::array<uint8_t, Blake2bPrf::kKeySize> k_cp = k;
+    Blake2bPrf prf(sse::crypto::Key<Blake2bPrf::kKeySize>(k.data()));
+
+    std::vector<uint8_t> in(3 * sse::crypto::Hash::kBlockSize);
+    sse::crypto::random_bytes(in.size(), in.data());
+
+    for (size_t len = 0; len <= in.size(); len++) {
+        std::array<uint8_t, N> reference;
+        crypto_generichash_blake2b_salt_personal(
+            reference.data(),
+            N,
+            in.data(),
+            len,
+            k_cp.data(),
+            k_cp.size(),
+            nullptr,
+            sse::crypto::KeyedBlake2bParams::kPersonalization);
+
+        ASSERT_EQ(prf.prf(in.data(), len), reference);
+    }
+}
+
+template<size_t N, class Policy = sse::crypto::HMacPrfPolicy>
+void test_prf_batch()
+{
+    sse::crypto::Prf<N, Policy> prf;
+
+    std::string in       = sse::crypto::random_string(1000);
+    const auto* in_bytes = reinterpret_cast<const uint8_t*>(in.data());
+
+    // inputs of different lengths, more than a group of lanes
+    std::vector<const uint8_t*> ins;
+    std::vector<size_t>         lens;
+    for (size_t len = 0; len < 300; len += 7) {
+        ins.push_back(in_bytes + len);
+        lens.push_back(len);
+    }
+
+    std::vector<uint8_t> out(ins.size() * N);
+    prf.prf_batch(ins.data(), lens.data(), ins.size(), out.data());
+
+    for (size_t i = 0; i < ins.size(); i++) {
+        auto reference = prf.prf(ins[i], lens[i]);
+        ASSERT_TRUE(
+            std::equal(reference.begin(), reference.end(), out.begin() + i * N))
+            << "input length " << lens[i];
+    }
+
+    // fixed length inputs
+    for (size_t len : {0, 8, 16, 150}) {
+        const size_t         count = in.size() / (len + 1);
+        std::vector<uint8_t> fixed_out(count * N);
+        prf.prf_batch(in_bytes, len, count, fixed_out.data());
+
+        for (size_t i = 0; i < count; i++) {
+            auto reference = prf.prf(in_bytes + i * len, len);
+            ASSERT_TRUE(std::equal(
+                reference.begin(), reference.end(), fixed_out.begin() + i * N));
+        }
+    }
+}
+
+// Outputs larger than the HMac digest are made of the blocks HMac(in || i)
+template<size_t N, class Policy = sse::crypto::HMacPrfPolicy>
+void test_prf_counter_mode(size_t input_size)
+{
+    using HMacBase
+        = sse::crypto::HMac<typename sse::crypto::PrfPolicyHash<Policy>::type,
+                            32>;
+
+    uint8_t key_buf[32];
+    uint8_t key_copy[32];
+    sse::crypto::random_bytes(32, key_buf);
+    std::copy(key_buf, key_buf + 32, key_copy);
+
+    sse::crypto::Prf<N, Policy> prf{sse::crypto::Key<32>(key_buf)};
+    HMacBase                    hmac{sse::crypto::Key<32>(key_copy)};
+
+    std::vector<uint8_t> in(input_size + 1);
+    sse::crypto::random_bytes(input_size, in.data());
+
+    auto out = prf.prf(in.data(), input_size);
+
+    for (size_t pos = 0, i = 0; pos < N; pos += HMacBase::kDigestSize, i++) {
+        const size_t len = std::min<size_t>(N - pos, HMacBase::kDigestSize);
+        uint8_t      block[HMacBase::kDigestSize];
+
+        in[input_size] = static_cast<uint8_t>(i);
+        hmac.hmac(in.data(), input_size + 1, block, len);
+        ASSERT_TRUE(std::equal(block, block + len, out.begin() + pos));
+    }
+}
+
 } // namespace tests
 
 TEST(prf, consistency)
@@ -172,6 +276,52 @@ TEST(prf, key_derivation_consistency)
     tests::test_key_derivation_consistency_array<1024, 200>();
 }
 
+TEST(prf, counter_mode)
+{
+    for (size_t i = 0; i <= 2 * sse::crypto::Hash::kBlockSize + 20; i++) {
+        tests::test_prf_counter_mode<65>(i);
+        tests::test_prf_counter_mode<128>(i);
+        tests::test_prf_counter_mode<300>(i);
+    }
+}
+
+// HMac over the hash backends that are not the default one
+TEST(prf, hash_backends)
+{
+    using Blake2bHash = sse::crypto::BasicHash<sse::crypto::Blake2bBackend>;
+    using Sha512Hash  = sse::crypto::BasicHash<sse::crypto::Sha512Backend>;
+    using Blake3Hash  = sse::crypto::BasicHash<sse::crypto::Blake3Backend>;
+
+    using Blake2bHMac = sse::crypto::BasicHMacPrfPolicy<Blake2bHash>;
+    using Sha512HMac  = sse::crypto::BasicHMacPrfPolicy<Sha512Hash>;
+    using Blake3HMac  = sse::crypto::BasicHMacPrfPolicy<Blake3Hash>;
+    using DefaultHMac = sse::crypto::BasicHMacPrfPolicy<sse::crypto::Hash>;
+
+    for (size_t i = 0; i <= 2 * sse::crypto::Hash::kBlockSize + 20; i += 7) {
+        tests::test_prf_counter_mode<65, Blake2bHMac>(i);
+        tests::test_prf_counter_mode<300, Blake2bHMac>(i);
+        tests::test_prf_counter_mode<65, Sha512HMac>(i);
+        tests::test_prf_counter_mode<300, Sha512HMac>(i);
+        tests::test_prf_counter_mode<65, Blake3HMac>(i);
+        tests::test_prf_counter_mode<300, Blake3HMac>(i);
+    }
+    tests::test_prf_batch<16, Sha512HMac>();
+    tests::test_prf_batch<128, Blake3HMac>();
+
+    // BasicHMacPrfPolicy<Hash> is HMacPrfPolicy
+    uint8_t key_buf[32];
+    uint8_t key_copy[32];
+    sse::crypto::random_bytes(32, key_buf);
+    std::copy(key_buf, key_buf + 32, key_copy);
+
+    sse::crypto::Prf<100>              prf{sse::crypto::Key<32>(key_buf)};
+    sse::crypto::Prf<100, DefaultHMac> basic_prf{
+        sse::crypto::Key<32>(key_copy)};
+
+    const std::string in = sse::crypto::random_string(200);
+    ASSERT_EQ(prf.prf(in), basic_prf.prf(in));
+}
+
 TEST(prf, wrapping)
 {
     tests::test_wrapping<1>();
@@ -188,3 +338,154 @@ TEST(prf, exceptions)
 
     ASSERT_THROW(prf.prf(nullptr, 0), std::invalid_argument);
 }
+
+TEST(prf, batch)
+{
+    tests::test_prf_batch<1>();
+    tests::test_prf_batch<16>();
+    tests::test_prf_batch<64>();
+    tests::test_prf_batch<128>();
+    tests::test_prf_batch<16, sse::crypto::Blake2bPrfPolicy>();
+    tests::test_prf_batch<64, sse::crypto::Blake2bPrfPolicy>();
+    tests::test_prf_batch<200, sse::crypto::Blake2bPrfPolicy>();
+
+    sse::crypto::Prf<16> prf;
+    const uint8_t*       in  = nullptr;
+    size_t               len = 0;
+    uint8_t              out[16];
+
+    ASSERT_NO_THROW(prf.prf_batch(&in, &len, 0, out));
+    ASSERT_THROW(prf.prf_batch(&in, &len, 1, out), std::invalid_argument);
+    ASSERT_THROW(prf.prf_batch(nullptr, &len, 1, out), std::invalid_argument);
+    ASSERT_THROW(prf.prf_batch(in, 0, 1, out), std::invalid_argument);
+    ASSERT_THROW(prf.prf_batch(out, 0, 1, nullptr), std::invalid_argument);
+}
+
+// Keyed BLAKE2b, compared to libsodium's implementation
+TEST(prf_blake2b, reference)
+{
+    tests::test_blake2b_reference<1>();
+    tests::test_blake2b_reference<16>();
+    tests::test_blake2b_reference<32>();
+    tests::test_blake2b_reference<64>();
+}
+
+// BLAKE2Xb, with the personalization string of the PRF
+TEST(prf_blake2b, blake2x_test_vectors)
+{
+    using sse::crypto::Blake2bPrfPolicy;
+
+    std::array<uint8_t, sse::crypto::Prf<100>::kKeySize> k;
+    std::array<uint8_t, 200>                             in;
+    for (size_t i = 0; i < k.size(); i++) {
+        k[i] = static_cast<uint8_t>(i);
+    }
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = static_cast<uint8_t>(i);
+    }
+
+    std::array<uint8_t, 100> reference_100
+        = {{
+            0x3f, 0x01, 0xcb, 0x9c, 0x45, 0xb8, 0x74, 0xb4, 0x6d, 0x08, 0xa3,
+            0x13, 0x63, 0x21, 0x00, 0x0b, 0x70, 0xb8, 0xc6, 0x59, 0x4b, 0x59,
+            0xac, 0xb7, 0xf2, 0xd0, 0xaa, 0x88, 0x0c, 0xf1, 0xf7, 0xd5, 0xad,
+            0x50, 0x2a, 0xef, 0x72, 0x6d, 0xdf, 0x13, 0xef, 0xbd, 0x2b, 0x13,
+            0xbd, 0x82, 0x95, 0x38, 0x90, 0xfb, 0x9f, 0x9a, 0x5a, 0xfe, 0xeb,
+            0x7a, 0x77, 0x6a, 0xf3, 0x19, 0xd0, 0x3d, 0xae, 0x96, 0x88, 0xd0,
+            0x81, 0xdb, 0x3e, 0x5a, 0x96, 0xa6, 0xf6, 0x7a, 0x38, 0xb4, 0x92,
+            0xc2, 0xd2, 0xf7, 0xf7, 0x4e, 0x2e, 0xc6, 0xe0, 0x1c, 0x92, 0xd0,
+            0xde, 0x00, 0x54, 0xdb, 0xd9, 0xe7, 0xd6, 0x80, 0x22, 0xd7, 0x2b,
+            0xc4}};
+    std::array<uint8_t, 200> reference_200
+        = {{
+            0xeb, 0xd7, 0x8a, 0xc6, 0xcb, 0x0d, 0xd3, 0x96, 0xe0, 0x5a, 0xd0,
+            0xd2, 0x26, 0x1d, 0x04, 0xf6, 0x83, 0x76, 0x42, 0x24, 0xed, 0xdf,
+            0xc0, 0x34, 0x4e, 0xa0, 0xec, 0x36, 0x90, 0xb8, 0xdf, 0xf9, 0xec,
+            0xf3, 0xc9, 0xba, 0x24, 0xf5, 0xb6, 0x2f, 0xe8, 0xd4, 0x42, 0x86,
+            0x72, 0xe4, 0xb7, 0x75, 0x05, 0x4a, 0x62, 0x36, 0xdc, 0x5e, 0x49,
+            0x09, 0x9c, 0xd9, 0x6b, 0xf0, 0xa0, 0x6d, 0x84, 0xcd, 0x64, 0x6d,
+            0xab, 0xd9, 0x4c, 0x12, 0xc4, 0xe4, 0xbb, 0x4c, 0x2f, 0x20, 0x59,
+            0xaf, 0xdc, 0x30, 0x70, 0x6d, 0xb9, 0x16, 0xd7, 0x52, 0x63, 0xcb,
+            0x62, 0xbc, 0x91, 0xe5, 0x6c, 0x40, 0xb1, 0xcd, 0x34, 0x29, 0x72,
+            0xdc, 0x6b, 0xe3, 0xef, 0xfc, 0xea, 0xf5, 0xc0, 0x91, 0x2e, 0x3e,
+            0x11, 0x66, 0x84, 0xaf, 0x2b, 0xb9, 0xfe, 0x47, 0xac, 0x51, 0x8d,
+            0x22, 0x18, 0x46, 0x52, 0x7e, 0x88, 0x56, 0x10, 0xdd, 0xc3, 0x33,
+            0xe0, 0xd0, 0xb8, 0x20, 0x7c, 0xc1, 0x9c, 0xd0, 0xf5, 0xa2, 0x7f,
+            0xf6, 0x9d, 0x48, 0x0f, 0xf9, 0x42, 0xd5, 0xed, 0xe7, 0x29, 0x1a,
+            0x33, 0x24, 0xe1, 0x41, 0xa7, 0x48, 0x7a, 0x3b, 0xf6, 0x94, 0x26,
+            0xd8, 0x6b, 0x3e, 0xe8, 0x68, 0x6c, 0x97, 0x97, 0x71, 0x04, 0x20,
+            0x65, 0x6e, 0x8d, 0x89, 0x33, 0x8f, 0xd9, 0x26, 0x02, 0x3f, 0x26,
+            0x7d, 0x43, 0x61, 0x64, 0x18, 0x4e, 0xa8, 0x02, 0x43, 0x26, 0x0e,
+            0x1b, 0x95}};
+
+    std::array<uint8_t, sse::crypto::Prf<100>::kKeySize> k_cp = k;
+
+    sse::crypto::Prf<100, Blake2bPrfPolicy> prf_100(
+        sse::crypto::Key<32>(k.data()));
+    sse::crypto::Prf<200, Blake2bPrfPolicy> prf_200(
+        sse::crypto::Key<32>(k_cp.data()));
+
+    ASSERT_EQ(prf_100.prf(in.data(), 3), reference_100);
+    ASSERT_EQ(prf_200.prf(in), reference_200);
+}
+
+TEST(prf_blake2b, consistency)
+{
+    using sse::crypto::Blake2bPrfPolicy;
+
+    for (size_t i = 0; i <= 2 * sse::crypto::Hash::kBlockSize + 20; i++) {
+        tests::test_prf_consistency<1, Blake2bPrfPolicy>(i);
+        tests::test_prf_consistency<16, Blake2bPrfPolicy>(i);
+        tests::test_prf_consistency<64, Blake2bPrfPolicy>(i);
+        tests::test_prf_consistency<65, Blake2bPrfPolicy>(i);
+        tests::test_prf_consistency<200, Blake2bPrfPolicy>(i);
+    }
+    tests::test_prf_consistency_array<16, 20, Blake2bPrfPolicy>();
+    tests::test_prf_consistency_array<200, 200, Blake2bPrfPolicy>();
+}
+
+TEST(prf_blake2b, domain_separation)
+{
+    std::array<uint8_t, sse::crypto::Prf<32>::kKeySize> k;
+    sse::crypto::random_bytes(k);
+    std::array<uint8_t, sse::crypto::Prf<32>::kKeySize> k_cp = k;
+
+    sse::crypto::Prf<32> hmac_prf(sse::crypto::Key<32>(k.data()));
+    sse::crypto::Prf<32, sse::crypto::Blake2bPrfPolicy> blake2b_prf(
+        sse::crypto::Key<32>(k_cp.data()));
+
+    for (size_t i = 0; i < 100; i++) {
+        std::string in = sse::crypto::random_string(i);
+
+        ASSERT_NE(hmac_prf.prf(in), blake2b_prf.prf(in));
+    }
+}
+
+TEST(prf_blake2b, wrapping)
+{
+    tests::test_wrapping<16, sse::crypto::Blake2bPrfPolicy>();
+    tests::test_wrapping<200, sse::crypto::Blake2bPrfPolicy>();
+
+    // a wrapped PRF cannot be unwrapped with the other policy
+    sse::crypto::Wrapper wrapper(
+        (sse::crypto::Key<sse::crypto::Wrapper::kKeySize>()));
+
+    sse::crypto::Prf<16, sse::crypto::Blake2bPrfPolicy> blake2b_prf;
+    auto rep = wrapper.wrap(blake2b_prf);
+
+    ASSERT_THROW(wrapper.unwrap<sse::crypto::Prf<16>>(rep), std::runtime_error);
+}
+
+TEST(prf_blake2b, exceptions)
+{
+    sse::crypto::Prf<20, sse::crypto::Blake2bPrfPolicy> prf;
+
+    ASSERT_THROW(prf.prf(nullptr, 0), std::invalid_argument);
+
+    // empty key
+    sse::crypto::Key<32> key;
+    sse::crypto::Key<32> moved_key(std::move(key));
+    ASSERT_THROW(
+        (sse::crypto::Prf<20, sse::crypto::Blake2bPrfPolicy>(std::move(key))),
+        std::invalid_argument);
+}
@@ -25,7 +25,9 @@
 #include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -312,6 +314,81 @@ TEST(prg, consistency_4)
     tests::prg_test_key_derivation_consistency<32>();
 }
 
+TEST(prg, derive_batch)
+{
+    using EphemeralKey = sse::crypto::EphemeralKey<kPrgKeySize>;
+
+    constexpr size_t kMaxSeeds    = 40;
+    constexpr size_t kDistinct    = 7;
+    const size_t     lengths[]    = {1, 16, 64, 100, 200};
+    const size_t     offsets[]    = {0, 5, 64, 130, 1000};
+    const size_t     kLargeOffset = (static_cast<size_t>(1) << 38) + 37;
+
+    // keep a copy of the seeds to build the reference Prg objects
+    std::vector<std::array<uint8_t, kPrgKeySize>> seeds(kDistinct);
+    std::vector<std::unique_ptr<EphemeralKey>>    keys;
+    for (size_t i = 0; i < kDistinct; i++) {
+        sse::crypto::random_bytes(seeds[i]);
+        std::array<uint8_t, kPrgKeySize> cp = seeds[i];
+        keys.emplace_back(new EphemeralKey(cp.data()));
+    }
+
+    for (size_t n = 1; n <= kMaxSeeds; n++) {
+        for (size_t len : lengths) {
+            std::vector<const EphemeralKey*>  k_ptrs;
+            std::vector<size_t>               offs;
+            std::vector<std::vector<uint8_t>> bufs(n,
+                                                   std::vector<uint8_t>(len));
+            std::vector<unsigned char*>       out_ptrs;
+
+            for (size_t i = 0; i < n; i++) {
+                // seeds are repeated, and the offsets are both aligned and
+                // unaligned on block boundaries
+                k_ptrs.push_back(keys[i % kDistinct].get());
+                offs.push_back((i % 11 == 10) ? kLargeOffset
+                                              : offsets[i % 5] + 3 * (i / 5));
+                out_ptrs.push_back(bufs[i].data());
+            }
+
+            sse::crypto::Prg::derive_batch(
+                n, k_ptrs.data(), offs.data(), len, out_ptrs.data());
+
+            for (size_t i = 0; i < n; i++) {
+                std::array<uint8_t, kPrgKeySize> cp = seeds[i % kDistinct];
+                sse::crypto::Prg prg(sse::crypto::Key<kPrgKeySize>(cp.data()));
+
+                std::vector<uint8_t> expected(len);
+                prg.derive(offs[i], len, expected.data());
+                ASSERT_EQ(bufs[i], expected);
+            }
+        }
+    }
+
+    // exceptions
+    unsigned char       out[16];
+    unsigned char*      out_ptr  = out;
+    unsigned char*      null_out = nullptr;
+    const EphemeralKey* key_ptr  = keys[0].get();
+    const EphemeralKey* null_key = nullptr;
+    size_t              offset   = 0;
+
+    ASSERT_THROW(
+        sse::crypto::Prg::derive_batch(1, nullptr, &offset, 16, &out_ptr),
+        std::invalid_argument);
+    ASSERT_THROW(
+        sse::crypto::Prg::derive_batch(1, &key_ptr, nullptr, 16, &out_ptr),
+        std::invalid_argument);
+    ASSERT_THROW(
+        sse::crypto::Prg::derive_batch(1, &key_ptr, &offset, 16, nullptr),
+        std::invalid_argument);
+    ASSERT_THROW(
+        sse::crypto::Prg::derive_batch(1, &null_key, &offset, 16, &out_ptr),
+        std::invalid_argument);
+    ASSERT_THROW(
+        sse::crypto::Prg::derive_batch(1, &key_ptr, &offset, 16, &null_out),
+        std::invalid_argument);
+}
+
 TEST(prg, wrapping)
 {
     constexpr size_t kLenTest = 1000;
@@ -25,11 +25,17 @@
 #include <sse/crypto/random.hpp>
 #include <sse/crypto/wrapper.hpp>
 
+#include <algorithm>
+#include <array>
 #include <iomanip>
 #include <iostream>
+#include <numeric>
+#include <sstream>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
+#include <sodium/crypto_generichash_blake2b.h>
 
 using namespace std;
 
@@ -128,6 +134,207 @@ TEST(prp, consistency_64)
     }
 }
 
+TEST(prp, batch)
+{
+    sse::crypto::Prp fpe;
+
+    // batch sizes around the number of values processed together
+    for (size_t count : {1, 7, 8, 9, 100}) {
+        vector<uint32_t> in_32(count), out_32(count), dec_32(count);
+        vector<uint64_t> in_64(count), out_64(count), dec_64(count);
+        sse::crypto::random_bytes(count * sizeof(uint32_t),
+                                  reinterpret_cast<uint8_t*>(in_32.data()));
+        sse::crypto::random_bytes(count * sizeof(uint64_t),
+                                  reinterpret_cast<uint8_t*>(in_64.data()));
+
+        fpe.encrypt_batch(in_32.data(), count, out_32.data());
+        fpe.encrypt_64_batch(in_64.data(), count, out_64.data());
+
+        for (size_t i = 0; i < count; i++) {
+            ASSERT_EQ(out_32[i], fpe.encrypt(in_32[i]));
+            ASSERT_EQ(out_64[i], fpe.encrypt_64(in_64[i]));
+        }
+
+        fpe.decrypt_batch(out_32.data(), count, dec_32.data());
+        fpe.decrypt_64_batch(out_64.data(), count, dec_64.data());
+        ASSERT_EQ(in_32, dec_32);
+        ASSERT_EQ(in_64, dec_64);
+
+        // in place
+        fpe.encrypt_64_batch(in_64.data(), count, in_64.data());
+        ASSERT_EQ(in_64, out_64);
+        fpe.decrypt_batch(out_32.data(), count, out_32.data());
+        ASSERT_EQ(in_32, out_32);
+    }
+
+    fpe.encrypt_64_batch(nullptr, 0, nullptr);
+
+    uint64_t v = 0;
+    ASSERT_THROW(fpe.encrypt_64_batch(nullptr, 1, &v), std::invalid_argument);
+    ASSERT_THROW(fpe.decrypt_64_batch(&v, 1, nullptr), std::invalid_argument);
+}
+
+TEST(prp, vectors)
+{
+    // BLAKE2b-256 digests of the encryption of a fixed message under a fixed
+    // key, recorded with the AES-NI implementation. They check that every
+    // implementation of the AEZ core (in particular the VAES one, used for
+    // long inputs) computes the same permutation.
+    const std::vector<std::pair<size_t, std::string>> test_vectors = {
+        {32,
+         "c75e24989a5d60f6236f635ff383a09a151188b8ac6380da67c656e6395e33e2"},
+        {100,
+         "01a474343c2613f5ce6dd6cde615aa88ffc6d95a8e6eed9a48e72b5f9bee2ae0"},
+        {255,
+         "78ce59c151450492b7504c4f9023d8d247862ec2f9149e1e5bbf49bb577a7014"},
+        {256,
+         "2ca56bb1f3e53fb3b6fa32f208f207e9d8c63a775f633f46065e885da641e7b5"},
+        {257,
+         "5fd224101f47f86bd24af3af6f8fb79de7ef8722468f1df39b8f42a534c243e9"},
+        {511,
+         "88a589fccb09bbc64cd0f2432c9806431d26b3770ace43c86b130a0f975b86e1"},
+        {1024,
+         "7545e37b52e5336accaebec77b9bc31b073a31f9e11d77ed24ffe6f81ca06466"},
+        {1100,
+         "8af5c9ca9536c80b8eb547ab62ffaf889cde2b74d3d9f4114306f3ef91bd8e63"},
+        {2048,
+         "efb2466543c10cabae3a24c7d2a6e4589f497dd3cdb8d5d9fc1f5e92f851434a"},
+        {4113,
+         "91761a31bb8c18d0f19dfed184b1347be773881d18ac18000c1d1c8168c17b4a"},
+        {65584,
+         "a90f2908b66413daa6cd6973e95b61096cacd39da92aa75be556a973cbe75fe1"},
+    };
+
+    std::array<uint8_t, sse::crypto::Prp::kKeySize> key;
+    for (size_t i = 0; i < key.size(); i++) {
+        key[i] = static_cast<uint8_t>(i);
+    }
+    sse::crypto::Prp prp(sse::crypto::Key<sse::crypto::Prp::kKeySize>(
+        key.data()));
+
+    for (const auto& v : test_vectors) {
+        const size_t    len = v.first;
+        vector<uint8_t> in(len), out(len), dec(len);
+        for (size_t i = 0; i < len; i++) {
+            in[i] = static_cast<uint8_t>(i * 7 + 3);
+        }
+
+        prp.encrypt(in.data(), static_cast<unsigned int>(len), out.data());
+
+        uint8_t digest[32];
+        crypto_generichash_blake2b(
+            digest, sizeof(digest), out.data(), len, nullptr, 0);
+        std::ostringstream hex;
+        for (uint8_t b : digest) {
+            hex << std::hex << std::setw(2) << std::setfill('0')
+                << static_cast<unsigned int>(b);
+        }
+        EXPECT_EQ(v.second, hex.str()) << "length " << len;
+
+        prp.decrypt(out.data(), static_cast<unsigned int>(len), dec.data());
+        EXPECT_EQ(in, dec) << "length " << len;
+    }
+}
+
+TEST(range_prp, permutation)
+{
+    for (uint64_t n : {1, 2, 3, 4, 5, 17, 100, 1000, 65536, 65537}) {
+        sse::crypto::RangePrp prp(n);
+        ASSERT_EQ(n, prp.domain_size());
+
+        vector<uint64_t> image(n);
+        prp.permute_domain(image.data());
+
+        for (uint64_t i = 0; i < n; i++) {
+            ASSERT_EQ(image[i], prp.encrypt(i));
+            ASSERT_EQ(i, prp.decrypt(image[i]));
+        }
+
+        vector<uint64_t> sorted(image);
+        vector<uint64_t> expected(n);
+        std::sort(sorted.begin(), sorted.end());
+        std::iota(expected.begin(), expected.end(), 0);
+        ASSERT_EQ(expected, sorted);
+    }
+}
+
+TEST(range_prp, batch)
+{
+    for (uint64_t n : {uint64_t(1000),
+                       (uint64_t(1) << 40) + 3,
+                       ~uint64_t(0)}) {
+        sse::crypto::RangePrp prp(n);
+        const size_t          count = 3000;
+
+        vector<uint64_t> in(count), out(count), dec(count);
+        sse::crypto::random_bytes(count * sizeof(uint64_t),
+                                  reinterpret_cast<uint8_t*>(in.data()));
+        for (auto& v : in) {
+            v %= n;
+        }
+
+        prp.encrypt_batch(in.data(), count, out.data());
+        for (size_t i = 0; i < count; i++) {
+            ASSERT_LT(out[i], n);
+            ASSERT_EQ(out[i], prp.encrypt(in[i]));
+        }
+        prp.decrypt_batch(out.data(), count, dec.data());
+        ASSERT_EQ(in, dec);
+
+        // in place
+        prp.encrypt_batch(in.data(), count, in.data());
+        ASSERT_EQ(out, in);
+    }
+
+    // parallel evaluation of the whole domain
+    sse::crypto::RangePrp prp(100000);
+    vector<uint64_t>      serial(prp.domain_size());
+    vector<uint64_t>      parallel(prp.domain_size());
+    prp.permute_domain(serial.data());
+    prp.permute_domain(parallel.data(), sse::crypto::thread_executor(4));
+    ASSERT_EQ(serial, parallel);
+}
+
+TEST(range_prp, keys)
+{
+    std::array<uint8_t, sse::crypto::RangePrp::kKeySize> key;
+    sse::crypto::random_bytes(key);
+
+    using RangeKey = sse::crypto::Key<sse::crypto::RangePrp::kKeySize>;
+    auto key_copy  = key;
+    sse::crypto::RangePrp prp_1(1000, RangeKey(key_copy.data()));
+    key_copy = key;
+    sse::crypto::RangePrp prp_2(1000, RangeKey(key_copy.data()));
+    key_copy = key;
+    sse::crypto::RangePrp prp_3(1001, RangeKey(key_copy.data()));
+
+    vector<uint64_t> image_1(1000), image_2(1000), image_3(1001);
+    prp_1.permute_domain(image_1.data());
+    prp_2.permute_domain(image_2.data());
+    prp_3.permute_domain(image_3.data());
+    image_3.pop_back();
+
+    ASSERT_EQ(image_1, image_2);
+    // the domain size tweaks the permutation
+    ASSERT_NE(image_1, image_3);
+}
+
+TEST(range_prp, exceptions)
+{
+    ASSERT_THROW(sse::crypto::RangePrp(0), std::invalid_argument);
+
+    sse::crypto::RangePrp prp(10);
+    uint64_t              v[2] = {3, 10};
+    uint64_t              out[2];
+
+    ASSERT_THROW(prp.encrypt(10), std::invalid_argument);
+    ASSERT_THROW(prp.decrypt(11), std::invalid_argument);
+    ASSERT_THROW(prp.encrypt_batch(v, 2, out), std::invalid_argument);
+    ASSERT_THROW(prp.decrypt_batch(nullptr, 1, out), std::invalid_argument);
+    ASSERT_THROW(prp.permute_domain(nullptr), std::invalid_argument);
+    prp.encrypt_batch(nullptr, 0, nullptr);
+}
+
 TEST(prp, wrapping)
 {
     // Create new wrapper
@@ -22,10 +22,19 @@
 #include <sse/crypto/rcprf.hpp>
 #include <sse/crypto/wrapper.hpp>
 
+#include <cstring>
+
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -141,6 +150,220 @@ TEST(rc_prf, double_constrain)
     }
 }
 
+// Constrained keys built from a vector of elements and from the flat
+// representation must agree
+TEST(rc_prf, constrain_elements)
+{
+    constexpr uint8_t                  test_depth = 16;
+    std::array<uint8_t, kRCPrfKeySize> k{
+        {0x00}}; // fixed key for easy debugging and bug reproducing
+    sse::crypto::RCPrf<16> rc_prf(sse::crypto::Key<kRCPrfKeySize>(k.data()),
+                                  test_depth);
+
+    const std::vector<std::pair<uint64_t, uint64_t>> ranges
+        = {{0, 0}, {1, 2}, {3, 1000}, {1234, 30000}, {0, 32766}};
+
+    for (const auto& range : ranges) {
+        const uint64_t min = range.first;
+        const uint64_t max = range.second;
+
+        std::vector<std::unique_ptr<sse::crypto::ConstrainedRCPrfElement<16>>>
+            elements;
+        rc_prf.generate_constrained_subkeys(min, max, elements);
+
+        sse::crypto::ConstrainedRCPrf<16> from_elements(std::move(elements));
+        auto                              constrained_prf
+            = rc_prf.constrain(min, max);
+
+        ASSERT_EQ(from_elements.min_leaf(), min);
+        ASSERT_EQ(from_elements.max_leaf(), max);
+        ASSERT_EQ(constrained_prf.min_leaf(), min);
+        ASSERT_EQ(constrained_prf.max_leaf(), max);
+
+        for (uint64_t leaf : {min, (min + max) / 2, max}) {
+            ASSERT_EQ(from_elements.eval(leaf), rc_prf.eval(leaf));
+            ASSERT_EQ(constrained_prf.eval(leaf), rc_prf.eval(leaf));
+        }
+        from_elements.eval_range(
+            min,
+            max,
+            [&constrained_prf](uint64_t leaf,
+                               const std::array<uint8_t, 16>& value) {
+                ASSERT_EQ(constrained_prf.eval(leaf), value);
+            });
+
+        // reconstrain to the middle of the range
+        const uint64_t sub_min = min + (max - min) / 3;
+        const uint64_t sub_max = max - (max - min) / 3;
+
+        std::vector<std::unique_ptr<sse::crypto::ConstrainedRCPrfElement<16>>>
+            sub_elements;
+        constrained_prf.generate_constrained_subkeys(
+            sub_min, sub_max, sub_elements);
+
+        sse::crypto::ConstrainedRCPrf<16> sub_from_elements(
+            std::move(sub_elements));
+        auto reconstrained_prf = constrained_prf.constrain(sub_min, sub_max);
+
+        reconstrained_prf.eval_range(
+            sub_min,
+            sub_max,
+            [&sub_from_elements, &rc_prf](
+                uint64_t leaf, const std::array<uint8_t, 16>& value) {
+                ASSERT_EQ(sub_from_elements.eval(leaf), value);
+                ASSERT_EQ(rc_prf.eval(leaf), value);
+            });
+    }
+}
+
+TEST(rc_prf, constrained_view)
+{
+    constexpr uint8_t                  test_depth = 16;
+    std::array<uint8_t, kRCPrfKeySize> k{
+        {0x00}}; // fixed key for easy debugging and bug reproducing
+    sse::crypto::RCPrf<16> rc_prf(sse::crypto::Key<kRCPrfKeySize>(k.data()),
+                                  test_depth);
+
+    const std::vector<std::pair<uint64_t, uint64_t>> ranges
+        = {{0, 0}, {1, 2}, {3, 1000}, {1234, 30000}, {0, 32766}};
+
+    for (const auto& range : ranges) {
+        const uint64_t min = range.first;
+        const uint64_t max = range.second;
+
+        auto constrained_prf = rc_prf.constrain(min, max);
+
+        // the buffer can be larger than the serialized key
+        std::vector<uint8_t> buffer(constrained_prf.serialized_size() + 7,
+                                    0xFF);
+        constrained_prf.serialize(buffer.data());
+        const std::vector<uint8_t> buffer_copy = buffer;
+
+        sse::crypto::ConstrainedRCPrfView<16> view(buffer.data(),
+                                                   buffer.size());
+
+        ASSERT_EQ(view.serialized_size(), constrained_prf.serialized_size());
+        ASSERT_FALSE(view.is_empty());
+        ASSERT_EQ(view.min_leaf(), min);
+        ASSERT_EQ(view.max_leaf(), max);
+        ASSERT_EQ(view.tree_height(), test_depth);
+
+        for (uint64_t leaf : {min, (min + max) / 2, max}) {
+            ASSERT_EQ(view.eval(leaf), rc_prf.eval(leaf));
+        }
+        EXPECT_THROW(view.eval(max + 1), std::out_of_range);
+
+        uint64_t count = 0;
+        view.eval_range(
+            min,
+            max,
+            [&constrained_prf, &count](uint64_t                       leaf,
+                                       const std::array<uint8_t, 16>& value) {
+                ASSERT_EQ(constrained_prf.eval(leaf), value);
+                count++;
+            });
+        ASSERT_EQ(count, max - min + 1);
+
+        std::atomic<uint64_t> parallel_count(0);
+        view.eval_range(
+            min,
+            max,
+            [&constrained_prf, &parallel_count](
+                uint64_t leaf, const std::array<uint8_t, 16>& value) {
+                EXPECT_EQ(constrained_prf.eval(leaf), value);
+                parallel_count++;
+            },
+            sse::crypto::thread_executor(4));
+        ASSERT_EQ(parallel_count.load(), max - min + 1);
+
+        // reconstrain to the middle of the range
+        const uint64_t sub_min = min + (max - min) / 3;
+        const uint64_t sub_max = max - (max - min) / 3;
+
+        std::vector<std::unique_ptr<sse::crypto::ConstrainedRCPrfElement<16>>>
+            sub_elements;
+        view.generate_constrained_subkeys(sub_min, sub_max, sub_elements);
+
+        sse::crypto::ConstrainedRCPrf<16> sub_from_elements(
+            std::move(sub_elements));
+        ASSERT_EQ(sub_from_elements.min_leaf(), sub_min);
+        ASSERT_EQ(sub_from_elements.max_leaf(), sub_max);
+
+        sub_from_elements.eval_range(
+            sub_min,
+            sub_max,
+            [&rc_prf](uint64_t leaf, const std::array<uint8_t, 16>& value) {
+                ASSERT_EQ(rc_prf.eval(leaf), value);
+            });
+
+        // the view never writes in the buffer
+        ASSERT_EQ(buffer, buffer_copy);
+    }
+}
+
+// Exceptions raised by the ConstrainedRCPrfView constructor
+TEST(rc_prf, constrained_view_exceptions)
+{
+    constexpr uint8_t      test_depth = 16;
+    sse::crypto::RCPrf<16> rc_prf(sse::crypto::Key<kRCPrfKeySize>(),
+                                  test_depth);
+
+    // two leaves: the records have the same size
+    auto                 constrained_prf = rc_prf.constrain(1, 2);
+    std::vector<uint8_t> buffer(constrained_prf.serialized_size());
+    constrained_prf.serialize(buffer.data());
+
+    const size_t header_size = 1 + 4;
+    const size_t record_size = 1 + 8 + 8 + 16;
+    ASSERT_EQ(buffer.size(), header_size + 2 * record_size);
+
+    EXPECT_THROW(sse::crypto::ConstrainedRCPrfView<16>(nullptr, 10),
+                 std::invalid_argument);
+    EXPECT_THROW(
+        sse::crypto::ConstrainedRCPrfView<16>(buffer.data(), header_size - 1),
+        std::invalid_argument);
+
+    // truncated buffers
+    EXPECT_THROW(
+        sse::crypto::ConstrainedRCPrfView<16>(buffer.data(), header_size + 3),
+        std::invalid_argument);
+    EXPECT_THROW(sse::crypto::ConstrainedRCPrfView<16>(buffer.data(),
+                                                       buffer.size() - 1),
+                 std::invalid_argument);
+
+    // invalid tree height
+    std::vector<uint8_t> corrupted = buffer;
+    corrupted[0]                   = 65;
+    EXPECT_THROW(sse::crypto::ConstrainedRCPrfView<16>(corrupted.data(),
+                                                       corrupted.size()),
+                 std::invalid_argument);
+
+    // invalid subtree height
+    corrupted              = buffer;
+    corrupted[header_size] = test_depth + 1;
+    EXPECT_THROW(sse::crypto::ConstrainedRCPrfView<16>(corrupted.data(),
+                                                       corrupted.size()),
+                 std::invalid_argument);
+
+    // unsorted elements
+    corrupted = buffer;
+    std::swap_ranges(corrupted.begin() + header_size,
+                     corrupted.begin() + header_size + record_size,
+                     corrupted.begin() + header_size + record_size);
+    EXPECT_THROW(sse::crypto::ConstrainedRCPrfView<16>(corrupted.data(),
+                                                       corrupted.size()),
+                 std::invalid_argument);
+
+    // the empty constrain
+    std::array<uint8_t, header_size> empty{{test_depth, 0, 0, 0, 0}};
+    sse::crypto::ConstrainedRCPrfView<16> empty_view(empty.data(),
+                                                     empty.size());
+    EXPECT_TRUE(empty_view.is_empty());
+    EXPECT_EQ(empty_view.min_leaf(), UINT64_MAX);
+    EXPECT_EQ(empty_view.max_leaf(), 0);
+    EXPECT_THROW(empty_view.eval(0), std::out_of_range);
+}
+
 TEST(rc_prf, range_eval)
 {
     constexpr uint8_t                  test_depth = 6;
@@ -172,6 +395,491 @@ TEST(rc_prf, range_eval)
     }
 }
 
+TEST(rc_prf, range_eval_into)
+{
+    std::array<uint8_t, kRCPrfKeySize> k{
+        {0x00}}; // fixed key for easy debugging and bug reproducing
+
+    // exhaustive test on small trees
+    for (uint8_t test_depth = 2; test_depth <= 6; test_depth++) {
+        std::array<uint8_t, kRCPrfKeySize> k_cp = k;
+        sse::crypto::RCPrf<16>             rc_prf(
+            sse::crypto::Key<kRCPrfKeySize>(k_cp.data()), test_depth);
+
+        const uint64_t max_leaf
+            = sse::crypto::RCPrfParams::max_leaf_index(test_depth);
+
+        std::vector<std::array<uint8_t, 16>> reference(max_leaf + 1);
+        for (uint64_t i = 0; i <= max_leaf; i++) {
+            reference[i] = rc_prf.eval(i);
+        }
+
+        for (uint64_t min = 0; min <= max_leaf; min++) {
+            for (uint64_t max = min; max <= max_leaf; max++) {
+                std::vector<std::array<uint8_t, 16>> out(max - min + 1);
+                rc_prf.eval_range_into(min, max, out[0].data());
+
+                for (uint64_t leaf = min; leaf <= max; leaf++) {
+                    ASSERT_EQ(out[leaf - min], reference[leaf]);
+                }
+            }
+        }
+    }
+
+    // larger trees, spanning several tiles
+    constexpr uint8_t test_depth = 15;
+    const uint64_t    max_leaf
+        = sse::crypto::RCPrfParams::max_leaf_index(test_depth);
+
+    sse::crypto::RCPrf<32> rc_prf(sse::crypto::Key<kRCPrfKeySize>(k.data()),
+                                  test_depth);
+
+    const std::array<std::pair<uint64_t, uint64_t>, 5> ranges{
+        {{0, max_leaf},
+         {1, max_leaf - 1},
+         {1023, 1024},
+         {1000, 5000},
+         {max_leaf - 3000, max_leaf}}};
+
+    for (const auto& range : ranges) {
+        const uint64_t min = range.first;
+        const uint64_t max = range.second;
+
+        std::vector<std::array<uint8_t, 32>> out(max - min + 1);
+        rc_prf.eval_range_into(min, max, out[0].data());
+
+        // compare with the callback API, and check some points with the
+        // single point evaluation
+        rc_prf.eval_range(
+            min,
+            max,
+            [&out, min](uint64_t leaf, const std::array<uint8_t, 32>& value) {
+                ASSERT_EQ(out[leaf - min], value);
+            });
+        for (uint64_t leaf = min; leaf <= max; leaf += 97) {
+            ASSERT_EQ(out[leaf - min], rc_prf.eval(leaf));
+        }
+        ASSERT_EQ(out[max - min], rc_prf.eval(max));
+    }
+
+    // exceptions
+    std::array<uint8_t, 32> buf;
+    EXPECT_THROW(rc_prf.eval_range_into(0, max_leaf + 1, buf.data()),
+                 std::out_of_range);
+    EXPECT_THROW(rc_prf.eval_range_into(2, 1, buf.data()),
+                 std::invalid_argument);
+    EXPECT_THROW(rc_prf.eval_range_into(0, 0, nullptr), std::invalid_argument);
+}
+
+namespace {
+// a stateful callable object, with a non-const call operator
+struct LeafCounter
+{
+    uint64_t count{0};
+    uint64_t sum{0};
+
+    void operator()(uint64_t leaf, const std::array<uint8_t, 16>&)
+    {
+        count++;
+        sum += leaf;
+    }
+};
+} // namespace
+
+TEST(rc_prf, range_eval_callables)
+{
+    constexpr uint8_t test_depth = 13;
+    const uint64_t    max_leaf
+        = sse::crypto::RCPrfParams::max_leaf_index(test_depth);
+
+    sse::crypto::RCPrf<16> rc_prf(sse::crypto::Key<kRCPrfKeySize>(),
+                                  test_depth);
+
+    std::vector<std::array<uint8_t, 16>> reference(max_leaf + 1);
+    rc_prf.eval_range_into(0, max_leaf, reference[0].data());
+
+    const uint64_t min             = 17;
+    const uint64_t max             = max_leaf - 300;
+    auto           constrained_prf = rc_prf.constrain(min, max);
+    const uint64_t expected_sum    = (max * (max + 1) - (min - 1) * min) / 2;
+
+    // lambda
+    std::vector<std::array<uint8_t, 16>> out(max - min + 1);
+    auto check = [&out, min](uint64_t leaf, const std::array<uint8_t, 16>& v) {
+        out[leaf - min] = v;
+    };
+
+    rc_prf.eval_range(min, max, check);
+    ASSERT_TRUE(std::equal(out.begin(), out.end(), reference.begin() + min));
+
+    std::fill(out.begin(), out.end(), std::array<uint8_t, 16>());
+    constrained_prf.eval_range(min, max, check);
+    ASSERT_TRUE(std::equal(out.begin(), out.end(), reference.begin() + min));
+
+    // stateful callable objects are passed by reference
+    LeafCounter counter;
+    rc_prf.eval_range(min, max, counter);
+    EXPECT_EQ(counter.count, max - min + 1);
+    EXPECT_EQ(counter.sum, expected_sum);
+
+    LeafCounter constrained_counter;
+    constrained_prf.eval_range(min, max, constrained_counter);
+    EXPECT_EQ(constrained_counter.count, max - min + 1);
+    EXPECT_EQ(constrained_counter.sum, expected_sum);
+
+    // temporaries
+    uint64_t count = 0;
+    rc_prf.eval_range(
+        min, max, [&count](uint64_t, const std::array<uint8_t, 16>&) {
+            count++;
+        });
+    EXPECT_EQ(count, max - min + 1);
+
+    // non-const std::function objects
+    count = 0;
+    sse::crypto::RCPrf<16>::callback_type std_callback
+        = [&count](uint64_t, const std::array<uint8_t, 16>&) { count++; };
+    rc_prf.eval_range(min, max, std_callback);
+    constrained_prf.eval_range(min, max, std_callback);
+    EXPECT_EQ(count, 2 * (max - min + 1));
+}
+
+TEST(rc_prf, parallel_range_eval)
+{
+    constexpr uint8_t test_depth = 17;
+    const uint64_t    max_leaf
+        = sse::crypto::RCPrfParams::max_leaf_index(test_depth);
+
+    sse::crypto::RCPrf<16> rc_prf(sse::crypto::Key<kRCPrfKeySize>(),
+                                  test_depth);
+
+    std::vector<std::array<uint8_t, 16>> reference(max_leaf + 1);
+    rc_prf.eval_range_into(0, max_leaf, reference[0].data());
+
+    // an executor running the tasks sequentially, in reverse order
+    sse::crypto::Executor reverse_executor
+        = [](size_t n_tasks, const std::function<void(size_t)>& task) {
+              for (size_t i = n_tasks; i > 0; i--) {
+                  task(i - 1);
+              }
+          };
+
+    const std::array<sse::crypto::Executor, 3> executors{
+        {sse::crypto::thread_executor(4),
+         sse::crypto::thread_executor(),
+         reverse_executor}};
+
+    const std::array<std::pair<uint64_t, uint64_t>, 4> ranges{
+        {{0, max_leaf}, {3, 3}, {1000, 1100}, {1023, max_leaf - 5000}}};
+
+    for (const auto& executor : executors) {
+        for (const auto& range : ranges) {
+            const uint64_t min = range.first;
+            const uint64_t max = range.second;
+
+            // every leaf is written by a single thread
+            std::vector<std::array<uint8_t, 16>> out(max - min + 1);
+            std::atomic<uint64_t>                count(0);
+
+            auto callback = [&out, &count, min](
+                                uint64_t                       leaf,
+                                const std::array<uint8_t, 16>& value) {
+                out[leaf - min] = value;
+                count++;
+            };
+
+            rc_prf.eval_range(min, max, callback, executor);
+            ASSERT_EQ(count.load(), max - min + 1);
+            ASSERT_TRUE(std::equal(
+                out.begin(), out.end(), reference.begin() + min));
+
+            // constrained evaluation
+            if (min == 0 && max == max_leaf) {
+                continue;
+            }
+            auto constrained_prf = rc_prf.constrain(min, max);
+
+            count = 0;
+            constrained_prf.eval_range(min, max, callback, executor);
+            ASSERT_EQ(count.load(), max - min + 1);
+            ASSERT_TRUE(std::equal(
+                out.begin(), out.end(), reference.begin() + min));
+        }
+    }
+
+    // exceptions thrown by the callback are forwarded
+    auto throwing_callback
+        = [](uint64_t leaf, const std::array<uint8_t, 16>&) {
+              if (leaf == 5000) {
+                  throw std::runtime_error("leaf 5000");
+              }
+          };
+    EXPECT_THROW(rc_prf.eval_range(0,
+                                   max_leaf,
+                                   throwing_callback,
+                                   sse::crypto::thread_executor(4)),
+                 std::runtime_error);
+
+    EXPECT_THROW(rc_prf.eval_range(0,
+                                   max_leaf + 1,
+                                   throwing_callback,
+                                   sse::crypto::thread_executor(4)),
+                 std::out_of_range);
+}
+
+// Range evaluations on large trees: the tree is expanded by bounded windows,
+// subtree by subtree
+TEST(rc_prf, wide_range_eval)
+{
+    constexpr uint8_t test_depth = 24;
+
+    sse::crypto::RCPrf<16> rc_prf(sse::crypto::Key<kRCPrfKeySize>(),
+                                  test_depth);
+
+    // ranges crossing the boundaries of the tiles and of the windows
+    const std::array<std::pair<uint64_t, uint64_t>, 3> ranges{
+        {{1000, 3000},
+         {(1UL << 20) - 1500, (1UL << 20) + 1500},
+         {(1UL << 22) - 10, (1UL << 22) + 5}}};
+
+    for (const auto& range : ranges) {
+        const uint64_t min = range.first;
+        const uint64_t max = range.second;
+
+        std::vector<std::array<uint8_t, 16>> out(max - min + 1);
+        rc_prf.eval_range_into(min, max, out[0].data());
+
+        uint64_t next = min;
+        rc_prf.eval_range(
+            min, max, [&](uint64_t leaf, const std::array<uint8_t, 16>& value) {
+                EXPECT_EQ(leaf, next);
+                EXPECT_EQ(value, out[leaf - min]);
+                next++;
+            });
+        ASSERT_EQ(next, max + 1);
+
+        for (uint64_t leaf = min; leaf <= max; leaf += 97) {
+            ASSERT_EQ(rc_prf.eval(leaf), out[leaf - min]);
+        }
+    }
+
+    // the first leaves of a huge range are emitted without expanding all the
+    // roots of its tiles first
+    // (2^49 tiles)
+    constexpr uint8_t      big_depth = 60;
+    sse::crypto::RCPrf<16> big_rc_prf(sse::crypto::Key<kRCPrfKeySize>(),
+                                      big_depth);
+    const uint64_t         max_leaf
+        = sse::crypto::RCPrfParams::max_leaf_index(big_depth);
+
+    std::atomic<uint64_t> count(0);
+    auto                  stop_callback
+        = [&](uint64_t leaf, const std::array<uint8_t, 16>& value) {
+              EXPECT_EQ(value, big_rc_prf.eval(leaf));
+              if (++count >= 3000) {
+                  throw std::runtime_error("enough leaves");
+              }
+          };
+
+    EXPECT_THROW(big_rc_prf.eval_range(0, max_leaf, stop_callback),
+                 std::runtime_error);
+    EXPECT_EQ(count.load(), 3000);
+
+    // every task stops as soon as it emits a leaf after the 3000th
+
+    count = 0;
+    EXPECT_THROW(big_rc_prf.eval_range(0,
+                                       max_leaf,
+                                       stop_callback,
+                                       sse::crypto::thread_executor(2)),
+                 std::runtime_error);
+}
+
+// The seeds of a constrained RC-PRF are locked between two evaluations: a
+// shared object can still be evaluated from several threads
+TEST(rc_prf, shared_constrained)
+{
+    constexpr uint8_t  test_depth = 12;
+    constexpr uint64_t kMin       = 5;
+    constexpr uint64_t kMax       = 1500;
+
+    sse::crypto::RCPrf<16> rc_prf(sse::crypto::Key<kRCPrfKeySize>(),
+                                  test_depth);
+
+    std::vector<std::array<uint8_t, 16>> reference(kMax + 1);
+    rc_prf.eval_range_into(0, kMax, reference[0].data());
+
+    const auto constrained_prf = rc_prf.constrain(kMin, kMax);
+
+    std::vector<uint8_t> serialized(constrained_prf.serialized_size());
+    constrained_prf.serialize(serialized.data());
+
+    std::atomic<bool>        mismatch(false);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            for (uint64_t leaf = kMin + t; leaf <= kMax; leaf += 37) {
+                if (constrained_prf.eval(leaf) != reference[leaf]) {
+                    mismatch = true;
+                }
+            }
+
+            constrained_prf.eval_range(
+                kMin + t,
+                kMax - t,
+                [&](uint64_t leaf, const std::array<uint8_t, 16>& value) {
+                    if (value != reference[leaf]) {
+                        mismatch = true;
+                    }
+                });
+
+            const auto sub_prf = constrained_prf.constrain(100 + t, 1000);
+            if (sub_prf.eval(500) != reference[500]) {
+                mismatch = true;
+            }
+
+            std::vector<uint8_t> buffer(constrained_prf.serialized_size());
+            constrained_prf.serialize(buffer.data());
+            if (buffer != serialized) {
+                mismatch = true;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_FALSE(mismatch.load());
+
+    // an unwrapped (deserialized) object is locked as well
+    sse::crypto::Wrapper wrapper(
+        (sse::crypto::Key<sse::crypto::Wrapper::kKeySize>()));
+    auto       rep = wrapper.wrap(constrained_prf);
+    const auto deserialized_prf
+        = wrapper.unwrap<sse::crypto::ConstrainedRCPrf<16>>(rep);
+
+    std::atomic<uint64_t> count(0);
+    deserialized_prf.eval_range(
+        kMin,
+        kMax,
+        [&](uint64_t leaf, const std::array<uint8_t, 16>& value) {
+            if (value != reference[leaf]) {
+                mismatch = true;
+            }
+            count++;
+        },
+        sse::crypto::thread_executor(4));
+    ASSERT_EQ(count.load(), kMax - kMin + 1);
+    ASSERT_FALSE(mismatch.load());
+}
+
+namespace sse {
+namespace crypto {
+
+// The elements of a serialized constrained key come from an untrusted input:
+// a large token whose elements are in reverse order must be sorted quickly
+void test_constrained_rcprf_deserialization()
+{
+    constexpr uint8_t  test_depth = 17;
+    constexpr uint32_t kElements  = 50000;
+    // subtree height, min and max leaf
+    constexpr size_t kInfoSize
+        = sizeof(RCPrfParams::depth_type) + 2 * sizeof(uint64_t);
+
+    RCPrf<16> rc_prf(Key<kRCPrfKeySize>(), test_depth);
+
+    std::vector<std::array<uint8_t, 16>> reference(kElements);
+    rc_prf.eval_range_into(0, kElements - 1, reference[0].data());
+
+    // a token made of kElements leaves, by decreasing index
+    std::vector<uint8_t> token(1 + sizeof(uint32_t)
+                               + kElements * (kInfoSize + 16));
+    uint8_t* out = token.data();
+    *out++       = test_depth;
+    memcpy(out, &kElements, sizeof(kElements));
+    out += sizeof(kElements);
+    for (uint64_t leaf = kElements; leaf > 0; leaf--) {
+        const uint64_t index = leaf - 1;
+
+        out[0] = 1; // subtree height
+        memcpy(out + 1, &index, sizeof(index));
+        memcpy(out + 1 + sizeof(index), &index, sizeof(index));
+        memcpy(out + kInfoSize, reference[index].data(), 16);
+        out += kInfoSize + 16;
+    }
+
+    size_t     n_bytes_read;
+    const auto cprf = ConstrainedRCPrf<16>::deserialize(
+        token.data(), token.size(), n_bytes_read);
+    ASSERT_EQ(n_bytes_read, token.size());
+    ASSERT_EQ(cprf.min_leaf(), 0);
+    ASSERT_EQ(cprf.max_leaf(), kElements - 1);
+
+    uint64_t count = 0;
+    cprf.eval_range(0,
+                    kElements - 1,
+                    [&](uint64_t leaf, const std::array<uint8_t, 16>& value) {
+                        EXPECT_EQ(leaf, count);
+                        EXPECT_EQ(value, reference[leaf]);
+                        count++;
+                    });
+    ASSERT_EQ(count, kElements);
+}
+
+} // namespace crypto
+} // namespace sse
+
+TEST(rc_prf, deserialize_reversed)
+{
+    sse::crypto::test_constrained_rcprf_deserialization();
+}
+
+TEST(rc_prf, cursor)
+{
+    for (uint8_t test_depth : {2, 3, 8, 20, 48}) {
+        const uint64_t max_leaf
+            = sse::crypto::RCPrfParams::max_leaf_index(test_depth);
+
+        sse::crypto::RCPrf<16> rc_prf(sse::crypto::Key<kRCPrfKeySize>(),
+                                      test_depth);
+        sse::crypto::RCPrfCursor<16> cursor(rc_prf);
+
+        EXPECT_EQ(cursor.cached_depth(), 0);
+
+        // sequential evaluations
+        const uint64_t start = (max_leaf > 3000) ? max_leaf / 3 : 0;
+        const uint64_t end   = std::min(max_leaf, start + 3000);
+        for (uint64_t leaf = start; leaf <= end; leaf++) {
+            ASSERT_EQ(cursor.eval(leaf), rc_prf.eval(leaf));
+        }
+        if (test_depth > 2) {
+            EXPECT_EQ(cursor.cached_depth(), test_depth - 2);
+        }
+
+        // random evaluations
+        for (size_t i = 0; i < 200; i++) {
+            uint64_t leaf;
+            sse::crypto::random_bytes(sizeof(leaf),
+                                      reinterpret_cast<uint8_t*>(&leaf));
+            leaf &= max_leaf;
+            ASSERT_EQ(cursor.eval(leaf), rc_prf.eval(leaf));
+            ASSERT_EQ(cursor.eval(leaf), rc_prf.eval(leaf));
+            ASSERT_EQ(cursor.eval(leaf ^ 1), rc_prf.eval(leaf ^ 1));
+        }
+
+        cursor.reset();
+        EXPECT_EQ(cursor.cached_depth(), 0);
+        ASSERT_EQ(cursor.eval(max_leaf), rc_prf.eval(max_leaf));
+        ASSERT_EQ(cursor.eval(0), rc_prf.eval(0));
+
+        // moved cursors keep their cache
+        sse::crypto::RCPrfCursor<16> moved(std::move(cursor));
+        ASSERT_EQ(moved.eval(1), rc_prf.eval(1));
+        EXPECT_THROW(cursor.eval(0), std::runtime_error);
+
+        EXPECT_THROW(moved.eval(max_leaf + 1), std::out_of_range);
+    }
+}
+
 TEST(rc_prf, constrain_range_eval)
 {
     // This test has a very high complexity (something like 2^(4*test_depth)).
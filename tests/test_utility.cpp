@@ -18,13 +18,20 @@
 // along with libsse_crypto.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#include <sse/crypto/random.hpp>
 #include <sse/crypto/utils.hpp>
 
 #include <cstring>
 
+#include <array>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
+#include <sys/wait.h>
+#include <unistd.h>
 
 
 // str1 and str2 are NULL-terminated C-strings of length len1 and len2
@@ -88,3 +95,79 @@ TEST(utility, strstrn)
     EXPECT_TRUE(test_strstrn("abab", "bb"));
     EXPECT_TRUE(test_strstrn("aabb", "bb"));
 }
+
+TEST(utility, random_bytes)
+{
+    // around the buffer and the direct generation thresholds
+    for (size_t len : {1, 16, 31, 32, 33, 511, 512, 513, 992, 1024, 4493}) {
+        std::vector<uint8_t> a(len), b(len);
+        sse::crypto::random_bytes(len, a.data());
+        sse::crypto::random_bytes(len, b.data());
+        if (len >= 16) {
+            EXPECT_NE(a, b) << "length " << len;
+        }
+
+        // the last bytes (possibly from a partial keystream block) are set
+        const std::vector<uint8_t> zero(std::min<size_t>(len, 13), 0);
+        if (len >= 13) {
+            EXPECT_FALSE(std::equal(zero.begin(), zero.end(), a.end() - 13));
+        }
+    }
+
+    // every byte value shows up in a long output
+    std::vector<uint8_t> long_out(1 << 17);
+    sse::crypto::random_bytes(long_out.size(), long_out.data());
+    std::set<uint8_t> values(long_out.begin(), long_out.end());
+    EXPECT_EQ(256, values.size());
+
+    // the outputs of concurrent threads are distinct
+    constexpr size_t kThreads = 4;
+    constexpr size_t kRounds  = 100;
+
+    std::vector<std::vector<std::string>> outputs(kThreads);
+    std::vector<std::thread>              threads;
+    for (size_t t = 0; t < kThreads; t++) {
+        threads.emplace_back([&outputs, t]() {
+            for (size_t i = 0; i < kRounds; i++) {
+                outputs[t].push_back(sse::crypto::random_string(32));
+            }
+        });
+    }
+    std::set<std::string> all;
+    for (size_t t = 0; t < kThreads; t++) {
+        threads[t].join();
+        all.insert(outputs[t].begin(), outputs[t].end());
+    }
+    EXPECT_EQ(kThreads * kRounds, all.size());
+}
+
+TEST(utility, random_bytes_fork)
+{
+    // make sure the generator of this thread is seeded
+    sse::crypto::random_string(32);
+
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+
+    pid_t pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        // the child must not replay the parent's output
+        std::array<uint8_t, 32> child_out;
+        sse::crypto::random_bytes(child_out);
+        ssize_t written = write(fds[1], child_out.data(), child_out.size());
+        _exit(written == static_cast<ssize_t>(child_out.size()) ? 0 : 1);
+    }
+
+    std::array<uint8_t, 32> parent_out, child_out;
+    sse::crypto::random_bytes(parent_out);
+
+    ASSERT_EQ(static_cast<ssize_t>(child_out.size()),
+              read(fds[0], child_out.data(), child_out.size()));
+    int status;
+    waitpid(pid, &status, 0);
+    close(fds[0]);
+    close(fds[1]);
+
+    EXPECT_NE(parent_out, child_out);
+}